@@ -0,0 +1,109 @@
+#include "peerchat/compression.hpp"
+#include "peerchat/framing.hpp"
+#include "peerchat/message.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <nlohmann/json.hpp>
+
+#include <random>
+
+using namespace peerchat;
+
+namespace {
+
+// One side of a chat session as it goes over the wire: handshake, texts
+// of mixed length with their ACKs, a heartbeat every few messages and the
+// odd sync round. Seeded, so every run replays the same frames.
+std::vector<std::string> session_corpus() {
+    static const char* phrases[] = {
+        "hey",
+        "ok",
+        "sounds good, see you at 6",
+        "did you get the file I sent?",
+        "yes thanks, it came through fine",
+        "lol",
+        "can you check the build on your machine when you get a chance",
+        "I pushed the fix, the tests pass locally now",
+        "brb",
+        "what time works for the call tomorrow?",
+        "the new release notes are in the shared folder",
+        "👍",
+    };
+    const std::string alice = "6f1c2a4e-93b1-4c55-a1d7-0e2b9f8c3d41";
+    const std::string bob = "c08e7d12-5a3f-4b9e-8f60-71d4e2a9b5c7";
+
+    std::mt19937 rng(2024);
+    std::vector<std::string> out;
+    auto hs = Message::make_handshake(alice, "alice", "1234");
+    nlohmann::json caps;
+    caps["compression"] = nlohmann::json::array({kCompressionZstd});
+    hs.body = caps.dump();
+    out.push_back(hs.serialize());
+
+    for (int i = 0; i < 2000; ++i) {
+        auto body = std::string(phrases[rng() % std::size(phrases)]);
+        if (rng() % 4 == 0) {
+            body += " " + std::string(phrases[rng() % std::size(phrases)]);
+        }
+        out.push_back(Message::make_text(alice, "alice", "1234", body)
+                          .serialize());
+        // ACK for the peer's reply
+        auto reply = Message::make_text(bob, "bob", "8765", body);
+        out.push_back(Message::make_ack(alice, reply.id).serialize());
+        if (i % 10 == 0) out.push_back(Message::make_ping(alice).serialize());
+        if (i % 500 == 0) {
+            auto sync = R"({"r":[[1792400332180,"0f3a9c5e",1]]})";
+            out.push_back(Message::make_sync(alice, sync).serialize());
+        }
+    }
+    return out;
+}
+
+const std::vector<std::string>& corpus() {
+    static const auto frames = session_corpus();
+    return frames;
+}
+
+// Wire bytes for the corpus: 0 = uncompressed, 1 = each frame compressed
+// on its own (dictionary only), 2 = one stream per connection as sent
+void BM_ChatFrameCompression(benchmark::State& state) {
+    const auto mode = state.range(0);
+    uint64_t raw = 0, wire = 0;
+    for (auto _ : state) {
+        raw = wire = 0;
+        FrameCompressor stream;
+        for (const auto& frame : corpus()) {
+            raw += FrameEncoder::kHeaderSize + frame.size();
+            std::size_t payload = frame.size();
+            if (mode != 0 && frame.size() >= kCompressMinBytes) {
+                if (mode == 1) {
+                    FrameCompressor single;
+                    payload = single.compress(frame).size();
+                } else {
+                    payload = stream.compress(frame).size();
+                }
+            }
+            wire += FrameEncoder::kHeaderSize + payload;
+        }
+        benchmark::DoNotOptimize(wire);
+    }
+
+    static const char* labels[] = {"none", "per-frame", "stream"};
+    state.SetLabel(labels[mode]);
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                            static_cast<int64_t>(corpus().size()));
+    auto frames = static_cast<double>(corpus().size());
+    state.counters["raw_B/frame"] = static_cast<double>(raw) / frames;
+    state.counters["wire_B/frame"] = static_cast<double>(wire) / frames;
+    state.counters["saved_%"] =
+        100.0 * (1.0 - static_cast<double>(wire) / static_cast<double>(raw));
+}
+
+} // namespace
+
+BENCHMARK(BM_ChatFrameCompression)
+    ->Arg(0)
+    ->Arg(1)
+    ->Arg(2)
+    ->Unit(benchmark::kMillisecond);
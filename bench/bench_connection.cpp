@@ -0,0 +1,76 @@
+#include "peerchat/connection.hpp"
+#include "peerchat/message.hpp"
+#include "peerchat/server.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <thread>
+
+using namespace peerchat;
+
+namespace {
+
+// Chat messages over loopback TCP to a peer that echoes every frame back.
+// With a window of 1 each iteration is one round trip; larger windows
+// keep that many messages in flight.
+void BM_ConnectionRoundTrip(benchmark::State& state) {
+    const auto window = static_cast<uint64_t>(state.range(0));
+    asio::io_context io;
+
+    ConnectionPtr echo;
+    Server server(io, 0, [&](ConnectionPtr conn) {
+        echo = conn;
+        conn->start(
+            [conn](std::string_view json) { conn->send(std::string(json)); },
+            [](const std::string&) {});
+    });
+
+    std::atomic<uint64_t> received{0};
+    asio::ip::tcp::socket socket(io);
+    socket.connect({asio::ip::make_address("127.0.0.1"), server.port()});
+    auto conn = Connection::create(std::move(socket));
+    conn->start(
+        [&](std::string_view) {
+            received.fetch_add(1, std::memory_order_release);
+            received.notify_one();
+        },
+        [](const std::string&) {});
+
+    auto work = asio::make_work_guard(io);
+    std::thread io_thread([&] { io.run(); });
+
+    const auto json = Message::make_text("3f2a9c1e-5b7d-4e8f-a1c2-d3e4f5a6b7c8",
+                                         "alice", "1530", "see you at eight?")
+                          .serialize();
+    uint64_t sent = 0;
+    for (auto _ : state) {
+        for (uint64_t i = 0; i < window; ++i) conn->send(json);
+        sent += window;
+        for (auto n = received.load(std::memory_order_acquire); n < sent;
+             n = received.load(std::memory_order_acquire)) {
+            received.wait(n, std::memory_order_acquire);
+        }
+    }
+
+    conn->close();
+    asio::post(io, [&] {
+        if (echo) echo->close();
+        server.stop();
+    });
+    work.reset();
+    io_thread.join();
+
+    state.SetItemsProcessed(static_cast<int64_t>(sent));
+}
+
+} // namespace
+
+BENCHMARK(BM_ConnectionRoundTrip)
+    ->ArgName("window")
+    ->Arg(1)
+    ->Arg(64)
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
@@ -0,0 +1,109 @@
+#include "peerchat/message.hpp"
+#include "peerchat/message_schema.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace peerchat;
+
+namespace {
+
+// A synthetic schema of N type names shaped like the real ones, with the
+// names a peer sends drawn uniformly from it.
+template <std::size_t N>
+struct Schema {
+    std::vector<std::string> storage;
+    std::array<std::string_view, N> names{};
+    std::vector<std::string_view> stream;
+
+    Schema() {
+        for (std::size_t i = 0; i < N; ++i) {
+            storage.push_back("type_" + std::to_string(i) + "_rpc");
+        }
+        for (std::size_t i = 0; i < N; ++i) names[i] = storage[i];
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<std::size_t> pick(0, N - 1);
+        for (int i = 0; i < 4096; ++i) stream.push_back(names[pick(rng)]);
+    }
+};
+
+template <std::size_t I>
+void handler(uint64_t& acc) {
+    acc += I;
+}
+
+template <std::size_t... Is>
+constexpr auto make_jump_table(std::index_sequence<Is...>) {
+    return std::array<void (*)(uint64_t&), sizeof...(Is)>{&handler<Is>...};
+}
+
+// Perfect-hash lookup and jump table, as Message and PeerManager do
+template <std::size_t N>
+void BM_DispatchSchema(benchmark::State& state) {
+    static const Schema<N> schema;
+    static const PerfectHash<N> lookup(schema.names);
+    static constexpr auto table = make_jump_table(std::make_index_sequence<N>());
+
+    uint64_t acc = 0;
+    for (auto _ : state) {
+        for (auto name : schema.stream) {
+            table[lookup.find(name)](acc);
+        }
+    }
+    benchmark::DoNotOptimize(acc);
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() *
+                                                 schema.stream.size()));
+}
+
+// The if-chain the schema replaced: compare against each name in turn
+template <std::size_t N>
+void BM_DispatchIfChain(benchmark::State& state) {
+    static const Schema<N> schema;
+    static constexpr auto table = make_jump_table(std::make_index_sequence<N>());
+
+    uint64_t acc = 0;
+    for (auto _ : state) {
+        for (auto name : schema.stream) {
+            std::size_t i = 0;
+            while (i < N && schema.names[i] != name) ++i;
+            table[i](acc);
+        }
+    }
+    benchmark::DoNotOptimize(acc);
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() *
+                                                 schema.stream.size()));
+}
+
+BENCHMARK_TEMPLATE(BM_DispatchSchema, 7);
+BENCHMARK_TEMPLATE(BM_DispatchSchema, 32);
+BENCHMARK_TEMPLATE(BM_DispatchSchema, 128);
+BENCHMARK_TEMPLATE(BM_DispatchSchema, 512);
+BENCHMARK_TEMPLATE(BM_DispatchIfChain, 7);
+BENCHMARK_TEMPLATE(BM_DispatchIfChain, 32);
+BENCHMARK_TEMPLATE(BM_DispatchIfChain, 128);
+BENCHMARK_TEMPLATE(BM_DispatchIfChain, 512);
+
+void BM_SerializeText(benchmark::State& state) {
+    auto msg = Message::make_text("3f2a9c1e-5b7d-4e8f-a1c2-d3e4f5a6b7c8",
+                                  "alice", "1530", "see you at eight?");
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(msg.serialize());
+    }
+}
+BENCHMARK(BM_SerializeText);
+
+// The nlohmann::json round trip serialize() used before
+void BM_SerializeTextViaJson(benchmark::State& state) {
+    auto msg = Message::make_text("3f2a9c1e-5b7d-4e8f-a1c2-d3e4f5a6b7c8",
+                                  "alice", "1530", "see you at eight?");
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(msg.to_json().dump());
+    }
+}
+BENCHMARK(BM_SerializeTextViaJson);
+
+} // namespace
@@ -0,0 +1,160 @@
+#include "peerchat/framing.hpp"
+#include "peerchat/types.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace peerchat;
+
+namespace {
+
+std::atomic<uint64_t> g_allocations{0};
+
+} // namespace
+
+// Counts heap allocations for BM_FrameDispatch. This replaces operator
+// new for the whole bench binary; the cost is one relaxed increment. Kept
+// out of line, or GCC sees malloc paired with delete and warns.
+[[gnu::noinline]] void* operator new(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+[[gnu::noinline]] void operator delete(void* p) noexcept { std::free(p); }
+[[gnu::noinline]] void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+// How reads split the byte stream; kRandom cuts at 1..4096 bytes
+constexpr int64_t kWhole = 0;
+constexpr int64_t kRandom = -1;
+
+std::string payload_of(std::size_t size) {
+    std::string p = R"({"body":")";
+    p.resize(size > p.size() + 2 ? size - 2 : p.size(), 'x');
+    return p + "\"}";
+}
+
+void BM_FrameEncode(benchmark::State& state) {
+    const auto payload = payload_of(static_cast<std::size_t>(state.range(0)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(FrameEncoder::encode(payload));
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                            state.range(0));
+}
+
+constexpr int kFrames = 256;
+
+// kFrames chat-sized frames back to back
+std::vector<uint8_t> frame_stream(std::mt19937& rng) {
+    std::vector<uint8_t> stream;
+    std::uniform_int_distribution<std::size_t> size(64, 512);
+    for (int i = 0; i < kFrames; ++i) {
+        auto frame = FrameEncoder::encode(payload_of(size(rng)));
+        stream.insert(stream.end(), frame.begin(), frame.end());
+    }
+    return stream;
+}
+
+// 256 chat-sized frames back to back, fed the way reads would deliver
+// them: all at once, byte by byte, in odd-sized pieces, one TCP segment
+// at a time, or at random cut points
+void BM_FrameDecode(benchmark::State& state) {
+    std::mt19937 rng(1);
+    const auto stream = frame_stream(rng);
+
+    std::vector<std::size_t> cuts;
+    const auto split = state.range(0);
+    std::uniform_int_distribution<std::size_t> cut(1, 4096);
+    for (std::size_t at = 0; at < stream.size();) {
+        auto n = split == kWhole    ? stream.size()
+                 : split == kRandom ? cut(rng)
+                                    : static_cast<std::size_t>(split);
+        at = std::min(at + n, stream.size());
+        cuts.push_back(at);
+    }
+
+    for (auto _ : state) {
+        FrameDecoder decoder;
+        std::size_t from = 0;
+        int frames = 0;
+        for (auto to : cuts) {
+            decoder.feed(stream.data() + from, to - from);
+            from = to;
+            while (auto frame = decoder.next()) {
+                benchmark::DoNotOptimize(frame->data());
+                ++frames;
+            }
+        }
+        if (frames != kFrames) state.SkipWithError("lost frames");
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                            kFrames);
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                            static_cast<int64_t>(stream.size()));
+}
+
+// A read's worth of frames decoded and handed to the message callback,
+// as TcpConnection::do_read does. kOwning is the old path, a std::string
+// per frame through a std::function; kView passes views into the
+// decoder's buffer through MessageCallback.
+constexpr int64_t kOwning = 0;
+constexpr int64_t kView = 1;
+
+void BM_FrameDispatch(benchmark::State& state) {
+    std::mt19937 rng(1);
+    const auto stream = frame_stream(rng);
+
+    std::size_t bytes = 0;
+    std::function<void(const std::string&)> owning =
+        [&bytes](const std::string& payload) { bytes += payload.size(); };
+    MessageCallback view = [&bytes](std::string_view payload) {
+        bytes += payload.size();
+    };
+
+    FrameDecoder decoder;
+    const auto before = g_allocations.load(std::memory_order_relaxed);
+    for (auto _ : state) {
+        decoder.feed(stream.data(), stream.size());
+        if (state.range(0) == kOwning) {
+            while (auto frame = decoder.next()) owning(*frame);
+        } else {
+            while (auto frame = decoder.next_view()) view(*frame);
+        }
+    }
+    const auto allocations =
+        g_allocations.load(std::memory_order_relaxed) - before;
+    benchmark::DoNotOptimize(bytes);
+
+    const auto frames = static_cast<int64_t>(state.iterations()) * kFrames;
+    state.counters["allocs_per_frame"] =
+        static_cast<double>(allocations) / static_cast<double>(frames);
+    state.SetItemsProcessed(frames);
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                            static_cast<int64_t>(stream.size()));
+}
+
+} // namespace
+
+BENCHMARK(BM_FrameEncode)->Arg(64)->Arg(1024)->Arg(16 * 1024)->Arg(64 * 1024);
+BENCHMARK(BM_FrameDecode)
+    ->ArgName("split")
+    ->Arg(kWhole)
+    ->Arg(1)
+    ->Arg(7)
+    ->Arg(1460)
+    ->Arg(kRandom);
+BENCHMARK(BM_FrameDispatch)->ArgName("view")->Arg(kOwning)->Arg(kView);
@@ -0,0 +1,41 @@
+#include "peerchat/message.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+using namespace peerchat;
+
+namespace {
+
+Message text_of(std::size_t body_size) {
+    auto msg = Message::make_text("3f2a9c1e-5b7d-4e8f-a1c2-d3e4f5a6b7c8",
+                                  "alice", "1530",
+                                  std::string(body_size, 'm'));
+    msg.hlc = {msg.timestamp, 3};
+    return msg;
+}
+
+void BM_MessageSerialize(benchmark::State& state) {
+    const auto msg = text_of(static_cast<std::size_t>(state.range(0)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(msg.serialize());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+
+void BM_MessageDeserialize(benchmark::State& state) {
+    const auto json =
+        text_of(static_cast<std::size_t>(state.range(0))).serialize();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Message::deserialize(json));
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                            static_cast<int64_t>(json.size()));
+}
+
+} // namespace
+
+BENCHMARK(BM_MessageSerialize)->Arg(16)->Arg(256)->Arg(4096);
+BENCHMARK(BM_MessageDeserialize)->Arg(16)->Arg(256)->Arg(4096);
@@ -0,0 +1,106 @@
+#include "peerchat/framing.hpp"
+#include "peerchat/relay.hpp"
+
+#include <benchmark/benchmark.h>
+#include <nlohmann/json.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace peerchat;
+
+namespace {
+
+using tcp = asio::ip::tcp;
+
+tcp::socket open(asio::io_context& io, uint16_t port,
+                 const std::vector<uint8_t>& setup) {
+    tcp::socket socket(io);
+    socket.connect({asio::ip::make_address("127.0.0.1"), port});
+    asio::write(socket, asio::buffer(setup));
+    return socket;
+}
+
+// Waits until the relay, on its own thread, has a peer registered
+void wait_registered(asio::io_context& io, const RelayServer& relay) {
+    std::atomic<bool> seen{false};
+    while (!seen.load()) {
+        std::atomic<bool> checked{false};
+        asio::post(io, [&] {
+            seen = !relay.names().empty();
+            checked = true;
+            checked.notify_one();
+        });
+        checked.wait(false);
+        if (!seen) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+// One direction of a session through a relay on loopback: a writer thread
+// streams bytes into the dialer's connection and each iteration reads one
+// chunk off the named peer's. Arg 1 splices, 0 copies through a buffer.
+void BM_RelayThroughput(benchmark::State& state) {
+    constexpr std::size_t kChunk = 64 * 1024;
+    asio::io_context io;
+    RelayServer relay(io, 0, RelayConfig{.splice = state.range(0) != 0});
+    auto work = asio::make_work_guard(io);
+    std::thread io_thread([&] { io.run(); });
+
+    // Blocking sockets on this thread, on a context nobody runs
+    asio::io_context client_io;
+    auto control =
+        open(client_io, relay.port(), relay_frame(RelayOp::Listen, "bob"));
+    wait_registered(io, relay);
+    auto dialer =
+        open(client_io, relay.port(), relay_frame(RelayOp::Connect, "bob"));
+
+    std::array<uint8_t, FrameEncoder::kHeaderSize> header{};
+    asio::read(control, asio::buffer(header));
+    std::string payload((std::size_t{header[0]} << 24) |
+                            (std::size_t{header[1]} << 16) |
+                            (std::size_t{header[2]} << 8) | header[3],
+                        '\0');
+    asio::read(control, asio::buffer(payload));
+    const auto key = nlohmann::json::parse(payload).at("key").get<std::string>();
+    auto peer = open(client_io, relay.port(), relay_frame(RelayOp::Accept, key));
+
+    std::atomic<bool> done{false};
+    std::thread writer([&] {
+        const std::vector<uint8_t> chunk(kChunk, 0x5a);
+        asio::error_code ec;
+        while (!done.load(std::memory_order_relaxed) && !ec) {
+            asio::write(dialer, asio::buffer(chunk), ec);
+        }
+    });
+
+    std::vector<uint8_t> in(kChunk);
+    for (auto _ : state) {
+        asio::read(peer, asio::buffer(in));
+        benchmark::DoNotOptimize(in.data());
+    }
+
+    // Closing the peer's end ends the session, failing the writer's write
+    done = true;
+    peer.close();
+    writer.join();
+    dialer.close();
+    control.close();
+    asio::post(io, [&] { relay.stop(); });
+    work.reset();
+    io_thread.join();
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * kChunk));
+}
+
+} // namespace
+
+BENCHMARK(BM_RelayThroughput)
+    ->ArgName("splice")
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
@@ -0,0 +1,67 @@
+#include "peerchat/message.hpp"
+#include "peerchat/reorder_buffer.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include <vector>
+
+using namespace peerchat;
+
+namespace {
+
+// Messages arrive every 1 ms of wall time, but their HLCs are skewed by up
+// to +/- skew_ms, as when several relayed or replayed streams interleave.
+std::vector<Message> skewed_stream(std::size_t count, int64_t skew_ms) {
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<int64_t> jitter(-skew_ms, skew_ms);
+    std::vector<Message> msgs;
+    msgs.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        Message m;
+        m.type = MessageType::Text;
+        m.sender = "peer";
+        m.body = "x";
+        m.hlc = {static_cast<int64_t>(i) + jitter(rng),
+                 static_cast<uint32_t>(i & 3)};
+        msgs.push_back(std::move(m));
+    }
+    return msgs;
+}
+
+void BM_ReorderSkewed(benchmark::State& state) {
+    const auto skew = state.range(0);
+    constexpr std::size_t kCount = 1 << 16;
+    const auto stream = skewed_stream(kCount, skew);
+
+    std::vector<Message> out;
+    out.reserve(kCount);
+    std::size_t inversions = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto input = stream;
+        out.clear();
+        state.ResumeTiming();
+
+        ReorderBuffer buf(std::chrono::milliseconds(2 * skew + 1));
+        int64_t now = 0;
+        for (auto& m : input) {
+            buf.push(std::move(m), now);
+            buf.release(now, out);
+            ++now;
+        }
+        buf.flush(out);
+        benchmark::DoNotOptimize(out.data());
+
+        state.PauseTiming();
+        for (std::size_t i = 1; i < out.size(); ++i) {
+            if (out[i].hlc < out[i - 1].hlc) ++inversions;
+        }
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * kCount));
+    state.counters["inversions"] = static_cast<double>(inversions);
+}
+BENCHMARK(BM_ReorderSkewed)->Arg(0)->Arg(10)->Arg(100)->Arg(1000)->Arg(10000);
+
+} // namespace
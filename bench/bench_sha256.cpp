@@ -0,0 +1,102 @@
+#include "peerchat/file_transfer.hpp"
+#include "peerchat/hash_pipeline.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+using namespace peerchat;
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Size of the hashed file; override with PEERCHAT_BENCH_HASH_MB
+std::size_t hash_mb() {
+    if (const char* env = std::getenv("PEERCHAT_BENCH_HASH_MB")) {
+        return std::strtoull(env, nullptr, 10);
+    }
+    return 512;
+}
+
+void set_gbps(benchmark::State& state, double bytes_per_iter,
+              double threads) {
+    double bytes = static_cast<double>(state.iterations()) * bytes_per_iter;
+    state.SetBytesProcessed(static_cast<int64_t>(bytes));
+    state.counters["GB/s"] =
+        benchmark::Counter(bytes / 1e9, benchmark::Counter::kIsRate);
+    state.counters["GB/s/core"] =
+        benchmark::Counter(bytes / 1e9 / threads, benchmark::Counter::kIsRate);
+}
+
+// One thread hashing batches of eight transfer chunks with each kernel
+void BM_Sha256Kernel(benchmark::State& state) {
+    auto kernel = static_cast<Sha256Kernel>(state.range(0));
+    auto saved = sha256_kernel();
+    try {
+        sha256_set_kernel(kernel);
+    } catch (const std::invalid_argument&) {
+        state.SkipWithError("kernel not supported on this CPU");
+        return;
+    }
+    state.SetLabel(sha256_kernel_name(kernel));
+
+    std::vector<uint8_t> data(8 * kChunkSize);
+    std::mt19937 rng(1);
+    for (auto& b : data) b = static_cast<uint8_t>(rng());
+    const uint8_t* messages[8];
+    for (int i = 0; i < 8; ++i) messages[i] = data.data() + i * kChunkSize;
+    Sha256Digest out[8];
+
+    for (auto _ : state) {
+        sha256_many(messages, kChunkSize, out, 8);
+        benchmark::DoNotOptimize(out);
+    }
+    set_gbps(state, static_cast<double>(data.size()), 1);
+    sha256_set_kernel(saved);
+}
+
+// Whole-file chunk hashing as done on /send, with reads overlapping
+// hashing. The file is in the page cache after the first iteration.
+void BM_HashPipeline(benchmark::State& state) {
+    const auto path = fs::temp_directory_path() / "peerchat_bench_hash.bin";
+    const uint64_t size = hash_mb() * 1024 * 1024;
+    {
+        std::ofstream out(path, std::ios::binary);
+        std::mt19937_64 rng(7);
+        std::vector<uint64_t> block(1024 * 1024 / sizeof(uint64_t));
+        for (std::size_t i = 0; i < hash_mb(); ++i) {
+            for (auto& w : block) w = rng();
+            out.write(reinterpret_cast<const char*>(block.data()),
+                      static_cast<std::streamsize>(block.size() * 8));
+        }
+    }
+
+    auto threads = static_cast<std::size_t>(state.range(0));
+    HashPipeline pipeline(threads);
+    auto file = NativeFile::open(path, NativeFile::Mode::Read);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(pipeline.hash_chunks(file, size, kChunkSize));
+    }
+    state.SetLabel(sha256_kernel_name(sha256_kernel()));
+    set_gbps(state, static_cast<double>(size), static_cast<double>(threads));
+    file.close();
+    fs::remove(path);
+}
+
+} // namespace
+
+BENCHMARK(BM_Sha256Kernel)
+    ->Arg(static_cast<int>(Sha256Kernel::Scalar))
+    ->Arg(static_cast<int>(Sha256Kernel::Avx2))
+    ->Arg(static_cast<int>(Sha256Kernel::ShaNi));
+
+BENCHMARK(BM_HashPipeline)
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(4)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
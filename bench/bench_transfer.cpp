@@ -0,0 +1,126 @@
+#include "peerchat/connection.hpp"
+#include "peerchat/file_transfer.hpp"
+#include "peerchat/server.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <random>
+#include <thread>
+
+using namespace peerchat;
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Size of the transferred file; override with PEERCHAT_BENCH_TRANSFER_MB
+std::size_t transfer_mb() {
+    if (const char* env = std::getenv("PEERCHAT_BENCH_TRANSFER_MB")) {
+        return std::strtoull(env, nullptr, 10);
+    }
+    return 2048;
+}
+
+fs::path make_source(const fs::path& dir, std::size_t mb) {
+    fs::create_directories(dir);
+    auto path = dir / "payload.bin";
+    std::ofstream out(path, std::ios::binary);
+    std::mt19937_64 rng(7);
+    std::vector<uint64_t> block(1024 * 1024 / sizeof(uint64_t));
+    for (std::size_t i = 0; i < mb; ++i) {
+        for (auto& w : block) w = rng();
+        out.write(reinterpret_cast<const char*>(block.data()),
+                  static_cast<std::streamsize>(block.size() * sizeof(uint64_t)));
+    }
+    return path;
+}
+
+FrameSender sender_for(const ConnectionPtr& conn) {
+    return [conn](std::vector<uint8_t> frame) {
+        conn->send_frame(std::move(frame));
+    };
+}
+
+void handle(TransferManager& mgr, const ConnectionPtr& conn,
+            std::string_view payload) {
+    mgr.handle_frame(reinterpret_cast<const uint8_t*>(payload.data()),
+                     payload.size(), sender_for(conn));
+}
+
+// Full pipeline over loopback TCP: hash list fetch, Merkle check,
+// windowed chunk requests, per-chunk verification and positional writes.
+void BM_LoopbackTransfer(benchmark::State& state) {
+    const auto dir = fs::temp_directory_path() / "peerchat_bench_transfer";
+    fs::remove_all(dir);
+    const auto src = make_source(dir / "src", transfer_mb());
+
+    TransferManager seeder("");
+    const auto manifest = seeder.share(src);
+
+    for (auto _ : state) {
+        asio::io_context io;
+        TransferManager leecher(dir / "dl",
+                                static_cast<std::size_t>(state.range(0)));
+        std::promise<bool> done;
+        leecher.on_complete([&](const FileManifest&, const fs::path&,
+                                const TransferStats&) {
+            done.set_value(true);
+        });
+        leecher.on_failed([&](const FileManifest&, const std::string&) {
+            done.set_value(false);
+        });
+
+        ConnectionPtr seed_conn;
+        Server server(io, 0, [&](ConnectionPtr conn) {
+            seed_conn = conn;
+            conn->start(
+                [&, conn](std::string_view p) { handle(seeder, conn, p); },
+                [](const std::string&) {});
+        });
+
+        asio::ip::tcp::socket socket(io);
+        socket.connect({asio::ip::make_address("127.0.0.1"), server.port()});
+        auto conn = Connection::create(std::move(socket));
+        conn->start(
+            [&, conn](std::string_view p) { handle(leecher, conn, p); },
+            [](const std::string&) {});
+
+        asio::post(io, [&, conn] { leecher.download(manifest, sender_for(conn)); });
+        std::thread io_thread([&] { io.run(); });
+        bool ok = done.get_future().get();
+
+        conn->close();
+        if (seed_conn) seed_conn->close();
+        server.stop();
+        io.stop();
+        io_thread.join();
+        fs::remove_all(dir / "dl");
+
+        if (!ok) {
+            state.SkipWithError("transfer failed");
+            break;
+        }
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                            static_cast<int64_t>(manifest.size));
+    state.counters["MB/s"] = benchmark::Counter(
+        static_cast<double>(state.iterations()) *
+            static_cast<double>(manifest.size) / (1024.0 * 1024.0),
+        benchmark::Counter::kIsRate);
+    fs::remove_all(dir);
+}
+
+} // namespace
+
+BENCHMARK(BM_LoopbackTransfer)
+    ->Arg(4)
+    ->Arg(16)
+    ->Arg(64)
+    ->Iterations(1)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
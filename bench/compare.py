@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+"""Compare two peerchat_bench JSON results and flag regressions.
+
+    ./build/peerchat_bench --benchmark_out=new.json --benchmark_out_format=json
+    bench/compare.py old.json new.json --threshold 10 \\
+        --threshold-for 'ConnectionRoundTrip=25'
+
+Times are compared per benchmark, using the median when the run has
+repetitions. A benchmark regresses when it got slower by more than its
+threshold (percent). Exits with 1 if any did, so CI can gate on it.
+"""
+
+import argparse
+import json
+import re
+import sys
+
+TO_NS = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+
+
+def load(path, metric):
+    with open(path) as f:
+        data = json.load(f)
+    runs = {}
+    medians = {}
+    for b in data["benchmarks"]:
+        if b.get("error_occurred"):
+            continue
+        name = b.get("run_name", b["name"])
+        ns = b[metric] * TO_NS[b.get("time_unit", "ns")]
+        if b.get("run_type") == "aggregate":
+            if b.get("aggregate_name") == "median":
+                medians[name] = ns
+        else:
+            runs.setdefault(name, []).append(ns)
+    result = {name: sum(v) / len(v) for name, v in runs.items()}
+    result.update(medians)
+    return result
+
+
+def parse_override(text):
+    pattern, _, pct = text.rpartition("=")
+    if not pattern:
+        raise argparse.ArgumentTypeError("expected REGEX=PERCENT")
+    return re.compile(pattern), float(pct)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--metric", choices=["real_time", "cpu_time"],
+                        default="real_time")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="allowed slowdown in percent (default 10)")
+    parser.add_argument("--threshold-for", type=parse_override, default=[],
+                        action="append", metavar="REGEX=PERCENT",
+                        help="threshold for benchmarks matching REGEX")
+    args = parser.parse_args()
+
+    base = load(args.baseline, args.metric)
+    cur = load(args.current, args.metric)
+
+    def threshold(name):
+        for pattern, pct in args.threshold_for:
+            if pattern.search(name):
+                return pct
+        return args.threshold
+
+    regressions = 0
+    width = max((len(n) for n in base.keys() | cur.keys()), default=10)
+    print(f"{'benchmark':<{width}}  {'baseline':>12}  {'current':>12}  change")
+    for name in sorted(base.keys() | cur.keys()):
+        if name not in cur:
+            print(f"{name:<{width}}  {base[name]:>10.0f}ns  {'-':>12}  missing")
+            continue
+        if name not in base:
+            print(f"{name:<{width}}  {'-':>12}  {cur[name]:>10.0f}ns  new")
+            continue
+        change = (cur[name] - base[name]) / base[name] * 100
+        verdict = ""
+        if change > threshold(name):
+            verdict = f"  REGRESSION (> {threshold(name):g}%)"
+            regressions += 1
+        print(f"{name:<{width}}  {base[name]:>10.0f}ns  {cur[name]:>10.0f}ns"
+              f"  {change:+6.1f}%{verdict}")
+
+    if regressions:
+        print(f"\n{regressions} benchmark(s) regressed", file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -1,33 +1,58 @@
 #pragma once
 
 #include "peerchat/cli.hpp"
+#include "peerchat/connection_manager.hpp"
+#include "peerchat/frontend.hpp"
 #include "peerchat/identity.hpp"
+#include "peerchat/multipath.hpp"
 #include "peerchat/peer_manager.hpp"
-#include "peerchat/server.hpp"
+#include "peerchat/relay.hpp"
 
 #include <asio.hpp>
 #include <memory>
+#include <optional>
+#include <string>
 #include <thread>
 
 namespace peerchat {
 
+struct RelayOptions {
+    // Forward other peers' sessions on this port
+    std::optional<uint16_t> serve_port;
+    RelayConfig serve_config;
+    // Be reachable through the relay at host:port, under our display name
+    std::string via_host;
+    uint16_t via_port{0};
+};
+
 class App {
   public:
-    App(uint16_t port, const std::string& nickname);
+    // Without a frontend, the line-based Cli is used. Offered files
+    // larger than `max_download` bytes are declined.
+    App(uint16_t port, const std::string& nickname,
+        std::unique_ptr<Frontend> ui = nullptr, RelayOptions relay = {},
+        uint64_t max_download = TransferManager::kDefaultMaxDownload);
     ~App();
 
     void run();
 
   private:
+    void accept(std::shared_ptr<MultipathConnection> session);
+    // Races TCP and UDP; `host` may be prefixed udp:// for UDP only, or
+    // be relay://<name> for a peer registered with our relay
     void connect_to(const std::string& host, uint16_t port);
     void show_status();
+    void show_history(std::size_t limit);
+    std::string status_line() const;
     void shutdown();
 
     asio::io_context io_;
     Identity identity_;
-    std::unique_ptr<Server> server_;
+    std::unique_ptr<ConnectionManager> connections_;
+    std::weak_ptr<MultipathConnection> session_;
+    std::unique_ptr<RelayServer> relay_;
     PeerManager peer_manager_;
-    Cli cli_;
+    std::unique_ptr<Frontend> ui_;
 
     std::thread io_thread_;
 };
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "peerchat/sha256.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace peerchat {
+
+struct ChunkStoreConfig {
+    // Chunks live in <directory>/<first 2 hex>/<hex>
+    std::filesystem::path directory;
+    // Hot chunks kept in memory
+    std::size_t memory_limit = 16 * 1024 * 1024;
+    // Chunks kept on disk
+    uint64_t disk_limit = 1ULL << 30;
+};
+
+// Content-addressed chunk cache shared by all transfers. Chunks are keyed
+// by their SHA-256, so a chunk still cached from an earlier download is
+// never fetched again. Past disk_limit the least recently used chunks are
+// deleted, except those of files being downloaded: a download holds a
+// reference on its chunks until it finishes or is abandoned. Thread-safe.
+class ChunkStore {
+  public:
+    struct Stats {
+        uint64_t memory_hits{0};
+        uint64_t disk_hits{0};
+        uint64_t misses{0};
+        uint64_t evicted{0};
+    };
+
+    explicit ChunkStore(ChunkStoreConfig config);
+
+    bool contains(const Sha256Digest& hash) const;
+
+    // Chunk data, from memory or disk. Disk copies are re-verified; a
+    // corrupt copy is deleted and reported as missing.
+    std::optional<std::vector<uint8_t>> get(const Sha256Digest& hash);
+
+    // Add a chunk whose data is known to hash to `hash`
+    void put(const Sha256Digest& hash, const uint8_t* data, std::size_t len);
+
+    // Keep every chunk of a file, present or still to come, from being
+    // evicted. Retaining the same root twice has no effect.
+    void retain_file(const Sha256Digest& root,
+                     const std::vector<Sha256Digest>& chunks);
+    // Drop a file's references; its chunks stay cached until evicted
+    void release_file(const Sha256Digest& root);
+
+    uint32_t refs(const Sha256Digest& hash) const;
+    std::size_t memory_bytes() const;
+    uint64_t disk_bytes() const;
+    Stats stats() const;
+
+  private:
+    using Lru = std::list<std::pair<Sha256Digest, std::vector<uint8_t>>>;
+    // Hash and size of each chunk on disk
+    using DiskLru = std::list<std::pair<Sha256Digest, uint64_t>>;
+
+    std::filesystem::path chunk_path(const Sha256Digest& hash) const;
+    void load();
+    void cache(const Sha256Digest& hash, std::vector<uint8_t> data);
+    void touch(const Sha256Digest& hash);
+    void evict();
+    void remove_chunk(const Sha256Digest& hash);
+
+    ChunkStoreConfig config_;
+    mutable std::mutex mutex_;
+
+    // Number of files being downloaded that use each chunk
+    std::unordered_map<Sha256Digest, uint32_t, DigestHash> refs_;
+    std::unordered_map<Sha256Digest, std::vector<Sha256Digest>, DigestHash>
+        files_;
+
+    DiskLru disk_lru_; // most recently used first
+    std::unordered_map<Sha256Digest, DiskLru::iterator, DigestHash>
+        disk_index_;
+    uint64_t disk_bytes_{0};
+
+    Lru lru_; // most recently used first
+    std::unordered_map<Sha256Digest, Lru::iterator, DigestHash> lru_index_;
+    std::size_t memory_bytes_{0};
+
+    Stats stats_;
+};
+
+} // namespace peerchat
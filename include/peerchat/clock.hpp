@@ -0,0 +1,100 @@
+#pragma once
+
+#include <chrono>
+#include <compare>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+namespace peerchat {
+
+// Hybrid logical clock timestamp: wall-clock milliseconds plus a logical
+// counter that orders events within the same millisecond and across
+// peers whose clocks disagree.
+struct HlcTimestamp {
+    int64_t wall_ms{0};
+    uint32_t logical{0};
+
+    auto operator<=>(const HlcTimestamp&) const = default;
+};
+
+using WallClockSource = std::function<int64_t()>;
+
+class HybridClock {
+  public:
+    // Remote timestamps further ahead of our wall clock than this are
+    // not adopted, so one peer with a broken clock can't drag us along.
+    static constexpr int64_t kMaxDriftMs = 60 * 1000;
+
+    explicit HybridClock(WallClockSource source = wall_now_ms);
+
+    // Timestamp for a local event (sending a message)
+    HlcTimestamp now();
+
+    // Merge a timestamp received from a peer and return the timestamp of
+    // the receive event. Greater than every timestamp handed out before
+    // and, unless the peer is beyond kMaxDriftMs, greater than `remote`.
+    HlcTimestamp update(const HlcTimestamp& remote);
+
+    // Unix epoch milliseconds from the system clock
+    static int64_t wall_now_ms();
+
+  private:
+    WallClockSource source_;
+    std::mutex mutex_;
+    HlcTimestamp last_;
+};
+
+// Clock for the peer layer's timers and timestamps. Reads the steady and
+// system clocks, unless the calling thread is running a simulation (see
+// VirtualTime), in which case both read simulated time.
+struct NetClock {
+    using duration = std::chrono::steady_clock::duration;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::time_point<NetClock>;
+    static constexpr bool is_steady = true;
+
+    static time_point now();
+    // Unix epoch milliseconds
+    static int64_t wall_ms();
+};
+
+// Simulated time for NetClock on the thread that creates it, until it is
+// destroyed. Starts at zero, with the wall clock at `epoch_ms`, and only
+// moves when advanced.
+class VirtualTime {
+  public:
+    explicit VirtualTime(int64_t epoch_ms = 1'700'000'000'000);
+    ~VirtualTime();
+
+    VirtualTime(const VirtualTime&) = delete;
+    VirtualTime& operator=(const VirtualTime&) = delete;
+
+    NetClock::time_point now() const { return now_; }
+    int64_t wall_ms() const;
+    // Never moves backwards
+    void advance_to(NetClock::time_point t);
+
+    // The calling thread's, or null
+    static VirtualTime* current();
+
+  private:
+    NetClock::time_point now_{};
+    int64_t epoch_ms_;
+    VirtualTime* previous_;
+};
+
+// Wait traits for asio timers on NetClock. Under VirtualTime a timer is
+// due when simulated time reaches it, so the reactor never sleeps for it.
+struct NetClockWaitTraits {
+    static NetClock::duration to_wait_duration(const NetClock::duration& d) {
+        return VirtualTime::current() ? NetClock::duration::zero() : d;
+    }
+    static NetClock::duration
+    to_wait_duration(const NetClock::time_point& t) {
+        return to_wait_duration(t - NetClock::now());
+    }
+};
+
+} // namespace peerchat
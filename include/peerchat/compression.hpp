@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace peerchat {
+
+// Advertised in the handshake. The suffix names the built-in dictionary
+// both ends start from; bump it whenever that dictionary changes.
+inline constexpr const char* kCompressionZstd = "zstd/1";
+
+// JSON payloads shorter than this go out uncompressed
+static constexpr std::size_t kCompressMinBytes = 64;
+
+// Compresses the chat frames sent on one connection as a single zstd
+// stream. Each frame is flushed on its own, so the peer can decode it as
+// soon as it arrives, but the stream window carries over between frames:
+// keys, peer IDs and nicknames seen recently cost a few bytes each. Both
+// ends prime their stream with a dictionary of typical frames so even the
+// first messages shrink. Frames must be decoded in the order they were
+// compressed.
+class FrameCompressor {
+  public:
+    struct Stats {
+        uint64_t frames{0};
+        uint64_t bytes_in{0};
+        uint64_t bytes_out{0};
+    };
+
+    // Throws std::runtime_error if zstd can't set up the stream
+    FrameCompressor();
+    ~FrameCompressor();
+
+    FrameCompressor(const FrameCompressor&) = delete;
+    FrameCompressor& operator=(const FrameCompressor&) = delete;
+
+    // Payload tagged with FrameKind::Compressed
+    std::string compress(const std::string& payload);
+
+    const Stats& stats() const { return stats_; }
+
+  private:
+    struct Stream;
+    std::unique_ptr<Stream> stream_;
+    Stats stats_;
+};
+
+class FrameDecompressor {
+  public:
+    FrameDecompressor();
+    ~FrameDecompressor();
+
+    FrameDecompressor(const FrameDecompressor&) = delete;
+    FrameDecompressor& operator=(const FrameDecompressor&) = delete;
+
+    // Takes a payload tagged with FrameKind::Compressed. Throws
+    // std::invalid_argument if it is corrupt or inflates past
+    // kMaxFrameSize; the stream is unusable afterwards.
+    std::string decompress(const uint8_t* data, std::size_t len);
+
+  private:
+    struct Stream;
+    std::unique_ptr<Stream> stream_;
+};
+
+} // namespace peerchat
@@ -1,44 +1,112 @@
 #pragma once
 
+#include "peerchat/clock.hpp"
+#include "peerchat/compression.hpp"
 #include "peerchat/framing.hpp"
 #include "peerchat/types.hpp"
+#include "peerchat/write_scheduler.hpp"
 
 #include <asio.hpp>
 #include <functional>
 #include <memory>
 #include <mutex>
-#include <queue>
 #include <string>
+#include <vector>
 
 namespace peerchat {
 
+// Follows simulated time when driven by a SimNetwork
+using NetTimer = asio::basic_waitable_timer<NetClock, NetClockWaitTraits>;
+
+// A reliable, ordered stream of frames to one peer. TcpConnection and
+// UdpConnection are the real transports, MultipathConnection a session
+// over several of them; SimConnection (sim_network.hpp) runs over a
+// simulated network for tests and experiments.
 class Connection : public std::enable_shared_from_this<Connection> {
   public:
+    virtual ~Connection() = default;
+
+    // A TcpConnection over a connected socket
     static ConnectionPtr create(asio::ip::tcp::socket socket);
 
-    void start(MessageCallback on_message, ErrorCallback on_error);
-    void send(const std::string& json);
-    void close();
+    virtual void start(MessageCallback on_message, ErrorCallback on_error) = 0;
+    virtual void send(const std::string& json,
+                      Priority priority = Priority::Interactive) = 0;
+    // Queue many messages at once, to go out in batched writes
+    virtual void send_batch(const std::vector<std::string>& messages,
+                            Priority priority = Priority::Bulk) = 0;
+    // Queue an already encoded frame (length prefix included) as-is
+    virtual void send_frame(std::vector<uint8_t> frame,
+                            Priority priority = Priority::Bulk) = 0;
+    virtual void close() = 0;
 
-    std::string remote_address() const;
-    bool is_open() const;
+    // Compress JSON frames sent from now on. Call once both ends have
+    // advertised kCompressionZstd. Compressed frames from the peer are
+    // accepted either way.
+    virtual void enable_compression() = 0;
+    // Split long payloads so other classes can cut in. Call once the peer
+    // has advertised kFragmentation; fragments from the peer are accepted
+    // either way.
+    virtual void enable_fragmentation() = 0;
+    virtual bool compression_enabled() const = 0;
+    virtual FrameCompressor::Stats compression_stats() const = 0;
 
-  private:
-    explicit Connection(asio::ip::tcp::socket socket);
+    virtual std::string remote_address() const = 0;
+    virtual bool is_open() const = 0;
+};
+
+class TcpConnection final : public Connection {
+  public:
+    explicit TcpConnection(asio::ip::tcp::socket socket);
+    ~TcpConnection() override;
 
+    void start(MessageCallback on_message, ErrorCallback on_error) override;
+    void send(const std::string& json,
+              Priority priority = Priority::Interactive) override;
+    void send_batch(const std::vector<std::string>& messages,
+                    Priority priority = Priority::Bulk) override;
+    void send_frame(std::vector<uint8_t> frame,
+                    Priority priority = Priority::Bulk) override;
+    void close() override;
+
+    void enable_compression() override;
+    void enable_fragmentation() override;
+    bool compression_enabled() const override;
+    FrameCompressor::Stats compression_stats() const override;
+
+    std::string remote_address() const override;
+    bool is_open() const override;
+
+  private:
     void do_read();
     void do_write();
+    // Starts the write loop unless it is running. Caller holds
+    // write_mutex_; returns whether it must call do_write().
+    bool queued_locked(std::size_t payloads);
+    bool deliver(std::string_view frame);
+    bool fail(const std::string& reason);
 
     asio::ip::tcp::socket socket_;
     FrameDecoder decoder_;
     MessageCallback on_message_;
     ErrorCallback on_error_;
 
-    std::array<uint8_t, 4096> read_buf_;
+    // Large enough to take a whole file chunk frame in one read
+    std::array<uint8_t, 64 * 1024> read_buf_;
 
-    std::mutex write_mutex_;
-    std::queue<std::vector<uint8_t>> write_queue_;
+    mutable std::mutex write_mutex_;
+    WriteScheduler scheduler_;
     bool writing_{false};
+    std::unique_ptr<FrameCompressor> compressor_; // guarded by write_mutex_
+    // Frames of the write in progress; only the write loop touches it
+    std::vector<std::vector<uint8_t>> in_flight_;
+
+    std::unique_ptr<FrameDecompressor> decompressor_; // read side only
+    FragmentAssembler assembler_;                     // read side only
+
+    // Frames gathered into one write. Large enough for throughput, small
+    // enough that a control frame queued meanwhile isn't held up long.
+    static constexpr std::size_t kWriteBytes = 64 * 1024;
 };
 
 } // namespace peerchat
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "peerchat/multipath.hpp"
+#include "peerchat/transport.hpp"
+#include "peerchat/types.hpp"
+
+#include <asio.hpp>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace peerchat {
+
+// One way to try reaching a peer
+struct PathCandidate {
+    TransportKind kind{TransportKind::Tcp};
+    std::string host;
+    uint16_t port{0};
+};
+
+// Owns the transports and turns their connections into sessions: dials
+// every candidate path to a peer at once and joins the paths that peers
+// open to us into the sessions they belong to.
+class ConnectionManager {
+  public:
+    using SessionCallback =
+        std::function<void(std::shared_ptr<MultipathConnection> session)>;
+
+    // Sessions peers open go to `on_session`, unstarted
+    ConnectionManager(asio::io_context& io, SessionCallback on_session);
+
+    ConnectionManager(const ConnectionManager&) = delete;
+    ConnectionManager& operator=(const ConnectionManager&) = delete;
+
+    // Listens on it. Call before the io_context runs.
+    void add_transport(std::unique_ptr<Transport> transport);
+
+    // Races all candidates; `on_connect` gets the session once the first
+    // path is confirmed, the rest join it as they come up. `on_error`
+    // fires if none does.
+    void connect(const std::vector<PathCandidate>& candidates,
+                 SessionCallback on_connect, ErrorCallback on_error);
+
+    // A path a peer opened, unstarted. Its first frame says which session
+    // it is for; a peer from before paths gets a session of its own.
+    void accept(ConnectionPtr conn, TransportKind kind);
+
+    // The first transport's
+    uint16_t port() const;
+    void stop();
+
+  private:
+    // An accepted path until its first frame routes it
+    struct Inbound {
+        ConnectionManager* manager;
+        std::weak_ptr<Connection> conn;
+        TransportKind kind;
+        std::weak_ptr<MultipathConnection> session;
+        uint8_t id{0};
+        bool routed{false};
+    };
+
+    // Returns whether `payload` is for the session, rather than its Hello
+    bool route(Inbound& inbound, std::string_view payload);
+
+    asio::io_context& io_;
+    SessionCallback on_session_;
+    std::vector<std::unique_ptr<Transport>> transports_;
+
+    std::mutex mutex_;
+    std::map<SessionToken, std::weak_ptr<MultipathConnection>> sessions_;
+};
+
+} // namespace peerchat
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "peerchat/identity.hpp"
+
+#include <cstdint>
+#include <string>
+
+namespace peerchat {
+
+// Serializes our handshake, ping, pong and ACK messages from templates
+// rendered once per identity. The output is byte-for-byte what
+// Message::make_*(...).serialize() produces; only the id and timestamps
+// are formatted per call.
+//
+// Results are written to a thread-local buffer that the next call on the
+// same thread reuses, so once it has grown, pings and pongs don't
+// allocate. Copy the result if it must outlive that.
+class ControlSerializer {
+  public:
+    // `handshake_body` is sent as the body of every handshake
+    ControlSerializer(const Identity& identity, std::string handshake_body);
+
+    const std::string& handshake(int64_t timestamp_ms) const;
+    const std::string& ping(int64_t timestamp_ms) const;
+    const std::string& pong(int64_t timestamp_ms) const;
+    const std::string& ack(const std::string& msg_id,
+                           int64_t timestamp_ms) const;
+
+  private:
+    // {"body":<body>,"hlc":[<ts>,0],"id":"<id>"<fields><ts>,"type":"<t>"}
+    static const std::string& render(const std::string& head,
+                                     const char* id, std::size_t id_len,
+                                     const std::string& fields,
+                                     const std::string& tail, int64_t ts);
+
+    const Identity& identity_;
+    std::string handshake_head_;
+    // ,"nickname":..,"sender":..,"tag":..,"timestamp":
+    std::string control_fields_;
+    // Handshakes carry the nickname, which can change at runtime
+    mutable std::string handshake_fields_;
+    mutable std::string handshake_nick_;
+};
+
+} // namespace peerchat
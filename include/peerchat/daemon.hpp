@@ -0,0 +1,83 @@
+#pragma once
+
+#include "peerchat/frontend.hpp"
+
+#include <asio.hpp>
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace peerchat {
+
+// Headless frontend for running peerchat as a service. Instead of a
+// terminal it serves a Unix domain socket: clients write commands as one
+// JSON object per line and read events back the same way. Only built
+// where asio has local sockets (PEERCHAT_HAS_DAEMON).
+//
+// Commands ("id" is optional and echoed as "re" in the reply):
+//   {"cmd":"connect","host":"10.0.0.2","port":9000}
+//   {"cmd":"send","text":"hi"}        {"cmd":"send_file","path":"/tmp/a"}
+//   {"cmd":"status"}                  {"cmd":"history","limit":50}
+//   {"cmd":"disconnect"}              {"cmd":"quit"}
+//
+// Commands are read in bulk and run in order without waiting on each
+// other, so a script can write thousands of sends in one go. Replies
+// (status, history, errors, and "ok" for commands with an id) go to the
+// client that asked; messages, ACKs and state changes go to every client.
+class Daemon : public Frontend {
+  public:
+    // Largest backlog of unsent events a client may build up before it
+    // is disconnected
+    static constexpr std::size_t kMaxPendingBytes = 8 * 1024 * 1024;
+
+    // ~/.peerchat/control.sock
+    static std::filesystem::path default_socket_path();
+
+    // Binds the socket, replacing a stale one. Throws std::runtime_error
+    // if another daemon is already listening there.
+    explicit Daemon(std::filesystem::path socket_path);
+    ~Daemon() override;
+
+    // Blocking: serves clients until a quit command, SIGINT or SIGTERM
+    void run() override;
+
+    const std::filesystem::path& socket_path() const { return path_; }
+
+    void display_message(const std::string& nick,
+                         const std::string& body) override;
+    void display_system(const std::string& msg) override;
+    void display_ack(const std::string& msg_id) override;
+    void set_status(const std::string& status) override;
+    void display_status(const StatusReport& report) override;
+    void display_history(const std::vector<Message>& messages) override;
+
+  private:
+    class Session;
+
+    void accept();
+    void handle_command(Session& from, const std::string& line);
+    void run_command(const nlohmann::json& cmd);
+    // Replies to the command being handled, or broadcasts if there is none
+    void emit(nlohmann::json event);
+    void broadcast(std::string line);
+    void quit();
+
+    asio::io_context io_;
+    asio::local::stream_protocol::acceptor acceptor_;
+    asio::signal_set signals_;
+    std::filesystem::path path_;
+    std::atomic<std::thread::id> io_thread_;
+
+    // io_ thread only
+    std::vector<std::shared_ptr<Session>> sessions_;
+    Session* replying_to_{nullptr};
+    nlohmann::json reply_id_;
+    bool replied_{false};
+};
+
+} // namespace peerchat
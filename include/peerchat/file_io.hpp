@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+namespace peerchat {
+
+// Positional file I/O on a native handle (pread/pwrite on POSIX,
+// overlapped offsets on Windows). No shared file position, so chunk reads
+// and writes at different offsets never interfere.
+class NativeFile {
+  public:
+    enum class Mode { Read, ReadWrite };
+
+    // Throws std::system_error if the file can't be opened.
+    // ReadWrite creates the file if it doesn't exist.
+    static NativeFile open(const std::filesystem::path& path, Mode mode);
+
+    NativeFile() = default;
+    NativeFile(NativeFile&& other) noexcept;
+    NativeFile& operator=(NativeFile&& other) noexcept;
+    NativeFile(const NativeFile&) = delete;
+    NativeFile& operator=(const NativeFile&) = delete;
+    ~NativeFile();
+
+    bool is_open() const;
+    uint64_t size() const;
+    void resize(uint64_t size);
+
+    // Read up to len bytes at offset. Returns the bytes read, which is
+    // only short at end of file. Throws std::system_error on failure.
+    std::size_t read_at(void* buf, std::size_t len, uint64_t offset) const;
+
+    // Write all len bytes at offset. Throws std::system_error on failure.
+    void write_at(const void* buf, std::size_t len, uint64_t offset);
+
+    void close();
+
+  private:
+#ifdef _WIN32
+    void* handle_{nullptr};
+#else
+    int fd_{-1};
+#endif
+};
+
+} // namespace peerchat
@@ -0,0 +1,209 @@
+#pragma once
+
+#include "peerchat/chunk_store.hpp"
+#include "peerchat/file_io.hpp"
+#include "peerchat/sha256.hpp"
+#include "peerchat/swarm.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace peerchat {
+
+// Chunk data plus its binary header must fit in one frame
+static constexpr uint32_t kChunkSize = 32 * 1024;
+static constexpr uint32_t kHashesPerFrame = 1024;
+static constexpr std::size_t kDefaultRequestWindow = 16;
+
+// Offer sent to the peer as a file_offer message. The Merkle root over
+// the chunk hashes doubles as the file ID.
+struct FileManifest {
+    Sha256Digest root{};
+    std::string name;
+    uint64_t size{0};
+    uint32_t chunk_size{kChunkSize};
+
+    uint32_t chunk_count() const;
+    uint32_t chunk_length(uint32_t index) const;
+
+    std::string serialize() const;
+    static FileManifest deserialize(const std::string& data);
+};
+
+// Where a download's bytes came from. Reused bytes were never requested:
+// they were found in the chunk store or repeat another chunk of the file.
+struct TransferStats {
+    uint64_t bytes_total{0};
+    uint64_t bytes_fetched{0};
+    uint64_t bytes_reused{0};
+
+    double dedup_ratio() const {
+        return bytes_total == 0
+                   ? 0.0
+                   : static_cast<double>(bytes_reused) / bytes_total;
+    }
+};
+
+// Sends an encoded frame (length prefix included) to the peer
+using FrameSender = std::function<void(std::vector<uint8_t> frame)>;
+
+// A local file offered to peers. Chunks are read with positional reads
+// straight into the outgoing frame buffer.
+class FileSource {
+  public:
+    // Hashes the whole file. Throws std::system_error if unreadable.
+    explicit FileSource(const std::filesystem::path& path,
+                        uint32_t chunk_size = kChunkSize);
+
+    const FileManifest& manifest() const { return manifest_; }
+    const std::vector<Sha256Digest>& chunk_hashes() const { return hashes_; }
+
+    std::vector<uint8_t> hash_list_frame(uint32_t first, uint32_t count) const;
+    std::vector<uint8_t> chunk_frame(uint32_t index) const;
+
+  private:
+    NativeFile file_;
+    FileManifest manifest_;
+    std::vector<Sha256Digest> hashes_;
+};
+
+// One incoming file. Fetches the chunk hash list, checks it against the
+// manifest's Merkle root, and fills every chunk it can from `store` or
+// from another chunk of the file with the same hash. A SwarmScheduler
+// picks requests for the rest (at least `window` in flight, more on high
+// bandwidth-delay links); verified chunks are written at their offsets
+// and added to the store, which keeps them until the download ends.
+class FileDownload {
+  public:
+    enum class Status { InProgress, Complete, Failed };
+
+    FileDownload(FileManifest manifest, std::filesystem::path dest,
+                 std::size_t window, ChunkStore* store = nullptr);
+    ~FileDownload();
+
+    FileDownload(const FileDownload&) = delete;
+    FileDownload& operator=(const FileDownload&) = delete;
+
+    Status start(const FrameSender& send);
+    Status handle_hash_list(uint32_t first, uint32_t count,
+                            const uint8_t* hashes, const FrameSender& send);
+    Status handle_chunk(uint32_t index, const uint8_t* data, std::size_t len,
+                        const FrameSender& send);
+    // Gives up on the download and deletes the partial file
+    void abandon();
+
+    const FileManifest& manifest() const { return manifest_; }
+    const std::filesystem::path& path() const { return dest_; }
+    const std::string& error() const { return error_; }
+    uint32_t chunks_done() const { return chunks_done_; }
+    const TransferStats& stats() const { return stats_; }
+
+  private:
+    void reuse_local();
+    void write_chunk(uint32_t index, const uint8_t* data, std::size_t len);
+    void request_hashes(const FrameSender& send);
+    void request_chunks(const FrameSender& send);
+    Status finish();
+    Status fail(const std::string& reason);
+    void release_chunks();
+
+    FileManifest manifest_;
+    std::filesystem::path dest_;
+    std::filesystem::path part_path_;
+    std::size_t window_;
+    NativeFile file_;
+
+    std::vector<Sha256Digest> hashes_;
+    std::vector<bool> hash_batch_done_;
+    uint32_t next_hash_batch_{0};
+    uint32_t hash_batches_done_{0};
+    bool verified_{false};
+
+    ChunkStore* store_;
+    bool retained_{false};
+    // First index of each repeated hash -> the later indices it fills
+    std::unordered_map<uint32_t, std::vector<uint32_t>> repeats_;
+
+    SwarmScheduler scheduler_;
+    uint32_t chunks_done_{0};
+    int failures_{0};
+    TransferStats stats_;
+    std::string error_;
+
+    static constexpr int kMaxFailures = 16;
+    // Downloads currently have a single source: the session's peer
+    static constexpr SwarmPeerId kSessionPeer = 0;
+};
+
+// Routes binary transfer frames for one peer session: serves shared files
+// and drives downloads.
+class TransferManager {
+  public:
+    using CompleteCallback = std::function<void(
+        const FileManifest& manifest, const std::filesystem::path& path,
+        const TransferStats& stats)>;
+    using FailedCallback = std::function<void(const FileManifest& manifest,
+                                              const std::string& reason)>;
+
+    // Offers larger than this are declined unless raised
+    static constexpr uint64_t kDefaultMaxDownload = 1ULL << 30;
+    // Kept free on the download disk after preallocating a file
+    static constexpr uint64_t kFreeSpaceReserve = 256ULL << 20;
+
+    // `store`, if set, is consulted before requesting any chunk
+    explicit TransferManager(std::filesystem::path download_dir,
+                             std::size_t window = kDefaultRequestWindow,
+                             std::shared_ptr<ChunkStore> store = nullptr);
+
+    // Start sharing a local file. Thread-safe.
+    FileManifest share(const std::filesystem::path& path);
+
+    // Begin downloading an offered file from the peer behind `send`.
+    // Offers over max_download() or that wouldn't fit on disk fail
+    // straight away, through on_failed.
+    void download(const FileManifest& manifest, FrameSender send);
+
+    // Handle a binary frame payload (FrameKind byte first). Throws
+    // std::invalid_argument on malformed frames.
+    void handle_frame(const uint8_t* data, std::size_t len,
+                      const FrameSender& send);
+
+    // Abandon all downloads (peer went away); partial files are kept
+    void cancel_downloads();
+
+    bool can_download() const { return !download_dir_.empty(); }
+    uint64_t max_download() const { return max_download_; }
+    void set_max_download(uint64_t bytes) { max_download_ = bytes; }
+
+    void on_complete(CompleteCallback cb) { on_complete_ = std::move(cb); }
+    void on_failed(FailedCallback cb) { on_failed_ = std::move(cb); }
+
+  private:
+    std::shared_ptr<const FileSource> find_source(
+        const Sha256Digest& root) const;
+    void settle(std::map<Sha256Digest, FileDownload>::iterator it,
+                FileDownload::Status status);
+    std::filesystem::path unique_destination(const std::string& name) const;
+
+    std::filesystem::path download_dir_;
+    std::size_t window_;
+    std::shared_ptr<ChunkStore> store_;
+    uint64_t max_download_{kDefaultMaxDownload};
+
+    mutable std::mutex sources_mutex_;
+    std::map<Sha256Digest, std::shared_ptr<const FileSource>> sources_;
+    std::map<Sha256Digest, FileDownload> downloads_;
+
+    CompleteCallback on_complete_;
+    FailedCallback on_failed_;
+};
+
+} // namespace peerchat
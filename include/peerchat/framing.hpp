@@ -2,17 +2,61 @@
 
 #include "peerchat/types.hpp"
 
+#include <array>
 #include <cstdint>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace peerchat {
 
+// Payloads that aren't JSON start with a FrameKind byte. JSON payloads
+// always start with '{', so the two never collide.
+enum class FrameKind : uint8_t {
+    HashRequest = 0x01,
+    HashList = 0x02,
+    ChunkRequest = 0x03,
+    Chunk = 0x04,
+    // zstd-compressed JSON payload (see FrameCompressor)
+    Compressed = 0x05,
+    // Piece of a longer payload, split so other traffic can go out
+    // between its pieces: [kind][Priority][1 if last, else 0][bytes]
+    Fragment = 0x06,
+    // Path setup and migration within a session (see MultipathConnection)
+    Path = 0x07,
+};
+
+// Traffic classes sharing a connection, most urgent first. The writer
+// interleaves them by weight (see WriteScheduler), so heartbeats and ACKs
+// don't wait behind a file transfer or a history sync.
+enum class Priority : uint8_t {
+    Control = 0,     // handshake, ping, pong, ack
+    Interactive = 1, // chat text, file offers
+    Bulk = 2,        // history sync, outbox backlog, file transfer
+};
+inline constexpr std::size_t kPriorityClasses = 3;
+
+// Advertised in the handshake by peers that reassemble Fragment frames.
+// Payloads longer than kFragmentBytes are split only for those.
+inline constexpr const char* kFragmentation = "frag/1";
+static constexpr std::size_t kFragmentBytes = 8 * 1024;
+static constexpr std::size_t kFragmentHeaderSize = 3;
+
+inline bool is_binary_frame(std::string_view payload) {
+    return !payload.empty() && payload[0] != '{';
+}
+
 // Encodes a JSON string into a length-prefixed frame:
 // [4-byte big-endian length][payload]
 struct FrameEncoder {
+    static constexpr std::size_t kHeaderSize = 4;
+
     static std::vector<uint8_t> encode(const std::string& payload);
+
+    // Write the length prefix for a payload of `len` bytes. Lets callers
+    // build a frame in place, e.g. reading file data straight into it.
+    static void write_header(uint8_t* out, std::size_t len);
 };
 
 // Stateful decoder that accumulates bytes and yields complete frames.
@@ -26,11 +70,30 @@ class FrameDecoder {
     // Returns nullopt if no complete frame is available yet.
     std::optional<std::string> next();
 
+    // Same, without copying: the view points into the decoder's buffer
+    // and is valid until the next call to feed(), next() or next_view().
+    std::optional<std::string_view> next_view();
+
     // Number of buffered bytes not yet consumed
-    std::size_t buffered() const { return buffer_.size(); }
+    std::size_t buffered() const { return buffer_.size() - head_; }
 
   private:
     std::vector<uint8_t> buffer_;
+    std::size_t head_{0}; // start of the first unconsumed frame
+};
+
+// Joins Fragment payloads back into the payloads they were cut from. A
+// class sends its fragments in order, so each class has at most one
+// payload in progress.
+class FragmentAssembler {
+  public:
+    // Takes a FrameKind::Fragment payload. Returns the whole payload once
+    // its last piece is in. Throws std::invalid_argument if the fragment
+    // is malformed or the payload would outgrow kMaxFrameSize.
+    std::optional<std::string> add(std::string_view fragment);
+
+  private:
+    std::array<std::string, kPriorityClasses> partial_;
 };
 
 } // namespace peerchat
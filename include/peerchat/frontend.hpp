@@ -0,0 +1,100 @@
+#pragma once
+
+#include "peerchat/message.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace peerchat {
+
+using ConnectCommandCallback =
+    std::function<void(const std::string& host, uint16_t port)>;
+using SimpleCallback = std::function<void()>;
+using TextInputCallback = std::function<void(const std::string& text)>;
+using SendFileCallback = std::function<void(const std::string& path)>;
+using HistoryCallback = std::function<void(std::size_t limit)>;
+
+// Answer to a status command
+struct StatusReport {
+    std::string state;
+    std::string identity; // nickname#tag
+    std::string peer_id;
+    std::string listen_address;
+    // Empty unless connected
+    std::string remote_name;
+    std::string remote_peer_id;
+    std::string remote_address;
+    // One line per path to the peer, the active one marked
+    std::vector<std::string> paths;
+    std::size_t outbox_pending{0};
+    // Name and value of each metric (see MetricsRegistry::summary)
+    std::vector<std::pair<std::string, std::string>> metrics;
+};
+
+// User-facing side of the app: turns input into commands for App and
+// shows what App reports. The line-based CLI, the full-screen TUI and the
+// daemon's control socket are frontends; the two terminal ones share the
+// slash-command parsing here.
+class Frontend {
+  public:
+    virtual ~Frontend() = default;
+
+    // Blocking: handles input until /quit or end of input
+    virtual void run() = 0;
+
+    void on_connect_command(ConnectCommandCallback cb) {
+        on_connect_ = std::move(cb);
+    }
+    void on_disconnect_command(SimpleCallback cb) {
+        on_disconnect_ = std::move(cb);
+    }
+    void on_status_command(SimpleCallback cb) { on_status_ = std::move(cb); }
+    void on_quit_command(SimpleCallback cb) { on_quit_ = std::move(cb); }
+    void on_text_input(TextInputCallback cb) { on_text_ = std::move(cb); }
+    void on_send_file_command(SendFileCallback cb) {
+        on_send_file_ = std::move(cb);
+    }
+    void on_history_command(HistoryCallback cb) {
+        on_history_ = std::move(cb);
+    }
+
+    // Thread-safe, and must not block on the terminal: called from the
+    // network thread
+    virtual void display_message(const std::string& nick,
+                                 const std::string& body) = 0;
+    virtual void display_system(const std::string& msg) = 0;
+    virtual void display_ack(const std::string& msg_id) = 0;
+
+    // One-line summary of the connection, for frontends with a status bar
+    virtual void set_status(const std::string& status) { (void)status; }
+
+    // Results of the status and history commands; shown as system lines
+    // and messages unless overridden
+    virtual void display_status(const StatusReport& report);
+    virtual void display_history(const std::vector<Message>& messages);
+
+  protected:
+    // Dispatches a line of user input: a slash command or chat text
+    void process_line(const std::string& line);
+
+    bool running() const { return running_; }
+    void stop() { running_ = false; }
+
+    ConnectCommandCallback on_connect_;
+    SimpleCallback on_disconnect_;
+    SimpleCallback on_status_;
+    SimpleCallback on_quit_;
+    TextInputCallback on_text_;
+    SendFileCallback on_send_file_;
+    HistoryCallback on_history_;
+
+  private:
+    std::atomic<bool> running_{true};
+};
+
+} // namespace peerchat
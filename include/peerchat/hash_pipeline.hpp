@@ -0,0 +1,54 @@
+#pragma once
+
+#include "peerchat/file_io.hpp"
+#include "peerchat/sha256.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace peerchat {
+
+// Hashes a file's fixed-size chunks on a small worker pool. The file is
+// read in batches into two buffers: while the workers hash one batch the
+// caller reads the next, so disk reads overlap hashing. Equal-length
+// chunks go through sha256_many and so use the multi-buffer kernel when
+// that is the active one.
+class HashPipeline {
+  public:
+    // 0 threads: one per hardware thread
+    explicit HashPipeline(std::size_t threads = 0);
+    ~HashPipeline();
+
+    HashPipeline(const HashPipeline&) = delete;
+    HashPipeline& operator=(const HashPipeline&) = delete;
+
+    // Process-wide pool, created on first use. Safe to call from several
+    // threads at once.
+    static HashPipeline& shared();
+
+    std::size_t threads() const { return workers_.size(); }
+
+    // Hash of each `chunk_size` slice of the first `size` bytes of `file`;
+    // the last one may be short. Throws std::runtime_error if the file
+    // holds fewer than `size` bytes.
+    std::vector<Sha256Digest> hash_chunks(const NativeFile& file,
+                                          uint64_t size, uint32_t chunk_size);
+
+  private:
+    void run_worker();
+    void submit(std::function<void()> job);
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> jobs_;
+    bool stopping_{false};
+    std::vector<std::thread> workers_;
+};
+
+} // namespace peerchat
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "peerchat/message.hpp"
+#include "peerchat/sync.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+namespace peerchat {
+
+// In-memory message history for one conversation. Messages are kept in
+// arrival order and indexed by ID hash for duplicate detection and for
+// answering sync requests. Past `capacity` the messages with the oldest
+// timestamps are dropped, from the sync index too.
+class History {
+  public:
+    static constexpr std::size_t kDefaultCapacity = 10000;
+
+    explicit History(std::size_t capacity = kDefaultCapacity);
+
+    // Returns false if a message with the same ID is already stored, or
+    // if the history is full and the message is older than all of it
+    bool add(const Message& msg);
+
+    bool contains(const std::string& id) const;
+    const Message* find(uint64_t hash) const;
+
+    std::size_t size() const { return messages_.size(); }
+    std::size_t capacity() const { return capacity_; }
+    const std::list<Message>& messages() const { return messages_; }
+    const SyncIndex& index() const { return index_; }
+
+  private:
+    void evict();
+
+    std::size_t capacity_;
+    std::list<Message> messages_;
+    std::unordered_map<uint64_t, std::list<Message>::iterator> by_hash_;
+    SyncIndex index_;
+};
+
+} // namespace peerchat
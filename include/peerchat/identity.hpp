@@ -11,6 +11,9 @@ class Identity {
     // Otherwise generate a new UUID and save.
     explicit Identity(const std::string& nickname);
 
+    // A fresh identity that is never saved, for peers simulated in bulk
+    static Identity ephemeral(const std::string& nickname);
+
     const std::string& peer_id() const { return peer_id_; }
     const std::string& nickname() const { return nickname_; }
     const std::string& tag() const { return tag_; }
@@ -27,6 +30,8 @@ class Identity {
     static std::filesystem::path config_dir();
 
   private:
+    Identity(std::string nickname, std::string peer_id, std::string tag);
+
     std::string peer_id_;
     std::string nickname_;
     std::string tag_;
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace peerchat {
+
+template <typename Signature, std::size_t Capacity = 4 * sizeof(void*)>
+class InplaceFunction;
+
+// Move-only callable wrapper that keeps the callable inside itself and
+// never allocates. A callable bigger than Capacity is a compile error
+// rather than a silent trip to the heap, which is the point: it holds
+// callbacks that run once per frame. Calling an empty one is undefined;
+// test it first, as with a plain function pointer.
+template <typename R, typename... Args, std::size_t Capacity>
+class InplaceFunction<R(Args...), Capacity> {
+  public:
+    InplaceFunction() noexcept = default;
+    InplaceFunction(std::nullptr_t) noexcept {}
+
+    template <typename F, typename D = std::decay_t<F>,
+              typename = std::enable_if_t<
+                  !std::is_same_v<D, InplaceFunction> &&
+                  std::is_invocable_r_v<R, D&, Args...>>>
+    InplaceFunction(F&& f) {
+        static_assert(sizeof(D) <= Capacity,
+                      "callable too large for InplaceFunction: capture "
+                      "less, or raise Capacity");
+        static_assert(alignof(D) <= alignof(std::max_align_t));
+        static_assert(std::is_nothrow_move_constructible_v<D>);
+        ::new (static_cast<void*>(storage_)) D(std::forward<F>(f));
+        ops_ = &kOps<D>;
+    }
+
+    InplaceFunction(InplaceFunction&& other) noexcept { take(other); }
+    InplaceFunction& operator=(InplaceFunction&& other) noexcept {
+        if (this != &other) {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+    InplaceFunction& operator=(std::nullptr_t) noexcept {
+        reset();
+        return *this;
+    }
+    ~InplaceFunction() { reset(); }
+
+    explicit operator bool() const noexcept { return ops_ != nullptr; }
+
+    R operator()(Args... args) const {
+        return ops_->invoke(storage_, std::forward<Args>(args)...);
+    }
+
+  private:
+    struct Ops {
+        R (*invoke)(void* self, Args&&... args);
+        void (*move)(void* to, void* from) noexcept;
+        void (*destroy)(void* self) noexcept;
+    };
+
+    template <typename D>
+    static constexpr Ops kOps{
+        [](void* self, Args&&... args) -> R {
+            return std::invoke(*static_cast<D*>(self),
+                               std::forward<Args>(args)...);
+        },
+        [](void* to, void* from) noexcept {
+            ::new (to) D(std::move(*static_cast<D*>(from)));
+            static_cast<D*>(from)->~D();
+        },
+        [](void* self) noexcept { static_cast<D*>(self)->~D(); },
+    };
+
+    void take(InplaceFunction& other) noexcept {
+        if (!other.ops_) return;
+        other.ops_->move(storage_, other.storage_);
+        ops_ = std::exchange(other.ops_, nullptr);
+    }
+
+    void reset() noexcept {
+        if (ops_) std::exchange(ops_, nullptr)->destroy(storage_);
+    }
+
+    alignas(std::max_align_t) mutable unsigned char storage_[Capacity];
+    const Ops* ops_{nullptr};
+};
+
+} // namespace peerchat
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <compare>
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+
+namespace peerchat {
+
+// Handle to an immutable string held once in a process-wide table. Meant
+// for the identity fields every message repeats (peer ID, nickname, tag):
+// after the first message from a peer, interning the same text again is a
+// hash lookup and copying a handle is a reference count increment, with no
+// allocation. Entries are freed when their last handle goes away, so a
+// peer cycling through nicknames can't grow the table without bound.
+//
+// Equal text always maps to the same entry, so equality compares
+// pointers. Ordering compares the text.
+class InternedString {
+  public:
+    InternedString() = default;
+    InternedString(std::string_view text);
+    InternedString(const std::string& text)
+        : InternedString(std::string_view(text)) {}
+    InternedString(const char* text) : InternedString(std::string_view(text)) {}
+
+    InternedString(const InternedString& other);
+    InternedString(InternedString&& other) noexcept;
+    InternedString& operator=(const InternedString& other);
+    InternedString& operator=(InternedString&& other) noexcept;
+    ~InternedString();
+
+    const std::string& str() const;
+    operator const std::string&() const { return str(); }
+    bool empty() const { return entry_ == nullptr; }
+    std::size_t size() const { return str().size(); }
+
+    friend bool operator==(const InternedString& a, const InternedString& b) {
+        return a.entry_ == b.entry_;
+    }
+    friend bool operator==(const InternedString& a, std::string_view b) {
+        return a.str() == b;
+    }
+    friend bool operator==(const InternedString& a, const char* b) {
+        return a.str() == b;
+    }
+    friend std::strong_ordering operator<=>(const InternedString& a,
+                                            const InternedString& b) {
+        if (a.entry_ == b.entry_) return std::strong_ordering::equal;
+        return a.str().compare(b.str()) <=> 0;
+    }
+
+    // Distinct strings currently interned
+    static std::size_t table_size();
+
+  private:
+    struct Entry;
+    void release();
+
+    Entry* entry_{nullptr}; // null for the empty string
+};
+
+std::ostream& operator<<(std::ostream& os, const InternedString& s);
+
+} // namespace peerchat
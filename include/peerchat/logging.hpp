@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+#include <spdlog/common.h>
+
+namespace spdlog {
+class logger;
+namespace details {
+class thread_pool;
+}
+} // namespace spdlog
+
+// Debug logging on the message path goes through SPDLOG_DEBUG, which is
+// compiled out unless SPDLOG_ACTIVE_LEVEL allows it (cmake
+// -DPEERCHAT_LOG_LEVEL=DEBUG, the default for Debug builds). Release
+// builds never format a message body just to throw it away.
+
+namespace peerchat {
+
+struct LogConfig {
+    spdlog::level::level_enum level{spdlog::level::info};
+    std::size_t queue_size{8192}; // lines waiting for the log thread
+    // When the queue is full, wait for room rather than drop the oldest
+    // line. Dropping keeps a slow terminal from stalling the io thread.
+    bool block_when_full{false};
+};
+
+// Makes the default logger asynchronous for as long as it lives:
+// formatting and writing move to a thread of their own, and callers only
+// copy the line into a bounded queue. Writes to the same sinks as the
+// logger it replaces, and puts that one back, after draining the queue,
+// when destroyed.
+class AsyncLogging {
+  public:
+    explicit AsyncLogging(const LogConfig& config = {});
+    ~AsyncLogging();
+
+    AsyncLogging(const AsyncLogging&) = delete;
+    AsyncLogging& operator=(const AsyncLogging&) = delete;
+
+    // Lines lost to a full queue so far
+    std::size_t dropped() const;
+
+  private:
+    std::shared_ptr<spdlog::logger> previous_;
+    std::shared_ptr<spdlog::details::thread_pool> pool_;
+    std::shared_ptr<spdlog::logger> logger_;
+};
+
+} // namespace peerchat
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "peerchat/sha256.hpp"
+
+#include <vector>
+
+namespace peerchat {
+
+// Merkle root over a list of chunk hashes. Inner nodes are
+// SHA-256(0x01 || left || right); a node without a sibling is promoted
+// unchanged. The root of an empty list is SHA-256 of the empty string.
+Sha256Digest merkle_root(const std::vector<Sha256Digest>& leaves);
+
+} // namespace peerchat
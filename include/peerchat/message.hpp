@@ -1,7 +1,11 @@
 #pragma once
 
+#include "peerchat/clock.hpp"
+#include "peerchat/interned_string.hpp"
+
 #include <cstdint>
 #include <string>
+#include <string_view>
 
 #include <nlohmann/json.hpp>
 
@@ -13,25 +17,34 @@ enum class MessageType : uint8_t {
     Ack,
     Ping,
     Pong,
+    Sync,
+    FileOffer,
 };
 
+// Random version-4 UUID written to out[0..35], no terminator
+void write_uuid(char* out);
+// Makes this thread's UUIDs a fixed sequence, for reproducible simulations
+void seed_message_ids(uint32_t seed);
+
 std::string message_type_to_string(MessageType type);
 MessageType message_type_from_string(const std::string& s);
 
 struct Message {
     MessageType type;
     std::string id;       // UUID for text messages, echoed in ACKs
-    std::string sender;   // peer ID
-    std::string nickname; // display name
-    std::string tag;      // 4-digit identity tag
-    std::string body;     // text content (for Text), empty for control msgs
+    // Repeated in every message from a peer, so interned
+    InternedString sender;   // peer ID
+    InternedString nickname; // display name
+    InternedString tag;      // 4-digit identity tag
+    std::string body;     // text, sync payload or file manifest
     int64_t timestamp{0}; // Unix epoch milliseconds
+    HlcTimestamp hlc;     // causal order; defaults to {timestamp, 0}
 
     nlohmann::json to_json() const;
     static Message from_json(const nlohmann::json& j);
 
     std::string serialize() const;
-    static Message deserialize(const std::string& data);
+    static Message deserialize(std::string_view data);
 
     static Message make_handshake(const std::string& peer_id,
                                   const std::string& nick,
@@ -44,6 +57,10 @@ struct Message {
                             const std::string& msg_id);
     static Message make_ping(const std::string& peer_id);
     static Message make_pong(const std::string& peer_id);
+    static Message make_sync(const std::string& peer_id,
+                             const std::string& payload);
+    static Message make_file_offer(const std::string& peer_id,
+                                   const std::string& manifest);
 };
 
 } // namespace peerchat
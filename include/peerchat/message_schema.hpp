@@ -0,0 +1,227 @@
+#pragma once
+
+#include "peerchat/message.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace peerchat {
+
+// Compile-time description of the message protocol. The wire names of the
+// message types, the JSON fields every message carries and the handler
+// table for each consumer are all built from these lists, so a new type is
+// added here and in the MessageType enum, and every dispatcher that
+// doesn't route it fails to compile.
+
+// Wire names in MessageType order
+inline constexpr std::array<std::string_view, 7> kMessageTypeNames = {
+    "handshake", "text", "ack", "ping", "pong", "sync", "file_offer",
+};
+inline constexpr std::size_t kMessageTypeCount = kMessageTypeNames.size();
+
+static_assert(static_cast<std::size_t>(MessageType::FileOffer) + 1 ==
+                  kMessageTypeCount,
+              "kMessageTypeNames must name every MessageType");
+
+constexpr std::string_view message_type_name(MessageType type) {
+    auto i = static_cast<std::size_t>(type);
+    return i < kMessageTypeCount ? kMessageTypeNames[i] : "unknown";
+}
+
+// 32-bit FNV-1a
+constexpr uint32_t schema_hash(std::string_view s) {
+    uint32_t h = 2166136261u;
+    for (char c : s) {
+        h ^= static_cast<uint8_t>(c);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Derives an independent hash from `h` for each seed
+constexpr uint32_t schema_mix(uint32_t h, uint32_t seed) {
+    h ^= seed * 0x9e3779b9u;
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    return h;
+}
+
+// Perfect hash over a fixed set of names (hash and displace): the name's
+// hash picks a bucket, the bucket's seed remixes it into a slot, and each
+// slot holds at most one name. A lookup is one pass over the name, one
+// table read and one string compare, however many names there are.
+template <std::size_t N>
+class PerfectHash {
+  public:
+    static constexpr std::size_t npos = N;
+    static constexpr std::size_t kSlots = std::bit_ceil(N < 1 ? 2 : N * 2);
+    static constexpr std::size_t kBuckets =
+        std::bit_ceil(N < 4 ? std::size_t{1} : N / 2);
+
+    // Throws (or fails constant evaluation) if two names are equal
+    constexpr explicit PerfectHash(const std::array<std::string_view, N>& names)
+        : names_(names) {
+        slot_to_index_.fill(npos);
+
+        // Place the fullest buckets first, while most slots are free
+        std::array<std::size_t, N> order{};
+        std::array<std::size_t, N> bucket_of{};
+        std::array<std::size_t, kBuckets> bucket_size{};
+        for (std::size_t i = 0; i < N; ++i) {
+            order[i] = i;
+            hashes_[i] = schema_hash(names[i]);
+            bucket_of[i] = schema_mix(hashes_[i], 0) & (kBuckets - 1);
+            ++bucket_size[bucket_of[i]];
+        }
+        std::sort(order.begin(), order.end(),
+                  [&](std::size_t a, std::size_t b) {
+                      auto sa = bucket_size[bucket_of[a]];
+                      auto sb = bucket_size[bucket_of[b]];
+                      if (sa != sb) return sa > sb;
+                      return bucket_of[a] < bucket_of[b];
+                  });
+
+        for (std::size_t begin = 0; begin < N;) {
+            auto bucket = bucket_of[order[begin]];
+            auto end = begin;
+            while (end < N && bucket_of[order[end]] == bucket) ++end;
+            seeds_[bucket] = place(order, begin, end);
+            begin = end;
+        }
+    }
+
+    // Index of `name` in the original list, or npos
+    constexpr std::size_t find(std::string_view name) const {
+        auto h = schema_hash(name);
+        auto bucket = schema_mix(h, 0) & (kBuckets - 1);
+        auto slot = schema_mix(h, seeds_[bucket]) & (kSlots - 1);
+        auto i = slot_to_index_[slot];
+        return i != npos && names_[i] == name ? i : npos;
+    }
+
+  private:
+    constexpr uint32_t place(const std::array<std::size_t, N>& order,
+                             std::size_t begin, std::size_t end) {
+        for (uint32_t seed = 1; seed != 0; ++seed) {
+            std::array<std::size_t, N> slots{};
+            bool fits = true;
+            for (auto k = begin; k < end && fits; ++k) {
+                auto slot = schema_mix(hashes_[order[k]], seed) & (kSlots - 1);
+                slots[k] = slot;
+                fits = slot_to_index_[slot] == npos;
+                for (auto j = begin; j < k && fits; ++j) {
+                    fits = slots[j] != slot;
+                }
+            }
+            if (!fits) continue;
+            for (auto k = begin; k < end; ++k) {
+                slot_to_index_[slots[k]] = order[k];
+            }
+            return seed;
+        }
+        throw std::invalid_argument("Duplicate name in perfect hash");
+    }
+
+    std::array<std::string_view, N> names_{};
+    std::array<uint32_t, N> hashes_{}; // only needed while building
+    std::array<uint32_t, kBuckets> seeds_{};
+    std::array<std::size_t, kSlots> slot_to_index_{};
+};
+
+inline constexpr PerfectHash<kMessageTypeCount> kMessageTypeLookup{
+    kMessageTypeNames};
+
+// Appends `s` as a JSON string, escaped exactly as nlohmann's dump() does
+void append_json_string(std::string& out, std::string_view s);
+
+// One top-level JSON field of a serialized message
+struct MessageField {
+    std::string_view key;
+    void (*append)(std::string& out, const Message& m);
+};
+
+namespace schema_detail {
+
+template <auto Member>
+void append_string(std::string& out, const Message& m) {
+    const std::string& s = m.*Member;
+    append_json_string(out, s);
+}
+
+void append_hlc(std::string& out, const Message& m);
+void append_timestamp(std::string& out, const Message& m);
+void append_type(std::string& out, const Message& m);
+
+} // namespace schema_detail
+
+// Fields in the order they are written. nlohmann sorts object keys, and
+// serialize() must stay byte-compatible with to_json().dump(), so this
+// list is kept sorted too.
+inline constexpr std::array<MessageField, 8> kMessageFields = {{
+    {"body", schema_detail::append_string<&Message::body>},
+    {"hlc", schema_detail::append_hlc},
+    {"id", schema_detail::append_string<&Message::id>},
+    {"nickname", schema_detail::append_string<&Message::nickname>},
+    {"sender", schema_detail::append_string<&Message::sender>},
+    {"tag", schema_detail::append_string<&Message::tag>},
+    {"timestamp", schema_detail::append_timestamp},
+    {"type", schema_detail::append_type},
+}};
+
+static_assert(std::is_sorted(kMessageFields.begin(), kMessageFields.end(),
+                             [](const MessageField& a, const MessageField& b) {
+                                 return a.key < b.key;
+                             }),
+              "kMessageFields must be sorted by key");
+
+// Routes one message type to a member function of the consumer
+template <MessageType Type, auto Handler>
+struct On;
+
+template <MessageType Type, typename Owner,
+          void (Owner::*Handler)(const Message&)>
+struct On<Type, Handler> {
+    using owner_type = Owner;
+    static constexpr MessageType type = Type;
+    static constexpr auto handler = Handler;
+};
+
+// Jump table from MessageType to handler, built at compile time from a
+// list of On<...> routes. Every type must be routed exactly once.
+template <typename... Routes>
+class MessageDispatcher {
+    using Owner = std::common_type_t<typename Routes::owner_type...>;
+    using Handler = void (Owner::*)(const Message&);
+
+    static constexpr bool routes_each_type_once() {
+        std::array<int, kMessageTypeCount> seen{};
+        (++seen[static_cast<std::size_t>(Routes::type)], ...);
+        return std::all_of(seen.begin(), seen.end(),
+                           [](int n) { return n == 1; });
+    }
+    static_assert(routes_each_type_once(),
+                  "MessageDispatcher must route every MessageType once");
+
+    static constexpr std::array<Handler, kMessageTypeCount> kTable = [] {
+        std::array<Handler, kMessageTypeCount> table{};
+        ((table[static_cast<std::size_t>(Routes::type)] = Routes::handler),
+         ...);
+        return table;
+    }();
+
+  public:
+    static void dispatch(Owner& owner, const Message& msg) {
+        auto i = static_cast<std::size_t>(msg.type);
+        if (i < kMessageTypeCount) (owner.*kTable[i])(msg);
+    }
+};
+
+} // namespace peerchat
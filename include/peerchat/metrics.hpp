@@ -0,0 +1,170 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace peerchat {
+
+// Each metric is striped over this many cache lines. Threads are spread
+// over the stripes round-robin, so the network thread, the UI thread and
+// the transfer workers each bump their own line and never contend; a
+// scrape sums the stripes.
+inline constexpr std::size_t kMetricShards = 8;
+
+namespace detail {
+
+inline std::size_t metric_shard() {
+    static std::atomic<std::size_t> next{0};
+    thread_local const std::size_t shard =
+        next.fetch_add(1, std::memory_order_relaxed) % kMetricShards;
+    return shard;
+}
+
+} // namespace detail
+
+// Monotonic count
+class Counter {
+  public:
+    void inc(uint64_t n = 1) {
+        shards_[detail::metric_shard()].value.fetch_add(
+            n, std::memory_order_relaxed);
+    }
+    uint64_t value() const;
+
+  private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> value{0};
+    };
+    std::array<Shard, kMetricShards> shards_;
+};
+
+// Level that goes up and down, e.g. a queue depth
+class alignas(64) Gauge {
+  public:
+    void add(int64_t n) { value_.fetch_add(n, std::memory_order_relaxed); }
+    void set(int64_t n) { value_.store(n, std::memory_order_relaxed); }
+    int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+  private:
+    std::atomic<int64_t> value_{0};
+};
+
+// Latency distribution in microseconds, bucketed HdrHistogram-style:
+// every power of two is split into kSubBuckets linear steps, so any
+// recorded value is reported within 12.5% at a fixed 4 KiB per stripe.
+class Histogram {
+  public:
+    static constexpr unsigned kSubBucketBits = 3;
+    static constexpr std::size_t kSubBuckets = 1u << kSubBucketBits;
+    static constexpr std::size_t kBuckets =
+        (64 - kSubBucketBits + 1) * kSubBuckets;
+
+    struct Snapshot {
+        uint64_t count{0};
+        uint64_t sum{0}; // microseconds
+        std::array<uint64_t, kBuckets> buckets{};
+
+        // Upper bound of the bucket holding the q-th value, 0 if empty
+        uint64_t quantile(double q) const;
+    };
+
+    void record(uint64_t micros) {
+        auto& shard = shards_[detail::metric_shard()];
+        shard.buckets[bucket_index(micros)].fetch_add(
+            1, std::memory_order_relaxed);
+        shard.count.fetch_add(1, std::memory_order_relaxed);
+        shard.sum.fetch_add(micros, std::memory_order_relaxed);
+    }
+
+    template <typename Rep, typename Period>
+    void record(std::chrono::duration<Rep, Period> d) {
+        auto us =
+            std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+        record(static_cast<uint64_t>(us < 0 ? 0 : us));
+    }
+
+    Snapshot snapshot() const;
+
+    static std::size_t bucket_index(uint64_t v);
+    // Largest value that lands in bucket `index`
+    static uint64_t bucket_upper(std::size_t index);
+
+  private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sum{0};
+        std::array<std::atomic<uint64_t>, kBuckets> buckets{};
+    };
+    std::array<Shard, kMetricShards> shards_;
+};
+
+// Named metrics, rendered in the Prometheus text format. Registering a
+// name twice returns the same metric, so modules can look theirs up
+// without coordinating; the references stay valid for the registry's
+// lifetime. Recording never takes the registry lock.
+class MetricsRegistry {
+  public:
+    // The process-wide registry peerchat records into
+    static MetricsRegistry& global();
+
+    // Throw std::logic_error if `name` is registered as another kind
+    Counter& counter(const std::string& name, const std::string& help);
+    Gauge& gauge(const std::string& name, const std::string& help);
+    // Rendered as a summary in seconds; `name` should end in _seconds
+    Histogram& histogram(const std::string& name, const std::string& help);
+
+    // Text exposition format, metrics sorted by name
+    std::string render_prometheus() const;
+
+    // Short name and human-readable value per metric, for /status
+    std::vector<std::pair<std::string, std::string>> summary() const;
+
+  private:
+    enum class Kind { Counter, Gauge, Histogram };
+
+    struct Entry {
+        Kind kind;
+        std::string help;
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Gauge> gauge;
+        std::unique_ptr<Histogram> histogram;
+    };
+
+    Entry& find_or_add(const std::string& name, const std::string& help,
+                       Kind kind);
+
+    mutable std::mutex mutex_;
+    std::map<std::string, Entry> entries_;
+};
+
+// The metrics the networking code records, registered once in the
+// global registry
+struct NetMetrics {
+    Counter& frames_in;
+    Counter& frames_out;
+    Counter& bytes_in;
+    Counter& bytes_out;
+    Counter& parse_failures;
+    Counter& connections_accepted;
+    Counter& reconnects;
+    Counter& udp_packets_lost;
+    Counter& path_migrations;
+    Counter& relay_bytes;
+    Gauge& write_queue_depth;
+    Gauge& relay_sessions;
+    Histogram& ack_latency;
+    Histogram& handshake_time;
+
+    static NetMetrics& get();
+};
+
+} // namespace peerchat
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "peerchat/metrics.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+namespace httplib {
+class Server;
+}
+
+namespace peerchat {
+
+// Serves the registry for Prometheus to scrape: GET /metrics on
+// 127.0.0.1, from a thread of its own. Loopback only, since the metrics
+// reveal who we talk to and how much. GET /trace dumps the trace rings
+// (see trace.hpp) as Chrome trace JSON.
+class MetricsServer {
+  public:
+    // Port 0 picks a free one. Throws std::runtime_error if the port
+    // can't be bound.
+    explicit MetricsServer(
+        uint16_t port, MetricsRegistry& registry = MetricsRegistry::global());
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+    uint16_t port() const { return port_; }
+
+  private:
+    std::unique_ptr<httplib::Server> server_;
+    std::thread thread_;
+    uint16_t port_{0};
+};
+
+} // namespace peerchat
@@ -0,0 +1,220 @@
+#pragma once
+
+#include "peerchat/clock.hpp"
+#include "peerchat/connection.hpp"
+#include "peerchat/transport.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace peerchat {
+
+// Identifies a session to the peer across all of its paths
+using SessionToken = std::array<uint8_t, 16>;
+
+// Path frames, FrameKind::Path:
+//   [kind][Hello][16-byte token][path id]  first frame on every path we open
+//   [kind][HelloAck][path id]              answer, on the same path
+//   [kind][Moved][Priority][path id]       last frame of that class on this
+//                                          path; the rest follow on `id`
+//   [kind][Probe]                          round-trip probe
+//   [kind][ProbeAck]                       answer, on the same path
+enum class PathOp : uint8_t {
+    Hello = 1,
+    HelloAck = 2,
+    Moved = 3,
+    Probe = 4,
+    ProbeAck = 5,
+};
+
+// A session with one peer over several paths (TCP, UDP, ...), seen by
+// PeerManager as a single Connection. Frames go out on the active path.
+//
+// Every path is probed with a Probe frame: the peer's session answers
+// with a ProbeAck on the path the Probe came in on, and the round trip
+// and the share of unanswered probes give each path a score. Heartbeats
+// pass through to PeerManager like any other message. The side that
+// opened the session moves to a path that scores clearly better, and the
+// peer follows it.
+//
+// Moving doesn't lose or reorder frames. The old path stays open, and
+// after its last frame of each Priority it carries a Moved marker; the
+// receiver holds back frames from the new path until all three markers
+// are in, so everything sent before the move is delivered first.
+//
+// Peers from before paths never answer a Hello. A TCP path to one is
+// taken as is once kHelloTimeout passes, and no others are added.
+class MultipathConnection final : public Connection {
+  public:
+    using ReadyCallback = std::function<void(
+        std::shared_ptr<MultipathConnection> session)>;
+
+    struct PathInfo {
+        uint8_t id{0};
+        TransportKind kind{TransportKind::Tcp};
+        std::string address;
+        bool active{false};
+        bool confirmed{false}; // answered its Hello (or is a legacy path)
+        std::optional<std::chrono::microseconds> rtt;
+        double loss{0.0}; // share of recent probes unanswered
+    };
+
+    static constexpr auto kHelloTimeout = std::chrono::milliseconds(500);
+    // Unanswered paths are given up after this
+    static constexpr auto kConfirmTimeout = std::chrono::seconds(5);
+    static constexpr auto kProbeInterval = std::chrono::seconds(1);
+    static constexpr auto kProbeTimeout = std::chrono::seconds(2);
+    // Probes a path needs before it may become active
+    static constexpr uint32_t kMinSamples = 3;
+    // A path must score this much better than the active one...
+    static constexpr double kSwitchRatio = 0.75;
+    // ...and the last move must be this long ago
+    static constexpr auto kMinDwell = std::chrono::seconds(5);
+    // Most a session holds back from paths it is not reading yet; a peer
+    // that never sends its Moved markers is dropped past this
+    static constexpr std::size_t kMaxHeldBytes = 8 * 1024 * 1024;
+
+    // `initiator`: we opened the session and decide which path it uses
+    MultipathConnection(asio::io_context& io, SessionToken token,
+                        bool initiator);
+    ~MultipathConnection() override;
+
+    // Initiator: a path that just connected. Sends it a Hello; the first
+    // path to be confirmed makes the session ready.
+    void add_path(ConnectionPtr conn, TransportKind kind);
+    // Initiator: one fewer dial outstanding. `on_failed` fires if none
+    // are left and no path was ever confirmed.
+    void expect_paths(std::size_t n, ReadyCallback on_ready,
+                      ErrorCallback on_failed);
+    void dial_failed(const std::string& reason);
+
+    // Acceptor: a path the peer opened, already started and routed here.
+    // Answers its Hello; `id` is the peer's. Legacy peers have no Hello
+    // and their single path is added with `legacy`.
+    void add_inbound_path(ConnectionPtr conn, TransportKind kind, uint8_t id,
+                          bool legacy = false);
+    // Frames and errors of path `id`; the paths' callbacks call these
+    void on_path_frame(uint8_t id, std::string_view payload);
+    void on_path_error(uint8_t id, const std::string& reason);
+
+    const SessionToken& token() const { return token_; }
+    std::vector<PathInfo> paths() const;
+    // Moves to path `id` now, if it is confirmed. Normally the probes
+    // decide; mainly for tests.
+    bool migrate(uint8_t id);
+
+    void start(MessageCallback on_message, ErrorCallback on_error) override;
+    void send(const std::string& json,
+              Priority priority = Priority::Interactive) override;
+    void send_batch(const std::vector<std::string>& messages,
+                    Priority priority = Priority::Bulk) override;
+    void send_frame(std::vector<uint8_t> frame,
+                    Priority priority = Priority::Bulk) override;
+    void close() override;
+
+    void enable_compression() override;
+    void enable_fragmentation() override;
+    bool compression_enabled() const override;
+    FrameCompressor::Stats compression_stats() const override;
+
+    // The active path's, with a udp:// prefix for UDP
+    std::string remote_address() const override;
+    bool is_open() const override;
+
+    // Starts `conn` with callbacks into `session`'s path `id`. They hold
+    // the session weakly, so a path never keeps it alive.
+    static void route(const ConnectionPtr& conn,
+                      const std::weak_ptr<MultipathConnection>& session,
+                      uint8_t id);
+
+    static std::vector<uint8_t> path_frame(PathOp op,
+                                           std::string_view body = {});
+
+  private:
+    struct Path {
+        ConnectionPtr conn;
+        TransportKind kind{TransportKind::Tcp};
+        bool confirmed{false};
+        bool legacy{false};
+        NetClock::time_point opened{};
+        // Probe in flight on this path
+        std::optional<NetClock::time_point> probe_sent;
+        NetClock::time_point last_probe{};
+        std::optional<NetClock::duration> srtt;
+        double loss{0.0};
+        uint32_t samples{0};
+        // Moved markers received on this path, one bit per Priority
+        uint8_t moved{0};
+        uint8_t moved_to{0};
+    };
+
+    // Frames to hand to PeerManager once the lock is released
+    using Deliveries = std::vector<std::string>;
+
+    void confirm_locked(uint8_t id, Path& path, NetClock::time_point now);
+    void sample_locked(Path& path, NetClock::time_point now);
+    // Sends on the active path from now on, marking the old one
+    void switch_locked(uint8_t id, bool mark_old);
+    void handle_path_frame_locked(uint8_t id, std::string_view payload,
+                                  Deliveries& out);
+    // After inbound_ changed: releases held frames that are now in order
+    void release_held_locked(Deliveries& out);
+    // Hands out held frames from path `from`
+    void take_held_locked(uint8_t from, Deliveries& out);
+    // Fails over if it was active; releases what waited on it
+    void remove_path_locked(uint8_t id, Deliveries& out);
+    // Removes paths closed before their error callback came
+    void prune_locked(Deliveries& out);
+    // Best other open path becomes active
+    void fail_over_locked();
+    Path* active_locked();
+    double score(const Path& path) const;
+    void pick_best_locked(NetClock::time_point now);
+    void schedule_tick();
+    void tick();
+    void deliver(const Deliveries& frames);
+    void fire_ready();
+
+    asio::io_context& io_;
+    const SessionToken token_;
+    const bool initiator_;
+
+    mutable std::mutex mutex_;
+    std::map<uint8_t, Path> paths_;
+    uint8_t next_id_{0};
+    std::optional<uint8_t> active_;  // where we send
+    std::optional<uint8_t> inbound_; // where the peer's frames come from
+    // Frames from other paths, waiting for inbound_'s Moved markers
+    std::vector<std::pair<uint8_t, std::string>> held_;
+    std::size_t held_bytes_{0};
+    NetClock::time_point last_move_{};
+    bool compress_{false};
+    bool fragment_{false};
+    bool legacy_{false};
+    bool closed_{false};
+
+    std::size_t dialing_{0};
+    bool ready_{false};
+    ReadyCallback on_ready_;
+    ErrorCallback on_failed_;
+
+    MessageCallback on_message_;
+    ErrorCallback on_error_;
+    bool started_{false};
+    std::vector<std::string> early_; // arrived before start()
+
+    NetTimer tick_timer_;
+    bool ticking_{false};
+};
+
+} // namespace peerchat
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace peerchat {
+
+struct OutboxConfig {
+    // Messages kept in memory per peer before the oldest spill to disk
+    std::size_t memory_limit{256};
+    // Maximum queued messages per peer (memory + disk)
+    std::size_t max_per_peer{10000};
+    // Queued messages older than this are dropped instead of delivered
+    std::chrono::seconds ttl{std::chrono::hours(72)};
+    // Spill directory. Empty keeps everything in memory.
+    std::filesystem::path directory;
+};
+
+// Store-and-forward queue for peers that are currently offline.
+// Holds serialized messages per peer ID. Recent messages stay in memory;
+// once a peer's queue grows past memory_limit the oldest entries are
+// appended to a per-peer spill file and read back on drain(). Spill files
+// left by a previous run are picked up on construction.
+// Thread-safe: the CLI thread queues while the io thread drains.
+class Outbox {
+  public:
+    explicit Outbox(OutboxConfig config = {});
+
+    // Queue a serialized message. Returns false if the peer's quota is full.
+    bool push(const std::string& peer_id, std::string payload,
+              int64_t now_ms);
+
+    // Remove and return all unexpired messages for a peer, oldest first.
+    std::vector<std::string> drain(const std::string& peer_id,
+                                   int64_t now_ms);
+
+    // Drop expired entries for all peers, spilled ones included.
+    // Returns the number of entries removed.
+    std::size_t expire(int64_t now_ms);
+
+    std::size_t pending(const std::string& peer_id) const;
+    std::size_t total_pending() const;
+
+    const OutboxConfig& config() const { return config_; }
+
+  private:
+    struct Entry {
+        int64_t enqueued_ms;
+        std::string payload;
+    };
+
+    struct PeerQueue {
+        std::deque<Entry> memory;
+        std::size_t spilled{0}; // entries in the spill file
+        int64_t spill_front_ms{0}; // enqueued_ms of the first one
+    };
+
+    void load();
+    PeerQueue& queue_for(const std::string& peer_id);
+    // Returns the number of entries removed
+    std::size_t expire_queue(const std::string& peer_id, PeerQueue& q,
+                             int64_t now_ms);
+    void spill(const std::string& peer_id, PeerQueue& q);
+    std::vector<Entry> read_spill(const std::string& peer_id);
+    std::filesystem::path spill_path(const std::string& peer_id) const;
+    bool is_expired(int64_t enqueued_ms, int64_t now_ms) const;
+
+    OutboxConfig config_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, PeerQueue> queues_;
+};
+
+} // namespace peerchat
@@ -1,14 +1,25 @@
 #pragma once
 
+#include "peerchat/clock.hpp"
 #include "peerchat/connection.hpp"
+#include "peerchat/control_messages.hpp"
+#include "peerchat/file_transfer.hpp"
+#include "peerchat/history.hpp"
 #include "peerchat/identity.hpp"
 #include "peerchat/message.hpp"
+#include "peerchat/outbox.hpp"
+#include "peerchat/reorder_buffer.hpp"
 #include "peerchat/types.hpp"
 
 #include <asio.hpp>
+#include <chrono>
+#include <filesystem>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 
 namespace peerchat {
 
@@ -25,26 +36,53 @@ using DisplayCallback =
     std::function<void(const std::string& nick, const std::string& body)>;
 using AckCallback = std::function<void(const std::string& msg_id)>;
 using StateChangeCallback = std::function<void(PeerState state)>;
+// Returns whether to download the offered file
+using FileOfferCallback = std::function<bool(const FileManifest& manifest)>;
 
 class PeerManager {
   public:
-    PeerManager(asio::io_context& io, Identity& identity);
+    // Offered files are downloaded into download_dir; an empty path
+    // declines all offers. Chunks already in chunk_store aren't fetched.
+    PeerManager(asio::io_context& io, Identity& identity,
+                OutboxConfig outbox_config = {},
+                std::filesystem::path download_dir = {},
+                std::shared_ptr<ChunkStore> chunk_store = nullptr);
 
     // Set up a new connection (inbound or outbound).
     // is_initiator: true if we initiated the connection (send handshake first).
     void set_connection(ConnectionPtr conn, bool is_initiator);
 
-    void send_text(const std::string& body);
+    // Send a text message. While disconnected, messages for the last
+    // known peer are queued in the outbox and delivered after the next
+    // handshake with that peer. Returns false if the message was dropped.
+    bool send_text(const std::string& body);
     void disconnect();
 
+    // Hash a local file and offer it to the connected peer. Throws
+    // std::system_error if the file can't be read.
+    FileManifest send_file(const std::filesystem::path& path);
+
     PeerState state() const { return state_; }
-    std::string remote_nickname() const { return remote_nickname_; }
-    std::string remote_tag() const { return remote_tag_; }
+    std::string remote_nickname() const { return remote_nickname_.str(); }
+    std::string remote_tag() const { return remote_tag_.str(); }
     std::string remote_display_name() const {
-        return remote_nickname_ + "#" + remote_tag_;
+        return remote_nickname_.str() + "#" + remote_tag_.str();
     }
-    std::string remote_peer_id() const { return remote_peer_id_; }
+    std::string remote_peer_id() const { return remote_peer_id_.str(); }
     std::string remote_address() const;
+    // Whether frames to the peer are compressed (negotiated in handshake)
+    bool compression_active() const;
+
+    // Peer of the current or most recent session, kept across disconnects
+    const std::string& last_peer_id() const { return last_peer_id_; }
+    const std::string& last_peer_name() const { return last_peer_name_; }
+    const Outbox& outbox() const { return outbox_; }
+
+    // Number of messages kept for the conversation with a peer
+    std::size_t history_size(const std::string& peer_id) const;
+    // Up to `limit` of the most recent messages with `peer_id`, oldest first
+    std::vector<Message> recent_history(const std::string& peer_id,
+                                        std::size_t limit) const;
 
     void on_display(DisplayCallback cb) { on_display_ = std::move(cb); }
     void on_ack(AckCallback cb) { on_ack_ = std::move(cb); }
@@ -54,18 +92,45 @@ class PeerManager {
     void on_disconnect(DisconnectCallback cb) {
         on_disconnect_ = std::move(cb);
     }
+    // Without a callback, offers within the download limit are accepted
+    void on_file_offer(FileOfferCallback cb) {
+        on_file_offer_ = std::move(cb);
+    }
+    // Offers larger than this many bytes are declined
+    void set_max_download(uint64_t bytes) {
+        transfers_.set_max_download(bytes);
+    }
+    uint64_t max_download() const { return transfers_.max_download(); }
+    void on_file_received(TransferManager::CompleteCallback cb) {
+        transfers_.on_complete(std::move(cb));
+    }
+    void on_file_failed(TransferManager::FailedCallback cb) {
+        transfers_.on_failed(std::move(cb));
+    }
 
   private:
-    void handle_message(const std::string& json);
+    void handle_message(std::string_view payload);
     void handle_error(const std::string& reason);
 
     void handle_handshake(const Message& msg);
     void handle_text(const Message& msg);
     void handle_ack(const Message& msg);
     void handle_ping(const Message& msg);
-    void handle_pong();
+    void handle_pong(const Message& msg);
+    void handle_sync(const Message& msg);
+    void handle_file_offer(const Message& msg);
+    void handle_transfer_frame(std::string_view payload);
+    FrameSender frame_sender();
 
     void send_handshake();
+    void flush_outbox();
+    void start_sync();
+    void schedule_reorder();
+    void release_reordered(bool flush_all);
+    void display(const Message& msg);
+    void send_history(const History& history,
+                      const std::vector<uint64_t>& hashes);
+    bool record(const std::string& peer_id, const Message& msg);
     void start_handshake_timer();
     void start_heartbeat();
     void reset_pong_timer();
@@ -75,26 +140,53 @@ class PeerManager {
 
     asio::io_context& io_;
     Identity& identity_;
+    ControlSerializer control_;
     ConnectionPtr conn_;
     PeerState state_{PeerState::Disconnected};
     bool is_initiator_{false};
 
-    std::string remote_nickname_;
-    std::string remote_tag_;
-    std::string remote_peer_id_;
+    // Shared with the messages that carried them
+    InternedString remote_nickname_;
+    InternedString remote_tag_;
+    InternedString remote_peer_id_;
+    std::string last_peer_id_;
+    std::string last_peer_name_;
+
+    Outbox outbox_;
+
+    // Conversation history per remote peer ID, used for duplicate
+    // suppression and anti-entropy sync after reconnects
+    mutable std::mutex history_mutex_;
+    std::unordered_map<std::string, History> histories_;
+    int sync_rounds_{0};
+
+    TransferManager transfers_;
+
+    // Send times of texts not yet ACKed, for the ACK latency metric
+    std::mutex ack_mutex_;
+    std::unordered_map<std::string, NetClock::time_point> awaiting_ack_;
+    NetClock::time_point connected_at_;
+
+    HybridClock clock_;
+    ReorderBuffer reorder_;
 
-    asio::steady_timer handshake_timer_;
-    asio::steady_timer ping_timer_;
-    asio::steady_timer pong_timer_;
+    NetTimer handshake_timer_;
+    NetTimer ping_timer_;
+    NetTimer pong_timer_;
+    NetTimer reorder_timer_;
 
     DisplayCallback on_display_;
     AckCallback on_ack_;
     StateChangeCallback on_state_change_;
     DisconnectCallback on_disconnect_;
+    FileOfferCallback on_file_offer_;
 
     static constexpr int kHandshakeTimeoutSec = 5;
     static constexpr int kPingIntervalSec = 30;
     static constexpr int kPongTimeoutSec = 10;
+    static constexpr int kMaxSyncRounds = 64;
+    static constexpr int kReorderWindowMs = 100;
+    static constexpr std::size_t kMaxAwaitingAcks = 4096;
 };
 
 } // namespace peerchat
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace peerchat {
+
+// Setup frames, one FrameEncoder frame of JSON at the start of every
+// connection to a relay; after it the connection carries the session's
+// own frames.
+//   {"type":"relay_listen","name":N}   control connection of peer N
+//   {"type":"relay_incoming","key":K}  relay -> N: someone dials you
+//   {"type":"relay_accept","key":K}    N's new connection for session K
+//   {"type":"relay_connect","name":N}  a peer's connection to N
+enum class RelayOp { Listen, Incoming, Accept, Connect };
+
+std::vector<uint8_t> relay_frame(RelayOp op, const std::string& arg);
+
+struct RelayConfig {
+    // Per session, both directions together; 0 is unlimited
+    uint64_t bandwidth_bps{0};
+    // Most bytes moved per read, and the size of each direction's buffer
+    // when not splicing
+    std::size_t buffer_size{64 * 1024};
+    // Move bytes with splice(2) through a pipe, never copying them into
+    // user space. Linux only; elsewhere (or off) each direction reads
+    // into and writes from one buffer.
+    bool splice{true};
+    // Time the named peer has to answer an incoming session
+    std::chrono::milliseconds accept_timeout{5000};
+    // Time a new connection has to send its setup frame
+    std::chrono::milliseconds setup_timeout{5000};
+    // Most names registered at once
+    std::size_t max_names{1024};
+    // Most connections waiting to send their setup frame, and separately
+    // most dials waiting for the named peer to answer
+    std::size_t max_pending{256};
+};
+
+class RelaySession;
+
+// Forwards traffic between peers that can't reach each other directly,
+// as a TURN server does. Peers register under a name over a control
+// connection, which holds the name until it closes. A peer connecting
+// to that name is paired with a fresh connection from the named peer,
+// and from then on the two byte streams are joined without being
+// parsed, so the relay only sees opaque frames.
+//
+// Not thread-safe: run `io` on one thread.
+class RelayServer {
+  public:
+    struct SessionStats {
+        uint64_t id{0};
+        std::string name; // of the peer that was dialed
+        uint64_t bytes_to_peer{0};
+        uint64_t bytes_from_peer{0};
+    };
+
+    // Throws std::system_error if the port can't be bound
+    RelayServer(asio::io_context& io, uint16_t port, RelayConfig config = {});
+    ~RelayServer();
+
+    RelayServer(const RelayServer&) = delete;
+    RelayServer& operator=(const RelayServer&) = delete;
+
+    uint16_t port() const;
+    void stop();
+
+    const RelayConfig& config() const { return config_; }
+    // Peers registered now
+    std::vector<std::string> names() const;
+    std::vector<SessionStats> sessions() const;
+    // Over every session so far
+    uint64_t bytes_forwarded() const;
+
+  private:
+    using Socket = std::shared_ptr<asio::ip::tcp::socket>;
+
+    // A registered peer's control connection
+    struct Listener {
+        std::string name;
+        Socket control;
+        std::deque<std::vector<uint8_t>> outbox;
+        std::vector<uint8_t> discard;
+    };
+
+    // A dial waiting for the named peer's connection
+    struct Pending {
+        Socket dialer;
+        std::string name;
+        // Told about the dial; only its host may join the session
+        std::weak_ptr<Listener> listener;
+        std::unique_ptr<asio::steady_timer> timer;
+    };
+
+    void do_accept();
+    void read_setup(Socket socket);
+    void end_setup(const Socket& socket);
+    void handle_setup(Socket socket, const std::string& payload);
+    void listen(Socket socket, const std::string& name);
+    void connect(Socket socket, const std::string& name);
+    void join(Socket socket, const std::string& key);
+    void notify(const std::shared_ptr<Listener>& listener,
+                std::vector<uint8_t> frame);
+    void write_next(const std::shared_ptr<Listener>& listener);
+    void watch(const std::shared_ptr<Listener>& listener);
+    // Closes its control connection and frees its name
+    void drop(const std::shared_ptr<Listener>& listener);
+    void session_ended(uint64_t id, uint64_t bytes);
+
+    asio::io_context& io_;
+    asio::ip::tcp::acceptor acceptor_;
+    const RelayConfig config_;
+
+    // Connections yet to send their setup frame, with its deadline
+    std::map<Socket, std::unique_ptr<asio::steady_timer>> setup_;
+    std::map<std::string, std::shared_ptr<Listener>> listeners_;
+    std::map<std::string, Pending> pending_;
+    std::map<uint64_t, std::weak_ptr<RelaySession>> sessions_;
+    uint64_t next_session_{1};
+    uint64_t bytes_done_{0}; // of sessions that ended
+    // Set by stop(); handlers still queued then check it before touching
+    // the server, which may be gone
+    std::shared_ptr<bool> stopped_{std::make_shared<bool>(false)};
+};
+
+} // namespace peerchat
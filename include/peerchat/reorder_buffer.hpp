@@ -0,0 +1,58 @@
+#pragma once
+
+#include "peerchat/message.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace peerchat {
+
+// Per-conversation display buffer. Incoming messages are held for a short
+// window after arrival and released in HLC order, so messages relayed or
+// replayed out of order are shown in causal order. Insertion is O(log n).
+class ReorderBuffer {
+  public:
+    explicit ReorderBuffer(std::chrono::milliseconds window,
+                           std::size_t capacity = 4096);
+
+    void push(Message msg, int64_t now_ms);
+
+    // Append every message whose hold window has elapsed to `out`, in HLC
+    // order. Messages behind the head wait for it, so a release never
+    // goes backwards within the buffer.
+    void release(int64_t now_ms, std::vector<Message>& out);
+
+    // Release everything regardless of hold time
+    void flush(std::vector<Message>& out);
+
+    // Arrival deadline of the head message, if any
+    std::optional<int64_t> next_deadline() const;
+
+    std::size_t size() const { return heap_.size(); }
+    bool empty() const { return heap_.empty(); }
+
+  private:
+    struct Entry {
+        Message msg;
+        int64_t deadline_ms;
+        uint64_t seq; // tie-break for identical HLCs
+
+        bool operator>(const Entry& o) const {
+            if (msg.hlc != o.msg.hlc) return msg.hlc > o.msg.hlc;
+            if (msg.sender != o.msg.sender) return msg.sender > o.msg.sender;
+            return seq > o.seq;
+        }
+    };
+
+    void pop_into(std::vector<Message>& out);
+
+    int64_t window_ms_;
+    std::size_t capacity_;
+    uint64_t next_seq_{0};
+    std::vector<Entry> heap_; // min-heap via std::greater<>
+};
+
+} // namespace peerchat
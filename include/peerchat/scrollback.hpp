@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace peerchat {
+
+// Fixed-capacity history of display lines for the TUI. Once full, each new
+// line overwrites the oldest in place. Rendering is virtualized: view()
+// lays out only the lines that reach the screen, so its cost depends on
+// the window height, not on how long the session has run.
+class Scrollback {
+  public:
+    static constexpr std::size_t kDefaultCapacity = 50000;
+
+    explicit Scrollback(std::size_t capacity = kDefaultCapacity);
+
+    void push(std::string_view line);
+
+    std::size_t size() const { return count_; }
+    std::size_t capacity() const { return lines_.size(); }
+    // Lines pushed since construction, including evicted ones
+    uint64_t total() const { return total_; }
+
+    // 0 is the oldest line still held
+    const std::string& line(std::size_t i) const;
+
+    // Screen rows, top to bottom, for a `height` x `width` window whose
+    // last row shows the end of the line `scroll` lines above the newest.
+    // Long lines wrap at `width` bytes without splitting UTF-8 sequences.
+    // Fewer than `height` rows are returned when history runs out.
+    std::vector<std::string_view> view(std::size_t height, std::size_t width,
+                                       std::size_t scroll) const;
+
+  private:
+    std::vector<std::string> lines_;
+    std::size_t next_{0}; // slot the next line goes into
+    std::size_t count_{0};
+    uint64_t total_{0};
+};
+
+} // namespace peerchat
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace peerchat {
+
+using Sha256Digest = std::array<uint8_t, 32>;
+
+// Incremental SHA-256 (FIPS 180-4)
+class Sha256 {
+  public:
+    Sha256();
+
+    void update(const void* data, std::size_t len);
+    Sha256Digest finish();
+
+    // One-shot hash
+    static Sha256Digest hash(const void* data, std::size_t len);
+
+  private:
+    void compress(const uint8_t* blocks, std::size_t count);
+
+    std::array<uint32_t, 8> state_;
+    std::array<uint8_t, 64> buffer_{};
+    std::size_t buffered_{0};
+    uint64_t total_len_{0};
+};
+
+// Hasher for unordered containers keyed by digest. The digest is already
+// uniformly distributed, so its first bytes are used directly.
+struct DigestHash {
+    std::size_t operator()(const Sha256Digest& d) const {
+        std::size_t h = 0;
+        for (std::size_t i = 0; i < sizeof(h); ++i) {
+            h = (h << 8) | d[i];
+        }
+        return h;
+    }
+};
+
+// Compression kernels. The fastest one the CPU supports is picked on first
+// use: SHA-NI hashes one buffer with the dedicated instructions; AVX2
+// hashes eight equal-length buffers at once in sha256_many and leaves
+// single-buffer hashing to the scalar code.
+enum class Sha256Kernel { Scalar, Avx2, ShaNi };
+
+std::string sha256_kernel_name(Sha256Kernel kernel);
+Sha256Kernel sha256_kernel();
+std::vector<Sha256Kernel> sha256_supported_kernels();
+// Override the automatic choice (tests, benchmarks). Throws
+// std::invalid_argument if the CPU doesn't support `kernel`.
+void sha256_set_kernel(Sha256Kernel kernel);
+
+// Hash `count` messages that are all `len` bytes long
+void sha256_many(const uint8_t* const* messages, std::size_t len,
+                 Sha256Digest* out, std::size_t count);
+
+std::string to_hex(const Sha256Digest& digest);
+// Throws std::invalid_argument unless `hex` is 64 hex characters
+Sha256Digest digest_from_hex(const std::string& hex);
+
+} // namespace peerchat
@@ -0,0 +1,197 @@
+#pragma once
+
+#include "peerchat/clock.hpp"
+#include "peerchat/connection.hpp"
+
+#include <asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <queue>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace peerchat {
+
+class SimNetwork;
+
+// Simulated behaviour of the path between two nodes, per direction
+struct LinkConfig {
+    std::chrono::microseconds latency{std::chrono::milliseconds(1)};
+    // Extra delay drawn uniformly from [0, jitter]; frames stay in order
+    std::chrono::microseconds jitter{0};
+    // Bits per second shared by every connection on the link; 0 is
+    // unlimited
+    uint64_t bandwidth_bps{0};
+    // Chance that a transmission is lost. Connections are streams, so a
+    // lost frame is resent after `rto` (doubling on each loss) and holds
+    // up the frames behind it, as with TCP.
+    double loss{0.0};
+    std::chrono::milliseconds rto{200};
+};
+
+// Connection over a SimNetwork. Frames are delivered whole and in send
+// order, on the simulation's thread; compression and fragmentation are
+// negotiated but not applied, and priorities are ignored.
+class SimConnection final : public Connection {
+  public:
+    using NodeId = uint32_t;
+
+    SimConnection(SimNetwork& net, NodeId local, NodeId remote);
+
+    void start(MessageCallback on_message, ErrorCallback on_error) override;
+    void send(const std::string& json,
+              Priority priority = Priority::Interactive) override;
+    void send_batch(const std::vector<std::string>& messages,
+                    Priority priority = Priority::Bulk) override;
+    void send_frame(std::vector<uint8_t> frame,
+                    Priority priority = Priority::Bulk) override;
+    void close() override;
+
+    void enable_compression() override { compression_ = true; }
+    void enable_fragmentation() override {}
+    bool compression_enabled() const override { return compression_; }
+    FrameCompressor::Stats compression_stats() const override { return {}; }
+
+    std::string remote_address() const override;
+    bool is_open() const override { return open_; }
+
+    NodeId local_node() const { return local_; }
+    NodeId remote_node() const { return remote_; }
+
+  private:
+    friend class SimNetwork;
+
+    void receive(std::string payload);
+    void peer_closed();
+
+    SimNetwork& net_;
+    const NodeId local_;
+    const NodeId remote_;
+    std::weak_ptr<SimConnection> peer_;
+    MessageCallback on_message_;
+    ErrorCallback on_error_;
+    std::vector<std::string> early_; // arrived before start()
+    bool started_{false};
+    bool open_{true};
+    bool compression_{false};
+
+    // Sending side of the stream to peer_: frames in order with their
+    // arrival times; an empty payload closes the stream
+    std::deque<std::pair<NetClock::time_point, std::optional<std::string>>>
+        in_flight_;
+    NetClock::time_point last_arrival_{};
+    bool blocked_{false}; // by a partition
+};
+
+// Deterministic, single-threaded network for running many peers faster
+// than real time. Nodes are plain numbers; connect() hands out connected
+// SimConnection pairs that PeerManagers (or anything else taking a
+// Connection) use as they would TCP.
+//
+// Time is virtual: constructing a SimNetwork installs a VirtualTime on
+// the calling thread, so NetClock timers on the io_context (PeerManager's
+// handshake, heartbeat and reorder timers) fire by simulated time. The
+// run_* calls execute ready handlers, then jump to the next frame
+// delivery or scheduled event, stepping at most `timer_resolution` at a
+// time so asio timers are never late by more than that. Given the same
+// seed and the same calls, a run replays exactly.
+//
+// Everything happens on the thread that created the network, which must
+// also be the only thread running `io`. `io` and the network must outlive
+// the connections and nodes using them.
+class SimNetwork {
+  public:
+    using NodeId = SimConnection::NodeId;
+
+    struct Stats {
+        uint64_t frames_sent{0};
+        uint64_t frames_delivered{0};
+        uint64_t bytes_delivered{0}; // payload plus length prefix
+        uint64_t retransmits{0};
+        uint64_t frames_held{0}; // delayed by a partition
+    };
+
+    // Also reseeds this thread's message IDs from `seed`
+    explicit SimNetwork(asio::io_context& io, uint32_t seed = 1,
+                        LinkConfig defaults = {});
+
+    asio::io_context& io() { return io_; }
+    NetClock::time_point now() const { return time_.now(); }
+    NetClock::duration elapsed() const { return now().time_since_epoch(); }
+
+    // A connected pair: first is a's end, second is b's
+    std::pair<ConnectionPtr, ConnectionPtr> connect(NodeId a, NodeId b);
+
+    // Both directions between a and b
+    void set_link(NodeId a, NodeId b, LinkConfig config);
+
+    // Cuts `side` off from every other node until heal(). Frames across
+    // the cut wait, and go through once it heals; connections stay open
+    // unless the peers' own timeouts close them.
+    void partition(const std::vector<NodeId>& side);
+    void heal();
+
+    // Runs `fn` once simulated time has moved on by `delay`
+    void schedule(NetClock::duration delay, std::function<void()> fn);
+
+    void set_timer_resolution(NetClock::duration d) { resolution_ = d; }
+
+    void run_for(NetClock::duration d);
+    // Runs until `done` returns true (checked between steps) or `limit`
+    // has passed; returns whether `done` was reached
+    bool run_until(const std::function<bool()>& done,
+                   NetClock::duration limit);
+
+    const Stats& stats() const { return stats_; }
+
+  private:
+    friend class SimConnection;
+
+    struct Event {
+        NetClock::time_point at;
+        uint64_t seq;
+        std::function<void()> fn;
+
+        bool operator>(const Event& o) const {
+            return at != o.at ? at > o.at : seq > o.seq;
+        }
+    };
+
+    void transmit(SimConnection& from, std::optional<std::string> payload);
+    // Hands the peer every frame of the stream that is due
+    void pump(const std::shared_ptr<SimConnection>& from);
+    bool cut(NodeId a, NodeId b) const;
+    const LinkConfig& link(NodeId a, NodeId b) const;
+    NetClock::duration delivery_delay(NodeId from, NodeId to,
+                                      std::size_t bytes);
+    void at(NetClock::time_point t, std::function<void()> fn);
+    void drain_io();
+    void step(NetClock::time_point limit);
+
+    asio::io_context& io_;
+    VirtualTime time_;
+    std::mt19937 rng_;
+    LinkConfig defaults_;
+    NetClock::duration resolution_{std::chrono::milliseconds(1)};
+
+    std::priority_queue<Event, std::vector<Event>, std::greater<>> events_;
+    uint64_t next_seq_{0};
+
+    std::map<std::pair<NodeId, NodeId>, LinkConfig> links_;
+    // When each direction of a link finishes sending what it has queued
+    std::map<std::pair<NodeId, NodeId>, NetClock::time_point> busy_until_;
+    std::set<NodeId> partitioned_;
+    std::vector<std::weak_ptr<SimConnection>> holding_;
+
+    Stats stats_;
+};
+
+} // namespace peerchat
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace peerchat {
+
+using SwarmPeerId = uint32_t;
+
+struct SwarmRequest {
+    SwarmPeerId peer;
+    uint32_t chunk;
+};
+
+struct SwarmConfig {
+    // Requests kept in flight per peer before any measurement, and the
+    // slack added on top of the measured bandwidth-delay product
+    std::size_t min_window = 2;
+    std::size_t max_window = 64;
+    // Copies of one chunk that may be in flight at once during endgame;
+    // 1 disables endgame
+    std::size_t max_copies = 2;
+    // Requests outstanding longer than max(this, 4 x smoothed RTT) are
+    // given to another peer
+    int64_t min_timeout_ms = 2000;
+};
+
+// Decides which peer to ask for which chunk of one file. Pure bookkeeping:
+// the caller sends the requests it returns and reports what comes back.
+//
+// Chunks are picked rarest-first (fewest peers holding them, lowest index
+// on ties). Each peer gets as many requests in flight as its measured
+// throughput times its minimum RTT covers, so fast or distant peers are
+// kept busy. Once every missing chunk has been requested, endgame mode
+// asks idle peers for duplicates of the oldest outstanding chunks.
+class SwarmScheduler {
+  public:
+    struct PeerStats {
+        double bytes_per_ms{0};
+        double min_rtt_ms{0};
+        double srtt_ms{0};
+        uint64_t received{0};
+        uint64_t timeouts{0};
+        uint64_t failures{0};
+        std::size_t in_flight{0};
+    };
+
+    SwarmScheduler(uint32_t chunk_count, uint32_t chunk_size,
+                   SwarmConfig config = {});
+
+    // A peer holding the whole file
+    void add_peer(SwarmPeerId peer);
+    // A peer holding only the chunks set in `have`
+    void add_peer(SwarmPeerId peer, const std::vector<bool>& have);
+    void peer_has(SwarmPeerId peer, uint32_t chunk);
+    // Outstanding requests to the peer go back to the pool
+    void remove_peer(SwarmPeerId peer);
+
+    // Requests to send now. Also expires timed-out requests.
+    std::vector<SwarmRequest> next_requests(int64_t now_ms);
+
+    // Whether a chunk arriving from `peer` is still needed
+    bool wanted(SwarmPeerId peer, uint32_t chunk) const;
+    // A wanted chunk arrived and verified. Duplicates still outstanding at
+    // other peers are dropped and appended to `cancels` if given.
+    void on_received(SwarmPeerId peer, uint32_t chunk, int64_t now_ms,
+                     std::vector<SwarmRequest>* cancels = nullptr);
+    // A wanted chunk arrived corrupt; it will be requested again
+    void on_failed(SwarmPeerId peer, uint32_t chunk);
+    // The chunk was obtained without asking anyone (e.g. from a cache)
+    void mark_done(uint32_t chunk);
+
+    bool complete() const { return remaining_ == 0; }
+    bool in_endgame() const { return remaining_ > 0 && pool_.empty(); }
+    uint32_t remaining() const { return remaining_; }
+
+    std::size_t window(SwarmPeerId peer) const;
+    PeerStats stats(SwarmPeerId peer) const;
+
+  private:
+    struct Peer {
+        std::vector<bool> have; // empty: has every chunk
+        std::map<uint32_t, int64_t> in_flight; // chunk -> sent at
+        double bytes_per_ms{0};
+        double min_rtt_ms{0};
+        double srtt_ms{0};
+        int64_t last_delivery_ms{-1};
+        uint64_t received{0};
+        uint64_t timeouts{0};
+        uint64_t failures{0};
+
+        bool has(uint32_t chunk) const { return have.empty() || have[chunk]; }
+    };
+
+    std::size_t window_for(const Peer& peer) const;
+    uint32_t availability(uint32_t chunk) const;
+    void pool_insert(uint32_t chunk);
+    void pool_erase(uint32_t chunk);
+    void release(uint32_t chunk);
+    void expire(Peer& peer, int64_t now_ms);
+    void assign(SwarmPeerId id, Peer& peer, std::size_t slots, int64_t now_ms,
+                std::vector<SwarmRequest>& out);
+    void assign_endgame(SwarmPeerId id, Peer& peer, std::size_t slots,
+                        int64_t now_ms, std::vector<SwarmRequest>& out);
+
+    uint32_t chunk_size_;
+    SwarmConfig config_;
+
+    std::vector<bool> done_;
+    std::vector<uint8_t> copies_;      // requests in flight per chunk
+    std::vector<uint16_t> partial_;    // partial peers holding each chunk
+    uint32_t seeds_{0};                // peers holding everything
+    uint32_t remaining_;
+
+    // Unrequested, missing chunks some peer holds, keyed by
+    // (partial availability, index). Seeds add the same count to every
+    // chunk so they don't affect the order.
+    std::set<std::pair<uint16_t, uint32_t>> pool_;
+
+    std::map<SwarmPeerId, Peer> peers_;
+};
+
+} // namespace peerchat
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace peerchat {
+
+// Range-based set reconciliation for message histories.
+//
+// Each message is reduced to a (timestamp, hash-of-ID) key. Peers exchange
+// fingerprints (XOR of hashes plus a count) over key ranges; matching
+// ranges are dropped, differing ones are split recursively until they are
+// small enough to send the hashes themselves. Bandwidth scales with the
+// size of the difference, not the size of the history.
+
+struct SyncItem {
+    int64_t timestamp{0};
+    uint64_t hash{0};
+
+    auto operator<=>(const SyncItem&) const = default;
+
+    static constexpr SyncItem min() {
+        return {std::numeric_limits<int64_t>::min(), 0};
+    }
+    static constexpr SyncItem max() {
+        return {std::numeric_limits<int64_t>::max(),
+                std::numeric_limits<uint64_t>::max()};
+    }
+};
+
+// 64-bit hash of a message ID
+uint64_t sync_hash(std::string_view id);
+
+// Sorted key set with O(log n) range fingerprints.
+// Inserts are O(1); sorting is deferred until the next query.
+class SyncIndex {
+  public:
+    void insert(SyncItem item);
+    // Remove the `n` lowest items
+    void erase_lowest(std::size_t n);
+    std::size_t size() const { return items_.size(); }
+
+    // Position of the first item not less than bound
+    std::size_t lower_bound(const SyncItem& bound) const;
+    const SyncItem& at(std::size_t pos) const;
+
+    // XOR of item hashes over positions [begin, end)
+    uint64_t fingerprint(std::size_t begin, std::size_t end) const;
+
+  private:
+    void ensure_sorted() const;
+
+    mutable std::vector<SyncItem> items_;
+    mutable std::vector<uint64_t> prefix_; // prefix_[i] = xor of [0, i)
+    mutable bool dirty_{false};
+};
+
+struct SyncRange {
+    enum class Mode : uint8_t { Skip, Fingerprint, IdList };
+
+    // Exclusive upper bound. The lower bound is the previous range's upper
+    // bound (SyncItem::min() for the first range).
+    SyncItem upper;
+    Mode mode{Mode::Skip};
+    uint64_t fingerprint{0};     // Fingerprint
+    uint32_t count{0};           // Fingerprint
+    std::vector<uint64_t> hashes; // IdList
+};
+
+// One sync message: ranges still to reconcile plus hashes requested from
+// the receiver.
+struct SyncPayload {
+    std::vector<SyncRange> ranges;
+    std::vector<uint64_t> need;
+
+    std::string encode() const;
+    static SyncPayload decode(const std::string& data);
+};
+
+struct SyncLimits {
+    // Ranges at or below this size are sent as a hash list
+    std::size_t id_list_threshold{16};
+    // Number of sub-ranges a differing range is split into
+    std::size_t branching{16};
+    // Per-round caps that keep a sync message well inside kMaxFrameSize.
+    // Whatever doesn't fit is folded into one trailing fingerprint.
+    std::size_t max_ranges{384};
+    std::size_t max_hashes{768};
+};
+
+class Reconciler {
+  public:
+    explicit Reconciler(const SyncIndex& index, SyncLimits limits = {});
+
+    // Opening round: a single fingerprint over the whole key space
+    std::vector<SyncRange> initiate() const;
+
+    // Answer the peer's ranges. Hashes we hold that the peer lacks are
+    // appended to `have`, hashes the peer holds that we lack to `need`.
+    // Returns the next round; empty once both sides agree.
+    std::vector<SyncRange> reconcile(const std::vector<SyncRange>& incoming,
+                                     std::vector<uint64_t>& have,
+                                     std::vector<uint64_t>& need) const;
+
+  private:
+    SyncItem bound_between(std::size_t pos) const;
+    void split(std::size_t begin, std::size_t end, const SyncItem& upper,
+               std::vector<SyncRange>& out) const;
+
+    const SyncIndex& index_;
+    SyncLimits limits_;
+};
+
+} // namespace peerchat
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+namespace peerchat {
+
+struct TerminalOutputOptions {
+    // How long the writer waits after the first pending line for more to
+    // arrive, so bursts go out in one write
+    std::chrono::milliseconds flush_interval{4};
+    // A batch holding more delivery notices than this shows one summary
+    // line instead; 0 keeps every notice
+    std::size_t collapse_acks_above{8};
+};
+
+// Line-oriented output to a file descriptor, written by a dedicated
+// thread. push() never blocks on the terminal: lines go onto a lock-free
+// list and the writer coalesces everything pending into one write(2), so a
+// slow terminal or a full pipe stalls only the writer.
+class TerminalOutput {
+  public:
+    enum class LineKind : uint8_t { Normal, Ack };
+
+    struct Stats {
+        uint64_t lines{0};          // pushed lines written or collapsed
+        uint64_t writes{0};         // batches written
+        uint64_t collapsed_acks{0}; // notices folded into summaries
+    };
+
+    explicit TerminalOutput(int fd, TerminalOutputOptions options = {});
+    // Writes everything still pending
+    ~TerminalOutput();
+
+    TerminalOutput(const TerminalOutput&) = delete;
+    TerminalOutput& operator=(const TerminalOutput&) = delete;
+
+    // Thread-safe; `line` excludes the newline
+    void push(std::string line, LineKind kind = LineKind::Normal);
+
+    // Blocks until every line pushed before the call has been written
+    void flush();
+
+    Stats stats() const;
+
+  private:
+    struct Node;
+
+    void run();
+    void write_batch(Node* newest_first);
+    void write_all(const char* data, std::size_t size);
+
+    const int fd_;
+    const TerminalOutputOptions options_;
+
+    std::atomic<Node*> head_{nullptr}; // newest first
+    std::atomic<uint32_t> signal_{0};  // bumped on every push and request
+    std::atomic<bool> urgent_{false};  // skip the coalescing delay
+    std::atomic<bool> stopping_{false};
+    std::atomic<uint64_t> pushed_{0};
+    std::atomic<uint64_t> done_{0}; // lines written or collapsed
+
+    std::string buffer_; // writer thread only
+    std::atomic<uint64_t> writes_{0};
+    std::atomic<uint64_t> collapsed_acks_{0};
+    std::thread writer_;
+};
+
+} // namespace peerchat
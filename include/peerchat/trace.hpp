@@ -0,0 +1,137 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Trace points on the receive and send paths, for finding out where the
+// time goes when latency spikes. They are compiled in only when
+// PEERCHAT_TRACE is defined (cmake -DPEERCHAT_TRACE=ON); otherwise the
+// macros below expand to nothing.
+//
+// Each thread records completed spans into a ring of its own, without
+// locks; chrome_json() collects the rings for chrome://tracing or
+// ui.perfetto.dev.
+
+namespace peerchat::trace {
+
+// A completed span. Times are steady_clock nanoseconds.
+struct Event {
+    const char* name{nullptr}; // string literal
+    uint64_t start_ns{0};
+    uint64_t dur_ns{0};
+    uint64_t arg{0}; // bytes, counts; whatever the trace point records
+};
+
+// Spans kept per thread; older ones are overwritten
+inline constexpr std::size_t kRingSize = 8192;
+
+// Written by its own thread only, read from any. A reader copies the
+// slots and then drops any the writer may have reused meanwhile.
+class Ring {
+  public:
+    explicit Ring(uint32_t tid) : tid_(tid) {}
+
+    void push(const char* name, uint64_t start_ns, uint64_t dur_ns,
+              uint64_t arg) noexcept {
+        const uint64_t i = written_.load(std::memory_order_relaxed);
+        claimed_.store(i + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        auto& slot = slots_[i % kRingSize];
+        slot.name.store(name, std::memory_order_relaxed);
+        slot.start_ns.store(start_ns, std::memory_order_relaxed);
+        slot.dur_ns.store(dur_ns, std::memory_order_relaxed);
+        slot.arg.store(arg, std::memory_order_relaxed);
+        written_.store(i + 1, std::memory_order_release);
+    }
+
+    // Events still in the ring, oldest first
+    std::vector<Event> snapshot() const;
+    // Forget what has been recorded so far
+    void clear();
+
+    uint32_t tid() const { return tid_; }
+
+  private:
+    struct Slot {
+        std::atomic<const char*> name{nullptr};
+        std::atomic<uint64_t> start_ns{0};
+        std::atomic<uint64_t> dur_ns{0};
+        std::atomic<uint64_t> arg{0};
+    };
+
+    std::array<Slot, kRingSize> slots_;
+    std::atomic<uint64_t> claimed_{0};
+    std::atomic<uint64_t> written_{0};
+    std::atomic<uint64_t> floor_{0}; // set by clear()
+    const uint32_t tid_;
+};
+
+inline uint64_t now_ns() noexcept {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+}
+
+// Registers a ring for the calling thread. Rings outlive their threads,
+// so a dump still shows what finished threads did.
+Ring& register_thread();
+
+inline Ring& this_thread_ring() {
+    thread_local Ring* ring = &register_thread();
+    return *ring;
+}
+
+// Records the time from construction to destruction
+class Scope {
+  public:
+    explicit Scope(const char* name, uint64_t arg = 0) noexcept
+        : name_(name), arg_(arg), start_(now_ns()) {}
+    ~Scope() {
+        this_thread_ring().push(name_, start_, now_ns() - start_, arg_);
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    const char* name_;
+    uint64_t arg_;
+    uint64_t start_;
+};
+
+// Every thread's events in Chrome trace event format
+std::string chrome_json();
+// Drops everything recorded so far, on all threads
+void clear();
+
+// Whether the trace points were compiled in
+inline constexpr bool kEnabled =
+#ifdef PEERCHAT_TRACE
+    true;
+#else
+    false;
+#endif
+
+} // namespace peerchat::trace
+
+#ifdef PEERCHAT_TRACE
+#define PEERCHAT_TRACE_CAT2(a, b) a##b
+#define PEERCHAT_TRACE_CAT(a, b) PEERCHAT_TRACE_CAT2(a, b)
+// Traces the rest of the enclosing block
+#define PEERCHAT_TRACE_SCOPE(name)                                           \
+    ::peerchat::trace::Scope PEERCHAT_TRACE_CAT(peerchat_trace_, __LINE__)(  \
+        name)
+// Same, recording `arg` with the span
+#define PEERCHAT_TRACE_SCOPE_ARG(name, arg)                                  \
+    ::peerchat::trace::Scope PEERCHAT_TRACE_CAT(peerchat_trace_, __LINE__)(  \
+        name, static_cast<uint64_t>(arg))
+#else
+#define PEERCHAT_TRACE_SCOPE(name) static_cast<void>(0)
+#define PEERCHAT_TRACE_SCOPE_ARG(name, arg) static_cast<void>(0)
+#endif
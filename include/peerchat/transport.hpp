@@ -0,0 +1,117 @@
+#pragma once
+
+#include "peerchat/server.hpp"
+#include "peerchat/types.hpp"
+#include "peerchat/udp_transport.hpp"
+
+#include <asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace peerchat {
+
+enum class TransportKind : uint8_t {
+    Tcp,
+    Udp,
+    Relay,
+};
+
+// "tcp", "udp", "relay"
+std::string transport_kind_to_string(TransportKind kind);
+
+// One way of reaching peers: listens on a local port and dials remote
+// ones, handing out Connections either way. ConnectionManager races the
+// transports it has against each other.
+class Transport {
+  public:
+    virtual ~Transport() = default;
+
+    virtual TransportKind kind() const = 0;
+    // Paths peers open to us go to `on_accept`, unstarted. Call before
+    // the io_context runs.
+    virtual void listen(ConnectCallback on_accept) = 0;
+    // Exactly one of the callbacks fires, on the io thread
+    virtual void dial(const std::string& host, uint16_t port,
+                      ConnectCallback on_connect, ErrorCallback on_error) = 0;
+    virtual uint16_t port() const = 0;
+    virtual void stop() = 0;
+};
+
+class TcpTransport final : public Transport {
+  public:
+    // Throws std::system_error if the port can't be bound
+    TcpTransport(asio::io_context& io, uint16_t port);
+
+    TransportKind kind() const override { return TransportKind::Tcp; }
+    void listen(ConnectCallback on_accept) override;
+    void dial(const std::string& host, uint16_t port,
+              ConnectCallback on_connect, ErrorCallback on_error) override;
+    uint16_t port() const override { return server_.port(); }
+    void stop() override { server_.stop(); }
+
+  private:
+    asio::io_context& io_;
+    ConnectCallback on_accept_;
+    Server server_;
+};
+
+// Connections over UdpEndpoint. Dialing succeeds as soon as the address
+// resolves: whether anyone answers only shows once traffic flows.
+class UdpTransport final : public Transport {
+  public:
+    // Throws std::system_error if the port can't be bound
+    UdpTransport(asio::io_context& io, uint16_t port, UdpConfig config = {});
+
+    TransportKind kind() const override { return TransportKind::Udp; }
+    void listen(ConnectCallback on_accept) override;
+    void dial(const std::string& host, uint16_t port,
+              ConnectCallback on_connect, ErrorCallback on_error) override;
+    uint16_t port() const override { return endpoint_->port(); }
+    void stop() override { endpoint_->stop(); }
+
+  private:
+    asio::io_context& io_;
+    ConnectCallback on_accept_;
+    std::shared_ptr<UdpEndpoint> endpoint_;
+};
+
+// TCP connections through a RelayServer, for peers that can't reach each
+// other directly. listen() registers us with the relay under `name` and
+// answers the sessions it announces; dial()'s `host` is the name the
+// other peer registered, and its port is unused.
+class RelayTransport final : public Transport {
+  public:
+    // The relay is dialed again this long after losing it
+    static constexpr auto kRetryInterval = std::chrono::seconds(10);
+
+    RelayTransport(asio::io_context& io, std::string relay_host,
+                   uint16_t relay_port, std::string name);
+
+    TransportKind kind() const override { return TransportKind::Relay; }
+    void listen(ConnectCallback on_accept) override;
+    void dial(const std::string& host, uint16_t port,
+              ConnectCallback on_connect, ErrorCallback on_error) override;
+    // Nothing listens locally
+    uint16_t port() const override { return 0; }
+    void stop() override;
+
+  private:
+    // A connection to the relay whose first frame is `setup`
+    void open(std::vector<uint8_t> setup, ConnectCallback on_connect,
+              ErrorCallback on_error);
+    void register_with_relay();
+    void retry_later();
+
+    asio::io_context& io_;
+    const std::string relay_host_;
+    const uint16_t relay_port_;
+    const std::string name_;
+    ConnectCallback on_accept_;
+    ConnectionPtr control_;
+    asio::steady_timer retry_timer_;
+    bool stopped_{false};
+};
+
+} // namespace peerchat
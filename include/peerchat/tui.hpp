@@ -0,0 +1,67 @@
+#pragma once
+
+#include "peerchat/frontend.hpp"
+#include "peerchat/scrollback.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace peerchat {
+
+// Full-screen ncurses frontend: scrollback on top, a status bar, and an
+// input line at the bottom. Only built when curses is available
+// (PEERCHAT_HAS_TUI).
+//
+// ncurses is driven from the thread in run() alone. The display methods
+// only append to the scrollback and mark what changed. run() redraws the
+// damaged regions at most once per frame, so a message flood costs one
+// redraw per frame, not one per message.
+class Tui : public Frontend {
+  public:
+    static constexpr std::chrono::milliseconds kFrameInterval{33};
+
+    explicit Tui(std::size_t scrollback_lines = Scrollback::kDefaultCapacity);
+    ~Tui() override;
+
+    // Blocking: owns the terminal until /quit
+    void run() override;
+
+    void display_message(const std::string& nick,
+                         const std::string& body) override;
+    void display_system(const std::string& msg) override;
+    void display_ack(const std::string& msg_id) override;
+    void set_status(const std::string& status) override;
+
+  private:
+    struct Screen;
+
+    enum Damage : uint8_t {
+        kLog = 1,
+        kStatus = 2,
+        kInput = 4,
+        kAll = kLog | kStatus | kInput,
+    };
+
+    void append(const std::string& line);
+    void damage(uint8_t regions);
+    void handle_key(int key);
+    void redraw(uint8_t regions);
+
+    std::unique_ptr<Screen> screen_;
+
+    // Shared with the display methods
+    std::mutex mutex_;
+    Scrollback scrollback_;
+    std::size_t scroll_{0}; // lines hidden below the bottom row
+    std::string status_;
+    uint64_t delivered_{0};
+    uint8_t damage_{kAll};
+
+    // UI thread only
+    std::string input_;
+};
+
+} // namespace peerchat
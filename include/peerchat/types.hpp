@@ -1,21 +1,27 @@
 #pragma once
 
+#include "peerchat/inplace_function.hpp"
+
 #include <cstdint>
 #include <functional>
 #include <memory>
 #include <string>
+#include <string_view>
 
 namespace peerchat {
 
 class Connection;
 using ConnectionPtr = std::shared_ptr<Connection>;
 
-using MessageCallback = std::function<void(const std::string& json)>;
+// Called once per received frame. The payload is only valid for the
+// duration of the call: it points into the connection's read buffer.
+using MessageCallback = InplaceFunction<void(std::string_view payload)>;
 using ErrorCallback = std::function<void(const std::string& reason)>;
 using ConnectCallback = std::function<void(ConnectionPtr conn)>;
 using DisconnectCallback = std::function<void(const std::string& reason)>;
 
 static constexpr std::size_t kMaxFrameSize = 64 * 1024; // 64 KiB
 static constexpr uint16_t kDefaultPort = 9000;
+static constexpr uint16_t kDefaultRelayPort = 9001;
 
 } // namespace peerchat
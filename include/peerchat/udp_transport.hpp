@@ -0,0 +1,337 @@
+#pragma once
+
+#include "peerchat/compression.hpp"
+#include "peerchat/connection.hpp"
+#include "peerchat/framing.hpp"
+
+#include <asio.hpp>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace peerchat {
+
+class UdpEndpoint;
+
+struct UdpConfig {
+    // Share of outgoing datagrams dropped on purpose, to exercise loss
+    // recovery in tests
+    double loss{0.0};
+    // Connection IDs, first packet numbers and the loss draws. Unset, it
+    // comes from std::random_device; tests set it to replay a run.
+    std::optional<uint32_t> seed{};
+    // A connection that hears nothing from its peer for this long fails.
+    // Longer than PeerManager's ping interval, so a quiet peer stays up.
+    std::chrono::milliseconds idle_timeout{60'000};
+};
+
+// Largest datagram we send, headers included. Small enough to pass
+// unfragmented over any path that carries IPv6.
+inline constexpr std::size_t kMaxDatagram = 1200;
+
+// Disjoint half-open ranges [first, end) of unsigned integers: packet
+// numbers seen, stream bytes acknowledged or waiting to be resent.
+class RangeSet {
+  public:
+    // Returns how many of the values were not in the set yet
+    uint64_t add(uint64_t first, uint64_t end);
+    void remove(uint64_t first, uint64_t end);
+    bool contains(uint64_t value) const;
+
+    bool empty() const { return ranges_.empty(); }
+    std::size_t size() const { return ranges_.size(); }
+    // first -> end, ascending
+    const std::map<uint64_t, uint64_t>& ranges() const { return ranges_; }
+    // Forget the lowest ranges until at most `n` remain
+    void keep_highest(std::size_t n);
+
+  private:
+    std::map<uint64_t, uint64_t> ranges_;
+};
+
+// Round-trip estimate as in RFC 9002 section 5
+class RttEstimator {
+  public:
+    using duration = std::chrono::steady_clock::duration;
+
+    static constexpr duration kInitialRtt = std::chrono::milliseconds(100);
+    static constexpr duration kGranularity = std::chrono::milliseconds(1);
+
+    // `ack_delay` is how long the peer held the ACK back
+    void sample(duration rtt, duration ack_delay);
+
+    bool has_sample() const { return has_sample_; }
+    duration smoothed() const { return smoothed_; }
+    duration variance() const { return variance_; }
+    duration latest() const { return latest_; }
+    duration min() const { return min_; }
+    // Wait for an ACK this long before probing, doubled per probe sent
+    duration pto(duration max_ack_delay) const;
+
+  private:
+    bool has_sample_{false};
+    duration smoothed_{kInitialRtt};
+    duration variance_{kInitialRtt / 2};
+    duration latest_{kInitialRtt};
+    duration min_{duration::max()};
+};
+
+// NewReno congestion window in bytes (RFC 9002 section 7): slow start
+// until the first loss, then one datagram more per window acknowledged.
+// Losses halve the window at most once per round trip.
+class CongestionController {
+  public:
+    using time_point = std::chrono::steady_clock::time_point;
+
+    static constexpr std::size_t kInitialWindow = 10 * kMaxDatagram;
+    static constexpr std::size_t kMinimumWindow = 2 * kMaxDatagram;
+    static constexpr std::size_t kMaximumWindow = 16 * 1024 * 1024;
+
+    void on_sent(std::size_t bytes) { in_flight_ += bytes; }
+    void on_acked(std::size_t bytes, time_point sent);
+    void on_lost(std::size_t bytes, time_point sent, time_point now);
+    // Packets given up on without counting as congestion (closing)
+    void on_discarded(std::size_t bytes);
+
+    bool can_send(std::size_t bytes) const {
+        return in_flight_ + bytes <= window_;
+    }
+    std::size_t window() const { return window_; }
+    std::size_t in_flight() const { return in_flight_; }
+    bool in_slow_start() const { return window_ < ssthresh_; }
+
+  private:
+    std::size_t window_{kInitialWindow};
+    std::size_t ssthresh_{std::numeric_limits<std::size_t>::max()};
+    std::size_t in_flight_{0};
+    std::optional<time_point> recovery_start_;
+};
+
+// A reliable connection over UDP, in the manner of QUIC. Each Priority
+// class is its own ordered stream, so a datagram lost from a bulk
+// transfer only holds up bulk data; control and interactive frames
+// behind it are delivered as soon as they arrive. Datagrams carry
+// numbered packets acknowledged by selective ACK ranges; lost data is
+// resent in new packets, under a NewReno window and paced over the
+// round trip.
+//
+// Compression runs per stream, since streams are decoded independently.
+// Fragmentation is unnecessary: streams already keep classes apart.
+//
+// Created by a UdpEndpoint, which owns the socket.
+class UdpConnection final : public Connection {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    // Accepted connections number their packets from a random
+    // `first_pn`, so an ACK shows the peer really saw them
+    UdpConnection(std::shared_ptr<UdpEndpoint> endpoint,
+                  asio::ip::udp::endpoint remote, uint32_t id, bool initiator,
+                  uint64_t first_pn = 0);
+    ~UdpConnection() override;
+
+    void start(MessageCallback on_message, ErrorCallback on_error) override;
+    void send(const std::string& json,
+              Priority priority = Priority::Interactive) override;
+    void send_batch(const std::vector<std::string>& messages,
+                    Priority priority = Priority::Bulk) override;
+    void send_frame(std::vector<uint8_t> frame,
+                    Priority priority = Priority::Bulk) override;
+    void close() override;
+
+    void enable_compression() override;
+    void enable_fragmentation() override {}
+    bool compression_enabled() const override;
+    FrameCompressor::Stats compression_stats() const override;
+
+    std::string remote_address() const override;
+    bool is_open() const override;
+
+    // For tests
+    struct Stats {
+        uint64_t packets_sent{0};
+        uint64_t packets_lost{0};
+        std::size_t window{0};
+        std::chrono::microseconds rtt{0};
+    };
+    Stats stats() const;
+
+  private:
+    friend class UdpEndpoint;
+
+    struct SendStream {
+        std::string data;  // bytes from `start` on
+        uint64_t start{0};
+        uint64_t base{0};  // every byte before this is acknowledged
+        uint64_t next{0};  // first byte never sent
+        RangeSet acked;    // acknowledged beyond `base`
+        RangeSet lost;     // to send again
+        std::unique_ptr<FrameCompressor> compressor;
+    };
+
+    struct RecvStream {
+        uint64_t next{0}; // first byte not yet passed to the decoder
+        // Arrived out of order: disjoint runs by offset
+        std::map<uint64_t, std::string> pending;
+        FrameDecoder decoder;
+        std::unique_ptr<FrameDecompressor> decompressor;
+    };
+
+    struct Chunk {
+        uint8_t stream;
+        uint64_t offset;
+        uint32_t length;
+    };
+
+    struct SentPacket {
+        clock::time_point sent;
+        std::size_t bytes;
+        std::vector<Chunk> chunks;
+    };
+
+    // Endpoint side: one datagram from the peer, header already checked
+    void receive(uint64_t pn, const uint8_t* data, std::size_t len);
+    void peer_closed();
+
+    void queue_locked(Priority priority, std::string_view payload, bool json);
+    // Sends whatever the window, pacing and ACK state allow
+    void flush_locked(clock::time_point now);
+    // Appends one packet, or returns false if nothing is due
+    bool build_locked(clock::time_point now, std::vector<uint8_t>& packet);
+    void write_ack_locked(clock::time_point now, std::vector<uint8_t>& packet);
+    bool write_stream_locked(std::size_t s, std::vector<uint8_t>& packet,
+                             std::vector<Chunk>& chunks);
+    bool sendable_locked(const SendStream& stream) const;
+    // Returns false, changing nothing, if `ranges` name a packet we never
+    // sent
+    bool on_ack_locked(clock::time_point now, const RangeSet& ranges,
+                       clock::duration ack_delay);
+    bool amplification_limited_locked() const;
+    void detect_losses_locked(clock::time_point now);
+    void requeue_locked(const Chunk& chunk);
+    clock::duration loss_delay_locked() const;
+    clock::time_point pto_deadline_locked() const;
+    void arm_timers_locked(clock::time_point now, double pacing_rate);
+    void on_timer();
+    void on_flush_timer();
+    void on_idle_timer();
+
+    // Receive side
+    bool reassemble(std::size_t s, uint64_t offset, std::string_view bytes);
+    bool deliver(RecvStream& stream, std::string_view frame);
+    bool fail(const std::string& reason);
+    void release_locked();
+
+    std::shared_ptr<UdpEndpoint> endpoint_;
+    const asio::ip::udp::endpoint remote_;
+    const uint32_t id_;
+
+    mutable std::mutex mutex_; // everything below, except receive state
+    MessageCallback on_message_;
+    ErrorCallback on_error_;
+    bool started_{false};
+    bool closed_{false};
+    bool failed_{false};
+    // Until the peer answers, our packets say they open the connection
+    bool initiating_;
+    std::vector<std::string> early_; // arrived before start()
+
+    std::array<SendStream, kPriorityClasses> send_;
+    uint64_t next_pn_{0};
+    std::map<uint64_t, SentPacket> sent_; // awaiting acknowledgement
+    std::optional<uint64_t> largest_acked_;
+    RttEstimator rtt_;
+    CongestionController cc_;
+    unsigned pto_count_{0};
+    unsigned probes_{0}; // packets that may ignore the window
+    double pacing_tokens_{
+        static_cast<double>(CongestionController::kInitialWindow)};
+    clock::time_point pacing_refill_;
+    uint64_t packets_sent_{0};
+    uint64_t packets_lost_{0};
+    // Until the peer acknowledges one of our packets, its address may be
+    // spoofed: we then send at most three times the bytes it sent us
+    bool validated_;
+    uint64_t bytes_received_{0};
+    uint64_t bytes_sent_{0};
+
+    RangeSet received_;      // packet numbers from the peer
+    std::size_t unacked_{0}; // ack-eliciting packets not yet acknowledged
+    clock::time_point oldest_unacked_;
+    clock::time_point ack_due_{clock::time_point::max()};
+    clock::time_point last_heard_;
+
+    asio::steady_timer timer_; // loss detection and probes
+    asio::steady_timer ack_timer_;
+    asio::steady_timer pacing_timer_;
+    asio::steady_timer idle_timer_;
+    clock::time_point timer_deadline_{clock::time_point::max()};
+    clock::time_point ack_deadline_{clock::time_point::max()};
+    bool pacing_armed_{false};
+
+    // Receive state: only the endpoint's receive loop touches it
+    std::array<RecvStream, kPriorityClasses> recv_;
+};
+
+// One UDP socket shared by every connection to and from it; datagrams
+// are routed to connections by remote address and connection id.
+class UdpEndpoint : public std::enable_shared_from_this<UdpEndpoint> {
+  public:
+    // Bound to `port` on all interfaces; 0 picks a free one. Peers that
+    // open a connection are handed to `on_accept`, unstarted; without
+    // one, only outgoing connections work.
+    static std::shared_ptr<UdpEndpoint> create(asio::io_context& io,
+                                               uint16_t port,
+                                               ConnectCallback on_accept = {},
+                                               UdpConfig config = {});
+
+    UdpEndpoint(const UdpEndpoint&) = delete;
+    UdpEndpoint& operator=(const UdpEndpoint&) = delete;
+
+    // Nothing goes out until the first frame is sent, so start the
+    // connection before sending
+    std::shared_ptr<UdpConnection> connect(
+        const asio::ip::udp::endpoint& remote);
+    void stop();
+    uint16_t port() const;
+
+    const UdpConfig& config() const { return config_; }
+
+  private:
+    friend class UdpConnection;
+    using Key = std::pair<asio::ip::udp::endpoint, uint32_t>;
+
+    UdpEndpoint(asio::io_context& io, uint16_t port, ConnectCallback on_accept,
+                UdpConfig config);
+
+    void do_receive();
+    void dispatch(std::size_t len);
+    // Drops the datagram if the configured loss says so
+    void send_to(const asio::ip::udp::endpoint& remote, const uint8_t* data,
+                 std::size_t len);
+    void forget(const Key& key);
+
+    asio::io_context& io_;
+    asio::ip::udp::socket socket_;
+    ConnectCallback on_accept_;
+    const UdpConfig config_;
+
+    std::array<uint8_t, 64 * 1024> recv_buf_;
+    asio::ip::udp::endpoint sender_;
+
+    std::mutex mutex_; // below, and sends on the socket
+    std::map<Key, std::weak_ptr<UdpConnection>> connections_;
+    std::mt19937 rng_;
+};
+
+} // namespace peerchat
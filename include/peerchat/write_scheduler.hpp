@@ -0,0 +1,69 @@
+#pragma once
+
+#include "peerchat/compression.hpp"
+#include "peerchat/framing.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace peerchat {
+
+// Outgoing payloads of one connection, queued per Priority and drained by
+// deficit round robin. Each turn a class may send its weight in
+// fragment-sized pieces: Control 4, Interactive 2, Bulk 1. With
+// fragmentation on, a frame therefore waits behind at most three turns'
+// worth of other classes, however much bulk data is queued. Within a
+// class, payloads keep their order.
+//
+// Not thread-safe; TcpConnection holds its write mutex around it.
+class WriteScheduler {
+  public:
+    // A JSON or binary payload
+    void push(Priority priority, const std::string& payload);
+    // A frame already encoded, length prefix included
+    void push_frame(Priority priority, std::vector<uint8_t> frame);
+
+    // Cut payloads longer than kFragmentBytes into Fragment frames from
+    // now on. Only once the peer has advertised kFragmentation.
+    void enable_fragmentation() { fragment_ = true; }
+
+    // The next frame to write, length prefix included, or nullopt when
+    // nothing is queued. JSON goes through `compressor` if there is one:
+    // compressing here, in wire order, keeps the peer's decompressor in
+    // step even though classes overtake each other.
+    std::optional<std::vector<uint8_t>> next(
+        FrameCompressor* compressor = nullptr);
+
+    bool empty() const { return pending_ == 0; }
+    // Payloads not yet handed out in full
+    std::size_t size() const { return pending_; }
+
+  private:
+    struct Pending {
+        std::vector<uint8_t> frame; // length prefix, then payload
+        std::size_t sent{0};        // payload bytes handed out as fragments
+        bool json{false};
+    };
+
+    // Wire bytes the head of a class costs against its deficit
+    std::size_t next_cost(const Pending& p) const;
+    std::vector<uint8_t> take(std::size_t cls, FrameCompressor* compressor);
+    void popped(std::size_t cls);
+
+    // An idle scheduler sits on the last turn, so new work starts a fresh
+    // round at Control
+    static constexpr std::size_t kIdleTurn = kPriorityClasses - 1;
+
+    std::array<std::deque<Pending>, kPriorityClasses> queues_;
+    std::array<std::size_t, kPriorityClasses> deficit_{};
+    std::size_t turn_{kIdleTurn};
+    std::size_t pending_{0};
+    bool fragment_{false};
+};
+
+} // namespace peerchat
@@ -1,6 +1,6 @@
 #include "peerchat/app.hpp"
 
-#include "peerchat/client.hpp"
+#include "peerchat/metrics.hpp"
 #include "peerchat/version.hpp"
 
 #include <spdlog/spdlog.h>
@@ -60,74 +60,170 @@ std::string detect_local_ip() {
 
 } // namespace
 
-App::App(uint16_t port, const std::string& nickname)
-    : identity_(nickname), peer_manager_(io_, identity_) {
-    // Set up server
-    server_ = std::make_unique<Server>(
-        io_, port, [this](ConnectionPtr conn) {
-            if (peer_manager_.state() != PeerState::Disconnected) {
-                cli_.display_system(
-                    "Rejected connection: already connected to a peer.");
-                conn->close();
-                return;
-            }
-            cli_.display_system("Incoming connection from " +
-                                conn->remote_address());
-            peer_manager_.set_connection(conn, false);
+App::App(uint16_t port, const std::string& nickname,
+         std::unique_ptr<Frontend> ui, RelayOptions relay,
+         uint64_t max_download)
+    : identity_(nickname),
+      peer_manager_(io_, identity_,
+                    OutboxConfig{.directory = Identity::config_dir() /
+                                              "outbox"},
+                    Identity::config_dir() / "downloads",
+                    std::make_shared<ChunkStore>(ChunkStoreConfig{
+                        .directory = Identity::config_dir() / "chunks"})),
+      ui_(ui ? std::move(ui) : std::make_unique<Cli>()) {
+    // Registered up front so /status lists them before any traffic
+    NetMetrics::get();
+
+    // TCP, and UDP on the same port number
+    connections_ = std::make_unique<ConnectionManager>(
+        io_, [this](std::shared_ptr<MultipathConnection> session) {
+            accept(std::move(session));
         });
+    connections_->add_transport(std::make_unique<TcpTransport>(io_, port));
+    try {
+        connections_->add_transport(
+            std::make_unique<UdpTransport>(io_, connections_->port()));
+    } catch (const std::exception& e) {
+        spdlog::warn("No UDP transport: {}", e.what());
+    }
+    if (!relay.via_host.empty()) {
+        connections_->add_transport(std::make_unique<RelayTransport>(
+            io_, relay.via_host, relay.via_port, identity_.display_name()));
+    }
+    if (relay.serve_port) {
+        relay_ = std::make_unique<RelayServer>(io_, *relay.serve_port,
+                                               relay.serve_config);
+    }
 
     // Wire peer_manager callbacks
     peer_manager_.on_display(
         [this](const std::string& nick, const std::string& body) {
-            cli_.display_message(nick, body);
+            ui_->display_message(nick, body);
         });
 
     peer_manager_.on_ack(
-        [this](const std::string& msg_id) { cli_.display_ack(msg_id); });
+        [this](const std::string& msg_id) { ui_->display_ack(msg_id); });
 
     peer_manager_.on_state_change([this](PeerState state) {
+        ui_->set_status(status_line());
         if (state == PeerState::Connected) {
-            cli_.display_system("Connected to " +
+            ui_->display_system("Connected to " +
                                 peer_manager_.remote_display_name() + " (" +
                                 peer_manager_.remote_address() + ")");
         }
     });
 
     peer_manager_.on_disconnect([this](const std::string& reason) {
-        cli_.display_system("Disconnected: " + reason);
+        ui_->display_system("Disconnected: " + reason);
     });
 
-    // Wire CLI commands
-    cli_.on_connect_command(
+    peer_manager_.set_max_download(max_download);
+    peer_manager_.on_file_offer([this](const FileManifest& manifest) {
+        if (manifest.size > peer_manager_.max_download()) {
+            ui_->display_system("Declined " + manifest.name + " (" +
+                                std::to_string(manifest.size) +
+                                " bytes): over the --max-download limit");
+            return false;
+        }
+        ui_->display_system("Receiving " + manifest.name + " (" +
+                            std::to_string(manifest.size) + " bytes)...");
+        return true;
+    });
+
+    peer_manager_.on_file_received(
+        [this](const FileManifest&, const std::filesystem::path& path,
+               const TransferStats& stats) {
+            ui_->display_system("File saved to " + path.string());
+            if (stats.bytes_reused > 0) {
+                ui_->display_system(
+                    "  " + std::to_string(stats.bytes_reused) +
+                    " bytes reused from earlier transfers (" +
+                    std::to_string(static_cast<int>(
+                        stats.dedup_ratio() * 100)) +
+                    "% dedup)");
+            }
+        });
+
+    peer_manager_.on_file_failed(
+        [this](const FileManifest& manifest, const std::string& reason) {
+            ui_->display_system("Transfer of " + manifest.name +
+                                " failed: " + reason);
+        });
+
+    // Wire frontend commands
+    ui_->on_connect_command(
         [this](const std::string& host, uint16_t port) {
             connect_to(host, port);
         });
 
-    cli_.on_disconnect_command([this]() {
+    ui_->on_disconnect_command([this]() {
         peer_manager_.disconnect();
-        cli_.display_system("Disconnected.");
+        ui_->display_system("Disconnected.");
     });
 
-    cli_.on_status_command([this]() { show_status(); });
+    ui_->on_status_command([this]() { show_status(); });
 
-    cli_.on_quit_command([this]() { shutdown(); });
+    ui_->on_history_command([this](std::size_t limit) { show_history(limit); });
 
-    cli_.on_text_input([this](const std::string& text) {
+    ui_->on_send_file_command([this](const std::string& path) {
         if (peer_manager_.state() != PeerState::Connected) {
-            cli_.display_system("Not connected. Use /connect <host>:<port>");
+            ui_->display_system("Not connected. Use /connect <host>:<port>");
             return;
         }
-        peer_manager_.send_text(text);
+        try {
+            auto manifest = peer_manager_.send_file(path);
+            ui_->display_system("Offered " + manifest.name + " (" +
+                                std::to_string(manifest.size) + " bytes)");
+        } catch (const std::exception& e) {
+            ui_->display_system("Cannot send " + path + ": " + e.what());
+        }
+    });
+
+    ui_->on_quit_command([this]() { shutdown(); });
+
+    ui_->on_text_input([this](const std::string& text) {
+        if (peer_manager_.state() == PeerState::Connected) {
+            peer_manager_.send_text(text);
+            return;
+        }
+        if (peer_manager_.last_peer_id().empty()) {
+            ui_->display_system("Not connected. Use /connect <host>:<port>");
+            return;
+        }
+        if (peer_manager_.send_text(text)) {
+            ui_->display_system("Queued for " +
+                                peer_manager_.last_peer_name() +
+                                " (offline)");
+        } else {
+            ui_->display_system("Outbox full for " +
+                                peer_manager_.last_peer_name() +
+                                ", message dropped");
+        }
     });
 }
 
 App::~App() { shutdown(); }
 
+void App::accept(std::shared_ptr<MultipathConnection> session) {
+    if (peer_manager_.state() != PeerState::Disconnected) {
+        ui_->display_system(
+            "Rejected connection: already connected to a peer.");
+        session->close();
+        return;
+    }
+    ui_->display_system("Incoming connection from " +
+                        session->remote_address());
+    session_ = session;
+    peer_manager_.set_connection(std::move(session), false);
+}
+
 void App::run() {
     auto local_ip = detect_local_ip();
-    cli_.display_system("PeerChat v" + Version::string() + " | " +
+    ui_->display_system("PeerChat v" + Version::string() + " | " +
                         identity_.display_name() + " | Listening on " +
-                        local_ip + ":" + std::to_string(server_->port()));
+                        local_ip + ":" + std::to_string(connections_->port()));
+
+    ui_->set_status(status_line());
 
     // Run io_context in background thread
     auto work = asio::make_work_guard(io_);
@@ -135,54 +231,110 @@ void App::run() {
         io_.run();
     });
 
-    // CLI runs on main thread (blocking)
-    cli_.run();
+    // The frontend runs on the main thread (blocking)
+    ui_->run();
 
     shutdown();
 }
 
 void App::connect_to(const std::string& host, uint16_t port) {
     if (peer_manager_.state() != PeerState::Disconnected) {
-        cli_.display_system("Already connected. /disconnect first.");
+        ui_->display_system("Already connected. /disconnect first.");
         return;
     }
 
-    cli_.display_system("Connecting to " + host + ":" +
-                        std::to_string(port) + "...");
+    ui_->display_system("Connecting to " + host +
+                        (port ? ":" + std::to_string(port) : "") + "...");
 
-    // Client must be kept alive; allocate on heap, capture shared_ptr
-    asio::post(io_, [this, host, port]() {
-        // Client self-destructs after connect callback fires
-        new Client(
-            io_, host, port,
-            [this](ConnectionPtr conn) {
-                peer_manager_.set_connection(conn, true);
+    constexpr std::string_view kUdpScheme = "udp://";
+    constexpr std::string_view kRelayScheme = "relay://";
+    std::vector<PathCandidate> candidates;
+    if (host.starts_with(kRelayScheme)) {
+        candidates.push_back(
+            {TransportKind::Relay, host.substr(kRelayScheme.size()), 0});
+    } else if (host.starts_with(kUdpScheme)) {
+        candidates.push_back(
+            {TransportKind::Udp, host.substr(kUdpScheme.size()), port});
+    } else {
+        candidates.push_back({TransportKind::Tcp, host, port});
+        candidates.push_back({TransportKind::Udp, host, port});
+    }
+
+    asio::post(io_, [this, candidates = std::move(candidates)]() {
+        connections_->connect(
+            candidates,
+            [this](std::shared_ptr<MultipathConnection> session) {
+                session_ = session;
+                peer_manager_.set_connection(std::move(session), true);
             },
             [this](const std::string& err) {
-                cli_.display_system("Connection failed: " + err);
+                ui_->display_system("Connection failed: " + err);
             });
     });
 }
 
+std::string App::status_line() const {
+    auto line = identity_.display_name() + " | " +
+                peer_state_to_string(peer_manager_.state());
+    if (peer_manager_.state() == PeerState::Connected) {
+        line += " to " + peer_manager_.remote_display_name();
+    }
+    return line;
+}
+
 void App::show_status() {
-    cli_.display_system("State: " +
-                        peer_state_to_string(peer_manager_.state()));
-    cli_.display_system("Identity: " + identity_.display_name());
-    cli_.display_system("Peer ID: " + identity_.peer_id());
-    cli_.display_system("Listening on: " + detect_local_ip() + ":" +
-                        std::to_string(server_->port()));
+    StatusReport report;
+    report.state = peer_state_to_string(peer_manager_.state());
+    report.identity = identity_.display_name();
+    report.peer_id = identity_.peer_id();
+    report.listen_address =
+        detect_local_ip() + ":" + std::to_string(connections_->port());
     if (peer_manager_.state() == PeerState::Connected) {
-        cli_.display_system("Remote: " +
-                            peer_manager_.remote_display_name() + " (" +
-                            peer_manager_.remote_peer_id() + ")");
-        cli_.display_system("Address: " + peer_manager_.remote_address());
+        report.remote_name = peer_manager_.remote_display_name();
+        report.remote_peer_id = peer_manager_.remote_peer_id();
+        report.remote_address = peer_manager_.remote_address();
+        if (auto session = session_.lock()) {
+            for (const auto& path : session->paths()) {
+                auto line = transport_kind_to_string(path.kind) + " " +
+                            path.address;
+                if (path.rtt) {
+                    line += ", rtt " +
+                            std::to_string(path.rtt->count() / 1000) + " ms";
+                }
+                if (path.loss > 0) {
+                    line += ", loss " +
+                            std::to_string(static_cast<int>(path.loss * 100)) +
+                            "%";
+                }
+                if (path.active) line += " (active)";
+                report.paths.push_back(std::move(line));
+            }
+        }
     }
+    report.outbox_pending = peer_manager_.outbox().total_pending();
+    report.metrics = MetricsRegistry::global().summary();
+    ui_->display_status(report);
+}
+
+void App::show_history(std::size_t limit) {
+    // The current peer, or the last one while offline
+    auto peer = peer_manager_.state() == PeerState::Connected
+                    ? peer_manager_.remote_peer_id()
+                    : peer_manager_.last_peer_id();
+    if (peer.empty()) {
+        ui_->display_system("No peer yet. Use /connect <host>:<port>");
+        return;
+    }
+    ui_->display_history(peer_manager_.recent_history(peer, limit));
 }
 
 void App::shutdown() {
     peer_manager_.disconnect();
-    if (server_) {
-        server_->stop();
+    if (connections_) {
+        connections_->stop();
+    }
+    if (relay_) {
+        relay_->stop();
     }
     io_.stop();
     if (io_thread_.joinable()) {
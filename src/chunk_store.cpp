@@ -0,0 +1,238 @@
+#include "peerchat/chunk_store.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <tuple>
+#include <unordered_set>
+
+#include <spdlog/spdlog.h>
+
+namespace peerchat {
+
+ChunkStore::ChunkStore(ChunkStoreConfig config) : config_(std::move(config)) {
+    if (!config_.directory.empty()) {
+        load();
+    }
+}
+
+bool ChunkStore::contains(const Sha256Digest& hash) const {
+    std::lock_guard lock(mutex_);
+    return disk_index_.count(hash) > 0 || lru_index_.count(hash) > 0;
+}
+
+std::optional<std::vector<uint8_t>> ChunkStore::get(
+    const Sha256Digest& hash) {
+    std::lock_guard lock(mutex_);
+    if (auto it = lru_index_.find(hash); it != lru_index_.end()) {
+        lru_.splice(lru_.begin(), lru_, it->second);
+        touch(hash);
+        ++stats_.memory_hits;
+        return it->second->second;
+    }
+    if (disk_index_.count(hash) == 0) {
+        ++stats_.misses;
+        return std::nullopt;
+    }
+
+    auto path = chunk_path(hash);
+    std::ifstream in(path, std::ios::binary);
+    std::vector<uint8_t> data;
+    if (in) data.assign(std::istreambuf_iterator<char>(in), {});
+    if (!in || Sha256::hash(data.data(), data.size()) != hash) {
+        spdlog::warn("Dropping corrupt cached chunk {}", to_hex(hash));
+        remove_chunk(hash);
+        ++stats_.misses;
+        return std::nullopt;
+    }
+    ++stats_.disk_hits;
+    touch(hash);
+    // The next run orders chunks by modification time
+    std::error_code ec;
+    std::filesystem::last_write_time(
+        path, std::filesystem::file_time_type::clock::now(), ec);
+    cache(hash, data);
+    return data;
+}
+
+void ChunkStore::put(const Sha256Digest& hash, const uint8_t* data,
+                     std::size_t len) {
+    std::lock_guard lock(mutex_);
+    if (!config_.directory.empty() && disk_index_.count(hash)) {
+        touch(hash);
+    } else if (!config_.directory.empty()) {
+        auto path = chunk_path(hash);
+        std::error_code ec;
+        std::filesystem::create_directories(path.parent_path(), ec);
+        // Write then rename, so a crash never leaves a truncated chunk
+        // under its final name
+        auto tmp = path;
+        tmp += ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(data),
+                      static_cast<std::streamsize>(len));
+            if (!out) {
+                spdlog::warn("Failed to cache chunk {}", to_hex(hash));
+                return;
+            }
+        }
+        std::filesystem::rename(tmp, path, ec);
+        if (ec) {
+            spdlog::warn("Failed to cache chunk {}: {}", to_hex(hash),
+                         ec.message());
+            return;
+        }
+        disk_lru_.emplace_front(hash, len);
+        disk_index_[hash] = disk_lru_.begin();
+        disk_bytes_ += len;
+        evict();
+    }
+    if (lru_index_.count(hash) == 0) {
+        cache(hash, std::vector<uint8_t>(data, data + len));
+    }
+}
+
+void ChunkStore::retain_file(const Sha256Digest& root,
+                             const std::vector<Sha256Digest>& chunks) {
+    std::lock_guard lock(mutex_);
+    if (files_.count(root)) return;
+
+    std::unordered_set<Sha256Digest, DigestHash> seen;
+    std::vector<Sha256Digest> held;
+    for (const auto& h : chunks) {
+        if (!seen.insert(h).second) continue;
+        ++refs_[h];
+        held.push_back(h);
+    }
+    files_[root] = std::move(held);
+}
+
+void ChunkStore::release_file(const Sha256Digest& root) {
+    std::lock_guard lock(mutex_);
+    auto it = files_.find(root);
+    if (it == files_.end()) return;
+
+    for (const auto& h : it->second) {
+        auto r = refs_.find(h);
+        if (r != refs_.end() && --r->second == 0) {
+            refs_.erase(r);
+        }
+    }
+    files_.erase(it);
+    // Held chunks may have kept the disk over its limit
+    evict();
+}
+
+uint32_t ChunkStore::refs(const Sha256Digest& hash) const {
+    std::lock_guard lock(mutex_);
+    auto it = refs_.find(hash);
+    return it == refs_.end() ? 0 : it->second;
+}
+
+std::size_t ChunkStore::memory_bytes() const {
+    std::lock_guard lock(mutex_);
+    return memory_bytes_;
+}
+
+uint64_t ChunkStore::disk_bytes() const {
+    std::lock_guard lock(mutex_);
+    return disk_bytes_;
+}
+
+ChunkStore::Stats ChunkStore::stats() const {
+    std::lock_guard lock(mutex_);
+    return stats_;
+}
+
+std::filesystem::path ChunkStore::chunk_path(const Sha256Digest& hash) const {
+    auto hex = to_hex(hash);
+    return config_.directory / hex.substr(0, 2) / hex;
+}
+
+void ChunkStore::load() {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    fs::create_directories(config_.directory, ec);
+    // Reference lists left by older versions, which kept the chunks of
+    // every finished file forever
+    fs::remove_all(config_.directory / "files", ec);
+
+    std::vector<std::tuple<fs::file_time_type, Sha256Digest, uint64_t>> found;
+    for (const auto& dir : fs::directory_iterator(config_.directory, ec)) {
+        if (!dir.is_directory()) continue;
+        for (const auto& entry : fs::directory_iterator(dir.path(), ec)) {
+            Sha256Digest hash;
+            try {
+                hash = digest_from_hex(entry.path().filename().string());
+            } catch (const std::exception&) {
+                fs::remove(entry.path(), ec); // stray .tmp from a crash
+                continue;
+            }
+            auto size = entry.file_size(ec);
+            if (ec) continue;
+            found.emplace_back(entry.last_write_time(ec), hash, size);
+        }
+    }
+
+    // Most recently used first, as they were before the restart
+    std::sort(found.begin(), found.end(), [](const auto& a, const auto& b) {
+        return std::get<0>(a) > std::get<0>(b);
+    });
+    for (const auto& [time, hash, size] : found) {
+        disk_lru_.emplace_back(hash, size);
+        disk_index_[hash] = std::prev(disk_lru_.end());
+        disk_bytes_ += size;
+    }
+    evict();
+
+    SPDLOG_DEBUG("Chunk store: {} chunks, {} bytes, {} evicted",
+                 disk_index_.size(), disk_bytes_, stats_.evicted);
+}
+
+void ChunkStore::cache(const Sha256Digest& hash, std::vector<uint8_t> data) {
+    if (data.size() > config_.memory_limit) return;
+    memory_bytes_ += data.size();
+    lru_.emplace_front(hash, std::move(data));
+    lru_index_[hash] = lru_.begin();
+    while (memory_bytes_ > config_.memory_limit) {
+        auto& [h, bytes] = lru_.back();
+        memory_bytes_ -= bytes.size();
+        lru_index_.erase(h);
+        lru_.pop_back();
+    }
+}
+
+void ChunkStore::touch(const Sha256Digest& hash) {
+    if (auto it = disk_index_.find(hash); it != disk_index_.end()) {
+        disk_lru_.splice(disk_lru_.begin(), disk_lru_, it->second);
+    }
+}
+
+void ChunkStore::evict() {
+    auto it = disk_lru_.end();
+    while (disk_bytes_ > config_.disk_limit && it != disk_lru_.begin()) {
+        --it;
+        if (refs_.count(it->first)) continue; // a download still needs it
+        auto hash = (it++)->first;
+        remove_chunk(hash);
+        ++stats_.evicted;
+    }
+}
+
+void ChunkStore::remove_chunk(const Sha256Digest& hash) {
+    if (auto it = disk_index_.find(hash); it != disk_index_.end()) {
+        std::error_code ec;
+        std::filesystem::remove(chunk_path(hash), ec);
+        disk_bytes_ -= it->second->second;
+        disk_lru_.erase(it->second);
+        disk_index_.erase(it);
+    }
+    if (auto it = lru_index_.find(hash); it != lru_index_.end()) {
+        memory_bytes_ -= it->second->second.size();
+        lru_.erase(it->second);
+        lru_index_.erase(it);
+    }
+}
+
+} // namespace peerchat
@@ -0,0 +1,109 @@
+#include "peerchat/clock.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#include <spdlog/spdlog.h>
+
+namespace peerchat {
+
+HybridClock::HybridClock(WallClockSource source) : source_(std::move(source)) {}
+
+int64_t HybridClock::wall_now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+namespace {
+
+thread_local VirtualTime* t_virtual_time = nullptr;
+
+} // namespace
+
+NetClock::time_point NetClock::now() {
+    if (auto* vt = t_virtual_time) return vt->now();
+    return time_point(std::chrono::steady_clock::now().time_since_epoch());
+}
+
+int64_t NetClock::wall_ms() {
+    if (auto* vt = t_virtual_time) return vt->wall_ms();
+    return HybridClock::wall_now_ms();
+}
+
+VirtualTime::VirtualTime(int64_t epoch_ms)
+    : epoch_ms_(epoch_ms), previous_(t_virtual_time) {
+    t_virtual_time = this;
+}
+
+VirtualTime::~VirtualTime() { t_virtual_time = previous_; }
+
+int64_t VirtualTime::wall_ms() const {
+    return epoch_ms_ + std::chrono::duration_cast<std::chrono::milliseconds>(
+                           now_.time_since_epoch())
+                           .count();
+}
+
+void VirtualTime::advance_to(NetClock::time_point t) {
+    if (t > now_) now_ = t;
+}
+
+VirtualTime* VirtualTime::current() { return t_virtual_time; }
+
+namespace {
+
+// The timestamp right after `t`. A spent counter moves on to the next
+// millisecond rather than wrapping back below `t`.
+HlcTimestamp successor(const HlcTimestamp& t) {
+    if (t.logical == std::numeric_limits<uint32_t>::max()) {
+        return {t.wall_ms + 1, 0};
+    }
+    return {t.wall_ms, t.logical + 1};
+}
+
+} // namespace
+
+HlcTimestamp HybridClock::now() {
+    int64_t pt = source_();
+    std::lock_guard lock(mutex_);
+    if (pt > last_.wall_ms) {
+        last_ = {pt, 0};
+    } else {
+        last_ = successor(last_);
+    }
+    return last_;
+}
+
+HlcTimestamp HybridClock::update(const HlcTimestamp& remote) {
+    int64_t pt = source_();
+    std::lock_guard lock(mutex_);
+
+    // Compared without subtracting: the peer picks wall_ms, and any
+    // difference could overflow
+    if (remote.wall_ms > pt + kMaxDriftMs) {
+        spdlog::warn("Ignoring peer clock at {} ms, more than {} ms ahead "
+                     "of ours",
+                     remote.wall_ms, kMaxDriftMs);
+        if (pt > last_.wall_ms) {
+            last_ = {pt, 0};
+        } else {
+            last_ = successor(last_);
+        }
+        return last_;
+    }
+
+    int64_t wall = std::max({last_.wall_ms, remote.wall_ms, pt});
+    if (wall == last_.wall_ms && wall == remote.wall_ms) {
+        last_ = successor(std::max(last_, remote));
+    } else if (wall == last_.wall_ms) {
+        last_ = successor(last_);
+    } else if (wall == remote.wall_ms) {
+        last_ = successor(remote);
+    } else {
+        last_ = {wall, 0};
+    }
+    return last_;
+}
+
+} // namespace peerchat
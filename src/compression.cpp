@@ -0,0 +1,127 @@
+#include "peerchat/compression.hpp"
+
+#include "peerchat/framing.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <zstd.h>
+
+namespace peerchat {
+
+namespace {
+
+// Compression level; chat frames are tiny, so higher levels buy nothing
+constexpr int kLevel = 3;
+// 128 KiB of history is plenty for chat and bounds per-connection memory
+// on both ends, including against a peer asking for a huge window
+constexpr int kWindowLog = 17;
+
+// Raw-content dictionary: frames shaped like the ones Message::serialize
+// produces (keys in sorted order), so the first frames of a connection
+// already find their keys and framing in the window.
+constexpr const char kDictionary[] =
+    R"({"body":"","hlc":[1700000000000,0],"id":"00000000-0000-4000-8000-000000000000","nickname":"","sender":"","tag":"","timestamp":1700000000000,"type":"ack"})"
+    R"({"body":"","hlc":[1700000000000,0],"id":"","nickname":"","sender":"","tag":"","timestamp":1700000000000,"type":"ping"})"
+    R"({"body":"","hlc":[1700000000000,0],"id":"","nickname":"","sender":"","tag":"","timestamp":1700000000000,"type":"pong"})"
+    R"({"body":"{\"compression\":[\"zstd/1\"]}","hlc":[1700000000000,0],"id":"","nickname":"","sender":"","tag":"","timestamp":1700000000000,"type":"handshake"})"
+    R"({"body":"{\"n\":[],\"r\":[[0,0,1]]}","hlc":[1700000000000,0],"id":"","nickname":"","sender":"","tag":"","timestamp":1700000000000,"type":"sync"})"
+    R"({"body":"{\"chunk_size\":32768,\"name\":\"\",\"root\":\"\",\"size\":0}","hlc":[1700000000000,0],"id":"","nickname":"","sender":"","tag":"","timestamp":1700000000000,"type":"file_offer"})"
+    R"({"body":"the a to and I you it is that of in for on this what we ok yes no thanks","hlc":[1700000000000,0],"id":"00000000-0000-4000-8000-000000000000","nickname":"","sender":"00000000-0000-4000-8000-000000000000","tag":"0000","timestamp":1700000000000,"type":"text"})";
+
+void check(std::size_t result, const char* what) {
+    if (ZSTD_isError(result)) {
+        throw std::runtime_error(std::string(what) + ": " +
+                                 ZSTD_getErrorName(result));
+    }
+}
+
+} // namespace
+
+struct FrameCompressor::Stream {
+    ZSTD_CCtx* ctx{ZSTD_createCCtx()};
+    ~Stream() { ZSTD_freeCCtx(ctx); }
+};
+
+struct FrameDecompressor::Stream {
+    ZSTD_DCtx* ctx{ZSTD_createDCtx()};
+    ~Stream() { ZSTD_freeDCtx(ctx); }
+};
+
+FrameCompressor::FrameCompressor() : stream_(std::make_unique<Stream>()) {
+    if (!stream_->ctx) throw std::runtime_error("Out of memory for zstd");
+    check(ZSTD_CCtx_setParameter(stream_->ctx, ZSTD_c_compressionLevel,
+                                 kLevel),
+          "zstd level");
+    check(ZSTD_CCtx_setParameter(stream_->ctx, ZSTD_c_windowLog, kWindowLog),
+          "zstd window");
+    check(ZSTD_CCtx_loadDictionary(stream_->ctx, kDictionary,
+                                   sizeof(kDictionary) - 1),
+          "zstd dictionary");
+}
+
+FrameCompressor::~FrameCompressor() = default;
+
+std::string FrameCompressor::compress(const std::string& payload) {
+    std::string out(1, static_cast<char>(FrameKind::Compressed));
+    ZSTD_inBuffer in{payload.data(), payload.size(), 0};
+    std::size_t pending;
+    do {
+        auto used = out.size();
+        out.resize(used + ZSTD_compressBound(in.size - in.pos) + 32);
+        ZSTD_outBuffer dst{out.data() + used, out.size() - used, 0};
+        pending = ZSTD_compressStream2(stream_->ctx, &dst, &in, ZSTD_e_flush);
+        check(pending, "zstd compress");
+        out.resize(used + dst.pos);
+    } while (pending != 0);
+
+    ++stats_.frames;
+    stats_.bytes_in += payload.size();
+    stats_.bytes_out += out.size();
+    return out;
+}
+
+FrameDecompressor::FrameDecompressor() : stream_(std::make_unique<Stream>()) {
+    if (!stream_->ctx) throw std::runtime_error("Out of memory for zstd");
+    check(ZSTD_DCtx_setParameter(stream_->ctx, ZSTD_d_windowLogMax,
+                                 kWindowLog),
+          "zstd window");
+    check(ZSTD_DCtx_loadDictionary(stream_->ctx, kDictionary,
+                                   sizeof(kDictionary) - 1),
+          "zstd dictionary");
+}
+
+FrameDecompressor::~FrameDecompressor() = default;
+
+std::string FrameDecompressor::decompress(const uint8_t* data,
+                                          std::size_t len) {
+    if (len < 1 || data[0] != static_cast<uint8_t>(FrameKind::Compressed)) {
+        throw std::invalid_argument("Not a compressed frame");
+    }
+    ZSTD_inBuffer in{data + 1, len - 1, 0};
+    std::string out;
+    std::size_t produced = 0;
+    for (;;) {
+        if (produced == out.size()) {
+            out.resize(std::min(std::max<std::size_t>(out.size() * 2, 1024),
+                                kMaxFrameSize + 1));
+        }
+        ZSTD_outBuffer dst{out.data() + produced, out.size() - produced, 0};
+        auto result = ZSTD_decompressStream(stream_->ctx, &dst, &in);
+        if (ZSTD_isError(result)) {
+            throw std::invalid_argument(
+                std::string("Corrupt compressed frame: ") +
+                ZSTD_getErrorName(result));
+        }
+        produced += dst.pos;
+        if (produced > kMaxFrameSize) {
+            throw std::invalid_argument("Compressed frame too large");
+        }
+        // All input consumed and room to spare: everything flushed
+        if (in.pos == in.size && dst.pos < dst.size) break;
+    }
+    out.resize(produced);
+    return out;
+}
+
+} // namespace peerchat
@@ -1,46 +1,108 @@
 #include "peerchat/connection.hpp"
 
+#include "peerchat/metrics.hpp"
+#include "peerchat/trace.hpp"
+
+#include <utility>
+
 #include <spdlog/spdlog.h>
 
 namespace peerchat {
 
 ConnectionPtr Connection::create(asio::ip::tcp::socket socket) {
-    return ConnectionPtr(new Connection(std::move(socket)));
+    return std::make_shared<TcpConnection>(std::move(socket));
 }
 
-Connection::Connection(asio::ip::tcp::socket socket)
+TcpConnection::TcpConnection(asio::ip::tcp::socket socket)
     : socket_(std::move(socket)) {}
 
-void Connection::start(MessageCallback on_message, ErrorCallback on_error) {
+TcpConnection::~TcpConnection() {
+    NetMetrics::get().write_queue_depth.add(
+        -static_cast<int64_t>(scheduler_.size()));
+}
+
+void TcpConnection::start(MessageCallback on_message, ErrorCallback on_error) {
     on_message_ = std::move(on_message);
     on_error_ = std::move(on_error);
     do_read();
 }
 
-void Connection::send(const std::string& json) {
-    auto frame = FrameEncoder::encode(json);
+void TcpConnection::send(const std::string& json, Priority priority) {
+    PEERCHAT_TRACE_SCOPE_ARG("send", json.size());
+    bool should_write = false;
+    {
+        std::lock_guard lock(write_mutex_);
+        scheduler_.push(priority, json);
+        should_write = queued_locked(1);
+    }
+    if (should_write) {
+        do_write();
+    }
+}
+
+void TcpConnection::send_frame(std::vector<uint8_t> frame, Priority priority) {
+    PEERCHAT_TRACE_SCOPE_ARG("send_frame", frame.size());
+    bool should_write = false;
+    {
+        std::lock_guard lock(write_mutex_);
+        scheduler_.push_frame(priority, std::move(frame));
+        should_write = queued_locked(1);
+    }
+    if (should_write) {
+        do_write();
+    }
+}
+
+void TcpConnection::send_batch(const std::vector<std::string>& messages,
+                               Priority priority) {
+    if (messages.empty()) return;
+    PEERCHAT_TRACE_SCOPE_ARG("send_batch", messages.size());
 
     bool should_write = false;
     {
         std::lock_guard lock(write_mutex_);
-        write_queue_.push(std::move(frame));
-        if (!writing_) {
-            writing_ = true;
-            should_write = true;
-        }
+        for (const auto& json : messages) scheduler_.push(priority, json);
+        should_write = queued_locked(messages.size());
     }
     if (should_write) {
         do_write();
     }
 }
 
-void Connection::close() {
+bool TcpConnection::queued_locked(std::size_t payloads) {
+    auto& metrics = NetMetrics::get();
+    metrics.frames_out.inc(payloads);
+    metrics.write_queue_depth.add(static_cast<int64_t>(payloads));
+    return !std::exchange(writing_, true);
+}
+
+void TcpConnection::close() {
     asio::error_code ec;
     socket_.shutdown(asio::ip::tcp::socket::shutdown_both, ec);
     socket_.close(ec);
 }
 
-std::string Connection::remote_address() const {
+void TcpConnection::enable_compression() {
+    std::lock_guard lock(write_mutex_);
+    if (!compressor_) compressor_ = std::make_unique<FrameCompressor>();
+}
+
+void TcpConnection::enable_fragmentation() {
+    std::lock_guard lock(write_mutex_);
+    scheduler_.enable_fragmentation();
+}
+
+bool TcpConnection::compression_enabled() const {
+    std::lock_guard lock(write_mutex_);
+    return compressor_ != nullptr;
+}
+
+FrameCompressor::Stats TcpConnection::compression_stats() const {
+    std::lock_guard lock(write_mutex_);
+    return compressor_ ? compressor_->stats() : FrameCompressor::Stats{};
+}
+
+std::string TcpConnection::remote_address() const {
     try {
         auto ep = socket_.remote_endpoint();
         return ep.address().to_string() + ":" + std::to_string(ep.port());
@@ -49,9 +111,9 @@ std::string Connection::remote_address() const {
     }
 }
 
-bool Connection::is_open() const { return socket_.is_open(); }
+bool TcpConnection::is_open() const { return socket_.is_open(); }
 
-void Connection::do_read() {
+void TcpConnection::do_read() {
     auto self = shared_from_this();
     socket_.async_read_some(
         asio::buffer(read_buf_),
@@ -63,33 +125,89 @@ void Connection::do_read() {
                 return;
             }
 
+            PEERCHAT_TRACE_SCOPE_ARG("read", bytes_read);
+            NetMetrics::get().bytes_in.inc(bytes_read);
             decoder_.feed(read_buf_.data(), bytes_read);
-            while (auto frame = decoder_.next()) {
-                if (on_message_) {
-                    on_message_(*frame);
-                }
+            while (auto frame = decoder_.next_view()) {
+                if (!deliver(*frame)) return;
             }
 
             do_read();
         });
 }
 
-void Connection::do_write() {
+bool TcpConnection::deliver(std::string_view frame) {
+    std::string whole;
+    if (!frame.empty() &&
+        static_cast<uint8_t>(frame[0]) ==
+            static_cast<uint8_t>(FrameKind::Compressed)) {
+        PEERCHAT_TRACE_SCOPE_ARG("decompress", frame.size());
+        try {
+            if (!decompressor_) {
+                decompressor_ = std::make_unique<FrameDecompressor>();
+            }
+            whole = decompressor_->decompress(
+                reinterpret_cast<const uint8_t*>(frame.data()), frame.size());
+            frame = whole;
+        } catch (const std::exception& e) {
+            // The stream can't resync after a bad frame
+            return fail(e.what());
+        }
+    }
+    if (!frame.empty() &&
+        static_cast<uint8_t>(frame[0]) ==
+            static_cast<uint8_t>(FrameKind::Fragment)) {
+        std::optional<std::string> joined;
+        try {
+            joined = assembler_.add(frame);
+        } catch (const std::exception& e) {
+            return fail(e.what());
+        }
+        if (!joined) return true;
+        whole = std::move(*joined);
+        frame = whole;
+    }
+    if (on_message_) {
+        on_message_(frame);
+    }
+    return true;
+}
+
+bool TcpConnection::fail(const std::string& reason) {
+    NetMetrics::get().parse_failures.inc();
+    spdlog::warn("Dropping connection: {}", reason);
+    if (on_error_) on_error_(reason);
+    return false;
+}
+
+void TcpConnection::do_write() {
     auto self = shared_from_this();
-    // Lock briefly to get front of queue
-    std::vector<uint8_t>* front;
+    std::vector<asio::const_buffer> buffers;
     {
         std::lock_guard lock(write_mutex_);
-        if (write_queue_.empty()) {
+        const auto before = scheduler_.size();
+        std::size_t bytes = 0;
+        while (bytes < kWriteBytes) {
+            auto frame = scheduler_.next(compressor_.get());
+            if (!frame) break;
+            bytes += frame->size();
+            in_flight_.push_back(std::move(*frame));
+        }
+        NetMetrics::get().write_queue_depth.add(
+            static_cast<int64_t>(scheduler_.size()) -
+            static_cast<int64_t>(before));
+        if (in_flight_.empty()) {
             writing_ = false;
             return;
         }
-        front = &write_queue_.front();
+        for (const auto& frame : in_flight_) {
+            buffers.push_back(asio::buffer(frame));
+        }
     }
 
     asio::async_write(
-        socket_, asio::buffer(*front),
-        [this, self](asio::error_code ec, std::size_t /*bytes_written*/) {
+        socket_, buffers,
+        [this, self](asio::error_code ec, std::size_t bytes_written) {
             if (ec) {
                 if (ec != asio::error::operation_aborted && on_error_) {
                     on_error_(ec.message());
@@ -97,10 +215,9 @@ void Connection::do_write() {
                 return;
             }
 
-            {
-                std::lock_guard lock(write_mutex_);
-                write_queue_.pop();
-            }
+            PEERCHAT_TRACE_SCOPE_ARG("written", bytes_written);
+            in_flight_.clear();
+            NetMetrics::get().bytes_out.inc(bytes_written);
             do_write();
         });
 }
@@ -0,0 +1,143 @@
+#include "peerchat/connection_manager.hpp"
+
+#include "peerchat/framing.hpp"
+
+#include <algorithm>
+#include <random>
+
+#include <spdlog/spdlog.h>
+
+namespace peerchat {
+
+namespace {
+
+SessionToken random_token() {
+    std::random_device rd;
+    SessionToken token;
+    for (auto& byte : token) byte = static_cast<uint8_t>(rd());
+    return token;
+}
+
+} // namespace
+
+ConnectionManager::ConnectionManager(asio::io_context& io,
+                                     SessionCallback on_session)
+    : io_(io), on_session_(std::move(on_session)) {}
+
+void ConnectionManager::add_transport(std::unique_ptr<Transport> transport) {
+    const auto kind = transport->kind();
+    transport->listen(
+        [this, kind](ConnectionPtr conn) { accept(std::move(conn), kind); });
+    transports_.push_back(std::move(transport));
+}
+
+void ConnectionManager::connect(const std::vector<PathCandidate>& candidates,
+                                SessionCallback on_connect,
+                                ErrorCallback on_error) {
+    auto session =
+        std::make_shared<MultipathConnection>(io_, random_token(), true);
+    session->expect_paths(candidates.size(), std::move(on_connect),
+                          std::move(on_error));
+    for (const auto& candidate : candidates) {
+        auto it = std::find_if(transports_.begin(), transports_.end(),
+                               [&](const auto& t) {
+                                   return t->kind() == candidate.kind;
+                               });
+        if (it == transports_.end()) {
+            session->dial_failed("no " +
+                                 transport_kind_to_string(candidate.kind) +
+                                 " transport");
+            continue;
+        }
+        (*it)->dial(
+            candidate.host, candidate.port,
+            [session, kind = candidate.kind](ConnectionPtr conn) {
+                session->add_path(std::move(conn), kind);
+            },
+            [session](const std::string& reason) {
+                session->dial_failed(reason);
+            });
+    }
+}
+
+void ConnectionManager::accept(ConnectionPtr conn, TransportKind kind) {
+    auto inbound = std::make_shared<Inbound>(
+        Inbound{this, conn, kind, {}, 0, false});
+    conn->start(
+        [inbound](std::string_view payload) {
+            if (!inbound->routed &&
+                !inbound->manager->route(*inbound, payload)) {
+                return;
+            }
+            if (auto session = inbound->session.lock()) {
+                session->on_path_frame(inbound->id, payload);
+            }
+        },
+        [inbound](const std::string& reason) {
+            if (auto session = inbound->session.lock()) {
+                session->on_path_error(inbound->id, reason);
+            }
+        });
+}
+
+bool ConnectionManager::route(Inbound& inbound, std::string_view payload) {
+    auto conn = inbound.conn.lock();
+    if (!conn) return false;
+    inbound.routed = true;
+
+    // [kind][Hello][token][path id]
+    constexpr std::size_t kHelloSize = 2 + sizeof(SessionToken) + 1;
+    const bool hello =
+        payload.size() == kHelloSize &&
+        static_cast<uint8_t>(payload[0]) ==
+            static_cast<uint8_t>(FrameKind::Path) &&
+        static_cast<uint8_t>(payload[1]) ==
+            static_cast<uint8_t>(PathOp::Hello);
+
+    std::shared_ptr<MultipathConnection> session;
+    bool fresh = false;
+    if (hello) {
+        SessionToken token;
+        std::copy_n(payload.begin() + 2, token.size(), token.begin());
+        inbound.id = static_cast<uint8_t>(payload.back());
+
+        std::lock_guard lock(mutex_);
+        std::erase_if(sessions_,
+                      [](const auto& entry) { return entry.second.expired(); });
+        auto& entry = sessions_[token];
+        session = entry.lock();
+        if (!session) {
+            session = std::make_shared<MultipathConnection>(io_, token, false);
+            entry = session;
+            fresh = true;
+        }
+    } else {
+        // A peer from before paths: its handshake is already here
+        session = std::make_shared<MultipathConnection>(io_, random_token(),
+                                                        false);
+        fresh = true;
+    }
+
+    inbound.session = session;
+    session->add_inbound_path(conn, inbound.kind, inbound.id, !hello);
+    if (!fresh) {
+        spdlog::info("Path {} ({}) from {} joined a session", inbound.id,
+                     transport_kind_to_string(inbound.kind),
+                     conn->remote_address());
+    } else if (on_session_) {
+        on_session_(session);
+    } else {
+        session->close();
+    }
+    return !hello;
+}
+
+uint16_t ConnectionManager::port() const {
+    return transports_.empty() ? 0 : transports_.front()->port();
+}
+
+void ConnectionManager::stop() {
+    for (auto& transport : transports_) transport->stop();
+}
+
+} // namespace peerchat
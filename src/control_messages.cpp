@@ -0,0 +1,120 @@
+#include "peerchat/control_messages.hpp"
+
+#include "peerchat/message.hpp"
+#include "peerchat/message_schema.hpp"
+
+#include <charconv>
+
+namespace peerchat {
+
+namespace {
+
+constexpr std::size_t kUuidLen = 36;
+
+// Control messages other than the handshake have an empty body
+const std::string kEmptyHead = R"({"body":"","hlc":[)";
+
+std::string json_string(const std::string& s) {
+    std::string out;
+    append_json_string(out, s);
+    return out;
+}
+
+void append_int(std::string& out, int64_t v) {
+    char digits[24];
+    auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), v);
+    out.append(digits, end);
+}
+
+std::string render_fields(const std::string& nickname,
+                          const std::string& sender, const std::string& tag) {
+    return ",\"nickname\":" + json_string(nickname) +
+           ",\"sender\":" + json_string(sender) +
+           ",\"tag\":" + json_string(tag) + ",\"timestamp\":";
+}
+
+const std::string& type_tail(MessageType type) {
+    static const std::string handshake = R"(,"type":"handshake"})";
+    static const std::string ping = R"(,"type":"ping"})";
+    static const std::string pong = R"(,"type":"pong"})";
+    static const std::string ack = R"(,"type":"ack"})";
+    switch (type) {
+        case MessageType::Handshake: return handshake;
+        case MessageType::Ping: return ping;
+        case MessageType::Pong: return pong;
+        default: return ack;
+    }
+}
+
+// A fresh UUID in quotes, spliced in as a JSON string
+struct QuotedUuid {
+    char text[kUuidLen + 2];
+
+    QuotedUuid() {
+        text[0] = '"';
+        write_uuid(text + 1);
+        text[kUuidLen + 1] = '"';
+    }
+};
+
+} // namespace
+
+ControlSerializer::ControlSerializer(const Identity& identity,
+                                     std::string handshake_body)
+    : identity_(identity),
+      handshake_head_("{\"body\":" + json_string(handshake_body) +
+                      ",\"hlc\":["),
+      control_fields_(render_fields("", identity.peer_id(), "")) {}
+
+const std::string& ControlSerializer::handshake(int64_t timestamp_ms) const {
+    if (handshake_fields_.empty() || handshake_nick_ != identity_.nickname()) {
+        handshake_nick_ = identity_.nickname();
+        handshake_fields_ = render_fields(handshake_nick_, identity_.peer_id(),
+                                          identity_.tag());
+    }
+    QuotedUuid id;
+    return render(handshake_head_, id.text, sizeof(id.text), handshake_fields_,
+                  type_tail(MessageType::Handshake), timestamp_ms);
+}
+
+const std::string& ControlSerializer::ping(int64_t timestamp_ms) const {
+    QuotedUuid id;
+    return render(kEmptyHead, id.text, sizeof(id.text), control_fields_,
+                  type_tail(MessageType::Ping), timestamp_ms);
+}
+
+const std::string& ControlSerializer::pong(int64_t timestamp_ms) const {
+    QuotedUuid id;
+    return render(kEmptyHead, id.text, sizeof(id.text), control_fields_,
+                  type_tail(MessageType::Pong), timestamp_ms);
+}
+
+const std::string& ControlSerializer::ack(const std::string& msg_id,
+                                          int64_t timestamp_ms) const {
+    // IDs come from the peer, so are escaped like any other string
+    thread_local std::string id;
+    id.clear();
+    append_json_string(id, msg_id);
+    return render(kEmptyHead, id.data(), id.size(), control_fields_,
+                  type_tail(MessageType::Ack), timestamp_ms);
+}
+
+const std::string& ControlSerializer::render(const std::string& head,
+                                             const char* id,
+                                             std::size_t id_len,
+                                             const std::string& fields,
+                                             const std::string& tail,
+                                             int64_t ts) {
+    thread_local std::string out;
+    out.clear();
+    out += head;
+    append_int(out, ts);
+    out += R"(,0],"id":)";
+    out.append(id, id_len);
+    out += fields;
+    append_int(out, ts);
+    out += tail;
+    return out;
+}
+
+} // namespace peerchat
@@ -0,0 +1,317 @@
+#include "peerchat/daemon.hpp"
+
+#include "peerchat/identity.hpp"
+
+#include <array>
+#include <csignal>
+#include <stdexcept>
+
+#include <spdlog/spdlog.h>
+#include <sys/stat.h>
+
+namespace peerchat {
+
+using asio::local::stream_protocol;
+
+class Daemon::Session : public std::enable_shared_from_this<Session> {
+  public:
+    Session(Daemon& daemon, stream_protocol::socket socket)
+        : daemon_(daemon), socket_(std::move(socket)) {}
+
+    void start() { do_read(); }
+
+    // Queues one event line; writes coalesce whatever has queued up
+    void send(const std::string& line) {
+        if (!socket_.is_open()) return;
+        if (pending_.size() + line.size() > kMaxPendingBytes) {
+            spdlog::warn("Control client is not reading events, dropping it");
+            close();
+            return;
+        }
+        pending_ += line;
+        if (!writing_) do_write();
+    }
+
+    // Closes once everything queued has been written
+    void finish() {
+        finishing_ = true;
+        if (!writing_) close();
+    }
+
+    void close() {
+        asio::error_code ec;
+        socket_.close(ec);
+    }
+
+    bool is_open() const { return socket_.is_open(); }
+
+  private:
+    void do_read() {
+        socket_.async_read_some(
+            asio::buffer(read_buf_),
+            [self = shared_from_this()](const asio::error_code& ec,
+                                        std::size_t n) {
+                if (ec) {
+                    self->close();
+                    return;
+                }
+                self->consume(n);
+                if (self->socket_.is_open() && !self->finishing_) {
+                    self->do_read();
+                }
+            });
+    }
+
+    // Runs every complete line received so far
+    void consume(std::size_t n) {
+        inbuf_.append(read_buf_.data(), n);
+        std::size_t start = 0;
+        for (auto nl = inbuf_.find('\n'); nl != std::string::npos;
+             nl = inbuf_.find('\n', start)) {
+            if (nl > start) {
+                daemon_.handle_command(*this,
+                                       inbuf_.substr(start, nl - start));
+            }
+            start = nl + 1;
+            if (finishing_) break;
+        }
+        inbuf_.erase(0, start);
+        if (inbuf_.size() > kMaxPendingBytes) {
+            spdlog::warn("Control command too long, dropping client");
+            close();
+        }
+    }
+
+    void do_write() {
+        writing_ = true;
+        writing_buf_.swap(pending_);
+        pending_.clear();
+        asio::async_write(
+            socket_, asio::buffer(writing_buf_),
+            [self = shared_from_this()](const asio::error_code& ec,
+                                        std::size_t) {
+                self->writing_ = false;
+                if (ec) {
+                    self->close();
+                } else if (!self->pending_.empty()) {
+                    self->do_write();
+                } else if (self->finishing_) {
+                    self->close();
+                }
+            });
+    }
+
+    Daemon& daemon_;
+    stream_protocol::socket socket_;
+    std::array<char, 64 * 1024> read_buf_;
+    std::string inbuf_;
+    std::string pending_;
+    std::string writing_buf_;
+    bool writing_{false};
+    bool finishing_{false};
+};
+
+namespace {
+
+nlohmann::json message_json(const Message& msg) {
+    return {{"id", msg.id},
+            {"from", msg.nickname.str()},
+            {"tag", msg.tag.str()},
+            {"sender", msg.sender.str()},
+            {"body", msg.body},
+            {"timestamp", msg.timestamp}};
+}
+
+// Refuses to take over a socket another daemon is serving, or a path
+// that isn't a socket at all; removes one left behind by a daemon that
+// died
+void claim_socket_path(asio::io_context& io,
+                       const std::filesystem::path& path) {
+    std::error_code ec;
+    const auto status = std::filesystem::symlink_status(path, ec);
+    if (!std::filesystem::exists(status)) return;
+    if (!std::filesystem::is_socket(status)) {
+        throw std::runtime_error(path.string() + " exists and is not a socket");
+    }
+    stream_protocol::socket probe(io);
+    asio::error_code connect_ec;
+    probe.connect(stream_protocol::endpoint(path.string()), connect_ec);
+    if (!connect_ec) {
+        throw std::runtime_error("A peerchat daemon is already listening on " +
+                                 path.string());
+    }
+    std::filesystem::remove(path, ec);
+}
+
+} // namespace
+
+std::filesystem::path Daemon::default_socket_path() {
+    return Identity::config_dir() / "control.sock";
+}
+
+Daemon::Daemon(std::filesystem::path socket_path)
+    : acceptor_(io_), signals_(io_, SIGINT, SIGTERM),
+      path_(std::move(socket_path)) {
+    std::filesystem::create_directories(path_.parent_path());
+    claim_socket_path(io_, path_);
+
+    // Owner-only: anyone who can connect can chat as us
+    auto old_mask = ::umask(0077);
+    asio::error_code ec;
+    acceptor_.open(stream_protocol(), ec);
+    if (!ec) acceptor_.bind(stream_protocol::endpoint(path_.string()), ec);
+    if (!ec) acceptor_.listen(asio::socket_base::max_listen_connections, ec);
+    ::umask(old_mask);
+    if (ec) {
+        throw std::runtime_error("Cannot listen on " + path_.string() + ": " +
+                                 ec.message());
+    }
+}
+
+Daemon::~Daemon() {
+    std::error_code ec;
+    std::filesystem::remove(path_, ec);
+}
+
+void Daemon::run() {
+    io_thread_ = std::this_thread::get_id();
+    spdlog::info("Control socket listening on {}", path_.string());
+    signals_.async_wait([this](const asio::error_code& ec, int) {
+        if (!ec) quit();
+    });
+    accept();
+    io_.run();
+}
+
+void Daemon::accept() {
+    acceptor_.async_accept(
+        [this](const asio::error_code& ec, stream_protocol::socket socket) {
+            if (ec) return; // acceptor closed
+            auto session =
+                std::make_shared<Session>(*this, std::move(socket));
+            std::erase_if(sessions_,
+                          [](const auto& s) { return !s->is_open(); });
+            sessions_.push_back(session);
+            session->start();
+            accept();
+        });
+}
+
+void Daemon::handle_command(Session& from, const std::string& line) {
+    if (!running()) return; // after quit, the rest of a pipeline is dropped
+    replying_to_ = &from;
+    reply_id_ = nullptr;
+    replied_ = false;
+    try {
+        auto cmd = nlohmann::json::parse(line);
+        if (cmd.contains("id")) reply_id_ = cmd["id"];
+        run_command(cmd);
+        // Commands that answered already (status, history) need no "ok"
+        if (!reply_id_.is_null() && !replied_) emit({{"event", "ok"}});
+    } catch (const std::exception& e) {
+        emit({{"event", "error"}, {"error", e.what()}});
+    }
+    replying_to_ = nullptr;
+}
+
+void Daemon::run_command(const nlohmann::json& cmd) {
+    const auto name = cmd.at("cmd").get<std::string>();
+    if (name == "send") {
+        if (on_text_) on_text_(cmd.at("text").get<std::string>());
+    } else if (name == "connect") {
+        if (on_connect_) {
+            on_connect_(cmd.at("host").get<std::string>(),
+                        cmd.at("port").get<uint16_t>());
+        }
+    } else if (name == "disconnect") {
+        if (on_disconnect_) on_disconnect_();
+    } else if (name == "send_file") {
+        if (on_send_file_) on_send_file_(cmd.at("path").get<std::string>());
+    } else if (name == "status") {
+        if (on_status_) on_status_();
+    } else if (name == "history") {
+        if (on_history_) on_history_(cmd.value("limit", std::size_t{100}));
+    } else if (name == "quit") {
+        quit();
+    } else {
+        throw std::invalid_argument("Unknown command: " + name);
+    }
+}
+
+void Daemon::quit() {
+    if (!running()) return;
+    stop();
+    if (on_quit_) on_quit_();
+    asio::error_code ec;
+    acceptor_.close(ec);
+    signals_.cancel(ec);
+    // Let queued events, including the reply to this command, reach
+    // clients first; run() returns once they have
+    asio::post(io_, [this] {
+        for (auto& s : sessions_) s->finish();
+    });
+}
+
+void Daemon::emit(nlohmann::json event) {
+    // Other threads mustn't look at replying_to_: it's the io thread's
+    if (std::this_thread::get_id() == io_thread_ && replying_to_) {
+        if (!reply_id_.is_null()) {
+            event["re"] = reply_id_;
+            replied_ = true;
+        }
+        replying_to_->send(event.dump() + '\n');
+        return;
+    }
+    broadcast(event.dump() + '\n');
+}
+
+void Daemon::broadcast(std::string line) {
+    asio::post(io_, [this, line = std::move(line)] {
+        for (auto& s : sessions_) s->send(line);
+    });
+}
+
+void Daemon::display_message(const std::string& nick,
+                             const std::string& body) {
+    emit({{"event", "message"}, {"from", nick}, {"body", body}});
+}
+
+void Daemon::display_system(const std::string& msg) {
+    emit({{"event", "system"}, {"text", msg}});
+}
+
+void Daemon::display_ack(const std::string& msg_id) {
+    emit({{"event", "ack"}, {"id", msg_id}});
+}
+
+void Daemon::set_status(const std::string& status) {
+    emit({{"event", "state"}, {"status", status}});
+}
+
+void Daemon::display_status(const StatusReport& report) {
+    nlohmann::json event = {{"event", "status"},
+                            {"state", report.state},
+                            {"identity", report.identity},
+                            {"peer_id", report.peer_id},
+                            {"listen", report.listen_address},
+                            {"outbox_pending", report.outbox_pending}};
+    if (!report.metrics.empty()) {
+        auto& metrics = event["metrics"] = nlohmann::json::object();
+        for (const auto& [name, value] : report.metrics) metrics[name] = value;
+    }
+    if (!report.remote_peer_id.empty()) {
+        event["remote"] = {{"name", report.remote_name},
+                           {"peer_id", report.remote_peer_id},
+                           {"address", report.remote_address},
+                           {"paths", report.paths}};
+    }
+    emit(std::move(event));
+}
+
+void Daemon::display_history(const std::vector<Message>& messages) {
+    auto list = nlohmann::json::array();
+    for (const auto& msg : messages) list.push_back(message_json(msg));
+    emit({{"event", "history"}, {"messages", std::move(list)}});
+}
+
+} // namespace peerchat
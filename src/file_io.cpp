@@ -0,0 +1,189 @@
+#include "peerchat/file_io.hpp"
+
+#include <system_error>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace peerchat {
+
+namespace {
+
+#if defined(_WIN32)
+[[noreturn]] void throw_last_error(const char* what) {
+    throw std::system_error(static_cast<int>(GetLastError()),
+                            std::system_category(), what);
+}
+#else
+[[noreturn]] void throw_errno(const char* what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+#endif
+
+} // namespace
+
+#if defined(_WIN32)
+
+NativeFile NativeFile::open(const std::filesystem::path& path, Mode mode) {
+    DWORD access = GENERIC_READ;
+    DWORD disposition = OPEN_EXISTING;
+    if (mode == Mode::ReadWrite) {
+        access |= GENERIC_WRITE;
+        disposition = OPEN_ALWAYS;
+    }
+    HANDLE h = CreateFileW(path.c_str(), access, FILE_SHARE_READ, nullptr,
+                           disposition, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) throw_last_error("open");
+    NativeFile f;
+    f.handle_ = h;
+    return f;
+}
+
+NativeFile::NativeFile(NativeFile&& other) noexcept : handle_(other.handle_) {
+    other.handle_ = nullptr;
+}
+
+NativeFile& NativeFile::operator=(NativeFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        handle_ = other.handle_;
+        other.handle_ = nullptr;
+    }
+    return *this;
+}
+
+bool NativeFile::is_open() const { return handle_ != nullptr; }
+
+uint64_t NativeFile::size() const {
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(handle_, &sz)) throw_last_error("size");
+    return static_cast<uint64_t>(sz.QuadPart);
+}
+
+void NativeFile::resize(uint64_t size) {
+    FILE_END_OF_FILE_INFO info;
+    info.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+    if (!SetFileInformationByHandle(handle_, FileEndOfFileInfo, &info,
+                                    sizeof(info))) {
+        throw_last_error("resize");
+    }
+}
+
+std::size_t NativeFile::read_at(void* buf, std::size_t len,
+                                uint64_t offset) const {
+    OVERLAPPED ov{};
+    ov.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+    ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD got = 0;
+    if (!ReadFile(handle_, buf, static_cast<DWORD>(len), &got, &ov)) {
+        if (GetLastError() == ERROR_HANDLE_EOF) return 0;
+        throw_last_error("read");
+    }
+    return got;
+}
+
+void NativeFile::write_at(const void* buf, std::size_t len, uint64_t offset) {
+    OVERLAPPED ov{};
+    ov.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+    ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD put = 0;
+    if (!WriteFile(handle_, buf, static_cast<DWORD>(len), &put, &ov) ||
+        put != len) {
+        throw_last_error("write");
+    }
+}
+
+void NativeFile::close() {
+    if (handle_) {
+        CloseHandle(handle_);
+        handle_ = nullptr;
+    }
+}
+
+#else
+
+NativeFile NativeFile::open(const std::filesystem::path& path, Mode mode) {
+    int flags = mode == Mode::Read ? O_RDONLY : (O_RDWR | O_CREAT);
+    int fd = ::open(path.c_str(), flags | O_CLOEXEC, 0644);
+    if (fd < 0) throw_errno("open");
+    NativeFile f;
+    f.fd_ = fd;
+    return f;
+}
+
+NativeFile::NativeFile(NativeFile&& other) noexcept : fd_(other.fd_) {
+    other.fd_ = -1;
+}
+
+NativeFile& NativeFile::operator=(NativeFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        fd_ = other.fd_;
+        other.fd_ = -1;
+    }
+    return *this;
+}
+
+bool NativeFile::is_open() const { return fd_ >= 0; }
+
+uint64_t NativeFile::size() const {
+    struct stat st{};
+    if (::fstat(fd_, &st) != 0) throw_errno("fstat");
+    return static_cast<uint64_t>(st.st_size);
+}
+
+void NativeFile::resize(uint64_t size) {
+    if (::ftruncate(fd_, static_cast<off_t>(size)) != 0) {
+        throw_errno("ftruncate");
+    }
+}
+
+std::size_t NativeFile::read_at(void* buf, std::size_t len,
+                                uint64_t offset) const {
+    auto* p = static_cast<uint8_t*>(buf);
+    std::size_t done = 0;
+    while (done < len) {
+        ssize_t n = ::pread(fd_, p + done, len - done,
+                            static_cast<off_t>(offset + done));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw_errno("pread");
+        }
+        if (n == 0) break; // EOF
+        done += static_cast<std::size_t>(n);
+    }
+    return done;
+}
+
+void NativeFile::write_at(const void* buf, std::size_t len, uint64_t offset) {
+    const auto* p = static_cast<const uint8_t*>(buf);
+    std::size_t done = 0;
+    while (done < len) {
+        ssize_t n = ::pwrite(fd_, p + done, len - done,
+                             static_cast<off_t>(offset + done));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw_errno("pwrite");
+        }
+        done += static_cast<std::size_t>(n);
+    }
+}
+
+void NativeFile::close() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+#endif
+
+NativeFile::~NativeFile() { close(); }
+
+} // namespace peerchat
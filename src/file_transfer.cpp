@@ -0,0 +1,531 @@
+#include "peerchat/file_transfer.hpp"
+
+#include "peerchat/framing.hpp"
+#include "peerchat/hash_pipeline.hpp"
+#include "peerchat/merkle.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+
+namespace peerchat {
+
+namespace {
+
+// Binary frame layouts (integers big-endian):
+//   HashRequest  [kind][root:32][first:4][count:4]
+//   HashList     [kind][root:32][first:4][count:4][count x 32-byte hash]
+//   ChunkRequest [kind][root:32][index:4]
+//   Chunk        [kind][root:32][index:4][data]
+constexpr std::size_t kIdSize = 1 + 32;
+
+void put_u32(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v >> 24);
+    p[1] = static_cast<uint8_t>(v >> 16);
+    p[2] = static_cast<uint8_t>(v >> 8);
+    p[3] = static_cast<uint8_t>(v);
+}
+
+uint32_t get_u32(const uint8_t* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) |
+           (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+// Allocate a complete frame with the kind/root header written. The caller
+// fills `body_len` bytes starting at the returned body offset.
+std::vector<uint8_t> make_frame(FrameKind kind, const Sha256Digest& root,
+                                std::size_t body_len, std::size_t& body) {
+    std::size_t payload = kIdSize + body_len;
+    std::vector<uint8_t> frame(FrameEncoder::kHeaderSize + payload);
+    FrameEncoder::write_header(frame.data(), payload);
+    frame[FrameEncoder::kHeaderSize] = static_cast<uint8_t>(kind);
+    std::copy(root.begin(), root.end(),
+              frame.begin() + FrameEncoder::kHeaderSize + 1);
+    body = FrameEncoder::kHeaderSize + kIdSize;
+    return frame;
+}
+
+std::vector<uint8_t> hash_request_frame(const Sha256Digest& root,
+                                        uint32_t first, uint32_t count) {
+    std::size_t body = 0;
+    auto frame = make_frame(FrameKind::HashRequest, root, 8, body);
+    put_u32(frame.data() + body, first);
+    put_u32(frame.data() + body + 4, count);
+    return frame;
+}
+
+std::vector<uint8_t> chunk_request_frame(const Sha256Digest& root,
+                                         uint32_t index) {
+    std::size_t body = 0;
+    auto frame = make_frame(FrameKind::ChunkRequest, root, 4, body);
+    put_u32(frame.data() + body, index);
+    return frame;
+}
+
+int64_t steady_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// Largest offer we accept; bounds the memory spent on hash lists
+constexpr uint64_t kMaxDownloadSize = 64ULL * 1024 * 1024 * 1024;
+constexpr uint64_t kMaxChunkCount = kMaxDownloadSize / kChunkSize;
+
+} // namespace
+
+// --- FileManifest ---
+
+uint32_t FileManifest::chunk_count() const {
+    return static_cast<uint32_t>((size + chunk_size - 1) / chunk_size);
+}
+
+uint32_t FileManifest::chunk_length(uint32_t index) const {
+    uint64_t offset = static_cast<uint64_t>(index) * chunk_size;
+    return static_cast<uint32_t>(std::min<uint64_t>(chunk_size, size - offset));
+}
+
+std::string FileManifest::serialize() const {
+    nlohmann::json j;
+    j["root"] = to_hex(root);
+    j["name"] = name;
+    j["size"] = size;
+    j["chunk_size"] = chunk_size;
+    return j.dump();
+}
+
+FileManifest FileManifest::deserialize(const std::string& data) {
+    auto j = nlohmann::json::parse(data);
+    FileManifest m;
+    m.root = digest_from_hex(j.at("root").get<std::string>());
+    m.name = j.at("name").get<std::string>();
+    m.size = j.at("size").get<uint64_t>();
+    m.chunk_size = j.at("chunk_size").get<uint32_t>();
+    // Smaller chunks would let an offer claim far more hashes and
+    // bitmap bits than its size suggests
+    if (m.chunk_size != kChunkSize) {
+        throw std::invalid_argument("Unsupported chunk size");
+    }
+    if (m.size > kMaxDownloadSize ||
+        (m.size + m.chunk_size - 1) / m.chunk_size > kMaxChunkCount) {
+        throw std::invalid_argument("Offered file is too large");
+    }
+    return m;
+}
+
+// --- FileSource ---
+
+FileSource::FileSource(const std::filesystem::path& path, uint32_t chunk_size)
+    : file_(NativeFile::open(path, NativeFile::Mode::Read)) {
+    manifest_.name = path.filename().string();
+    manifest_.size = file_.size();
+    manifest_.chunk_size = chunk_size;
+
+    hashes_ =
+        HashPipeline::shared().hash_chunks(file_, manifest_.size, chunk_size);
+    manifest_.root = merkle_root(hashes_);
+}
+
+std::vector<uint8_t> FileSource::hash_list_frame(uint32_t first,
+                                                 uint32_t count) const {
+    auto total = static_cast<uint32_t>(hashes_.size());
+    if (first >= total) {
+        throw std::invalid_argument("Hash request out of range");
+    }
+    count = std::min({count, kHashesPerFrame, total - first});
+
+    std::size_t body = 0;
+    auto frame = make_frame(FrameKind::HashList, manifest_.root,
+                            8 + static_cast<std::size_t>(count) * 32, body);
+    put_u32(frame.data() + body, first);
+    put_u32(frame.data() + body + 4, count);
+    uint8_t* out = frame.data() + body + 8;
+    for (uint32_t i = 0; i < count; ++i) {
+        std::copy(hashes_[first + i].begin(), hashes_[first + i].end(),
+                  out + 32 * i);
+    }
+    return frame;
+}
+
+std::vector<uint8_t> FileSource::chunk_frame(uint32_t index) const {
+    if (index >= manifest_.chunk_count()) {
+        throw std::invalid_argument("Chunk request out of range");
+    }
+    uint32_t len = manifest_.chunk_length(index);
+
+    std::size_t body = 0;
+    auto frame = make_frame(FrameKind::Chunk, manifest_.root, 4 + len, body);
+    put_u32(frame.data() + body, index);
+    // Read directly into the frame, no intermediate copy
+    uint64_t offset = static_cast<uint64_t>(index) * manifest_.chunk_size;
+    if (file_.read_at(frame.data() + body + 4, len, offset) != len) {
+        throw std::runtime_error("Shared file shrank");
+    }
+    return frame;
+}
+
+// --- FileDownload ---
+
+FileDownload::FileDownload(FileManifest manifest, std::filesystem::path dest,
+                           std::size_t window, ChunkStore* store)
+    : manifest_(std::move(manifest)),
+      dest_(std::move(dest)),
+      window_(std::max<std::size_t>(window, 1)),
+      store_(store),
+      scheduler_(manifest_.chunk_count(), manifest_.chunk_size,
+                 SwarmConfig{.min_window = window_,
+                             .max_window = window_ * 4}) {
+    part_path_ = dest_;
+    part_path_ += ".part";
+    file_ = NativeFile::open(part_path_, NativeFile::Mode::ReadWrite);
+    file_.resize(manifest_.size);
+
+    uint32_t count = manifest_.chunk_count();
+    hashes_.resize(count);
+    scheduler_.add_peer(kSessionPeer);
+    stats_.bytes_total = manifest_.size;
+    hash_batch_done_.assign((count + kHashesPerFrame - 1) / kHashesPerFrame,
+                            false);
+}
+
+FileDownload::~FileDownload() { release_chunks(); }
+
+FileDownload::Status FileDownload::start(const FrameSender& send) {
+    if (manifest_.chunk_count() == 0) {
+        if (merkle_root({}) != manifest_.root) {
+            return fail("empty file does not match manifest root");
+        }
+        return finish();
+    }
+    request_hashes(send);
+    return Status::InProgress;
+}
+
+FileDownload::Status FileDownload::handle_hash_list(uint32_t first,
+                                                    uint32_t count,
+                                                    const uint8_t* hashes,
+                                                    const FrameSender& send) {
+    if (verified_ || first % kHashesPerFrame != 0) return Status::InProgress;
+    uint32_t batch = first / kHashesPerFrame;
+    if (batch >= hash_batch_done_.size() || hash_batch_done_[batch]) {
+        return Status::InProgress;
+    }
+    uint32_t expected =
+        std::min(kHashesPerFrame, manifest_.chunk_count() - first);
+    if (count != expected) {
+        return fail("malformed hash list");
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        std::copy(hashes + 32 * i, hashes + 32 * (i + 1),
+                  hashes_[first + i].begin());
+    }
+    hash_batch_done_[batch] = true;
+    ++hash_batches_done_;
+
+    if (hash_batches_done_ < hash_batch_done_.size()) {
+        request_hashes(send);
+        return Status::InProgress;
+    }
+
+    if (merkle_root(hashes_) != manifest_.root) {
+        return fail("chunk hashes do not match manifest root");
+    }
+    verified_ = true;
+    if (store_) {
+        store_->retain_file(manifest_.root, hashes_);
+        retained_ = true;
+    }
+
+    try {
+        reuse_local();
+    } catch (const std::exception& e) {
+        return fail(e.what());
+    }
+    if (scheduler_.complete()) {
+        return finish();
+    }
+    request_chunks(send);
+    return Status::InProgress;
+}
+
+FileDownload::Status FileDownload::handle_chunk(uint32_t index,
+                                                const uint8_t* data,
+                                                std::size_t len,
+                                                const FrameSender& send) {
+    if (!verified_ || !scheduler_.wanted(kSessionPeer, index)) {
+        return Status::InProgress; // unsolicited or duplicate
+    }
+
+    if (len != manifest_.chunk_length(index) ||
+        Sha256::hash(data, len) != hashes_[index]) {
+        spdlog::warn("Chunk {} of {} failed verification", index,
+                     manifest_.name);
+        scheduler_.on_failed(kSessionPeer, index);
+        if (++failures_ > kMaxFailures) {
+            return fail("too many corrupt chunks");
+        }
+        request_chunks(send);
+        return Status::InProgress;
+    }
+
+    try {
+        write_chunk(index, data, len);
+    } catch (const std::exception& e) {
+        return fail(e.what());
+    }
+    stats_.bytes_fetched += len;
+    if (store_) store_->put(hashes_[index], data, len);
+    scheduler_.on_received(kSessionPeer, index, steady_ms());
+    if (scheduler_.complete()) {
+        return finish();
+    }
+    request_chunks(send);
+    return Status::InProgress;
+}
+
+void FileDownload::reuse_local() {
+    // Only the first index of each distinct hash is ever requested
+    std::unordered_map<Sha256Digest, uint32_t, DigestHash> first;
+    for (uint32_t i = 0; i < hashes_.size(); ++i) {
+        auto [it, inserted] = first.emplace(hashes_[i], i);
+        if (!inserted) {
+            repeats_[it->second].push_back(i);
+            scheduler_.mark_done(i);
+        }
+    }
+    if (!store_) return;
+
+    for (const auto& [hash, index] : first) {
+        auto data = store_->get(hash);
+        if (!data) continue;
+        write_chunk(index, data->data(), data->size());
+        stats_.bytes_reused += data->size();
+        scheduler_.mark_done(index);
+    }
+}
+
+void FileDownload::write_chunk(uint32_t index, const uint8_t* data,
+                               std::size_t len) {
+    file_.write_at(data, len,
+                   static_cast<uint64_t>(index) * manifest_.chunk_size);
+    ++chunks_done_;
+    auto it = repeats_.find(index);
+    if (it == repeats_.end()) return;
+    for (uint32_t dup : it->second) {
+        file_.write_at(data, len,
+                       static_cast<uint64_t>(dup) * manifest_.chunk_size);
+        ++chunks_done_;
+        stats_.bytes_reused += len;
+    }
+}
+
+void FileDownload::request_hashes(const FrameSender& send) {
+    auto batches = static_cast<uint32_t>(hash_batch_done_.size());
+    while (next_hash_batch_ < batches &&
+           next_hash_batch_ - hash_batches_done_ < window_) {
+        uint32_t first = next_hash_batch_ * kHashesPerFrame;
+        uint32_t count =
+            std::min(kHashesPerFrame, manifest_.chunk_count() - first);
+        send(hash_request_frame(manifest_.root, first, count));
+        ++next_hash_batch_;
+    }
+}
+
+void FileDownload::request_chunks(const FrameSender& send) {
+    for (const auto& req : scheduler_.next_requests(steady_ms())) {
+        send(chunk_request_frame(manifest_.root, req.chunk));
+    }
+}
+
+FileDownload::Status FileDownload::finish() {
+    file_.close();
+    release_chunks();
+    std::error_code ec;
+    std::filesystem::rename(part_path_, dest_, ec);
+    if (ec) {
+        error_ = ec.message();
+        return Status::Failed;
+    }
+    return Status::Complete;
+}
+
+FileDownload::Status FileDownload::fail(const std::string& reason) {
+    error_ = reason;
+    abandon();
+    return Status::Failed;
+}
+
+void FileDownload::abandon() {
+    file_.close();
+    std::error_code ec;
+    std::filesystem::remove(part_path_, ec);
+}
+
+void FileDownload::release_chunks() {
+    if (!retained_) return;
+    store_->release_file(manifest_.root);
+    retained_ = false;
+}
+
+// --- TransferManager ---
+
+TransferManager::TransferManager(std::filesystem::path download_dir,
+                                 std::size_t window,
+                                 std::shared_ptr<ChunkStore> store)
+    : download_dir_(std::move(download_dir)),
+      window_(window),
+      store_(std::move(store)) {}
+
+FileManifest TransferManager::share(const std::filesystem::path& path) {
+    auto source = std::make_shared<const FileSource>(path);
+    std::lock_guard lock(sources_mutex_);
+    sources_[source->manifest().root] = source;
+    return source->manifest();
+}
+
+void TransferManager::download(const FileManifest& manifest,
+                               FrameSender send) {
+    if (!can_download()) return;
+    if (downloads_.count(manifest.root)) return;
+
+    // The file is preallocated in full, so check before creating it
+    std::string refusal;
+    if (manifest.size > max_download_) {
+        refusal = "larger than the " + std::to_string(max_download_) +
+                  "-byte download limit";
+    } else {
+        std::error_code ec;
+        std::filesystem::create_directories(download_dir_, ec);
+        auto space = std::filesystem::space(download_dir_, ec);
+        if (!ec && space.available < manifest.size + kFreeSpaceReserve) {
+            refusal = "not enough free disk space";
+        }
+    }
+    if (!refusal.empty()) {
+        spdlog::warn("Declined {}: {}", manifest.name, refusal);
+        if (on_failed_) on_failed_(manifest, refusal);
+        return;
+    }
+
+    auto dest = unique_destination(manifest.name);
+    auto [it, inserted] =
+        downloads_.try_emplace(manifest.root, manifest, dest, window_,
+                               store_.get());
+    settle(it, it->second.start(send));
+}
+
+void TransferManager::handle_frame(const uint8_t* data, std::size_t len,
+                                   const FrameSender& send) {
+    if (len < kIdSize) {
+        throw std::invalid_argument("Truncated transfer frame");
+    }
+    auto kind = static_cast<FrameKind>(data[0]);
+    Sha256Digest root;
+    std::copy(data + 1, data + kIdSize, root.begin());
+    const uint8_t* body = data + kIdSize;
+    std::size_t body_len = len - kIdSize;
+
+    switch (kind) {
+        case FrameKind::HashRequest: {
+            if (body_len < 8) throw std::invalid_argument("Bad hash request");
+            auto source = find_source(root);
+            if (!source) return;
+            send(source->hash_list_frame(get_u32(body), get_u32(body + 4)));
+            break;
+        }
+        case FrameKind::ChunkRequest: {
+            if (body_len < 4) throw std::invalid_argument("Bad chunk request");
+            auto source = find_source(root);
+            if (!source) return;
+            send(source->chunk_frame(get_u32(body)));
+            break;
+        }
+        case FrameKind::HashList: {
+            if (body_len < 8) throw std::invalid_argument("Bad hash list");
+            uint32_t first = get_u32(body);
+            uint32_t count = get_u32(body + 4);
+            if (body_len != 8 + static_cast<std::size_t>(count) * 32) {
+                throw std::invalid_argument("Bad hash list length");
+            }
+            auto it = downloads_.find(root);
+            if (it == downloads_.end()) return;
+            settle(it, it->second.handle_hash_list(first, count, body + 8,
+                                                   send));
+            break;
+        }
+        case FrameKind::Chunk: {
+            if (body_len < 4) throw std::invalid_argument("Bad chunk");
+            auto it = downloads_.find(root);
+            if (it == downloads_.end()) return;
+            settle(it, it->second.handle_chunk(get_u32(body), body + 4,
+                                               body_len - 4, send));
+            break;
+        }
+        default: throw std::invalid_argument("Unknown transfer frame kind");
+    }
+}
+
+void TransferManager::cancel_downloads() {
+    for (auto& [root, dl] : downloads_) {
+        spdlog::info("Abandoned download of {} ({}/{} chunks)",
+                     dl.manifest().name, dl.chunks_done(),
+                     dl.manifest().chunk_count());
+        dl.abandon();
+    }
+    downloads_.clear();
+}
+
+std::shared_ptr<const FileSource> TransferManager::find_source(
+    const Sha256Digest& root) const {
+    std::lock_guard lock(sources_mutex_);
+    auto it = sources_.find(root);
+    if (it == sources_.end()) return nullptr;
+    return it->second;
+}
+
+void TransferManager::settle(std::map<Sha256Digest, FileDownload>::iterator it,
+                             FileDownload::Status status) {
+    if (status == FileDownload::Status::InProgress) return;
+
+    auto manifest = it->second.manifest();
+    auto path = it->second.path();
+    auto error = it->second.error();
+    auto stats = it->second.stats();
+    downloads_.erase(it);
+
+    if (status == FileDownload::Status::Complete) {
+        spdlog::info("Download complete: {} ({} bytes fetched, {} reused, "
+                     "dedup {:.1f}%)",
+                     path.string(), stats.bytes_fetched, stats.bytes_reused,
+                     stats.dedup_ratio() * 100);
+        if (on_complete_) on_complete_(manifest, path, stats);
+    } else {
+        spdlog::warn("Download of {} failed: {}", manifest.name, error);
+        if (on_failed_) on_failed_(manifest, error);
+    }
+}
+
+std::filesystem::path TransferManager::unique_destination(
+    const std::string& name) const {
+    // Only the final path component of a peer-supplied name is used
+    auto base = std::filesystem::path(name).filename();
+    if (base.empty() || base == "." || base == "..") base = "download";
+
+    std::filesystem::create_directories(download_dir_);
+    auto stem = base.stem().string();
+    auto ext = base.extension().string();
+    auto candidate = download_dir_ / base;
+    for (int i = 1; std::filesystem::exists(candidate) ||
+                    std::filesystem::exists(candidate.string() + ".part");
+         ++i) {
+        candidate = download_dir_ / (stem + " (" + std::to_string(i) + ")" + ext);
+    }
+    return candidate;
+}
+
+} // namespace peerchat
@@ -1,47 +1,91 @@
 #include "peerchat/framing.hpp"
 
+#include "peerchat/metrics.hpp"
+#include "peerchat/trace.hpp"
+
 #include <cstring>
 #include <stdexcept>
+#include <utility>
 
 namespace peerchat {
 
 std::vector<uint8_t> FrameEncoder::encode(const std::string& payload) {
-    uint32_t len = static_cast<uint32_t>(payload.size());
+    std::vector<uint8_t> frame(kHeaderSize + payload.size());
+    write_header(frame.data(), payload.size());
+    std::memcpy(frame.data() + kHeaderSize, payload.data(), payload.size());
+    return frame;
+}
+
+void FrameEncoder::write_header(uint8_t* out, std::size_t len) {
     if (len > kMaxFrameSize) {
         throw std::length_error("Payload exceeds max frame size");
     }
-
-    std::vector<uint8_t> frame(4 + len);
     // Big-endian length prefix
-    frame[0] = static_cast<uint8_t>((len >> 24) & 0xFF);
-    frame[1] = static_cast<uint8_t>((len >> 16) & 0xFF);
-    frame[2] = static_cast<uint8_t>((len >> 8) & 0xFF);
-    frame[3] = static_cast<uint8_t>(len & 0xFF);
-    std::memcpy(frame.data() + 4, payload.data(), len);
-    return frame;
+    auto n = static_cast<uint32_t>(len);
+    out[0] = static_cast<uint8_t>((n >> 24) & 0xFF);
+    out[1] = static_cast<uint8_t>((n >> 16) & 0xFF);
+    out[2] = static_cast<uint8_t>((n >> 8) & 0xFF);
+    out[3] = static_cast<uint8_t>(n & 0xFF);
 }
 
 void FrameDecoder::feed(const uint8_t* data, std::size_t len) {
+    // Frames handed out so far are dropped here, once per read rather
+    // than once per frame. Usually that is all of the buffer.
+    buffer_.erase(buffer_.begin(),
+                  buffer_.begin() + static_cast<std::ptrdiff_t>(head_));
+    head_ = 0;
     buffer_.insert(buffer_.end(), data, data + len);
 }
 
 std::optional<std::string> FrameDecoder::next() {
-    if (buffer_.size() < 4) return std::nullopt;
+    auto frame = next_view();
+    if (!frame) return std::nullopt;
+    return std::string(*frame);
+}
+
+std::optional<std::string_view> FrameDecoder::next_view() {
+    if (buffered() < 4) return std::nullopt;
 
-    uint32_t len = (static_cast<uint32_t>(buffer_[0]) << 24) |
-                   (static_cast<uint32_t>(buffer_[1]) << 16) |
-                   (static_cast<uint32_t>(buffer_[2]) << 8) |
-                   static_cast<uint32_t>(buffer_[3]);
+    const uint8_t* p = buffer_.data() + head_;
+    uint32_t len = (static_cast<uint32_t>(p[0]) << 24) |
+                   (static_cast<uint32_t>(p[1]) << 16) |
+                   (static_cast<uint32_t>(p[2]) << 8) |
+                   static_cast<uint32_t>(p[3]);
 
     if (len > kMaxFrameSize) {
+        NetMetrics::get().parse_failures.inc();
         throw std::length_error("Received frame exceeds max size");
     }
 
-    if (buffer_.size() < 4 + len) return std::nullopt;
+    if (buffered() < 4 + len) return std::nullopt;
 
-    std::string payload(buffer_.begin() + 4, buffer_.begin() + 4 + len);
-    buffer_.erase(buffer_.begin(), buffer_.begin() + 4 + len);
-    return payload;
+    PEERCHAT_TRACE_SCOPE_ARG("decode", len);
+
+    head_ += 4 + len;
+    NetMetrics::get().frames_in.inc();
+    return std::string_view(reinterpret_cast<const char*>(p + 4), len);
+}
+
+std::optional<std::string> FragmentAssembler::add(std::string_view fragment) {
+    if (fragment.size() < kFragmentHeaderSize ||
+        static_cast<uint8_t>(fragment[0]) !=
+            static_cast<uint8_t>(FrameKind::Fragment)) {
+        throw std::invalid_argument("Not a fragment");
+    }
+    auto cls = static_cast<uint8_t>(fragment[1]);
+    auto last = static_cast<uint8_t>(fragment[2]);
+    if (cls >= kPriorityClasses || last > 1) {
+        throw std::invalid_argument("Malformed fragment header");
+    }
+
+    auto& partial = partial_[cls];
+    auto bytes = fragment.substr(kFragmentHeaderSize);
+    if (partial.size() + bytes.size() > kMaxFrameSize) {
+        throw std::invalid_argument("Fragmented payload exceeds max size");
+    }
+    partial.append(bytes);
+    if (!last) return std::nullopt;
+    return std::exchange(partial, {});
 }
 
 } // namespace peerchat
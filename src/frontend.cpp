@@ -0,0 +1,138 @@
+#include "peerchat/frontend.hpp"
+
+#include <sstream>
+
+namespace peerchat {
+
+namespace {
+
+constexpr std::size_t kDefaultHistoryLines = 20;
+
+} // namespace
+
+void Frontend::process_line(const std::string& line) {
+    if (line[0] != '/') {
+        if (on_text_) on_text_(line);
+        return;
+    }
+
+    std::istringstream iss(line);
+    std::string cmd;
+    iss >> cmd;
+
+    if (cmd == "/connect") {
+        std::string addr;
+        iss >> addr;
+        if (addr.empty()) {
+            display_system("Usage: /connect <host>:<port>");
+            return;
+        }
+
+        // Relayed peers go by name, with no port
+        if (addr.starts_with("relay://")) {
+            if (on_connect_) on_connect_(addr, 0);
+            return;
+        }
+
+        auto colon = addr.rfind(':');
+        if (colon == std::string::npos) {
+            display_system("Usage: /connect <host>:<port>");
+            return;
+        }
+
+        std::string host = addr.substr(0, colon);
+        uint16_t port;
+        try {
+            port = static_cast<uint16_t>(std::stoi(addr.substr(colon + 1)));
+        } catch (...) {
+            display_system("Invalid port number");
+            return;
+        }
+
+        if (on_connect_) on_connect_(host, port);
+    } else if (cmd == "/disconnect") {
+        if (on_disconnect_) on_disconnect_();
+    } else if (cmd == "/send") {
+        // Rest of the line, so paths may contain spaces
+        std::string path;
+        std::getline(iss >> std::ws, path);
+        if (path.empty()) {
+            display_system("Usage: /send <path>");
+            return;
+        }
+        if (on_send_file_) on_send_file_(path);
+    } else if (cmd == "/status") {
+        if (on_status_) on_status_();
+    } else if (cmd == "/history") {
+        std::size_t limit = kDefaultHistoryLines;
+        if (std::string n; iss >> n) {
+            try {
+                limit = std::stoul(n);
+            } catch (...) {
+                display_system("Usage: /history [count]");
+                return;
+            }
+        }
+        if (on_history_) on_history_(limit);
+    } else if (cmd == "/quit" || cmd == "/exit") {
+        stop();
+        if (on_quit_) on_quit_();
+    } else if (cmd == "/help") {
+        display_system("Commands:");
+        display_system("  /connect <host>:<port>  - Connect to a peer "
+                       "(TCP and UDP, best path wins)");
+        display_system("  /connect udp://<host>:<port> - Same, over UDP only");
+        display_system("  /connect relay://<name> - Through our relay, to a "
+                       "peer registered there");
+        display_system("  /disconnect             - Disconnect from peer");
+        display_system("  /send <path>            - Send a file to the peer");
+        display_system("  /status                 - Show connection status");
+        display_system("  /history [count]        - Show recent messages");
+        display_system("  /quit                   - Exit PeerChat");
+    } else {
+        display_system("Unknown command: " + cmd + " (type /help)");
+    }
+}
+
+void Frontend::display_status(const StatusReport& report) {
+    display_system("State: " + report.state);
+    display_system("Identity: " + report.identity);
+    display_system("Peer ID: " + report.peer_id);
+    display_system("Listening on: " + report.listen_address);
+    if (!report.remote_peer_id.empty()) {
+        display_system("Remote: " + report.remote_name + " (" +
+                       report.remote_peer_id + ")");
+        display_system("Address: " + report.remote_address);
+        for (const auto& path : report.paths) {
+            display_system("  Path " + path);
+        }
+    }
+    if (report.outbox_pending > 0) {
+        display_system("Outbox: " + std::to_string(report.outbox_pending) +
+                       " queued message(s)");
+    }
+    if (!report.metrics.empty()) {
+        display_system("Metrics:");
+        for (const auto& [name, value] : report.metrics) {
+            display_system("  " + name + ": " + value);
+        }
+    }
+}
+
+void Frontend::display_history(const std::vector<Message>& messages) {
+    if (messages.empty()) {
+        display_system("No history with this peer yet.");
+        return;
+    }
+    display_system("Last " + std::to_string(messages.size()) + " message(s):");
+    for (const auto& msg : messages) {
+        std::string name = msg.nickname;
+        if (!msg.tag.empty()) {
+            name += '#';
+            name += msg.tag.str();
+        }
+        display_message(name, msg.body);
+    }
+}
+
+} // namespace peerchat
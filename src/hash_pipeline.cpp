@@ -0,0 +1,159 @@
+#include "peerchat/hash_pipeline.hpp"
+
+#include <algorithm>
+#include <array>
+#include <latch>
+#include <stdexcept>
+
+namespace peerchat {
+
+namespace {
+
+// Bytes read per batch, per buffer
+constexpr std::size_t kBatchBytes = 4 * 1024 * 1024;
+// Chunks per job are rounded to this so multi-buffer groups stay full
+constexpr std::size_t kLanes = 8;
+// Files this small are hashed on the calling thread
+constexpr uint64_t kInlineChunks = kLanes;
+
+// Hash chunks [first, last) of a buffer holding `bytes` bytes of
+// consecutive chunks
+void hash_range(const uint8_t* data, std::size_t bytes, uint32_t chunk_size,
+                std::size_t first, std::size_t last, Sha256Digest* out) {
+    std::size_t full = std::min<std::size_t>(last, bytes / chunk_size);
+    std::vector<const uint8_t*> messages;
+    for (std::size_t i = first; i < full; ++i) {
+        messages.push_back(data + i * chunk_size);
+    }
+    if (!messages.empty()) {
+        sha256_many(messages.data(), chunk_size, out + first, messages.size());
+    }
+    for (std::size_t i = std::max(first, full); i < last; ++i) {
+        out[i] = Sha256::hash(data + i * chunk_size, bytes - i * chunk_size);
+    }
+}
+
+} // namespace
+
+HashPipeline::HashPipeline(std::size_t threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    workers_.reserve(threads);
+    for (std::size_t i = 0; i < threads; ++i) {
+        workers_.emplace_back([this] { run_worker(); });
+    }
+}
+
+HashPipeline::~HashPipeline() {
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : workers_) {
+        t.join();
+    }
+}
+
+HashPipeline& HashPipeline::shared() {
+    static HashPipeline pipeline;
+    return pipeline;
+}
+
+std::vector<Sha256Digest> HashPipeline::hash_chunks(const NativeFile& file,
+                                                    uint64_t size,
+                                                    uint32_t chunk_size) {
+    if (chunk_size == 0) {
+        throw std::invalid_argument("Chunk size must be positive");
+    }
+    const uint64_t count = (size + chunk_size - 1) / chunk_size;
+    std::vector<Sha256Digest> out(count);
+
+    auto read_batch = [&](uint64_t first, std::size_t chunks,
+                          std::vector<uint8_t>& buf) {
+        uint64_t offset = first * chunk_size;
+        auto bytes = static_cast<std::size_t>(
+            std::min<uint64_t>(uint64_t{chunks} * chunk_size, size - offset));
+        buf.resize(bytes);
+        if (file.read_at(buf.data(), bytes, offset) != bytes) {
+            throw std::runtime_error("File shrank while hashing");
+        }
+    };
+
+    if (count <= kInlineChunks) {
+        std::vector<uint8_t> buf;
+        read_batch(0, static_cast<std::size_t>(count), buf);
+        hash_range(buf.data(), buf.size(), chunk_size, 0,
+                   static_cast<std::size_t>(count), out.data());
+        return out;
+    }
+
+    const std::size_t batch_chunks =
+        std::max(kBatchBytes / chunk_size, kLanes * workers_.size());
+
+    std::array<std::vector<uint8_t>, 2> bufs;
+    uint64_t first = 0;
+    auto chunks = static_cast<std::size_t>(
+        std::min<uint64_t>(batch_chunks, count));
+    read_batch(0, chunks, bufs[0]);
+
+    for (std::size_t cur = 0; first < count; cur ^= 1) {
+        // Split the batch across the workers in whole multi-buffer groups
+        std::size_t per_job = (chunks + workers_.size() - 1) / workers_.size();
+        per_job = (per_job + kLanes - 1) / kLanes * kLanes;
+        std::size_t jobs = (chunks + per_job - 1) / per_job;
+
+        std::latch done(static_cast<std::ptrdiff_t>(jobs));
+        const auto& buf = bufs[cur];
+        Sha256Digest* dest = out.data() + first;
+        for (std::size_t j = 0; j < jobs; ++j) {
+            std::size_t lo = j * per_job;
+            std::size_t hi = std::min(chunks, lo + per_job);
+            submit([&, lo, hi] {
+                hash_range(buf.data(), buf.size(), chunk_size, lo, hi, dest);
+                done.count_down();
+            });
+        }
+
+        // Read the next batch while this one is hashed
+        uint64_t next = first + chunks;
+        auto next_chunks = static_cast<std::size_t>(
+            std::min<uint64_t>(batch_chunks, count - next));
+        try {
+            if (next < count) read_batch(next, next_chunks, bufs[cur ^ 1]);
+        } catch (...) {
+            done.wait();
+            throw;
+        }
+        done.wait();
+
+        first = next;
+        chunks = next_chunks;
+    }
+    return out;
+}
+
+void HashPipeline::run_worker() {
+    for (;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock lock(mutex_);
+            cv_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+            if (jobs_.empty()) return;
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+        job();
+    }
+}
+
+void HashPipeline::submit(std::function<void()> job) {
+    {
+        std::lock_guard lock(mutex_);
+        jobs_.push_back(std::move(job));
+    }
+    cv_.notify_one();
+}
+
+} // namespace peerchat
@@ -0,0 +1,46 @@
+#include "peerchat/history.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+namespace peerchat {
+
+History::History(std::size_t capacity)
+    : capacity_(std::max<std::size_t>(capacity, 1)) {}
+
+bool History::add(const Message& msg) {
+    uint64_t hash = sync_hash(msg.id);
+    if (by_hash_.count(hash)) return false;
+    // It would be the first to go
+    SyncItem item{msg.timestamp, hash};
+    if (messages_.size() >= capacity_ && item < index_.at(0)) return false;
+
+    messages_.push_back(msg);
+    by_hash_.emplace(hash, std::prev(messages_.end()));
+    index_.insert(item);
+    if (messages_.size() > capacity_) evict();
+    return true;
+}
+
+bool History::contains(const std::string& id) const {
+    return by_hash_.count(sync_hash(id)) > 0;
+}
+
+const Message* History::find(uint64_t hash) const {
+    auto it = by_hash_.find(hash);
+    if (it == by_hash_.end()) return nullptr;
+    return &*it->second;
+}
+
+void History::evict() {
+    // A sixteenth at a time, so the index isn't re-sorted on every add
+    std::size_t n = messages_.size() - capacity_ + capacity_ / 16;
+    for (std::size_t i = 0; i < n; ++i) {
+        auto it = by_hash_.find(index_.at(i).hash);
+        messages_.erase(it->second);
+        by_hash_.erase(it);
+    }
+    index_.erase_lowest(n);
+}
+
+} // namespace peerchat
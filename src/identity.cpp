@@ -28,6 +28,15 @@ Identity::Identity(const std::string& nickname) : nickname_(nickname) {
     }
 }
 
+Identity::Identity(std::string nickname, std::string peer_id, std::string tag)
+    : peer_id_(std::move(peer_id)),
+      nickname_(std::move(nickname)),
+      tag_(std::move(tag)) {}
+
+Identity Identity::ephemeral(const std::string& nickname) {
+    return Identity(nickname, generate_uuid(), generate_tag());
+}
+
 std::string Identity::generate_uuid() {
     std::mt19937 rng{std::random_device{}()};
     std::uniform_int_distribution<uint32_t> dist(0, 15);
@@ -84,7 +93,7 @@ void Identity::save() const {
     std::ofstream f(identity_path());
     if (f.is_open()) {
         f << j.dump(2);
-        spdlog::debug("Identity saved to {}", identity_path().string());
+        SPDLOG_DEBUG("Identity saved to {}", identity_path().string());
     } else {
         spdlog::warn("Failed to save identity to {}",
                      identity_path().string());
@@ -0,0 +1,112 @@
+#include "peerchat/interned_string.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+
+namespace peerchat {
+
+struct InternedString::Entry {
+    std::atomic<uint32_t> refs{1};
+    const std::string text;
+
+    explicit Entry(std::string_view t) : text(t) {}
+};
+
+namespace {
+
+struct Table {
+    std::mutex mutex;
+    // Keys view the entry's own text
+    std::unordered_map<std::string_view, void*> entries;
+};
+
+Table& table() {
+    static Table* t = new Table; // outlives handles in other statics
+    return *t;
+}
+
+} // namespace
+
+InternedString::InternedString(std::string_view text) {
+    if (text.empty()) return;
+    auto& t = table();
+    std::lock_guard lock(t.mutex);
+    if (auto it = t.entries.find(text); it != t.entries.end()) {
+        entry_ = static_cast<Entry*>(it->second);
+        entry_->refs.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    entry_ = new Entry(text);
+    t.entries.emplace(entry_->text, entry_);
+}
+
+InternedString::InternedString(const InternedString& other)
+    : entry_(other.entry_) {
+    if (entry_) entry_->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+InternedString::InternedString(InternedString&& other) noexcept
+    : entry_(other.entry_) {
+    other.entry_ = nullptr;
+}
+
+InternedString& InternedString::operator=(const InternedString& other) {
+    if (entry_ != other.entry_) {
+        InternedString copy(other);
+        std::swap(entry_, copy.entry_);
+    }
+    return *this;
+}
+
+InternedString& InternedString::operator=(InternedString&& other) noexcept {
+    if (this != &other) {
+        release();
+        entry_ = other.entry_;
+        other.entry_ = nullptr;
+    }
+    return *this;
+}
+
+InternedString::~InternedString() { release(); }
+
+const std::string& InternedString::str() const {
+    static const std::string empty;
+    return entry_ ? entry_->text : empty;
+}
+
+std::size_t InternedString::table_size() {
+    auto& t = table();
+    std::lock_guard lock(t.mutex);
+    return t.entries.size();
+}
+
+void InternedString::release() {
+    if (!entry_) return;
+    auto* e = entry_;
+    entry_ = nullptr;
+
+    // Other handles remain: drop ours without the lock
+    auto refs = e->refs.load(std::memory_order_relaxed);
+    while (refs > 1) {
+        if (e->refs.compare_exchange_weak(refs, refs - 1,
+                                          std::memory_order_acq_rel)) {
+            return;
+        }
+    }
+    // Possibly the last one. Only interning (under the lock) can add a
+    // reference now, so decide under the lock.
+    auto& t = table();
+    std::lock_guard lock(t.mutex);
+    if (e->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        t.entries.erase(e->text);
+        delete e;
+    }
+}
+
+std::ostream& operator<<(std::ostream& os, const InternedString& s) {
+    return os << s.str();
+}
+
+} // namespace peerchat
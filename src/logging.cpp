@@ -0,0 +1,35 @@
+#include "peerchat/logging.hpp"
+
+#include <algorithm>
+
+#include <spdlog/async.h>
+#include <spdlog/async_logger.h>
+#include <spdlog/spdlog.h>
+
+namespace peerchat {
+
+AsyncLogging::AsyncLogging(const LogConfig& config)
+    : previous_(spdlog::default_logger()),
+      pool_(std::make_shared<spdlog::details::thread_pool>(
+          std::max<std::size_t>(1, config.queue_size), 1)) {
+    auto sinks = previous_->sinks();
+    logger_ = std::make_shared<spdlog::async_logger>(
+        previous_->name(), sinks.begin(), sinks.end(), pool_,
+        config.block_when_full ? spdlog::async_overflow_policy::block
+                               : spdlog::async_overflow_policy::overrun_oldest);
+    logger_->set_level(config.level);
+    logger_->flush_on(spdlog::level::warn);
+    spdlog::set_default_logger(logger_);
+}
+
+AsyncLogging::~AsyncLogging() {
+    spdlog::set_default_logger(previous_);
+    // Queued lines hold the logger; the pool writes them before its
+    // thread exits
+    logger_.reset();
+    pool_.reset();
+}
+
+std::size_t AsyncLogging::dropped() const { return pool_->overrun_counter(); }
+
+} // namespace peerchat
@@ -1,10 +1,21 @@
 #include "peerchat/app.hpp"
+#include "peerchat/logging.hpp"
+#include "peerchat/metrics_server.hpp"
+#if defined(PEERCHAT_HAS_DAEMON)
+#include "peerchat/daemon.hpp"
+#endif
+#if defined(PEERCHAT_HAS_TUI)
+#include "peerchat/tui.hpp"
+#endif
 #include "peerchat/types.hpp"
 #include "peerchat/updater.hpp"
 #include "peerchat/version.hpp"
 
 #include <cstdint>
+#include <filesystem>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -17,6 +28,13 @@ struct Args {
     bool update{false};
     bool update_beta{false};
     bool do_uninstall{false};
+    bool tui{false};
+    bool daemon{false};
+    std::string socket_path;
+    std::optional<uint16_t> metrics_port;
+    std::string log_level{"info"};
+    peerchat::RelayOptions relay;
+    uint64_t max_download{peerchat::TransferManager::kDefaultMaxDownload};
 };
 
 Args parse_args(int argc, char* argv[]) {
@@ -28,6 +46,33 @@ Args parse_args(int argc, char* argv[]) {
             args.port = static_cast<uint16_t>(std::stoi(av[++i]));
         } else if (av[i] == "--nick" && i + 1 < av.size()) {
             args.nickname = av[++i];
+        } else if (av[i] == "--tui") {
+            args.tui = true;
+        } else if (av[i] == "--daemon") {
+            args.daemon = true;
+        } else if (av[i] == "--socket" && i + 1 < av.size()) {
+            args.socket_path = av[++i];
+        } else if (av[i] == "--metrics-port" && i + 1 < av.size()) {
+            args.metrics_port = static_cast<uint16_t>(std::stoi(av[++i]));
+        } else if (av[i] == "--log-level" && i + 1 < av.size()) {
+            args.log_level = av[++i];
+        } else if (av[i] == "--max-download" && i + 1 < av.size()) {
+            // MiB
+            args.max_download = std::stoull(av[++i]) << 20;
+        } else if (av[i] == "--relay-port" && i + 1 < av.size()) {
+            args.relay.serve_port = static_cast<uint16_t>(std::stoi(av[++i]));
+        } else if (av[i] == "--relay-cap" && i + 1 < av.size()) {
+            // Kilobits per second
+            args.relay.serve_config.bandwidth_bps =
+                std::stoull(av[++i]) * 1000;
+        } else if (av[i] == "--relay-via" && i + 1 < av.size()) {
+            const auto& addr = av[++i];
+            const auto colon = addr.rfind(':');
+            args.relay.via_host = addr.substr(0, colon);
+            args.relay.via_port =
+                colon == std::string::npos
+                    ? peerchat::kDefaultRelayPort
+                    : static_cast<uint16_t>(std::stoi(addr.substr(colon + 1)));
         } else if (av[i] == "--version" || av[i] == "-v") {
             args.show_version = true;
         } else if (av[i] == "--update") {
@@ -40,6 +85,27 @@ Args parse_args(int argc, char* argv[]) {
             std::cout << "Usage: peerchat [OPTIONS]\n"
                       << "  --port PORT       Listen port (default: 9000)\n"
                       << "  --nick NICKNAME   Set nickname\n"
+#if defined(PEERCHAT_HAS_TUI)
+                      << "  --tui             Full-screen terminal UI\n"
+#endif
+#if defined(PEERCHAT_HAS_DAEMON)
+                      << "  --daemon          Headless, driven over a Unix\n"
+                      << "                    socket with JSON lines\n"
+                      << "  --socket PATH     Socket for --daemon (default:\n"
+                      << "                    ~/.peerchat/control.sock)\n"
+#endif
+                      << "  --metrics-port P  Serve Prometheus metrics on\n"
+                      << "                    127.0.0.1:P/metrics\n"
+                      << "  --log-level L     trace, debug, info (default),\n"
+                      << "                    warn, err or off\n"
+                      << "  --max-download MB Decline offered files larger\n"
+                      << "                    than MB MiB (default: 1024)\n"
+                      << "  --relay-port P    Relay other peers' sessions\n"
+                      << "                    on port P (usually 9001)\n"
+                      << "  --relay-cap KBPS  Bandwidth cap per relayed\n"
+                      << "                    session, in kbit/s\n"
+                      << "  --relay-via H:P   Be reachable as nick#tag\n"
+                      << "                    through the relay at H:P\n"
                       << "  --version, -v     Show version\n"
                       << "  --update          Update to latest release\n"
                       << "  --update-beta     Update to latest pre-release\n"
@@ -69,7 +135,49 @@ int main(int argc, char* argv[]) {
         return peerchat::Updater::perform(args.update_beta) ? 0 : 1;
     }
 
-    peerchat::App app(args.port, args.nickname);
+    // Declared before anything that logs, so it outlives all of it
+    peerchat::AsyncLogging logging(peerchat::LogConfig{
+        .level = spdlog::level::from_str(args.log_level)});
+
+    std::unique_ptr<peerchat::Frontend> ui;
+#if defined(PEERCHAT_HAS_DAEMON)
+    if (args.daemon) {
+        try {
+            ui = std::make_unique<peerchat::Daemon>(
+                args.socket_path.empty()
+                    ? peerchat::Daemon::default_socket_path()
+                    : std::filesystem::path(args.socket_path));
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
+    }
+#else
+    if (args.daemon) {
+        std::cerr << "Daemon mode is not available on this platform\n";
+        return 1;
+    }
+#endif
+#if defined(PEERCHAT_HAS_TUI)
+    if (args.tui && !ui) ui = std::make_unique<peerchat::Tui>();
+#else
+    if (args.tui) {
+        std::cerr << "This build has no terminal UI; using the CLI\n";
+    }
+#endif
+    std::unique_ptr<peerchat::MetricsServer> metrics;
+    if (args.metrics_port) {
+        try {
+            metrics =
+                std::make_unique<peerchat::MetricsServer>(*args.metrics_port);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
+    }
+
+    peerchat::App app(args.port, args.nickname, std::move(ui),
+                      std::move(args.relay), args.max_download);
     app.run();
 
     return 0;
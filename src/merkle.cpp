@@ -0,0 +1,28 @@
+#include "peerchat/merkle.hpp"
+
+namespace peerchat {
+
+Sha256Digest merkle_root(const std::vector<Sha256Digest>& leaves) {
+    if (leaves.empty()) return Sha256::hash(nullptr, 0);
+
+    std::vector<Sha256Digest> level = leaves;
+    while (level.size() > 1) {
+        std::size_t out = 0;
+        for (std::size_t i = 0; i < level.size(); i += 2) {
+            if (i + 1 == level.size()) {
+                level[out++] = level[i];
+                continue;
+            }
+            const uint8_t tag = 0x01;
+            Sha256 h;
+            h.update(&tag, 1);
+            h.update(level[i].data(), level[i].size());
+            h.update(level[i + 1].data(), level[i + 1].size());
+            level[out++] = h.finish();
+        }
+        level.resize(out);
+    }
+    return level.front();
+}
+
+} // namespace peerchat
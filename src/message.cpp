@@ -1,5 +1,9 @@
 #include "peerchat/message.hpp"
 
+#include "peerchat/message_schema.hpp"
+#include "peerchat/trace.hpp"
+
+#include <charconv>
 #include <chrono>
 #include <random>
 #include <sstream>
@@ -10,63 +14,111 @@ namespace peerchat {
 namespace {
 
 std::string generate_uuid() {
+    std::string uuid(36, '-');
+    write_uuid(uuid.data());
+    return uuid;
+}
+
+void append_int(std::string& out, int64_t v) {
+    char digits[24];
+    auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), v);
+    out.append(digits, end);
+}
+
+int64_t now_ms() { return NetClock::wall_ms(); }
+
+std::mt19937& uuid_rng() {
     static thread_local std::mt19937 rng{std::random_device{}()};
+    return rng;
+}
+
+} // namespace
+
+void seed_message_ids(uint32_t seed) { uuid_rng().seed(seed); }
+
+void write_uuid(char* out) {
+    auto& rng = uuid_rng();
     std::uniform_int_distribution<uint32_t> dist(0, 15);
     std::uniform_int_distribution<uint32_t> dist2(8, 11);
 
     const char* hex = "0123456789abcdef";
-    std::string uuid(36, '-');
     // xxxxxxxx-xxxx-4xxx-yxxx-xxxxxxxxxxxx
     for (int i = 0; i < 36; ++i) {
-        if (i == 8 || i == 13 || i == 18 || i == 23) continue;
-        if (i == 14) {
-            uuid[i] = '4';
+        if (i == 8 || i == 13 || i == 18 || i == 23) {
+            out[i] = '-';
+        } else if (i == 14) {
+            out[i] = '4';
         } else if (i == 19) {
-            uuid[i] = hex[dist2(rng)];
+            out[i] = hex[dist2(rng)];
         } else {
-            uuid[i] = hex[dist(rng)];
+            out[i] = hex[dist(rng)];
         }
     }
-    return uuid;
 }
 
-int64_t now_ms() {
-    return std::chrono::duration_cast<std::chrono::milliseconds>(
-               std::chrono::system_clock::now().time_since_epoch())
-        .count();
+std::string message_type_to_string(MessageType type) {
+    return std::string(message_type_name(type));
 }
 
-} // namespace
+MessageType message_type_from_string(const std::string& s) {
+    auto i = kMessageTypeLookup.find(s);
+    if (i == kMessageTypeLookup.npos) {
+        throw std::invalid_argument("Unknown message type: " + s);
+    }
+    return static_cast<MessageType>(i);
+}
 
-std::string message_type_to_string(MessageType type) {
-    switch (type) {
-        case MessageType::Handshake: return "handshake";
-        case MessageType::Text: return "text";
-        case MessageType::Ack: return "ack";
-        case MessageType::Ping: return "ping";
-        case MessageType::Pong: return "pong";
+void append_json_string(std::string& out, std::string_view s) {
+    // Needs no escaping and no UTF-8 validation, so can be copied as-is
+    bool plain = true;
+    for (char c : s) {
+        auto u = static_cast<unsigned char>(c);
+        if (u < 0x20 || u >= 0x80 || c == '"' || c == '\\') {
+            plain = false;
+            break;
+        }
+    }
+    if (!plain) {
+        out += nlohmann::json(s).dump();
+        return;
     }
-    return "unknown";
+    out += '"';
+    out += s;
+    out += '"';
 }
 
-MessageType message_type_from_string(const std::string& s) {
-    if (s == "handshake") return MessageType::Handshake;
-    if (s == "text") return MessageType::Text;
-    if (s == "ack") return MessageType::Ack;
-    if (s == "ping") return MessageType::Ping;
-    if (s == "pong") return MessageType::Pong;
-    throw std::invalid_argument("Unknown message type: " + s);
+namespace schema_detail {
+
+void append_hlc(std::string& out, const Message& m) {
+    out += '[';
+    append_int(out, m.hlc.wall_ms);
+    out += ',';
+    append_int(out, m.hlc.logical);
+    out += ']';
+}
+
+void append_timestamp(std::string& out, const Message& m) {
+    append_int(out, m.timestamp);
 }
 
+void append_type(std::string& out, const Message& m) {
+    out += '"';
+    out += message_type_name(m.type);
+    out += '"';
+}
+
+} // namespace schema_detail
+
 nlohmann::json Message::to_json() const {
     nlohmann::json j;
     j["type"] = message_type_to_string(type);
     j["id"] = id;
-    j["sender"] = sender;
-    j["nickname"] = nickname;
-    j["tag"] = tag;
+    j["sender"] = sender.str();
+    j["nickname"] = nickname.str();
+    j["tag"] = tag.str();
     j["body"] = body;
     j["timestamp"] = timestamp;
+    j["hlc"] = {hlc.wall_ms, hlc.logical};
     return j;
 }
 
@@ -74,19 +126,42 @@ Message Message::from_json(const nlohmann::json& j) {
     Message m;
     m.type = message_type_from_string(j.at("type").get<std::string>());
     m.id = j.at("id").get<std::string>();
-    m.sender = j.at("sender").get<std::string>();
-    m.nickname = j.at("nickname").get<std::string>();
+    // Interned straight from the parsed strings, without copies
+    m.sender = j.at("sender").get_ref<const std::string&>();
+    m.nickname = j.at("nickname").get_ref<const std::string&>();
     if (j.contains("tag")) {
-        m.tag = j.at("tag").get<std::string>();
+        m.tag = j.at("tag").get_ref<const std::string&>();
     }
     m.body = j.at("body").get<std::string>();
     m.timestamp = j.at("timestamp").get<int64_t>();
+    if (j.contains("hlc")) {
+        const auto& h = j.at("hlc");
+        m.hlc = {h.at(0).get<int64_t>(), h.at(1).get<uint32_t>()};
+    } else {
+        // Peers without a hybrid clock
+        m.hlc = {m.timestamp, 0};
+    }
     return m;
 }
 
-std::string Message::serialize() const { return to_json().dump(); }
+std::string Message::serialize() const {
+    std::string out;
+    out.reserve(192 + body.size());
+    char sep = '{';
+    for (const auto& field : kMessageFields) {
+        out += sep;
+        out += '"';
+        out += field.key;
+        out += "\":";
+        field.append(out, *this);
+        sep = ',';
+    }
+    out += '}';
+    return out;
+}
 
-Message Message::deserialize(const std::string& data) {
+Message Message::deserialize(std::string_view data) {
+    PEERCHAT_TRACE_SCOPE_ARG("parse", data.size());
     return from_json(nlohmann::json::parse(data));
 }
 
@@ -100,6 +175,7 @@ Message Message::make_handshake(const std::string& peer_id,
     m.nickname = nick;
     m.tag = tag;
     m.timestamp = now_ms();
+    m.hlc = {m.timestamp, 0};
     return m;
 }
 
@@ -114,6 +190,7 @@ Message Message::make_text(const std::string& peer_id, const std::string& nick,
     m.tag = tag;
     m.body = body;
     m.timestamp = now_ms();
+    m.hlc = {m.timestamp, 0};
     return m;
 }
 
@@ -124,6 +201,7 @@ Message Message::make_ack(const std::string& peer_id,
     m.id = msg_id;
     m.sender = peer_id;
     m.timestamp = now_ms();
+    m.hlc = {m.timestamp, 0};
     return m;
 }
 
@@ -133,6 +211,7 @@ Message Message::make_ping(const std::string& peer_id) {
     m.id = generate_uuid();
     m.sender = peer_id;
     m.timestamp = now_ms();
+    m.hlc = {m.timestamp, 0};
     return m;
 }
 
@@ -142,6 +221,31 @@ Message Message::make_pong(const std::string& peer_id) {
     m.id = generate_uuid();
     m.sender = peer_id;
     m.timestamp = now_ms();
+    m.hlc = {m.timestamp, 0};
+    return m;
+}
+
+Message Message::make_sync(const std::string& peer_id,
+                           const std::string& payload) {
+    Message m;
+    m.type = MessageType::Sync;
+    m.id = generate_uuid();
+    m.sender = peer_id;
+    m.body = payload;
+    m.timestamp = now_ms();
+    m.hlc = {m.timestamp, 0};
+    return m;
+}
+
+Message Message::make_file_offer(const std::string& peer_id,
+                                 const std::string& manifest) {
+    Message m;
+    m.type = MessageType::FileOffer;
+    m.id = generate_uuid();
+    m.sender = peer_id;
+    m.body = manifest;
+    m.timestamp = now_ms();
+    m.hlc = {m.timestamp, 0};
     return m;
 }
 
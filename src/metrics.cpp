@@ -0,0 +1,242 @@
+#include "peerchat/metrics.hpp"
+
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+namespace peerchat {
+
+namespace {
+
+constexpr double kQuantiles[] = {0.5, 0.9, 0.99};
+
+std::string format_seconds(uint64_t micros) {
+    char buf[32];
+    auto [end, ec] = std::to_chars(buf, buf + sizeof(buf),
+                                   static_cast<double>(micros) / 1e6);
+    (void)ec;
+    return {buf, end};
+}
+
+std::string format_millis(uint64_t micros) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.1f ms",
+                  static_cast<double>(micros) / 1e3);
+    return buf;
+}
+
+// peerchat_frames_in_total -> frames_in
+std::string short_name(std::string name) {
+    constexpr std::string_view kPrefix = "peerchat_";
+    if (name.starts_with(kPrefix)) name.erase(0, kPrefix.size());
+    for (std::string_view suffix : {"_total", "_seconds"}) {
+        if (name.ends_with(suffix)) {
+            name.erase(name.size() - suffix.size());
+            break;
+        }
+    }
+    return name;
+}
+
+} // namespace
+
+uint64_t Counter::value() const {
+    uint64_t total = 0;
+    for (const auto& s : shards_) {
+        total += s.value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+std::size_t Histogram::bucket_index(uint64_t v) {
+    if (v < kSubBuckets) return static_cast<std::size_t>(v);
+    const unsigned exp = std::bit_width(v) - 1;
+    const unsigned shift = exp - kSubBucketBits;
+    return (exp - kSubBucketBits + 1) * kSubBuckets +
+           static_cast<std::size_t>((v >> shift) & (kSubBuckets - 1));
+}
+
+uint64_t Histogram::bucket_upper(std::size_t index) {
+    if (index < kSubBuckets) return index;
+    const unsigned exp =
+        static_cast<unsigned>(index / kSubBuckets) + kSubBucketBits - 1;
+    const unsigned shift = exp - kSubBucketBits;
+    const uint64_t lower = (kSubBuckets + index % kSubBuckets) << shift;
+    return lower + ((uint64_t{1} << shift) - 1);
+}
+
+Histogram::Snapshot Histogram::snapshot() const {
+    Snapshot snap;
+    for (const auto& s : shards_) {
+        snap.count += s.count.load(std::memory_order_relaxed);
+        snap.sum += s.sum.load(std::memory_order_relaxed);
+        for (std::size_t i = 0; i < kBuckets; ++i) {
+            snap.buckets[i] += s.buckets[i].load(std::memory_order_relaxed);
+        }
+    }
+    return snap;
+}
+
+uint64_t Histogram::Snapshot::quantile(double q) const {
+    // Recorders don't update count and buckets together, so go by what
+    // the buckets hold
+    uint64_t total = 0;
+    for (auto n : buckets) total += n;
+    if (total == 0) return 0;
+    auto rank =
+        static_cast<uint64_t>(std::ceil(q * static_cast<double>(total)));
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (std::size_t i = 0; i < kBuckets; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) return bucket_upper(i);
+    }
+    return bucket_upper(kBuckets - 1);
+}
+
+MetricsRegistry& MetricsRegistry::global() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+MetricsRegistry::Entry& MetricsRegistry::find_or_add(const std::string& name,
+                                                     const std::string& help,
+                                                     Kind kind) {
+    std::lock_guard lock(mutex_);
+    auto [it, added] = entries_.try_emplace(name);
+    auto& entry = it->second;
+    if (!added) {
+        if (entry.kind != kind) {
+            throw std::logic_error("Metric " + name +
+                                   " is registered as another kind");
+        }
+        return entry;
+    }
+    entry.kind = kind;
+    entry.help = help;
+    switch (kind) {
+        case Kind::Counter: entry.counter = std::make_unique<Counter>(); break;
+        case Kind::Gauge: entry.gauge = std::make_unique<Gauge>(); break;
+        case Kind::Histogram:
+            entry.histogram = std::make_unique<Histogram>();
+            break;
+    }
+    return entry;
+}
+
+Counter& MetricsRegistry::counter(const std::string& name,
+                                  const std::string& help) {
+    return *find_or_add(name, help, Kind::Counter).counter;
+}
+
+Gauge& MetricsRegistry::gauge(const std::string& name,
+                              const std::string& help) {
+    return *find_or_add(name, help, Kind::Gauge).gauge;
+}
+
+Histogram& MetricsRegistry::histogram(const std::string& name,
+                                      const std::string& help) {
+    return *find_or_add(name, help, Kind::Histogram).histogram;
+}
+
+std::string MetricsRegistry::render_prometheus() const {
+    std::lock_guard lock(mutex_);
+    std::string out;
+    for (const auto& [name, entry] : entries_) {
+        out += "# HELP " + name + ' ' + entry.help + '\n';
+        switch (entry.kind) {
+            case Kind::Counter:
+                out += "# TYPE " + name + " counter\n";
+                out += name + ' ' + std::to_string(entry.counter->value()) +
+                       '\n';
+                break;
+            case Kind::Gauge:
+                out += "# TYPE " + name + " gauge\n";
+                out += name + ' ' + std::to_string(entry.gauge->value()) +
+                       '\n';
+                break;
+            case Kind::Histogram: {
+                out += "# TYPE " + name + " summary\n";
+                auto snap = entry.histogram->snapshot();
+                for (double q : kQuantiles) {
+                    char label[32];
+                    std::snprintf(label, sizeof(label), "{quantile=\"%g\"} ",
+                                  q);
+                    out += name + label +
+                           format_seconds(snap.quantile(q)) + '\n';
+                }
+                out += name + "_sum " + format_seconds(snap.sum) + '\n';
+                out += name + "_count " + std::to_string(snap.count) + '\n';
+                break;
+            }
+        }
+    }
+    return out;
+}
+
+std::vector<std::pair<std::string, std::string>>
+MetricsRegistry::summary() const {
+    std::lock_guard lock(mutex_);
+    std::vector<std::pair<std::string, std::string>> out;
+    for (const auto& [name, entry] : entries_) {
+        std::string value;
+        switch (entry.kind) {
+            case Kind::Counter:
+                value = std::to_string(entry.counter->value());
+                break;
+            case Kind::Gauge:
+                value = std::to_string(entry.gauge->value());
+                break;
+            case Kind::Histogram: {
+                auto snap = entry.histogram->snapshot();
+                if (snap.count == 0) {
+                    value = "no samples";
+                    break;
+                }
+                value = "p50 " + format_millis(snap.quantile(0.5)) +
+                        ", p99 " + format_millis(snap.quantile(0.99)) +
+                        " (" + std::to_string(snap.count) + ")";
+                break;
+            }
+        }
+        out.emplace_back(short_name(name), std::move(value));
+    }
+    return out;
+}
+
+NetMetrics& NetMetrics::get() {
+    static NetMetrics metrics = [] {
+        auto& r = MetricsRegistry::global();
+        return NetMetrics{
+            r.counter("peerchat_frames_in_total", "Frames received"),
+            r.counter("peerchat_frames_out_total", "Frames queued to send"),
+            r.counter("peerchat_bytes_in_total", "Bytes read from peers"),
+            r.counter("peerchat_bytes_out_total", "Bytes written to peers"),
+            r.counter("peerchat_parse_failures_total",
+                      "Frames or messages that could not be decoded"),
+            r.counter("peerchat_connections_accepted_total",
+                      "Inbound connections accepted"),
+            r.counter("peerchat_reconnects_total",
+                      "Handshakes with the peer of the previous session"),
+            r.counter("peerchat_udp_packets_lost_total",
+                      "Packets the UDP transport declared lost and resent"),
+            r.counter("peerchat_path_migrations_total",
+                      "Sessions moved to another path"),
+            r.counter("peerchat_relay_bytes_total",
+                      "Bytes forwarded for other peers as a relay"),
+            r.gauge("peerchat_write_queue_depth",
+                    "Messages waiting to be written to peers"),
+            r.gauge("peerchat_relay_sessions",
+                    "Sessions being relayed for other peers"),
+            r.histogram("peerchat_ack_latency_seconds",
+                        "Time from sending a text to its ACK"),
+            r.histogram("peerchat_handshake_seconds",
+                        "Time from connection to completed handshake"),
+        };
+    }();
+    return metrics;
+}
+
+} // namespace peerchat
@@ -0,0 +1,51 @@
+#include "peerchat/metrics_server.hpp"
+
+#include "peerchat/trace.hpp"
+
+#include <stdexcept>
+#include <string>
+
+#include <httplib.h>
+#include <spdlog/spdlog.h>
+
+namespace peerchat {
+
+namespace {
+
+constexpr const char* kLoopback = "127.0.0.1";
+constexpr const char* kContentType = "text/plain; version=0.0.4";
+
+} // namespace
+
+MetricsServer::MetricsServer(uint16_t port, MetricsRegistry& registry)
+    : server_(std::make_unique<httplib::Server>()) {
+    server_->Get("/metrics", [&registry](const httplib::Request&,
+                                         httplib::Response& res) {
+        res.set_content(registry.render_prometheus(), kContentType);
+    });
+    // What the trace rings hold right now, for ui.perfetto.dev
+    server_->Get("/trace", [](const httplib::Request&,
+                              httplib::Response& res) {
+        res.set_content(trace::chrome_json(), "application/json");
+    });
+
+    int bound = port == 0 ? server_->bind_to_any_port(kLoopback)
+                          : (server_->bind_to_port(kLoopback, port) ? port
+                                                                    : -1);
+    if (bound <= 0) {
+        throw std::runtime_error("Cannot serve metrics on port " +
+                                 std::to_string(port));
+    }
+    port_ = static_cast<uint16_t>(bound);
+    thread_ = std::thread([this] { server_->listen_after_bind(); });
+    // stop() is a no-op until the loop runs
+    server_->wait_until_ready();
+    spdlog::info("Metrics at http://{}:{}/metrics", kLoopback, port_);
+}
+
+MetricsServer::~MetricsServer() {
+    server_->stop();
+    if (thread_.joinable()) thread_.join();
+}
+
+} // namespace peerchat
@@ -0,0 +1,671 @@
+#include "peerchat/multipath.hpp"
+
+#include "peerchat/framing.hpp"
+#include "peerchat/metrics.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#include <spdlog/spdlog.h>
+
+namespace peerchat {
+
+namespace {
+
+using namespace std::chrono_literals;
+
+// How often paths are checked: Hello and probe timeouts, path choice
+constexpr auto kTickInterval = 250ms;
+
+constexpr uint8_t kAllClasses = (1u << kPriorityClasses) - 1;
+
+// Weight of the newest probe in a path's loss estimate
+constexpr double kLossGain = 0.2;
+
+bool is_path_frame(std::string_view payload) {
+    return payload.size() >= 2 &&
+           static_cast<uint8_t>(payload[0]) ==
+               static_cast<uint8_t>(FrameKind::Path);
+}
+
+} // namespace
+
+MultipathConnection::MultipathConnection(asio::io_context& io,
+                                         SessionToken token, bool initiator)
+    : io_(io),
+      token_(token),
+      initiator_(initiator),
+      tick_timer_(io) {}
+
+MultipathConnection::~MultipathConnection() {
+    for (auto& [id, path] : paths_) path.conn->close();
+}
+
+std::vector<uint8_t> MultipathConnection::path_frame(PathOp op,
+                                                     std::string_view body) {
+    std::string payload;
+    payload.reserve(2 + body.size());
+    payload.push_back(static_cast<char>(FrameKind::Path));
+    payload.push_back(static_cast<char>(op));
+    payload.append(body);
+    return FrameEncoder::encode(payload);
+}
+
+void MultipathConnection::route(
+    const ConnectionPtr& conn,
+    const std::weak_ptr<MultipathConnection>& session, uint8_t id) {
+    conn->start(
+        [session, id](std::string_view payload) {
+            if (auto s = session.lock()) s->on_path_frame(id, payload);
+        },
+        [session, id](const std::string& reason) {
+            if (auto s = session.lock()) s->on_path_error(id, reason);
+        });
+}
+
+void MultipathConnection::add_path(ConnectionPtr conn, TransportKind kind) {
+    uint8_t id = 0;
+    {
+        std::lock_guard lock(mutex_);
+        if (dialing_ > 0) --dialing_;
+        // A legacy peer only gets the one path
+        if (closed_ || legacy_) {
+            conn->close();
+            return;
+        }
+        id = next_id_++;
+        auto& path = paths_[id];
+        path.conn = conn;
+        path.kind = kind;
+        path.opened = NetClock::now();
+    }
+    spdlog::info("Path {} ({}) open to {}", id,
+                 transport_kind_to_string(kind), conn->remote_address());
+
+    route(conn,
+          std::static_pointer_cast<MultipathConnection>(shared_from_this()),
+          id);
+    std::string body(token_.begin(), token_.end());
+    body.push_back(static_cast<char>(id));
+    conn->send_frame(path_frame(PathOp::Hello, body), Priority::Control);
+    schedule_tick();
+}
+
+void MultipathConnection::expect_paths(std::size_t n, ReadyCallback on_ready,
+                                       ErrorCallback on_failed) {
+    std::lock_guard lock(mutex_);
+    dialing_ += n;
+    on_ready_ = std::move(on_ready);
+    on_failed_ = std::move(on_failed);
+}
+
+void MultipathConnection::dial_failed(const std::string& reason) {
+    ErrorCallback failed;
+    {
+        std::lock_guard lock(mutex_);
+        if (dialing_ > 0) --dialing_;
+        if (closed_ || ready_ || dialing_ > 0 || !paths_.empty()) return;
+        closed_ = true;
+        failed = std::move(on_failed_);
+    }
+    if (failed) failed(reason);
+}
+
+void MultipathConnection::add_inbound_path(ConnectionPtr conn,
+                                           TransportKind kind, uint8_t id,
+                                           bool legacy) {
+    {
+        std::lock_guard lock(mutex_);
+        if (closed_) {
+            conn->close();
+            return;
+        }
+        auto& path = paths_[id];
+        if (path.conn) path.conn->close();
+        path = Path{};
+        path.conn = conn;
+        path.kind = kind;
+        path.confirmed = true;
+        path.legacy = legacy;
+        path.opened = NetClock::now();
+        legacy_ = legacy_ || legacy;
+        ready_ = true;
+    }
+    if (!legacy) {
+        conn->send_frame(
+            path_frame(PathOp::HelloAck,
+                       std::string(1, static_cast<char>(id))),
+            Priority::Control);
+    }
+    schedule_tick();
+}
+
+void MultipathConnection::on_path_frame(uint8_t id, std::string_view payload) {
+    Deliveries out;
+    bool direct = false;
+    std::map<uint8_t, Path> dropped;
+    ErrorCallback on_error;
+    {
+        std::lock_guard lock(mutex_);
+        if (closed_) return;
+        prune_locked(out);
+        if (!paths_.contains(id)) return;
+        const auto now = NetClock::now();
+
+        if (is_path_frame(payload)) {
+            handle_path_frame_locked(id, payload, out);
+        } else {
+            if (!inbound_) {
+                inbound_ = id;
+                // The acceptor answers on whichever path the peer picked
+                if (!initiator_ && !active_) {
+                    active_ = id;
+                    last_move_ = now;
+                } else if (!initiator_ && active_ != id) {
+                    switch_locked(id, true);
+                }
+            }
+            if (*inbound_ == id) {
+                direct = true;
+            } else if (held_bytes_ + payload.size() > kMaxHeldBytes) {
+                spdlog::warn("Session held {} bytes out of order, dropping it",
+                             held_bytes_);
+                closed_ = true;
+                dropped.swap(paths_);
+                held_.clear();
+                held_bytes_ = 0;
+                tick_timer_.cancel();
+                on_error = on_error_;
+            } else {
+                held_.emplace_back(id, std::string(payload));
+                held_bytes_ += payload.size();
+            }
+        }
+
+        if (direct && !started_) {
+            early_.emplace_back(payload);
+            direct = false;
+        }
+    }
+    deliver(out);
+    if (!dropped.empty()) {
+        for (auto& [path_id, path] : dropped) path.conn->close();
+        if (on_error) on_error("too much held out of order");
+        return;
+    }
+    if (direct) on_message_(payload);
+    fire_ready();
+}
+
+void MultipathConnection::on_path_error(uint8_t id,
+                                        const std::string& reason) {
+    Deliveries out;
+    ErrorCallback on_error;
+    ErrorCallback failed;
+    {
+        std::lock_guard lock(mutex_);
+        if (closed_) return;
+        auto it = paths_.find(id);
+        if (it == paths_.end()) return;
+        spdlog::info("Path {} ({}) lost: {}", id,
+                     transport_kind_to_string(it->second.kind), reason);
+        remove_path_locked(id, out);
+
+        if (paths_.empty()) {
+            if (ready_) {
+                closed_ = true;
+                on_error = on_error_;
+            } else if (dialing_ == 0) {
+                closed_ = true;
+                failed = std::move(on_failed_);
+            }
+        }
+    }
+    deliver(out);
+    if (on_error) on_error(reason);
+    if (failed) failed(reason);
+}
+
+std::vector<MultipathConnection::PathInfo> MultipathConnection::paths() const {
+    std::lock_guard lock(mutex_);
+    std::vector<PathInfo> result;
+    result.reserve(paths_.size());
+    for (const auto& [id, path] : paths_) {
+        PathInfo info;
+        info.id = id;
+        info.kind = path.kind;
+        info.address = path.conn->remote_address();
+        info.active = active_ == id;
+        info.confirmed = path.confirmed;
+        if (path.srtt) {
+            info.rtt = std::chrono::duration_cast<std::chrono::microseconds>(
+                *path.srtt);
+        }
+        info.loss = path.loss;
+        result.push_back(std::move(info));
+    }
+    return result;
+}
+
+bool MultipathConnection::migrate(uint8_t id) {
+    std::lock_guard lock(mutex_);
+    auto it = paths_.find(id);
+    if (closed_ || it == paths_.end() || !it->second.confirmed) return false;
+    switch_locked(id, true);
+    return true;
+}
+
+void MultipathConnection::start(MessageCallback on_message,
+                                ErrorCallback on_error) {
+    Deliveries early;
+    {
+        std::lock_guard lock(mutex_);
+        on_message_ = std::move(on_message);
+        on_error_ = std::move(on_error);
+        started_ = true;
+        early.swap(early_);
+    }
+    deliver(early);
+}
+
+void MultipathConnection::send(const std::string& json, Priority priority) {
+    std::lock_guard lock(mutex_);
+    auto* path = active_locked();
+    if (!path) return;
+    path->conn->send(json, priority);
+}
+
+void MultipathConnection::send_batch(const std::vector<std::string>& messages,
+                                     Priority priority) {
+    std::lock_guard lock(mutex_);
+    if (auto* path = active_locked()) {
+        path->conn->send_batch(messages, priority);
+    }
+}
+
+void MultipathConnection::send_frame(std::vector<uint8_t> frame,
+                                     Priority priority) {
+    std::lock_guard lock(mutex_);
+    if (auto* path = active_locked()) {
+        path->conn->send_frame(std::move(frame), priority);
+    }
+}
+
+void MultipathConnection::close() {
+    std::map<uint8_t, Path> paths;
+    {
+        std::lock_guard lock(mutex_);
+        if (closed_) return;
+        closed_ = true;
+        paths.swap(paths_);
+        held_.clear();
+        held_bytes_ = 0;
+        tick_timer_.cancel();
+    }
+    for (auto& [id, path] : paths) path.conn->close();
+}
+
+void MultipathConnection::enable_compression() {
+    std::lock_guard lock(mutex_);
+    compress_ = true;
+    for (auto& [id, path] : paths_) path.conn->enable_compression();
+}
+
+void MultipathConnection::enable_fragmentation() {
+    std::lock_guard lock(mutex_);
+    fragment_ = true;
+    for (auto& [id, path] : paths_) path.conn->enable_fragmentation();
+}
+
+bool MultipathConnection::compression_enabled() const {
+    std::lock_guard lock(mutex_);
+    return compress_;
+}
+
+FrameCompressor::Stats MultipathConnection::compression_stats() const {
+    std::lock_guard lock(mutex_);
+    FrameCompressor::Stats total;
+    for (const auto& [id, path] : paths_) {
+        const auto stats = path.conn->compression_stats();
+        total.frames += stats.frames;
+        total.bytes_in += stats.bytes_in;
+        total.bytes_out += stats.bytes_out;
+    }
+    return total;
+}
+
+std::string MultipathConnection::remote_address() const {
+    std::lock_guard lock(mutex_);
+    auto it = active_ ? paths_.find(*active_) : paths_.begin();
+    if (it == paths_.end()) return "";
+    const auto& path = it->second;
+    return path.kind == TransportKind::Tcp
+               ? path.conn->remote_address()
+               : transport_kind_to_string(path.kind) + "://" +
+                     path.conn->remote_address();
+}
+
+bool MultipathConnection::is_open() const {
+    std::lock_guard lock(mutex_);
+    return !closed_ && !paths_.empty();
+}
+
+void MultipathConnection::confirm_locked(uint8_t id, Path& path,
+                                         NetClock::time_point now) {
+    path.confirmed = true;
+    if (compress_) path.conn->enable_compression();
+    if (fragment_) path.conn->enable_fragmentation();
+    if (!active_) {
+        active_ = id;
+        last_move_ = now;
+    }
+    ready_ = true;
+}
+
+void MultipathConnection::sample_locked(Path& path, NetClock::time_point now) {
+    if (!path.probe_sent) return;
+    const auto rtt = now - *path.probe_sent;
+    path.probe_sent.reset();
+    path.srtt = path.srtt ? (7 * *path.srtt + rtt) / 8 : rtt;
+    path.loss *= 1.0 - kLossGain;
+    ++path.samples;
+}
+
+void MultipathConnection::switch_locked(uint8_t id, bool mark_old) {
+    if (active_ == id) return;
+    if (mark_old && active_) {
+        if (auto it = paths_.find(*active_); it != paths_.end()) {
+            // Queued behind everything of its class already sent there
+            for (uint8_t p = 0; p < kPriorityClasses; ++p) {
+                const char body[] = {static_cast<char>(p),
+                                     static_cast<char>(id)};
+                it->second.conn->send_frame(
+                    path_frame(PathOp::Moved, std::string_view(body, 2)),
+                    static_cast<Priority>(p));
+            }
+        }
+    }
+    const auto& path = paths_.at(id);
+    spdlog::info("Session moved to path {} ({}, {})", id,
+                 transport_kind_to_string(path.kind),
+                 path.conn->remote_address());
+    NetMetrics::get().path_migrations.inc();
+    active_ = id;
+    last_move_ = NetClock::now();
+}
+
+void MultipathConnection::handle_path_frame_locked(uint8_t id,
+                                                   std::string_view payload,
+                                                   Deliveries& out) {
+    auto& path = paths_.at(id);
+    const auto now = NetClock::now();
+    switch (static_cast<PathOp>(payload[1])) {
+        case PathOp::HelloAck:
+            if (!initiator_ || (path.confirmed && !path.legacy)) break;
+            // The handshake's round trip is the path's first sample
+            path.probe_sent = path.opened;
+            sample_locked(path, now);
+            // Slow to answer, not legacy after all
+            path.legacy = false;
+            legacy_ = false;
+            if (!path.confirmed) {
+                confirm_locked(id, path, now);
+                spdlog::info("Path {} ({}) confirmed, rtt {} us", id,
+                             transport_kind_to_string(path.kind),
+                             std::chrono::duration_cast<
+                                 std::chrono::microseconds>(*path.srtt)
+                                 .count());
+            }
+            break;
+        case PathOp::Moved: {
+            if (payload.size() < 4) break;
+            const auto priority = static_cast<uint8_t>(payload[2]);
+            if (priority >= kPriorityClasses) break;
+            path.moved |= static_cast<uint8_t>(1u << priority);
+            path.moved_to = static_cast<uint8_t>(payload[3]);
+            if (!inbound_) inbound_ = id;
+            release_held_locked(out);
+            break;
+        }
+        case PathOp::Probe:
+            // Answered on the path it came in on, so the peer measures
+            // that path and not our active one
+            path.conn->send_frame(path_frame(PathOp::ProbeAck),
+                                  Priority::Control);
+            break;
+        case PathOp::ProbeAck:
+            sample_locked(path, now);
+            break;
+        case PathOp::Hello:
+            // Only ever the first frame of a path, which the
+            // ConnectionManager takes
+            break;
+    }
+}
+
+void MultipathConnection::release_held_locked(Deliveries& out) {
+    while (inbound_) {
+        auto it = paths_.find(*inbound_);
+        if (it == paths_.end() || it->second.moved != kAllClasses) return;
+        const auto to = it->second.moved_to;
+        it->second.moved = 0;
+        inbound_ = to;
+        // The peer moved; answer on the same path
+        if (!initiator_ && paths_.contains(to)) switch_locked(to, true);
+        take_held_locked(to, out);
+    }
+}
+
+void MultipathConnection::take_held_locked(uint8_t from, Deliveries& out) {
+    // In the order they came
+    std::vector<std::pair<uint8_t, std::string>> rest;
+    for (auto& [id, frame] : held_) {
+        if (id != from) {
+            rest.emplace_back(id, std::move(frame));
+            continue;
+        }
+        held_bytes_ -= frame.size();
+        if (started_) {
+            out.push_back(std::move(frame));
+        } else {
+            early_.push_back(std::move(frame));
+        }
+    }
+    held_ = std::move(rest);
+}
+
+void MultipathConnection::remove_path_locked(uint8_t id, Deliveries& out) {
+    paths_.erase(id);
+    std::erase_if(held_, [this, id](const auto& held) {
+        if (held.first != id) return false;
+        held_bytes_ -= held.second.size();
+        return true;
+    });
+
+    if (active_ == id) {
+        active_.reset();
+        fail_over_locked();
+    }
+
+    if (inbound_ == id) {
+        inbound_.reset();
+        if (!held_.empty()) {
+            // Nothing more comes before what is held, so it goes now
+            const auto next = held_.front().first;
+            paths_.at(next).moved = 0;
+            inbound_ = next;
+            if (!initiator_) switch_locked(next, false);
+            take_held_locked(next, out);
+        }
+    }
+}
+
+void MultipathConnection::prune_locked(Deliveries& out) {
+    std::vector<uint8_t> gone;
+    for (const auto& [id, path] : paths_) {
+        if (!path.conn->is_open()) gone.push_back(id);
+    }
+    for (auto id : gone) remove_path_locked(id, out);
+}
+
+void MultipathConnection::fail_over_locked() {
+    // No markers: whatever was in flight on the dead path is gone with it
+    std::optional<uint8_t> best;
+    for (const auto& [id, path] : paths_) {
+        if (!path.confirmed || !path.conn->is_open() || id == active_) {
+            continue;
+        }
+        if (!best || score(path) < score(paths_.at(*best))) best = id;
+    }
+    if (best) switch_locked(*best, false);
+}
+
+MultipathConnection::Path* MultipathConnection::active_locked() {
+    if (active_) {
+        auto it = paths_.find(*active_);
+        if (it != paths_.end() && it->second.conn->is_open()) {
+            return &it->second;
+        }
+        // Closed under us; the error callback may not have come yet
+        fail_over_locked();
+        it = paths_.find(*active_);
+        if (it != paths_.end() && it->second.conn->is_open()) {
+            return &it->second;
+        }
+        return nullptr;
+    }
+    // An acceptor answers on any path until the peer has picked one
+    if (!initiator_) {
+        for (auto& [id, path] : paths_) {
+            if (!path.confirmed) continue;
+            active_ = id;
+            last_move_ = NetClock::now();
+            return &path;
+        }
+    }
+    return nullptr;
+}
+
+double MultipathConnection::score(const Path& path) const {
+    if (!path.srtt) return std::numeric_limits<double>::infinity();
+    const auto rtt =
+        std::chrono::duration<double, std::micro>(*path.srtt).count();
+    // Losses cost retransmissions and head-of-line waits
+    return rtt * (1.0 + 4.0 * path.loss);
+}
+
+void MultipathConnection::pick_best_locked(NetClock::time_point now) {
+    if (!initiator_ || legacy_ || !active_) return;
+    if (now - last_move_ < kMinDwell) return;
+
+    std::optional<uint8_t> best;
+    for (const auto& [id, path] : paths_) {
+        if (!path.confirmed || path.samples < kMinSamples) continue;
+        if (!best || score(path) < score(paths_.at(*best))) best = id;
+    }
+    if (!best || best == active_) return;
+    if (score(paths_.at(*best)) < kSwitchRatio * score(paths_.at(*active_))) {
+        switch_locked(*best, true);
+    }
+}
+
+void MultipathConnection::schedule_tick() {
+    std::lock_guard lock(mutex_);
+    if (ticking_ || closed_) return;
+    ticking_ = true;
+    tick_timer_.expires_after(kTickInterval);
+    auto self =
+        std::static_pointer_cast<MultipathConnection>(shared_from_this());
+    // Nobody else holds a session that is still being set up
+    auto keep = ready_ ? nullptr : self;
+    tick_timer_.async_wait(
+        [weak = std::weak_ptr<MultipathConnection>(self),
+         keep = std::move(keep)](asio::error_code ec) {
+            if (ec) return;
+            if (auto self = weak.lock()) self->tick();
+        });
+}
+
+void MultipathConnection::tick() {
+    std::vector<ConnectionPtr> dropped;
+    Deliveries out;
+    ErrorCallback on_error;
+    ErrorCallback failed;
+    {
+        std::lock_guard lock(mutex_);
+        ticking_ = false;
+        if (closed_) return;
+        const auto now = NetClock::now();
+        prune_locked(out);
+
+        for (auto it = paths_.begin(); it != paths_.end();) {
+            const auto id = it->first;
+            auto& path = it->second;
+            if (!path.confirmed) {
+                if (!ready_ && path.kind == TransportKind::Tcp &&
+                    now - path.opened >= kHelloTimeout) {
+                    spdlog::info("No answer to Hello on path {}, taking it "
+                                 "as a single-path peer",
+                                 id);
+                    path.legacy = true;
+                    legacy_ = true;
+                    confirm_locked(id, path, now);
+                } else if (legacy_ || now - path.opened >= kConfirmTimeout) {
+                    dropped.push_back(path.conn);
+                    it = paths_.erase(it);
+                    continue;
+                }
+                ++it;
+                continue;
+            }
+            // Only the side that picks the path needs to measure them
+            if (initiator_ && !legacy_) {
+                if (path.probe_sent &&
+                    now - *path.probe_sent >= kProbeTimeout) {
+                    path.probe_sent.reset();
+                    path.loss = path.loss * (1.0 - kLossGain) + kLossGain;
+                }
+                if (!path.probe_sent &&
+                    now - path.last_probe >= kProbeInterval) {
+                    path.probe_sent = now;
+                    path.last_probe = now;
+                    path.conn->send_frame(path_frame(PathOp::Probe),
+                                          Priority::Control);
+                }
+            }
+            ++it;
+        }
+        pick_best_locked(now);
+
+        if (paths_.empty() && ready_) {
+            closed_ = true;
+            on_error = on_error_;
+        } else if (paths_.empty() && dialing_ == 0) {
+            closed_ = true;
+            failed = std::move(on_failed_);
+        }
+    }
+    for (auto& conn : dropped) conn->close();
+    deliver(out);
+    if (on_error) on_error("all paths closed");
+    if (failed) failed("no path answered");
+    fire_ready();
+    schedule_tick();
+}
+
+void MultipathConnection::deliver(const Deliveries& frames) {
+    for (const auto& frame : frames) on_message_(frame);
+}
+
+void MultipathConnection::fire_ready() {
+    ReadyCallback on_ready;
+    {
+        std::lock_guard lock(mutex_);
+        if (!ready_ || !on_ready_) return;
+        on_ready = std::move(on_ready_);
+        on_ready_ = nullptr;
+    }
+    on_ready(std::static_pointer_cast<MultipathConnection>(shared_from_this()));
+}
+
+} // namespace peerchat
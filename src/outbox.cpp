@@ -0,0 +1,264 @@
+#include "peerchat/outbox.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+#include <spdlog/spdlog.h>
+
+namespace peerchat {
+
+namespace {
+
+// Peer IDs come from the remote side; only allow a safe charset in file
+// names and hex-encode anything else.
+std::string safe_file_name(const std::string& peer_id) {
+    bool safe = !peer_id.empty() && peer_id.size() <= 64;
+    for (char c : peer_id) {
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+              (c >= '0' && c <= '9') || c == '-')) {
+            safe = false;
+            break;
+        }
+    }
+    if (safe) return peer_id;
+
+    const char* hex = "0123456789abcdef";
+    std::string out = "x";
+    for (unsigned char c : peer_id.substr(0, 64)) {
+        out += hex[c >> 4];
+        out += hex[c & 0xF];
+    }
+    return out;
+}
+
+// The peer ID a spill file belongs to, or empty if safe_file_name()
+// can't have produced the name. A hex name is read as an encoded ID.
+std::string peer_id_from_file_name(const std::string& name) {
+    if (name.size() >= 3 && name[0] == 'x' && name.size() % 2 == 1 &&
+        name.find_first_not_of("0123456789abcdef", 1) == std::string::npos) {
+        std::string id;
+        for (std::size_t i = 1; i < name.size(); i += 2) {
+            id += static_cast<char>(std::stoi(name.substr(i, 2), nullptr, 16));
+        }
+        if (safe_file_name(id) == name && safe_file_name(id) != id) return id;
+    }
+    return safe_file_name(name) == name ? name : std::string{};
+}
+
+} // namespace
+
+Outbox::Outbox(OutboxConfig config) : config_(std::move(config)) {
+    if (config_.memory_limit == 0) config_.memory_limit = 1;
+    if (!config_.directory.empty()) load();
+}
+
+bool Outbox::push(const std::string& peer_id, std::string payload,
+                  int64_t now_ms) {
+    std::lock_guard lock(mutex_);
+    auto& q = queue_for(peer_id);
+    expire_queue(peer_id, q, now_ms);
+
+    std::size_t quota = config_.max_per_peer;
+    if (config_.directory.empty()) {
+        quota = std::min(quota, config_.memory_limit);
+    }
+    if (q.memory.size() + q.spilled >= quota) {
+        return false;
+    }
+
+    q.memory.push_back({now_ms, std::move(payload)});
+    if (!config_.directory.empty() && q.memory.size() > config_.memory_limit) {
+        spill(peer_id, q);
+    }
+    return true;
+}
+
+std::vector<std::string> Outbox::drain(const std::string& peer_id,
+                                       int64_t now_ms) {
+    std::lock_guard lock(mutex_);
+    auto& q = queue_for(peer_id);
+
+    std::vector<std::string> out;
+    out.reserve(q.memory.size() + q.spilled);
+
+    // Spilled entries are always older than the in-memory ones
+    if (q.spilled > 0) {
+        for (auto& e : read_spill(peer_id)) {
+            if (!is_expired(e.enqueued_ms, now_ms)) {
+                out.push_back(std::move(e.payload));
+            }
+        }
+        std::error_code ec;
+        std::filesystem::remove(spill_path(peer_id), ec);
+        q.spilled = 0;
+    }
+
+    for (auto& e : q.memory) {
+        if (!is_expired(e.enqueued_ms, now_ms)) {
+            out.push_back(std::move(e.payload));
+        }
+    }
+    queues_.erase(peer_id);
+    return out;
+}
+
+std::size_t Outbox::expire(int64_t now_ms) {
+    std::lock_guard lock(mutex_);
+    std::size_t removed = 0;
+    for (auto it = queues_.begin(); it != queues_.end();) {
+        auto& q = it->second;
+        removed += expire_queue(it->first, q, now_ms);
+        if (q.memory.empty() && q.spilled == 0) {
+            it = queues_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return removed;
+}
+
+std::size_t Outbox::pending(const std::string& peer_id) const {
+    std::lock_guard lock(mutex_);
+    auto it = queues_.find(peer_id);
+    if (it == queues_.end()) return 0;
+    return it->second.memory.size() + it->second.spilled;
+}
+
+std::size_t Outbox::total_pending() const {
+    std::lock_guard lock(mutex_);
+    std::size_t total = 0;
+    for (const auto& [peer_id, q] : queues_) {
+        total += q.memory.size() + q.spilled;
+    }
+    return total;
+}
+
+void Outbox::load() {
+    [[maybe_unused]] std::size_t loaded = 0;
+    std::error_code ec;
+    for (const auto& entry :
+         std::filesystem::directory_iterator(config_.directory, ec)) {
+        if (entry.path().extension() != ".outbox") continue;
+        auto peer_id = peer_id_from_file_name(entry.path().stem().string());
+        if (peer_id.empty()) continue;
+
+        auto& q = queues_[peer_id];
+        std::ifstream f(entry.path(), std::ios::binary);
+        std::string line;
+        while (std::getline(f, line)) {
+            if (line.empty()) continue;
+            if (q.spilled++ == 0) {
+                try {
+                    q.spill_front_ms = std::stoll(line);
+                } catch (const std::exception&) {
+                    // Corrupt; read_spill skips it
+                }
+            }
+        }
+        loaded += q.spilled;
+        if (q.spilled == 0) queues_.erase(peer_id);
+    }
+    SPDLOG_DEBUG("Outbox: {} queued messages from a previous run", loaded);
+}
+
+Outbox::PeerQueue& Outbox::queue_for(const std::string& peer_id) {
+    return queues_[peer_id];
+}
+
+std::size_t Outbox::expire_queue(const std::string& peer_id, PeerQueue& q,
+                                 int64_t now_ms) {
+    std::size_t removed = 0;
+    // Entries are appended in time order, so expired ones sit at the
+    // front: of the spill file first, then of memory
+    if (q.spilled > 0 && is_expired(q.spill_front_ms, now_ms)) {
+        auto entries = read_spill(peer_id);
+        auto first = std::find_if(entries.begin(), entries.end(),
+                                  [&](const Entry& e) {
+                                      return !is_expired(e.enqueued_ms, now_ms);
+                                  });
+        auto kept = static_cast<std::size_t>(entries.end() - first);
+        removed += q.spilled - kept;
+        q.spilled = kept;
+
+        auto path = spill_path(peer_id);
+        std::error_code ec;
+        if (kept == 0) {
+            std::filesystem::remove(path, ec);
+        } else {
+            // Write then rename, so a crash leaves the old file whole
+            auto tmp = path;
+            tmp += ".tmp";
+            {
+                std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+                for (auto it = first; it != entries.end(); ++it) {
+                    f << it->enqueued_ms << ' ' << it->payload << '\n';
+                }
+            }
+            std::filesystem::rename(tmp, path, ec);
+            q.spill_front_ms = first->enqueued_ms;
+        }
+    }
+    while (!q.memory.empty() &&
+           is_expired(q.memory.front().enqueued_ms, now_ms)) {
+        q.memory.pop_front();
+        ++removed;
+    }
+    return removed;
+}
+
+void Outbox::spill(const std::string& peer_id, PeerQueue& q) {
+    // Spill down to half the limit so we append in batches instead of
+    // reopening the file on every push
+    std::size_t keep = config_.memory_limit / 2;
+    std::size_t count = q.memory.size() - keep;
+
+    std::error_code ec;
+    std::filesystem::create_directories(config_.directory, ec);
+    std::ofstream f(spill_path(peer_id), std::ios::app | std::ios::binary);
+    if (!f.is_open()) {
+        spdlog::warn("Failed to open outbox spill file {}",
+                     spill_path(peer_id).string());
+        return;
+    }
+
+    // Line format: "<enqueued_ms> <payload>\n". Serialized JSON never
+    // contains a raw newline.
+    if (q.spilled == 0) q.spill_front_ms = q.memory.front().enqueued_ms;
+    for (std::size_t i = 0; i < count; ++i) {
+        const auto& e = q.memory.front();
+        f << e.enqueued_ms << ' ' << e.payload << '\n';
+        q.memory.pop_front();
+    }
+    q.spilled += count;
+    SPDLOG_DEBUG("Spilled {} outbox entries for {}", count, peer_id);
+}
+
+std::vector<Outbox::Entry> Outbox::read_spill(const std::string& peer_id) {
+    std::vector<Entry> entries;
+    std::ifstream f(spill_path(peer_id), std::ios::binary);
+    std::string line;
+    while (std::getline(f, line)) {
+        auto space = line.find(' ');
+        if (space == std::string::npos) continue;
+        try {
+            entries.push_back(
+                {std::stoll(line.substr(0, space)), line.substr(space + 1)});
+        } catch (const std::exception&) {
+            spdlog::warn("Skipping corrupt outbox entry for {}", peer_id);
+        }
+    }
+    return entries;
+}
+
+std::filesystem::path Outbox::spill_path(const std::string& peer_id) const {
+    return config_.directory / (safe_file_name(peer_id) + ".outbox");
+}
+
+bool Outbox::is_expired(int64_t enqueued_ms, int64_t now_ms) const {
+    auto ttl_ms =
+        std::chrono::duration_cast<std::chrono::milliseconds>(config_.ttl)
+            .count();
+    return now_ms - enqueued_ms > ttl_ms;
+}
+
+} // namespace peerchat
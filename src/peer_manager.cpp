@@ -1,9 +1,40 @@
 #include "peerchat/peer_manager.hpp"
 
+#include "peerchat/message_schema.hpp"
+#include "peerchat/metrics.hpp"
+#include "peerchat/trace.hpp"
+
+#include <algorithm>
+
 #include <spdlog/spdlog.h>
 
 namespace peerchat {
 
+namespace {
+
+int64_t now_ms() { return NetClock::wall_ms(); }
+
+// Whether a handshake body lists `scheme` under `key`. Peers from before
+// capabilities send an empty body.
+bool offers(const std::string& body, const char* key, const char* scheme) {
+    auto j = nlohmann::json::parse(body, nullptr, false);
+    if (!j.is_object() || !j.contains(key)) return false;
+    const auto& schemes = j[key];
+    return schemes.is_array() &&
+           std::find(schemes.begin(), schemes.end(), scheme) !=
+               schemes.end();
+}
+
+// Capabilities ride in the otherwise empty handshake body
+std::string capabilities() {
+    nlohmann::json caps;
+    caps["compression"] = nlohmann::json::array({kCompressionZstd});
+    caps["framing"] = nlohmann::json::array({kFragmentation});
+    return caps.dump();
+}
+
+} // namespace
+
 std::string peer_state_to_string(PeerState state) {
     switch (state) {
         case PeerState::Disconnected: return "disconnected";
@@ -14,12 +45,25 @@ std::string peer_state_to_string(PeerState state) {
     return "unknown";
 }
 
-PeerManager::PeerManager(asio::io_context& io, Identity& identity)
+PeerManager::PeerManager(asio::io_context& io, Identity& identity,
+                         OutboxConfig outbox_config,
+                         std::filesystem::path download_dir,
+                         std::shared_ptr<ChunkStore> chunk_store)
     : io_(io),
       identity_(identity),
+      control_(identity, capabilities()),
+      outbox_(std::move(outbox_config)),
+      transfers_(std::move(download_dir), kDefaultRequestWindow,
+                 std::move(chunk_store)),
+      clock_(NetClock::wall_ms),
+      reorder_(std::chrono::milliseconds(kReorderWindowMs)),
       handshake_timer_(io),
       ping_timer_(io),
-      pong_timer_(io) {}
+      pong_timer_(io),
+      reorder_timer_(io) {
+    // Spill files from the last run may hold messages past their TTL
+    outbox_.expire(now_ms());
+}
 
 void PeerManager::set_connection(ConnectionPtr conn, bool is_initiator) {
     if (state_ != PeerState::Disconnected) {
@@ -28,10 +72,11 @@ void PeerManager::set_connection(ConnectionPtr conn, bool is_initiator) {
 
     conn_ = std::move(conn);
     is_initiator_ = is_initiator;
+    connected_at_ = NetClock::now();
     set_state(PeerState::WaitingHandshake);
 
     conn_->start(
-        [this](const std::string& json) { handle_message(json); },
+        [this](std::string_view payload) { handle_message(payload); },
         [this](const std::string& reason) { handle_error(reason); });
 
     if (is_initiator_) {
@@ -41,36 +86,97 @@ void PeerManager::set_connection(ConnectionPtr conn, bool is_initiator) {
     start_handshake_timer();
 }
 
-void PeerManager::send_text(const std::string& body) {
+bool PeerManager::send_text(const std::string& body) {
+    auto msg = Message::make_text(identity_.peer_id(), identity_.nickname(),
+                                   identity_.tag(), body);
+    msg.hlc = clock_.now();
+
     if (state_ != PeerState::Connected || !conn_) {
-        spdlog::warn("Cannot send: not connected");
-        return;
+        if (last_peer_id_.empty()) {
+            spdlog::warn("Cannot send: not connected");
+            return false;
+        }
+        // Only a message that will be delivered belongs in the history
+        if (!outbox_.push(last_peer_id_, msg.serialize(), now_ms())) {
+            spdlog::warn("Outbox full for {}, dropping message",
+                         last_peer_id_);
+            return false;
+        }
+        record(last_peer_id_, msg);
+        SPDLOG_DEBUG("Queued text [{}] for offline peer {}", msg.id,
+                     last_peer_id_);
+        return true;
     }
 
-    auto msg = Message::make_text(identity_.peer_id(), identity_.nickname(),
-                                   identity_.tag(), body);
+    record(remote_peer_id_, msg);
+    {
+        std::lock_guard lock(ack_mutex_);
+        if (awaiting_ack_.size() < kMaxAwaitingAcks) {
+            awaiting_ack_.emplace(msg.id, NetClock::now());
+        }
+    }
     conn_->send(msg.serialize());
-    spdlog::debug("Sent text [{}]: {}", msg.id, body);
+    SPDLOG_DEBUG("Sent text [{}]: {}", msg.id, body);
+    return true;
 }
 
 void PeerManager::disconnect() { cleanup(); }
 
+FileManifest PeerManager::send_file(const std::filesystem::path& path) {
+    auto manifest = transfers_.share(path);
+    if (conn_ && state_ == PeerState::Connected) {
+        auto offer = Message::make_file_offer(identity_.peer_id(),
+                                              manifest.serialize());
+        conn_->send(offer.serialize());
+        spdlog::info("Offered {} ({} bytes)", manifest.name, manifest.size);
+    }
+    return manifest;
+}
+
 std::string PeerManager::remote_address() const {
     if (conn_) return conn_->remote_address();
     return "<not connected>";
 }
 
-void PeerManager::handle_message(const std::string& json) {
+bool PeerManager::compression_active() const {
+    return conn_ && conn_->compression_enabled();
+}
+
+std::size_t PeerManager::history_size(const std::string& peer_id) const {
+    std::lock_guard lock(history_mutex_);
+    auto it = histories_.find(peer_id);
+    return it == histories_.end() ? 0 : it->second.size();
+}
+
+std::vector<Message> PeerManager::recent_history(const std::string& peer_id,
+                                                 std::size_t limit) const {
+    std::lock_guard lock(history_mutex_);
+    auto it = histories_.find(peer_id);
+    if (it == histories_.end()) return {};
+    const auto& all = it->second.messages();
+    auto first = all.end();
+    for (std::size_t n = 0; n < limit && first != all.begin(); ++n) --first;
+    return {first, all.end()};
+}
+
+void PeerManager::handle_message(std::string_view payload) {
+    PEERCHAT_TRACE_SCOPE_ARG("handle", payload.size());
+    if (is_binary_frame(payload)) {
+        handle_transfer_frame(payload);
+        return;
+    }
     try {
-        auto msg = Message::deserialize(json);
-        switch (msg.type) {
-            case MessageType::Handshake: handle_handshake(msg); break;
-            case MessageType::Text: handle_text(msg); break;
-            case MessageType::Ack: handle_ack(msg); break;
-            case MessageType::Ping: handle_ping(msg); break;
-            case MessageType::Pong: handle_pong(); break;
-        }
+        using Dispatcher = MessageDispatcher<
+            On<MessageType::Handshake, &PeerManager::handle_handshake>,
+            On<MessageType::Text, &PeerManager::handle_text>,
+            On<MessageType::Ack, &PeerManager::handle_ack>,
+            On<MessageType::Ping, &PeerManager::handle_ping>,
+            On<MessageType::Pong, &PeerManager::handle_pong>,
+            On<MessageType::Sync, &PeerManager::handle_sync>,
+            On<MessageType::FileOffer, &PeerManager::handle_file_offer>>;
+        Dispatcher::dispatch(*this, Message::deserialize(payload));
     } catch (const std::exception& e) {
+        NetMetrics::get().parse_failures.inc();
         spdlog::error("Failed to parse message: {}", e.what());
     }
 }
@@ -85,17 +191,25 @@ void PeerManager::handle_error(const std::string& reason) {
 }
 
 void PeerManager::handle_handshake(const Message& msg) {
+    PEERCHAT_TRACE_SCOPE("handle_handshake");
     if (state_ != PeerState::WaitingHandshake) {
         spdlog::warn("Unexpected handshake in state {}",
                      peer_state_to_string(state_));
         return;
     }
 
+    auto& metrics = NetMetrics::get();
+    metrics.handshake_time.record(NetClock::now() -
+                                  connected_at_);
+    if (msg.sender.str() == last_peer_id_) metrics.reconnects.inc();
+
     remote_peer_id_ = msg.sender;
     remote_nickname_ = msg.nickname;
     remote_tag_ = msg.tag;
-    spdlog::info("Handshake from {}#{} ({})", remote_nickname_, remote_tag_,
-                 remote_peer_id_);
+    last_peer_id_ = remote_peer_id_.str();
+    last_peer_name_ = remote_display_name();
+    spdlog::info("Handshake from {}#{} ({})", remote_nickname_.str(),
+                 remote_tag_.str(), remote_peer_id_.str());
 
     handshake_timer_.cancel();
 
@@ -103,57 +217,233 @@ void PeerManager::handle_handshake(const Message& msg) {
     if (!is_initiator_) {
         send_handshake();
     }
+    // Both sides have now advertised. Our handshake may still be queued
+    // and go out compressed; the peer accepts either.
+    if (offers(msg.body, "compression", kCompressionZstd)) {
+        conn_->enable_compression();
+        SPDLOG_DEBUG("Compressing frames with {}", kCompressionZstd);
+    }
+    if (offers(msg.body, "framing", kFragmentation)) {
+        conn_->enable_fragmentation();
+    }
 
     set_state(PeerState::Connected);
     start_heartbeat();
+    flush_outbox();
+
+    // The initiator opens history sync; the acceptor answers
+    sync_rounds_ = 0;
+    if (is_initiator_) {
+        start_sync();
+    }
 }
 
 void PeerManager::handle_text(const Message& msg) {
+    PEERCHAT_TRACE_SCOPE("handle_text");
     if (state_ != PeerState::Connected) return;
 
-    spdlog::debug("Received text [{}] from {}: {}", msg.id, msg.nickname,
-                  msg.body);
+    SPDLOG_DEBUG("Received text [{}] from {}: {}", msg.id, msg.nickname.str(),
+                 msg.body);
 
     // Send ACK
-    auto ack = Message::make_ack(identity_.peer_id(), msg.id);
-    conn_->send(ack.serialize());
+    conn_->send(control_.ack(msg.id, now_ms()), Priority::Control);
 
-    if (on_display_) {
-        std::string display = msg.nickname;
-        if (!msg.tag.empty()) {
-            display += "#" + msg.tag;
-        }
-        on_display_(display, msg.body);
+    // Replays from the outbox or history sync may repeat a message
+    if (!record(remote_peer_id_, msg)) {
+        SPDLOG_DEBUG("Duplicate text [{}] ignored", msg.id);
+        return;
     }
+
+    clock_.update(msg.hlc);
+    reorder_.push(msg, now_ms());
+    schedule_reorder();
+}
+
+void PeerManager::schedule_reorder() {
+    auto deadline = reorder_.next_deadline();
+    if (!deadline) return;
+    reorder_timer_.expires_after(
+        std::chrono::milliseconds(std::max<int64_t>(*deadline - now_ms(), 0)));
+    reorder_timer_.async_wait([this](asio::error_code ec) {
+        if (ec) return;
+        release_reordered(false);
+        schedule_reorder();
+    });
+}
+
+void PeerManager::release_reordered(bool flush_all) {
+    std::vector<Message> ready;
+    if (flush_all) {
+        reorder_.flush(ready);
+    } else {
+        reorder_.release(now_ms(), ready);
+    }
+    for (const auto& msg : ready) {
+        display(msg);
+    }
+}
+
+void PeerManager::display(const Message& msg) {
+    if (!on_display_) return;
+    std::string name = msg.nickname;
+    if (!msg.tag.empty()) {
+        name += '#';
+        name += msg.tag.str();
+    }
+    on_display_(name, msg.body);
 }
 
 void PeerManager::handle_ack(const Message& msg) {
+    PEERCHAT_TRACE_SCOPE("handle_ack");
     if (state_ != PeerState::Connected) return;
-    spdlog::debug("ACK received for message {}", msg.id);
+    SPDLOG_DEBUG("ACK received for message {}", msg.id);
+    {
+        std::lock_guard lock(ack_mutex_);
+        auto it = awaiting_ack_.find(msg.id);
+        if (it != awaiting_ack_.end()) {
+            NetMetrics::get().ack_latency.record(
+                NetClock::now() - it->second);
+            awaiting_ack_.erase(it);
+        }
+    }
     if (on_ack_) {
         on_ack_(msg.id);
     }
 }
 
-void PeerManager::handle_ping(const Message& msg) {
+void PeerManager::handle_ping([[maybe_unused]] const Message& msg) {
+    PEERCHAT_TRACE_SCOPE("handle_ping");
     if (state_ != PeerState::Connected || !conn_) return;
-    auto pong = Message::make_pong(identity_.peer_id());
-    conn_->send(pong.serialize());
-    spdlog::debug("Responded to ping from {}", msg.sender);
+    conn_->send(control_.pong(now_ms()), Priority::Control);
+    SPDLOG_DEBUG("Responded to ping from {}", msg.sender.str());
 }
 
-void PeerManager::handle_pong() {
+void PeerManager::handle_pong(const Message&) {
+    PEERCHAT_TRACE_SCOPE("handle_pong");
     if (state_ != PeerState::Connected) return;
-    spdlog::debug("Pong received");
+    SPDLOG_DEBUG("Pong received");
     pong_timer_.cancel();
 }
 
+void PeerManager::handle_sync(const Message& msg) {
+    PEERCHAT_TRACE_SCOPE("handle_sync");
+    if (state_ != PeerState::Connected || !conn_) return;
+    if (++sync_rounds_ > kMaxSyncRounds) {
+        spdlog::warn("History sync exceeded {} rounds, giving up",
+                     kMaxSyncRounds);
+        return;
+    }
+
+    auto incoming = SyncPayload::decode(msg.body);
+
+    std::vector<uint64_t> have;
+    SyncPayload reply;
+    {
+        std::lock_guard lock(history_mutex_);
+        auto& history = histories_[remote_peer_id_.str()];
+        // Serve what the peer asked for in its previous round
+        send_history(history, incoming.need);
+
+        Reconciler reconciler(history.index());
+        reply.ranges = reconciler.reconcile(incoming.ranges, have, reply.need);
+        send_history(history, have);
+    }
+
+    SPDLOG_DEBUG("Sync round {}: {} ranges in, {} out, {} sent, {} needed",
+                 sync_rounds_, incoming.ranges.size(), reply.ranges.size(),
+                 have.size(), reply.need.size());
+
+    if (reply.ranges.empty() && reply.need.empty()) return;
+    auto out = Message::make_sync(identity_.peer_id(), reply.encode());
+    conn_->send(out.serialize(), Priority::Bulk);
+}
+
+void PeerManager::handle_file_offer(const Message& msg) {
+    PEERCHAT_TRACE_SCOPE("handle_file_offer");
+    if (state_ != PeerState::Connected || !conn_) return;
+    auto manifest = FileManifest::deserialize(msg.body);
+    if (!transfers_.can_download()) {
+        spdlog::info("Ignoring offer of {}: downloads disabled",
+                     manifest.name);
+        return;
+    }
+    if (on_file_offer_ && !on_file_offer_(manifest)) {
+        spdlog::info("Declined offer of {} ({} bytes) from {}", manifest.name,
+                     manifest.size, remote_display_name());
+        return;
+    }
+    spdlog::info("Receiving {} ({} bytes) from {}", manifest.name,
+                 manifest.size, remote_display_name());
+    transfers_.download(manifest, frame_sender());
+}
+
+void PeerManager::handle_transfer_frame(std::string_view payload) {
+    PEERCHAT_TRACE_SCOPE("handle_transfer_frame");
+    if (state_ != PeerState::Connected || !conn_) return;
+    try {
+        transfers_.handle_frame(
+            reinterpret_cast<const uint8_t*>(payload.data()), payload.size(),
+            frame_sender());
+    } catch (const std::exception& e) {
+        spdlog::error("Bad transfer frame: {}", e.what());
+    }
+}
+
+FrameSender PeerManager::frame_sender() {
+    return [this](std::vector<uint8_t> frame) {
+        if (conn_) conn_->send_frame(std::move(frame));
+    };
+}
+
 void PeerManager::send_handshake() {
     if (!conn_) return;
-    auto msg = Message::make_handshake(identity_.peer_id(),
-                                       identity_.nickname(), identity_.tag());
-    conn_->send(msg.serialize());
-    spdlog::debug("Sent handshake");
+    conn_->send(control_.handshake(now_ms()), Priority::Control);
+    SPDLOG_DEBUG("Sent handshake");
+}
+
+void PeerManager::flush_outbox() {
+    if (!conn_) return;
+    auto queued = outbox_.drain(remote_peer_id_.str(), now_ms());
+    if (queued.empty()) return;
+
+    // One batched write instead of a round of small writes per message.
+    // Same class as live texts: order is only kept within a class, so at
+    // Bulk a text typed now could overtake the backlog.
+    conn_->send_batch(queued, Priority::Interactive);
+    spdlog::info("Delivered {} queued messages to {}", queued.size(),
+                 remote_display_name());
+}
+
+void PeerManager::start_sync() {
+    if (!conn_) return;
+    SyncPayload payload;
+    {
+        std::lock_guard lock(history_mutex_);
+        Reconciler reconciler(histories_[remote_peer_id_.str()].index());
+        payload.ranges = reconciler.initiate();
+    }
+    auto msg = Message::make_sync(identity_.peer_id(), payload.encode());
+    conn_->send(msg.serialize(), Priority::Bulk);
+    SPDLOG_DEBUG("Started history sync with {}", remote_display_name());
+}
+
+void PeerManager::send_history(const History& history,
+                               const std::vector<uint64_t>& hashes) {
+    if (hashes.empty() || !conn_) return;
+    std::vector<std::string> batch;
+    batch.reserve(hashes.size());
+    for (uint64_t h : hashes) {
+        if (const auto* m = history.find(h)) {
+            batch.push_back(m->serialize());
+        }
+    }
+    // Texts, like the outbox: kept in order with live ones
+    conn_->send_batch(batch, Priority::Interactive);
+}
+
+bool PeerManager::record(const std::string& peer_id, const Message& msg) {
+    std::lock_guard lock(history_mutex_);
+    return histories_[peer_id].add(msg);
 }
 
 void PeerManager::start_handshake_timer() {
@@ -174,9 +464,8 @@ void PeerManager::start_heartbeat() {
         if (ec) return;
         if (state_ != PeerState::Connected || !conn_) return;
 
-        auto ping = Message::make_ping(identity_.peer_id());
-        conn_->send(ping.serialize());
-        spdlog::debug("Sent ping");
+        conn_->send(control_.ping(now_ms()), Priority::Control);
+        SPDLOG_DEBUG("Sent ping");
 
         reset_pong_timer();
         start_heartbeat();
@@ -208,15 +497,22 @@ void PeerManager::cleanup() {
     handshake_timer_.cancel();
     ping_timer_.cancel();
     pong_timer_.cancel();
+    reorder_timer_.cancel();
+    release_reordered(true);
+    transfers_.cancel_downloads();
 
     if (conn_) {
         conn_->close();
         conn_.reset();
     }
 
-    remote_nickname_.clear();
-    remote_tag_.clear();
-    remote_peer_id_.clear();
+    {
+        std::lock_guard lock(ack_mutex_);
+        awaiting_ack_.clear();
+    }
+    remote_nickname_ = {};
+    remote_tag_ = {};
+    remote_peer_id_ = {};
     set_state(PeerState::Disconnected);
 }
 
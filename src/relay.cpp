@@ -0,0 +1,622 @@
+#include "peerchat/relay.hpp"
+
+#include "peerchat/framing.hpp"
+#include "peerchat/metrics.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <random>
+
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace peerchat {
+
+namespace {
+
+// Setup frames are a few dozen bytes; anything longer is not a peer
+constexpr std::size_t kMaxSetupFrame = 1024;
+
+// Moves per turn before a direction yields to other work on the io thread
+constexpr int kMovesPerTurn = 16;
+
+const char* relay_op_name(RelayOp op) {
+    switch (op) {
+        case RelayOp::Listen: return "relay_listen";
+        case RelayOp::Incoming: return "relay_incoming";
+        case RelayOp::Accept: return "relay_accept";
+        case RelayOp::Connect: return "relay_connect";
+    }
+    return "";
+}
+
+// Address of the socket's peer, if it is still connected
+std::optional<asio::ip::address> peer_host(const asio::ip::tcp::socket& s) {
+    asio::error_code ec;
+    const auto remote = s.remote_endpoint(ec);
+    if (ec) return std::nullopt;
+    return remote.address();
+}
+
+} // namespace
+
+std::vector<uint8_t> relay_frame(RelayOp op, const std::string& arg) {
+    const bool by_name = op == RelayOp::Listen || op == RelayOp::Connect;
+    nlohmann::json j = {{"type", relay_op_name(op)},
+                        {by_name ? "name" : "key", arg}};
+    return FrameEncoder::encode(j.dump());
+}
+
+// Two connections joined end to end. Each direction moves bytes on its
+// own, through a pipe with splice(2) or through one buffer, and both
+// draw on the session's bandwidth allowance.
+class RelaySession : public std::enable_shared_from_this<RelaySession> {
+  public:
+    using Socket = std::shared_ptr<asio::ip::tcp::socket>;
+    using EndedCallback = std::function<void(uint64_t id, uint64_t bytes)>;
+
+    RelaySession(asio::io_context& io, uint64_t id, std::string name,
+                 Socket dialer, Socket peer, const RelayConfig& config,
+                 EndedCallback on_ended)
+        : io_(io),
+          id_(id),
+          name_(std::move(name)),
+          config_(config),
+          on_ended_(std::move(on_ended)),
+          tokens_(static_cast<double>(config.buffer_size)),
+          refill_(std::chrono::steady_clock::now()),
+          dirs_{Direction(io, dialer, peer), Direction(io, peer, dialer)} {}
+
+    ~RelaySession() { close_pipes(); }
+
+    void start() {
+#if defined(__linux__)
+        splice_ = config_.splice && open_pipes();
+#endif
+        for (auto& d : dirs_) {
+            if (splice_) {
+                d.from->native_non_blocking(true);
+            } else {
+                d.buffer.resize(config_.buffer_size);
+            }
+        }
+        spdlog::info("Relaying session {} to {} ({})", id_, name_,
+                     splice_ ? "splice" : "buffered");
+        for (std::size_t i = 0; i < dirs_.size(); ++i) run(i);
+    }
+
+    void close() {
+        if (closed_) return;
+        closed_ = true;
+        for (auto& d : dirs_) {
+            asio::error_code ec;
+            d.from->close(ec);
+            d.wait.cancel();
+        }
+        spdlog::info("Relay session {} to {} ended, {} + {} bytes", id_,
+                     name_, dirs_[0].bytes, dirs_[1].bytes);
+        if (on_ended_) on_ended_(id_, dirs_[0].bytes + dirs_[1].bytes);
+    }
+
+    RelayServer::SessionStats stats() const {
+        return {id_, name_, dirs_[0].bytes, dirs_[1].bytes};
+    }
+
+  private:
+    struct Direction {
+        Direction(asio::io_context& io, Socket from, Socket to)
+            : from(std::move(from)), to(std::move(to)), wait(io) {}
+
+        Socket from;
+        Socket to;
+        uint64_t bytes{0};
+        asio::steady_timer wait; // for bandwidth
+        std::vector<char> buffer; // when not splicing
+        std::array<int, 2> pipe{-1, -1};
+        std::size_t in_pipe{0};
+    };
+
+    void run(std::size_t i) {
+        if (closed_) return;
+        if (splice_) {
+            pump(i);
+        } else {
+            copy(i);
+        }
+    }
+
+    // Bytes direction `i` may move now. Zero if the allowance is spent, in
+    // which case run(i) is called again once it has refilled.
+    std::size_t take(std::size_t i) {
+        if (config_.bandwidth_bps == 0) return config_.buffer_size;
+        const double rate = static_cast<double>(config_.bandwidth_bps) / 8;
+        const auto now = std::chrono::steady_clock::now();
+        tokens_ = std::min(
+            static_cast<double>(config_.buffer_size),
+            tokens_ + rate * std::chrono::duration<double>(now - refill_)
+                             .count());
+        refill_ = now;
+
+        const auto min_chunk =
+            std::min<std::size_t>(config_.buffer_size, 4096);
+        if (tokens_ >= static_cast<double>(min_chunk)) {
+            const auto n = static_cast<std::size_t>(tokens_);
+            tokens_ -= static_cast<double>(n);
+            return n;
+        }
+        const auto wait = std::chrono::duration<double>(
+            (static_cast<double>(min_chunk) - tokens_) / rate);
+        auto& d = dirs_[i];
+        d.wait.expires_after(
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                wait));
+        d.wait.async_wait(
+            [self = shared_from_this(), i](asio::error_code ec) {
+                if (!ec) self->run(i);
+            });
+        return 0;
+    }
+
+    // Bytes taken but not moved go back
+    void refund(std::size_t n) {
+        if (config_.bandwidth_bps != 0) tokens_ += static_cast<double>(n);
+    }
+
+    void forwarded(Direction& d, std::size_t n) {
+        d.bytes += n;
+        NetMetrics::get().relay_bytes.inc(n);
+    }
+
+    void copy(std::size_t i) {
+        const auto want = take(i);
+        if (want == 0) return;
+        auto& d = dirs_[i];
+        d.from->async_read_some(
+            asio::buffer(d.buffer.data(), want),
+            [self = shared_from_this(), i, want](asio::error_code ec,
+                                                 std::size_t n) {
+                self->refund(want - n);
+                if (ec) {
+                    self->close();
+                    return;
+                }
+                auto& d = self->dirs_[i];
+                asio::async_write(
+                    *d.to, asio::buffer(d.buffer.data(), n),
+                    [self, i](asio::error_code ec, std::size_t n) {
+                        if (ec) {
+                            self->close();
+                            return;
+                        }
+                        self->forwarded(self->dirs_[i], n);
+                        self->run(i);
+                    });
+            });
+    }
+
+#if defined(__linux__)
+    bool open_pipes() {
+        for (auto& d : dirs_) {
+            if (::pipe2(d.pipe.data(), O_NONBLOCK | O_CLOEXEC) != 0) {
+                spdlog::warn("No pipe for splicing: {}", std::strerror(errno));
+                close_pipes();
+                return false;
+            }
+            // Best effort; the default is 64 KiB
+            ::fcntl(d.pipe[1], F_SETPIPE_SZ,
+                    static_cast<int>(config_.buffer_size));
+        }
+        return true;
+    }
+
+    // socket -> pipe -> socket, in the kernel
+    void pump(std::size_t i) {
+        auto& d = dirs_[i];
+        constexpr unsigned kFlags = SPLICE_F_MOVE | SPLICE_F_NONBLOCK;
+        for (int moves = 0; moves < kMovesPerTurn; ++moves) {
+            if (d.in_pipe > 0) {
+                const auto n = ::splice(d.pipe[0], nullptr,
+                                        d.to->native_handle(), nullptr,
+                                        d.in_pipe, kFlags);
+                if (n > 0) {
+                    d.in_pipe -= static_cast<std::size_t>(n);
+                    forwarded(d, static_cast<std::size_t>(n));
+                    continue;
+                }
+                if (n < 0 && errno == EAGAIN) {
+                    d.to->async_wait(
+                        asio::ip::tcp::socket::wait_write,
+                        [self = shared_from_this(), i](asio::error_code ec) {
+                            if (ec) {
+                                self->close();
+                                return;
+                            }
+                            self->run(i);
+                        });
+                    return;
+                }
+                close();
+                return;
+            }
+
+            const auto want = take(i);
+            if (want == 0) return;
+            const auto n = ::splice(d.from->native_handle(), nullptr,
+                                    d.pipe[1], nullptr, want, kFlags);
+            if (n > 0) {
+                refund(want - static_cast<std::size_t>(n));
+                d.in_pipe = static_cast<std::size_t>(n);
+                continue;
+            }
+            refund(want);
+            if (n < 0 && errno == EAGAIN) {
+                d.from->async_wait(
+                    asio::ip::tcp::socket::wait_read,
+                    [self = shared_from_this(), i](asio::error_code ec) {
+                        if (ec) {
+                            self->close();
+                            return;
+                        }
+                        self->run(i);
+                    });
+                return;
+            }
+            // End of stream, or an error
+            close();
+            return;
+        }
+        // Let the other direction and other sessions have a turn
+        asio::post(io_, [self = shared_from_this(), i] { self->run(i); });
+    }
+#else
+    void pump(std::size_t i) { copy(i); }
+#endif
+
+    void close_pipes() {
+#if defined(__linux__)
+        for (auto& d : dirs_) {
+            for (auto& fd : d.pipe) {
+                if (fd >= 0) ::close(fd);
+                fd = -1;
+            }
+        }
+#endif
+    }
+
+    asio::io_context& io_;
+    const uint64_t id_;
+    const std::string name_;
+    const RelayConfig config_;
+    EndedCallback on_ended_;
+    bool splice_{false};
+    bool closed_{false};
+
+    // Bandwidth allowance in bytes, shared by both directions
+    double tokens_;
+    std::chrono::steady_clock::time_point refill_;
+
+    // [0] dialer to peer, [1] back
+    std::array<Direction, 2> dirs_;
+};
+
+RelayServer::RelayServer(asio::io_context& io, uint16_t port,
+                         RelayConfig config)
+    : io_(io),
+      acceptor_(io, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port)),
+      config_(config) {
+    acceptor_.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+    spdlog::info("Relay listening on port {}", this->port());
+    do_accept();
+}
+
+RelayServer::~RelayServer() { stop(); }
+
+uint16_t RelayServer::port() const {
+    return acceptor_.local_endpoint().port();
+}
+
+void RelayServer::stop() {
+    *stopped_ = true;
+    asio::error_code ec;
+    acceptor_.close(ec);
+    for (auto& [socket, timer] : setup_) socket->close(ec);
+    setup_.clear();
+    for (auto& [name, listener] : listeners_) listener->control->close(ec);
+    listeners_.clear();
+    for (auto& [key, pending] : pending_) pending.dialer->close(ec);
+    pending_.clear();
+    auto sessions = std::move(sessions_);
+    sessions_.clear();
+    for (auto& [id, weak] : sessions) {
+        if (auto session = weak.lock()) session->close();
+    }
+}
+
+std::vector<std::string> RelayServer::names() const {
+    std::vector<std::string> result;
+    for (const auto& [name, listener] : listeners_) result.push_back(name);
+    return result;
+}
+
+std::vector<RelayServer::SessionStats> RelayServer::sessions() const {
+    std::vector<SessionStats> result;
+    for (const auto& [id, weak] : sessions_) {
+        if (auto session = weak.lock()) result.push_back(session->stats());
+    }
+    return result;
+}
+
+uint64_t RelayServer::bytes_forwarded() const {
+    auto total = bytes_done_;
+    for (const auto& stats : sessions()) {
+        total += stats.bytes_to_peer + stats.bytes_from_peer;
+    }
+    return total;
+}
+
+void RelayServer::do_accept() {
+    acceptor_.async_accept(
+        [this, stopped = stopped_](asio::error_code ec,
+                                   asio::ip::tcp::socket socket) {
+            if (*stopped) return;
+            if (ec) {
+                if (ec != asio::error::operation_aborted) {
+                    spdlog::error("Relay accept error: {}", ec.message());
+                }
+                return;
+            }
+            asio::error_code opt_ec;
+            socket.set_option(asio::ip::tcp::no_delay(true), opt_ec);
+            read_setup(std::make_shared<asio::ip::tcp::socket>(
+                std::move(socket)));
+            do_accept();
+        });
+}
+
+void RelayServer::read_setup(Socket socket) {
+    asio::error_code ec;
+    if (setup_.size() >= config_.max_pending) {
+        spdlog::warn("Relay: too many connections in setup");
+        socket->close(ec);
+        return;
+    }
+    auto timer =
+        std::make_unique<asio::steady_timer>(io_, config_.setup_timeout);
+    timer->async_wait(
+        [this, stopped = stopped_, socket](asio::error_code ec) {
+            if (ec || *stopped) return;
+            spdlog::info("Relay: no setup frame from {}",
+                         socket->remote_endpoint(ec).address().to_string());
+            socket->close(ec);
+            setup_.erase(socket);
+        });
+    setup_.emplace(socket, std::move(timer));
+
+    // Exactly one frame: whatever follows belongs to the session
+    auto header =
+        std::make_shared<std::array<uint8_t, FrameEncoder::kHeaderSize>>();
+    asio::async_read(
+        *socket, asio::buffer(*header),
+        [this, stopped = stopped_, socket, header](asio::error_code ec,
+                                                   std::size_t) {
+            if (*stopped) return;
+            if (ec) {
+                end_setup(socket);
+                return;
+            }
+            std::size_t len = 0;
+            for (auto byte : *header) len = (len << 8) | byte;
+            if (len == 0 || len > kMaxSetupFrame) {
+                spdlog::warn("Relay: bad setup frame from {}",
+                             socket->remote_endpoint(ec).address().to_string());
+                socket->close(ec);
+                end_setup(socket);
+                return;
+            }
+            auto payload = std::make_shared<std::string>(len, '\0');
+            asio::async_read(
+                *socket, asio::buffer(*payload),
+                [this, stopped, socket, payload](asio::error_code ec,
+                                                 std::size_t) {
+                    if (*stopped) return;
+                    end_setup(socket);
+                    if (!ec) handle_setup(socket, *payload);
+                });
+        });
+}
+
+void RelayServer::end_setup(const Socket& socket) {
+    // Destroying the timer cancels the deadline
+    setup_.erase(socket);
+}
+
+void RelayServer::handle_setup(Socket socket, const std::string& payload) {
+    try {
+        const auto j = nlohmann::json::parse(payload);
+        const auto type = j.at("type").get<std::string>();
+        if (type == relay_op_name(RelayOp::Listen)) {
+            listen(std::move(socket), j.at("name").get<std::string>());
+        } else if (type == relay_op_name(RelayOp::Connect)) {
+            connect(std::move(socket), j.at("name").get<std::string>());
+        } else if (type == relay_op_name(RelayOp::Accept)) {
+            join(std::move(socket), j.at("key").get<std::string>());
+        } else {
+            throw std::invalid_argument("unknown type " + type);
+        }
+    } catch (const std::exception& e) {
+        spdlog::warn("Relay: bad setup frame: {}", e.what());
+        asio::error_code ec;
+        socket->close(ec);
+    }
+}
+
+void RelayServer::listen(Socket socket, const std::string& name) {
+    // Nothing proves who owns a name, so the first holder keeps it until
+    // its control connection closes; otherwise anyone could take over
+    // the sessions dialed to it
+    if (listeners_.size() >= config_.max_names) {
+        spdlog::warn("Relay: too many names registered, refusing {}", name);
+        asio::error_code ec;
+        socket->close(ec);
+        return;
+    }
+    if (listeners_.count(name)) {
+        spdlog::warn("Relay: {} is already registered", name);
+        asio::error_code ec;
+        socket->close(ec);
+        return;
+    }
+    // Keepalives notice a holder that vanished without closing
+    asio::error_code ec;
+    socket->set_option(asio::socket_base::keep_alive(true), ec);
+    auto listener = std::make_shared<Listener>();
+    listener->name = name;
+    listener->control = std::move(socket);
+    listeners_[name] = listener;
+    spdlog::info("Relay: {} registered", name);
+    watch(listener);
+}
+
+void RelayServer::watch(const std::shared_ptr<Listener>& listener) {
+    // Nothing is expected on a control connection; reading notices it
+    // closing
+    listener->discard.resize(256);
+    listener->control->async_read_some(
+        asio::buffer(listener->discard),
+        [this, stopped = stopped_, listener](asio::error_code ec,
+                                             std::size_t) {
+            if (*stopped || ec == asio::error::operation_aborted) return;
+            if (!ec) {
+                watch(listener);
+                return;
+            }
+            drop(listener);
+        });
+}
+
+void RelayServer::drop(const std::shared_ptr<Listener>& listener) {
+    asio::error_code ec;
+    listener->control->close(ec);
+    auto it = listeners_.find(listener->name);
+    if (it != listeners_.end() && it->second == listener) {
+        spdlog::info("Relay: {} left", listener->name);
+        listeners_.erase(it);
+    }
+}
+
+void RelayServer::connect(Socket socket, const std::string& name) {
+    auto it = listeners_.find(name);
+    if (it == listeners_.end()) {
+        spdlog::info("Relay: nobody named {}", name);
+        asio::error_code ec;
+        socket->close(ec);
+        return;
+    }
+    if (pending_.size() >= config_.max_pending) {
+        spdlog::warn("Relay: too many dials pending, refusing one to {}",
+                     name);
+        asio::error_code ec;
+        socket->close(ec);
+        return;
+    }
+
+    // The key admits the listener's side, so it must not be
+    // guessable: 128 bits straight from the system's entropy source
+    std::random_device entropy;
+    char key[33];
+    for (int i = 0; i < 4; ++i) {
+        std::snprintf(key + i * 8, 9, "%08x",
+                      static_cast<unsigned>(entropy() & 0xffffffffu));
+    }
+    Pending pending;
+    pending.dialer = std::move(socket);
+    pending.name = name;
+    pending.listener = it->second;
+    pending.timer = std::make_unique<asio::steady_timer>(io_);
+    pending.timer->expires_after(config_.accept_timeout);
+    pending.timer->async_wait([this, stopped = stopped_,
+                               key = std::string(key)](asio::error_code ec) {
+        if (ec || *stopped) return;
+        auto it = pending_.find(key);
+        if (it == pending_.end()) return;
+        spdlog::info("Relay: {} did not answer", it->second.name);
+        it->second.dialer->close(ec);
+        pending_.erase(it);
+    });
+    pending_.emplace(key, std::move(pending));
+    notify(it->second, relay_frame(RelayOp::Incoming, key));
+}
+
+void RelayServer::join(Socket socket, const std::string& key) {
+    auto it = pending_.find(key);
+    if (it == pending_.end()) {
+        asio::error_code ec;
+        socket->close(ec);
+        return;
+    }
+    // The session is for the listener that heard of the dial; a joiner
+    // from any other host is refused and the dial keeps waiting
+    const auto listener = it->second.listener.lock();
+    const auto from = peer_host(*socket);
+    if (!listener || !from || from != peer_host(*listener->control)) {
+        spdlog::warn("Relay: session for {} joined from elsewhere",
+                     it->second.name);
+        asio::error_code ec;
+        socket->close(ec);
+        return;
+    }
+    auto pending = std::move(it->second);
+    pending_.erase(it);
+    pending.timer->cancel();
+
+    const auto id = next_session_++;
+    auto session = std::make_shared<RelaySession>(
+        io_, id, pending.name, std::move(pending.dialer), std::move(socket),
+        config_, [this](uint64_t id, uint64_t bytes) {
+            session_ended(id, bytes);
+        });
+    sessions_[id] = session;
+    NetMetrics::get().relay_sessions.add(1);
+    session->start();
+}
+
+void RelayServer::session_ended(uint64_t id, uint64_t bytes) {
+    sessions_.erase(id);
+    bytes_done_ += bytes;
+    NetMetrics::get().relay_sessions.add(-1);
+}
+
+void RelayServer::notify(const std::shared_ptr<Listener>& listener,
+                         std::vector<uint8_t> frame) {
+    listener->outbox.push_back(std::move(frame));
+    if (listener->outbox.size() == 1) write_next(listener);
+}
+
+void RelayServer::write_next(const std::shared_ptr<Listener>& listener) {
+    asio::async_write(
+        *listener->control, asio::buffer(listener->outbox.front()),
+        [this, stopped = stopped_, listener](asio::error_code ec,
+                                             std::size_t) {
+            if (*stopped) return;
+            if (ec) {
+                // It can't hear about sessions any more
+                listener->outbox.clear();
+                drop(listener);
+                return;
+            }
+            listener->outbox.pop_front();
+            if (!listener->outbox.empty()) write_next(listener);
+        });
+}
+
+} // namespace peerchat
@@ -0,0 +1,44 @@
+#include "peerchat/reorder_buffer.hpp"
+
+#include <algorithm>
+#include <functional>
+
+namespace peerchat {
+
+ReorderBuffer::ReorderBuffer(std::chrono::milliseconds window,
+                             std::size_t capacity)
+    : window_ms_(window.count()), capacity_(capacity == 0 ? 1 : capacity) {}
+
+void ReorderBuffer::push(Message msg, int64_t now_ms) {
+    heap_.push_back({std::move(msg), now_ms + window_ms_, next_seq_++});
+    std::push_heap(heap_.begin(), heap_.end(), std::greater<>{});
+}
+
+void ReorderBuffer::release(int64_t now_ms, std::vector<Message>& out) {
+    // Over capacity the oldest-by-HLC messages go out early to bound memory
+    while (heap_.size() > capacity_) {
+        pop_into(out);
+    }
+    while (!heap_.empty() && heap_.front().deadline_ms <= now_ms) {
+        pop_into(out);
+    }
+}
+
+void ReorderBuffer::flush(std::vector<Message>& out) {
+    while (!heap_.empty()) {
+        pop_into(out);
+    }
+}
+
+std::optional<int64_t> ReorderBuffer::next_deadline() const {
+    if (heap_.empty()) return std::nullopt;
+    return heap_.front().deadline_ms;
+}
+
+void ReorderBuffer::pop_into(std::vector<Message>& out) {
+    std::pop_heap(heap_.begin(), heap_.end(), std::greater<>{});
+    out.push_back(std::move(heap_.back().msg));
+    heap_.pop_back();
+}
+
+} // namespace peerchat
@@ -0,0 +1,71 @@
+#include "peerchat/scrollback.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace peerchat {
+
+namespace {
+
+// Splits `line` into rows of at most `width` bytes, cutting only at UTF-8
+// sequence boundaries
+void wrap(std::string_view line, std::size_t width,
+          std::vector<std::string_view>& rows) {
+    if (line.empty()) {
+        rows.push_back(line);
+        return;
+    }
+    while (!line.empty()) {
+        auto cut = std::min(width, line.size());
+        while (cut < line.size() && cut > 1 &&
+               (static_cast<unsigned char>(line[cut]) & 0xc0) == 0x80) {
+            --cut;
+        }
+        rows.push_back(line.substr(0, cut));
+        line.remove_prefix(cut);
+    }
+}
+
+} // namespace
+
+Scrollback::Scrollback(std::size_t capacity) : lines_(capacity) {
+    if (capacity == 0) {
+        throw std::invalid_argument("Scrollback capacity must be positive");
+    }
+}
+
+void Scrollback::push(std::string_view line) {
+    // assign() reuses the evicted line's buffer
+    lines_[next_].assign(line);
+    next_ = (next_ + 1) % lines_.size();
+    count_ = std::min(count_ + 1, lines_.size());
+    ++total_;
+}
+
+const std::string& Scrollback::line(std::size_t i) const {
+    auto oldest = (next_ + lines_.size() - count_) % lines_.size();
+    return lines_[(oldest + i) % lines_.size()];
+}
+
+std::vector<std::string_view> Scrollback::view(std::size_t height,
+                                               std::size_t width,
+                                               std::size_t scroll) const {
+    std::vector<std::string_view> rows;
+    if (height == 0 || width == 0 || scroll >= count_) return rows;
+
+    // Walk back from the bottom line until the window is full
+    std::vector<std::string_view> wrapped;
+    std::vector<std::string_view> reversed;
+    for (auto i = count_ - scroll; i-- > 0 && reversed.size() < height;) {
+        wrapped.clear();
+        wrap(line(i), width, wrapped);
+        for (auto r = wrapped.rbegin();
+             r != wrapped.rend() && reversed.size() < height; ++r) {
+            reversed.push_back(*r);
+        }
+    }
+    rows.assign(reversed.rbegin(), reversed.rend());
+    return rows;
+}
+
+} // namespace peerchat
@@ -1,6 +1,7 @@
 #include "peerchat/server.hpp"
 
 #include "peerchat/connection.hpp"
+#include "peerchat/metrics.hpp"
 
 #include <spdlog/spdlog.h>
 
@@ -37,6 +38,7 @@ void Server::do_accept() {
                          socket.remote_endpoint().address().to_string(),
                          socket.remote_endpoint().port());
 
+            NetMetrics::get().connections_accepted.inc();
             auto conn = Connection::create(std::move(socket));
             if (on_connect_) {
                 on_connect_(conn);
@@ -0,0 +1,501 @@
+#include "peerchat/sha256.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define PEERCHAT_SHA256_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace peerchat {
+
+namespace {
+
+constexpr std::array<uint32_t, 64> kRoundConstants = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+constexpr std::array<uint32_t, 8> kInitialState = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+inline uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+inline uint32_t load_be32(const uint8_t* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) |
+           (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+inline void store_be32(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v >> 24);
+    p[1] = static_cast<uint8_t>(v >> 16);
+    p[2] = static_cast<uint8_t>(v >> 8);
+    p[3] = static_cast<uint8_t>(v);
+}
+
+// Compress `count` consecutive 64-byte blocks into `state`
+void compress_scalar(uint32_t* state, const uint8_t* blocks,
+                     std::size_t count) {
+    for (; count > 0; --count, blocks += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = load_be32(blocks + 4 * i);
+        }
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 =
+                rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 =
+                rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for (int i = 0; i < 64; ++i) {
+            uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t t1 = h + s1 + ch + kRoundConstants[i] + w[i];
+            uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + maj;
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#ifdef PEERCHAT_SHA256_X86
+
+// Final one or two blocks of a `len`-byte message whose tail (the bytes
+// after the last full block) is `tail`. Returns the block count.
+std::size_t pad_tail(const uint8_t* tail, std::size_t len, uint8_t* out) {
+    std::size_t rest = len % 64;
+    std::size_t blocks = rest < 56 ? 1 : 2;
+    std::memset(out, 0, 64 * blocks);
+    std::memcpy(out, tail, rest);
+    out[rest] = 0x80;
+    uint64_t bit_len = static_cast<uint64_t>(len) * 8;
+    for (int i = 0; i < 8; ++i) {
+        out[64 * blocks - 8 + i] = static_cast<uint8_t>(bit_len >> (56 - 8 * i));
+    }
+    return blocks;
+}
+
+__attribute__((target("sha,sse4.1,ssse3"))) void compress_shani(
+    uint32_t* state, const uint8_t* blocks, std::size_t count) {
+    const __m128i byte_swap =
+        _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // The rounds instruction wants the state as ABEF / CDGH
+    __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(state));
+    __m128i state1 =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4));
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);
+    state1 = _mm_shuffle_epi32(state1, 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    for (; count > 0; --count, blocks += 64) {
+        const __m128i abef = state0;
+        const __m128i cdgh = state1;
+        __m128i m[4];
+        for (int i = 0; i < 4; ++i) {
+            m[i] = _mm_shuffle_epi8(
+                _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(blocks + 16 * i)),
+                byte_swap);
+        }
+
+        // Four rounds per step; the message schedule for step i + 1 is
+        // finished while step i runs
+#pragma GCC unroll 16
+        for (int i = 0; i < 16; ++i) {
+            __m128i& cur = m[i & 3];
+            __m128i& next = m[(i + 1) & 3];
+            __m128i& prev = m[(i + 3) & 3];
+            __m128i msg = _mm_add_epi32(
+                cur, _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+                         kRoundConstants.data() + 4 * i)));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            if (i >= 3 && i <= 14) {
+                next = _mm_add_epi32(next, _mm_alignr_epi8(cur, prev, 4));
+                next = _mm_sha256msg2_epu32(next, cur);
+            }
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+            if (i >= 1 && i <= 12) {
+                prev = _mm_sha256msg1_epu32(prev, cur);
+            }
+        }
+
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), state1);
+}
+
+__attribute__((target("avx2"))) inline __m256i rotr8(__m256i x, int n) {
+    return _mm256_or_si256(_mm256_srli_epi32(x, n),
+                           _mm256_slli_epi32(x, 32 - n));
+}
+
+// Eight independent messages, one per 32-bit lane. `blocks[l]` points at
+// lane l's next block; each advances by `count` blocks.
+__attribute__((target("avx2"))) void compress_avx2_x8(
+    __m256i* state, const uint8_t** blocks, std::size_t count) {
+    const __m256i byte_swap = _mm256_set_epi8(
+        12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3, 12, 13, 14, 15,
+        8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+
+    for (; count > 0; --count) {
+        __m256i w[64];
+        // Transpose 8 lanes x 8 words, twice per block
+        for (int half = 0; half < 2; ++half) {
+            __m256i r[8];
+            for (int l = 0; l < 8; ++l) {
+                r[l] = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(blocks[l] + 32 * half));
+            }
+            __m256i t[8], u[8];
+            for (int i = 0; i < 4; ++i) {
+                t[2 * i] = _mm256_unpacklo_epi32(r[2 * i], r[2 * i + 1]);
+                t[2 * i + 1] = _mm256_unpackhi_epi32(r[2 * i], r[2 * i + 1]);
+            }
+            for (int i = 0; i < 2; ++i) {
+                u[4 * i] = _mm256_unpacklo_epi64(t[4 * i], t[4 * i + 2]);
+                u[4 * i + 1] = _mm256_unpackhi_epi64(t[4 * i], t[4 * i + 2]);
+                u[4 * i + 2] = _mm256_unpacklo_epi64(t[4 * i + 1], t[4 * i + 3]);
+                u[4 * i + 3] = _mm256_unpackhi_epi64(t[4 * i + 1], t[4 * i + 3]);
+            }
+            for (int i = 0; i < 4; ++i) {
+                w[8 * half + i] = _mm256_shuffle_epi8(
+                    _mm256_permute2x128_si256(u[i], u[i + 4], 0x20), byte_swap);
+                w[8 * half + i + 4] = _mm256_shuffle_epi8(
+                    _mm256_permute2x128_si256(u[i], u[i + 4], 0x31), byte_swap);
+            }
+        }
+        for (int l = 0; l < 8; ++l) {
+            blocks[l] += 64;
+        }
+
+        for (int i = 16; i < 64; ++i) {
+            __m256i s0 = _mm256_xor_si256(
+                _mm256_xor_si256(rotr8(w[i - 15], 7), rotr8(w[i - 15], 18)),
+                _mm256_srli_epi32(w[i - 15], 3));
+            __m256i s1 = _mm256_xor_si256(
+                _mm256_xor_si256(rotr8(w[i - 2], 17), rotr8(w[i - 2], 19)),
+                _mm256_srli_epi32(w[i - 2], 10));
+            w[i] = _mm256_add_epi32(_mm256_add_epi32(w[i - 16], s0),
+                                    _mm256_add_epi32(w[i - 7], s1));
+        }
+
+        __m256i a = state[0], b = state[1], c = state[2], d = state[3];
+        __m256i e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; ++i) {
+            __m256i s1 = _mm256_xor_si256(
+                _mm256_xor_si256(rotr8(e, 6), rotr8(e, 11)), rotr8(e, 25));
+            __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f),
+                                          _mm256_andnot_si256(e, g));
+            __m256i t1 = _mm256_add_epi32(
+                _mm256_add_epi32(h, s1),
+                _mm256_add_epi32(
+                    ch, _mm256_add_epi32(
+                            _mm256_set1_epi32(
+                                static_cast<int>(kRoundConstants[i])),
+                            w[i])));
+            __m256i s0 = _mm256_xor_si256(
+                _mm256_xor_si256(rotr8(a, 2), rotr8(a, 13)), rotr8(a, 22));
+            __m256i maj = _mm256_or_si256(
+                _mm256_and_si256(a, b),
+                _mm256_and_si256(c, _mm256_or_si256(a, b)));
+            h = g;
+            g = f;
+            f = e;
+            e = _mm256_add_epi32(d, t1);
+            d = c;
+            c = b;
+            b = a;
+            a = _mm256_add_epi32(t1, _mm256_add_epi32(s0, maj));
+        }
+
+        state[0] = _mm256_add_epi32(state[0], a);
+        state[1] = _mm256_add_epi32(state[1], b);
+        state[2] = _mm256_add_epi32(state[2], c);
+        state[3] = _mm256_add_epi32(state[3], d);
+        state[4] = _mm256_add_epi32(state[4], e);
+        state[5] = _mm256_add_epi32(state[5], f);
+        state[6] = _mm256_add_epi32(state[6], g);
+        state[7] = _mm256_add_epi32(state[7], h);
+    }
+}
+
+// Hash eight `len`-byte messages at once
+__attribute__((target("avx2"))) void hash_avx2_x8(
+    const uint8_t* const* messages, std::size_t len, Sha256Digest* out) {
+    __m256i state[8];
+    for (int i = 0; i < 8; ++i) {
+        state[i] = _mm256_set1_epi32(static_cast<int>(kInitialState[i]));
+    }
+
+    const uint8_t* blocks[8];
+    std::copy(messages, messages + 8, blocks);
+    compress_avx2_x8(state, blocks, len / 64);
+
+    alignas(32) uint8_t tails[8][128];
+    std::size_t tail_blocks = 0;
+    for (int l = 0; l < 8; ++l) {
+        tail_blocks = pad_tail(blocks[l], len, tails[l]);
+        blocks[l] = tails[l];
+    }
+    compress_avx2_x8(state, blocks, tail_blocks);
+
+    alignas(32) uint32_t words[8][8];
+    for (int i = 0; i < 8; ++i) {
+        _mm256_store_si256(reinterpret_cast<__m256i*>(words[i]), state[i]);
+    }
+    for (int l = 0; l < 8; ++l) {
+        for (int i = 0; i < 8; ++i) {
+            store_be32(out[l].data() + 4 * i, words[i][l]);
+        }
+    }
+}
+
+bool cpu_has_shani() {
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return false;
+    return (ebx & (1u << 29)) != 0 && __builtin_cpu_supports("sse4.1") &&
+           __builtin_cpu_supports("ssse3");
+}
+
+bool cpu_has_avx2() {
+    // Also checks the OS saves the YMM registers
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif // PEERCHAT_SHA256_X86
+
+bool kernel_supported(Sha256Kernel kernel) {
+    switch (kernel) {
+        case Sha256Kernel::Scalar:
+            return true;
+#ifdef PEERCHAT_SHA256_X86
+        case Sha256Kernel::Avx2:
+            return cpu_has_avx2();
+        case Sha256Kernel::ShaNi:
+            return cpu_has_shani();
+#endif
+        default:
+            return false;
+    }
+}
+
+Sha256Kernel detect_kernel() {
+    if (kernel_supported(Sha256Kernel::ShaNi)) return Sha256Kernel::ShaNi;
+    if (kernel_supported(Sha256Kernel::Avx2)) return Sha256Kernel::Avx2;
+    return Sha256Kernel::Scalar;
+}
+
+std::atomic<Sha256Kernel>& active_kernel() {
+    static std::atomic<Sha256Kernel> kernel{detect_kernel()};
+    return kernel;
+}
+
+using CompressFn = void (*)(uint32_t*, const uint8_t*, std::size_t);
+
+CompressFn single_buffer_compress() {
+#ifdef PEERCHAT_SHA256_X86
+    if (active_kernel().load(std::memory_order_relaxed) ==
+        Sha256Kernel::ShaNi) {
+        return compress_shani;
+    }
+#endif
+    return compress_scalar;
+}
+
+} // namespace
+
+Sha256::Sha256() : state_(kInitialState) {}
+
+void Sha256::update(const void* data, std::size_t len) {
+    const auto* p = static_cast<const uint8_t*>(data);
+    total_len_ += len;
+
+    if (buffered_ > 0) {
+        std::size_t take = std::min(len, buffer_.size() - buffered_);
+        std::memcpy(buffer_.data() + buffered_, p, take);
+        buffered_ += take;
+        p += take;
+        len -= take;
+        if (buffered_ < buffer_.size()) return;
+        compress(buffer_.data(), 1);
+        buffered_ = 0;
+    }
+
+    if (len >= 64) {
+        compress(p, len / 64);
+        p += len & ~std::size_t{63};
+        len %= 64;
+    }
+
+    if (len > 0) {
+        std::memcpy(buffer_.data(), p, len);
+        buffered_ = len;
+    }
+}
+
+Sha256Digest Sha256::finish() {
+    uint64_t bit_len = total_len_ * 8;
+
+    uint8_t pad[72] = {0x80};
+    std::size_t pad_len = (buffered_ < 56) ? 56 - buffered_ : 120 - buffered_;
+    for (int i = 0; i < 8; ++i) {
+        pad[pad_len + i] = static_cast<uint8_t>(bit_len >> (56 - 8 * i));
+    }
+    update(pad, pad_len + 8);
+
+    Sha256Digest out;
+    for (int i = 0; i < 8; ++i) {
+        store_be32(out.data() + 4 * i, state_[i]);
+    }
+    return out;
+}
+
+Sha256Digest Sha256::hash(const void* data, std::size_t len) {
+    Sha256 h;
+    h.update(data, len);
+    return h.finish();
+}
+
+void Sha256::compress(const uint8_t* blocks, std::size_t count) {
+    single_buffer_compress()(state_.data(), blocks, count);
+}
+
+std::string sha256_kernel_name(Sha256Kernel kernel) {
+    switch (kernel) {
+        case Sha256Kernel::Scalar:
+            return "scalar";
+        case Sha256Kernel::Avx2:
+            return "avx2-x8";
+        case Sha256Kernel::ShaNi:
+            return "sha-ni";
+    }
+    return "unknown";
+}
+
+Sha256Kernel sha256_kernel() {
+    return active_kernel().load(std::memory_order_relaxed);
+}
+
+std::vector<Sha256Kernel> sha256_supported_kernels() {
+    std::vector<Sha256Kernel> out;
+    for (auto k :
+         {Sha256Kernel::Scalar, Sha256Kernel::Avx2, Sha256Kernel::ShaNi}) {
+        if (kernel_supported(k)) out.push_back(k);
+    }
+    return out;
+}
+
+void sha256_set_kernel(Sha256Kernel kernel) {
+    if (!kernel_supported(kernel)) {
+        throw std::invalid_argument("SHA-256 kernel " +
+                                    sha256_kernel_name(kernel) +
+                                    " not supported on this CPU");
+    }
+    active_kernel().store(kernel, std::memory_order_relaxed);
+}
+
+void sha256_many(const uint8_t* const* messages, std::size_t len,
+                 Sha256Digest* out, std::size_t count) {
+    std::size_t i = 0;
+#ifdef PEERCHAT_SHA256_X86
+    if (sha256_kernel() == Sha256Kernel::Avx2) {
+        for (; i + 8 <= count; i += 8) {
+            hash_avx2_x8(messages + i, len, out + i);
+        }
+        // A short group still beats hashing three or more one at a time;
+        // the spare lanes repeat the last message
+        if (count - i >= 3) {
+            const uint8_t* group[8];
+            Sha256Digest digests[8];
+            for (std::size_t l = 0; l < 8; ++l) {
+                group[l] = messages[std::min(i + l, count - 1)];
+            }
+            hash_avx2_x8(group, len, digests);
+            std::copy(digests, digests + (count - i), out + i);
+            i = count;
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        out[i] = Sha256::hash(messages[i], len);
+    }
+}
+
+std::string to_hex(const Sha256Digest& digest) {
+    const char* hex = "0123456789abcdef";
+    std::string out;
+    out.reserve(64);
+    for (uint8_t b : digest) {
+        out += hex[b >> 4];
+        out += hex[b & 0xF];
+    }
+    return out;
+}
+
+Sha256Digest digest_from_hex(const std::string& hex) {
+    if (hex.size() != 64) {
+        throw std::invalid_argument("Digest must be 64 hex characters");
+    }
+    auto nibble = [](char c) -> uint8_t {
+        if (c >= '0' && c <= '9') return static_cast<uint8_t>(c - '0');
+        if (c >= 'a' && c <= 'f') return static_cast<uint8_t>(c - 'a' + 10);
+        if (c >= 'A' && c <= 'F') return static_cast<uint8_t>(c - 'A' + 10);
+        throw std::invalid_argument("Invalid hex digit in digest");
+    };
+    Sha256Digest out;
+    for (std::size_t i = 0; i < 32; ++i) {
+        out[i] = static_cast<uint8_t>((nibble(hex[2 * i]) << 4) |
+                                      nibble(hex[2 * i + 1]));
+    }
+    return out;
+}
+
+} // namespace peerchat
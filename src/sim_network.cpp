@@ -0,0 +1,235 @@
+#include "peerchat/sim_network.hpp"
+
+#include "peerchat/message.hpp"
+
+#include <algorithm>
+
+namespace peerchat {
+
+namespace {
+
+constexpr auto kMaxRto = std::chrono::seconds(60);
+// A link that loses everything would otherwise retry forever
+constexpr int kMaxRetransmits = 16;
+
+} // namespace
+
+// --- SimConnection ---
+
+SimConnection::SimConnection(SimNetwork& net, NodeId local, NodeId remote)
+    : net_(net), local_(local), remote_(remote) {}
+
+void SimConnection::start(MessageCallback on_message, ErrorCallback on_error) {
+    on_message_ = std::move(on_message);
+    on_error_ = std::move(on_error);
+    started_ = true;
+    auto early = std::move(early_);
+    for (auto& payload : early) receive(std::move(payload));
+}
+
+void SimConnection::send(const std::string& json, Priority) {
+    net_.transmit(*this, json);
+}
+
+void SimConnection::send_batch(const std::vector<std::string>& messages,
+                               Priority) {
+    for (const auto& json : messages) net_.transmit(*this, json);
+}
+
+void SimConnection::send_frame(std::vector<uint8_t> frame, Priority) {
+    net_.transmit(*this, std::string(frame.begin() + FrameEncoder::kHeaderSize,
+                                     frame.end()));
+}
+
+void SimConnection::close() {
+    if (!open_) return;
+    net_.transmit(*this, std::nullopt);
+    open_ = false;
+}
+
+std::string SimConnection::remote_address() const {
+    return "sim:" + std::to_string(remote_);
+}
+
+void SimConnection::receive(std::string payload) {
+    if (!open_) return;
+    if (!started_) {
+        early_.push_back(std::move(payload));
+        return;
+    }
+    if (on_message_) on_message_(payload);
+}
+
+void SimConnection::peer_closed() {
+    if (!open_) return;
+    open_ = false;
+    if (on_error_) on_error_("connection closed by peer");
+}
+
+// --- SimNetwork ---
+
+SimNetwork::SimNetwork(asio::io_context& io, uint32_t seed,
+                       LinkConfig defaults)
+    : io_(io), rng_(seed), defaults_(defaults) {
+    seed_message_ids(seed);
+}
+
+std::pair<ConnectionPtr, ConnectionPtr> SimNetwork::connect(NodeId a,
+                                                            NodeId b) {
+    auto ab = std::make_shared<SimConnection>(*this, a, b);
+    auto ba = std::make_shared<SimConnection>(*this, b, a);
+    ab->peer_ = ba;
+    ba->peer_ = ab;
+    return {ab, ba};
+}
+
+void SimNetwork::set_link(NodeId a, NodeId b, LinkConfig config) {
+    links_[std::minmax(a, b)] = config;
+}
+
+const LinkConfig& SimNetwork::link(NodeId a, NodeId b) const {
+    auto it = links_.find(std::minmax(a, b));
+    return it == links_.end() ? defaults_ : it->second;
+}
+
+void SimNetwork::partition(const std::vector<NodeId>& side) {
+    partitioned_ = {side.begin(), side.end()};
+}
+
+bool SimNetwork::cut(NodeId a, NodeId b) const {
+    return !partitioned_.empty() &&
+           partitioned_.contains(a) != partitioned_.contains(b);
+}
+
+void SimNetwork::heal() {
+    partitioned_.clear();
+    auto holding = std::move(holding_);
+    holding_.clear();
+    for (auto& weak : holding) {
+        auto conn = weak.lock();
+        if (!conn || !conn->blocked_) continue;
+        conn->blocked_ = false;
+        // What waited goes out now, one latency later, still in order
+        auto resume =
+            now() + link(conn->local_, conn->remote_).latency;
+        for (auto& frame : conn->in_flight_) {
+            frame.first = std::max(frame.first, resume);
+        }
+        conn->last_arrival_ =
+            std::max(conn->last_arrival_, conn->in_flight_.back().first);
+        at(conn->in_flight_.front().first, [this, conn] { pump(conn); });
+    }
+}
+
+void SimNetwork::schedule(NetClock::duration delay, std::function<void()> fn) {
+    at(now() + delay, std::move(fn));
+}
+
+void SimNetwork::at(NetClock::time_point t, std::function<void()> fn) {
+    events_.push({t, next_seq_++, std::move(fn)});
+}
+
+NetClock::duration SimNetwork::delivery_delay(NodeId from, NodeId to,
+                                              std::size_t bytes) {
+    const auto& cfg = link(from, to);
+    NetClock::duration delay = cfg.latency;
+    if (cfg.bandwidth_bps > 0) {
+        auto& busy = busy_until_[{from, to}];
+        auto start = std::max(now(), busy);
+        busy = start + std::chrono::nanoseconds(
+                           bytes * 8 * 1'000'000'000ULL / cfg.bandwidth_bps);
+        delay += busy - now();
+    }
+    if (cfg.jitter.count() > 0) {
+        std::uniform_int_distribution<int64_t> jitter(0, cfg.jitter.count());
+        delay += std::chrono::microseconds(jitter(rng_));
+    }
+    if (cfg.loss > 0) {
+        std::bernoulli_distribution lost(cfg.loss);
+        NetClock::duration rto = cfg.rto;
+        for (int i = 0; i < kMaxRetransmits && lost(rng_); ++i) {
+            delay += rto;
+            rto = std::min<NetClock::duration>(rto * 2, kMaxRto);
+            ++stats_.retransmits;
+        }
+    }
+    return delay;
+}
+
+void SimNetwork::transmit(SimConnection& from,
+                          std::optional<std::string> payload) {
+    if (!from.open_) return;
+    if (payload) ++stats_.frames_sent;
+    auto bytes = payload ? payload->size() + FrameEncoder::kHeaderSize : 0;
+    auto arrival = std::max(now() + delivery_delay(from.local_, from.remote_,
+                                                   bytes),
+                            from.last_arrival_);
+    from.last_arrival_ = arrival;
+    from.in_flight_.emplace_back(arrival, std::move(payload));
+    auto self =
+        std::static_pointer_cast<SimConnection>(from.shared_from_this());
+    at(arrival, [this, self] { pump(self); });
+}
+
+void SimNetwork::pump(const std::shared_ptr<SimConnection>& from) {
+    auto& queue = from->in_flight_;
+    while (!from->blocked_ && !queue.empty() && queue.front().first <= now()) {
+        if (cut(from->local_, from->remote_)) {
+            from->blocked_ = true;
+            stats_.frames_held += queue.size();
+            holding_.push_back(from);
+            return;
+        }
+        auto payload = std::move(queue.front().second);
+        queue.pop_front();
+        auto peer = from->peer_.lock();
+        if (!peer) continue;
+        if (!payload) {
+            peer->peer_closed();
+            continue;
+        }
+        ++stats_.frames_delivered;
+        stats_.bytes_delivered += payload->size() + FrameEncoder::kHeaderSize;
+        peer->receive(std::move(*payload));
+    }
+}
+
+void SimNetwork::drain_io() {
+    // poll() stops the io_context once it runs out of work
+    do {
+        io_.restart();
+    } while (io_.poll() > 0);
+}
+
+void SimNetwork::step(NetClock::time_point limit) {
+    drain_io();
+    auto next = now() + resolution_;
+    if (!events_.empty()) next = std::min(next, events_.top().at);
+    time_.advance_to(std::min(next, limit));
+    while (!events_.empty() && events_.top().at <= now()) {
+        auto fn = events_.top().fn;
+        events_.pop();
+        fn();
+    }
+    drain_io();
+}
+
+void SimNetwork::run_for(NetClock::duration d) {
+    const auto end = now() + d;
+    do {
+        step(end);
+    } while (now() < end);
+}
+
+bool SimNetwork::run_until(const std::function<bool()>& done,
+                           NetClock::duration limit) {
+    const auto end = now() + limit;
+    drain_io();
+    while (!done()) {
+        if (now() >= end) return false;
+        step(end);
+    }
+    return true;
+}
+
+} // namespace peerchat
@@ -0,0 +1,301 @@
+#include "peerchat/swarm.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace peerchat {
+
+namespace {
+
+constexpr double kRateGain = 0.25;
+constexpr double kRttGain = 0.125;
+
+} // namespace
+
+SwarmScheduler::SwarmScheduler(uint32_t chunk_count, uint32_t chunk_size,
+                               SwarmConfig config)
+    : chunk_size_(std::max<uint32_t>(chunk_size, 1)),
+      config_(config),
+      done_(chunk_count, false),
+      copies_(chunk_count, 0),
+      partial_(chunk_count, 0),
+      remaining_(chunk_count) {
+    config_.min_window = std::max<std::size_t>(config_.min_window, 1);
+    config_.max_window = std::max(config_.max_window, config_.min_window);
+    config_.max_copies = std::max<std::size_t>(config_.max_copies, 1);
+}
+
+void SwarmScheduler::add_peer(SwarmPeerId peer) {
+    remove_peer(peer);
+    peers_[peer] = Peer{};
+    if (++seeds_ == 1) {
+        for (uint32_t c = 0; c < done_.size(); ++c) {
+            if (partial_[c] == 0) pool_insert(c);
+        }
+    }
+}
+
+void SwarmScheduler::add_peer(SwarmPeerId peer,
+                              const std::vector<bool>& have) {
+    remove_peer(peer);
+    Peer p;
+    p.have.assign(done_.size(), false);
+    peers_[peer] = std::move(p);
+    for (uint32_t c = 0; c < have.size() && c < done_.size(); ++c) {
+        if (have[c]) peer_has(peer, c);
+    }
+}
+
+void SwarmScheduler::peer_has(SwarmPeerId peer, uint32_t chunk) {
+    auto it = peers_.find(peer);
+    if (it == peers_.end() || chunk >= done_.size()) return;
+    auto& p = it->second;
+    if (p.has(chunk)) return;
+
+    p.have[chunk] = true;
+    pool_erase(chunk);
+    ++partial_[chunk];
+    pool_insert(chunk);
+}
+
+void SwarmScheduler::remove_peer(SwarmPeerId peer) {
+    auto it = peers_.find(peer);
+    if (it == peers_.end()) return;
+    auto p = std::move(it->second);
+    peers_.erase(it);
+
+    if (p.have.empty()) {
+        if (--seeds_ == 0) {
+            for (uint32_t c = 0; c < done_.size(); ++c) {
+                if (partial_[c] == 0) pool_erase(c);
+            }
+        }
+    } else {
+        for (uint32_t c = 0; c < p.have.size(); ++c) {
+            if (!p.have[c]) continue;
+            pool_erase(c);
+            --partial_[c];
+            pool_insert(c);
+        }
+    }
+
+    for (const auto& [chunk, sent] : p.in_flight) {
+        release(chunk);
+    }
+}
+
+std::vector<SwarmRequest> SwarmScheduler::next_requests(int64_t now_ms) {
+    std::vector<SwarmRequest> out;
+    if (complete()) return out;
+
+    for (auto& [id, peer] : peers_) {
+        expire(peer, now_ms);
+    }
+
+    // Fastest peers pick first so they get the rarest chunks
+    std::vector<std::pair<SwarmPeerId, Peer*>> order;
+    order.reserve(peers_.size());
+    for (auto& [id, peer] : peers_) {
+        order.emplace_back(id, &peer);
+    }
+    std::stable_sort(order.begin(), order.end(), [](auto& a, auto& b) {
+        return a.second->bytes_per_ms > b.second->bytes_per_ms;
+    });
+
+    for (auto& [id, peer] : order) {
+        auto want = window_for(*peer);
+        if (peer->in_flight.size() >= want) continue;
+        assign(id, *peer, want - peer->in_flight.size(), now_ms, out);
+    }
+
+    if (pool_.empty() && config_.max_copies > 1) {
+        for (auto& [id, peer] : order) {
+            auto want = window_for(*peer);
+            if (peer->in_flight.size() >= want) continue;
+            assign_endgame(id, *peer, want - peer->in_flight.size(), now_ms,
+                           out);
+        }
+    }
+    return out;
+}
+
+bool SwarmScheduler::wanted(SwarmPeerId peer, uint32_t chunk) const {
+    auto it = peers_.find(peer);
+    return it != peers_.end() && chunk < done_.size() && !done_[chunk] &&
+           it->second.in_flight.count(chunk) > 0;
+}
+
+void SwarmScheduler::on_received(SwarmPeerId peer, uint32_t chunk,
+                                 int64_t now_ms,
+                                 std::vector<SwarmRequest>* cancels) {
+    if (!wanted(peer, chunk)) return;
+    auto& p = peers_.at(peer);
+    auto sent = p.in_flight.at(chunk);
+    p.in_flight.erase(chunk);
+    --copies_[chunk];
+
+    auto rtt = static_cast<double>(std::max<int64_t>(now_ms - sent, 1));
+    if (p.received == 0) {
+        p.min_rtt_ms = rtt;
+        p.srtt_ms = rtt;
+    } else {
+        p.min_rtt_ms = std::min(p.min_rtt_ms, rtt);
+        p.srtt_ms += kRttGain * (rtt - p.srtt_ms);
+    }
+
+    // Time this peer spent on the chunk: from the later of the request
+    // and its previous delivery
+    auto start = std::max(p.last_delivery_ms, sent);
+    auto busy = static_cast<double>(std::max<int64_t>(now_ms - start, 1));
+    double sample = chunk_size_ / busy;
+    if (p.bytes_per_ms == 0) {
+        p.bytes_per_ms = sample;
+    } else {
+        p.bytes_per_ms += kRateGain * (sample - p.bytes_per_ms);
+    }
+    p.last_delivery_ms = now_ms;
+    ++p.received;
+
+    done_[chunk] = true;
+    --remaining_;
+
+    // Endgame duplicates still outstanding elsewhere are no longer needed
+    if (copies_[chunk] == 0) return;
+    for (auto& [id, other] : peers_) {
+        if (other.in_flight.erase(chunk) == 0) continue;
+        --copies_[chunk];
+        if (cancels) cancels->push_back({id, chunk});
+    }
+}
+
+void SwarmScheduler::on_failed(SwarmPeerId peer, uint32_t chunk) {
+    if (!wanted(peer, chunk)) return;
+    auto& p = peers_.at(peer);
+    p.in_flight.erase(chunk);
+    ++p.failures;
+    release(chunk);
+}
+
+void SwarmScheduler::mark_done(uint32_t chunk) {
+    if (chunk >= done_.size() || done_[chunk]) return;
+    pool_erase(chunk);
+    done_[chunk] = true;
+    --remaining_;
+    if (copies_[chunk] == 0) return;
+    for (auto& [id, peer] : peers_) {
+        if (peer.in_flight.erase(chunk)) --copies_[chunk];
+    }
+}
+
+std::size_t SwarmScheduler::window(SwarmPeerId peer) const {
+    return window_for(peers_.at(peer));
+}
+
+SwarmScheduler::PeerStats SwarmScheduler::stats(SwarmPeerId peer) const {
+    const auto& p = peers_.at(peer);
+    PeerStats s;
+    s.bytes_per_ms = p.bytes_per_ms;
+    s.min_rtt_ms = p.min_rtt_ms;
+    s.srtt_ms = p.srtt_ms;
+    s.received = p.received;
+    s.timeouts = p.timeouts;
+    s.failures = p.failures;
+    s.in_flight = p.in_flight.size();
+    return s;
+}
+
+std::size_t SwarmScheduler::window_for(const Peer& peer) const {
+    if (peer.bytes_per_ms <= 0 || peer.min_rtt_ms <= 0) {
+        return config_.min_window;
+    }
+    // Bandwidth-delay product in chunks, plus slack to cover jitter
+    auto bdp = static_cast<std::size_t>(
+        std::ceil(peer.bytes_per_ms * peer.min_rtt_ms / chunk_size_));
+    return std::min(bdp + config_.min_window, config_.max_window);
+}
+
+uint32_t SwarmScheduler::availability(uint32_t chunk) const {
+    return partial_[chunk] + seeds_;
+}
+
+void SwarmScheduler::pool_insert(uint32_t chunk) {
+    if (done_[chunk] || copies_[chunk] > 0 || availability(chunk) == 0) {
+        return;
+    }
+    pool_.emplace(partial_[chunk], chunk);
+}
+
+void SwarmScheduler::pool_erase(uint32_t chunk) {
+    pool_.erase({partial_[chunk], chunk});
+}
+
+void SwarmScheduler::release(uint32_t chunk) {
+    if (copies_[chunk] > 0) --copies_[chunk];
+    pool_insert(chunk);
+}
+
+void SwarmScheduler::expire(Peer& peer, int64_t now_ms) {
+    auto timeout = std::max<int64_t>(
+        config_.min_timeout_ms, static_cast<int64_t>(4 * peer.srtt_ms));
+    for (auto it = peer.in_flight.begin(); it != peer.in_flight.end();) {
+        auto chunk = it->first;
+        // Over a reliable link a late chunk from the only holder will
+        // still arrive; asking that same peer again would only add load
+        if (now_ms - it->second <= timeout || availability(chunk) < 2) {
+            ++it;
+            continue;
+        }
+        it = peer.in_flight.erase(it);
+        ++peer.timeouts;
+        peer.bytes_per_ms /= 2;
+        release(chunk);
+    }
+}
+
+void SwarmScheduler::assign(SwarmPeerId id, Peer& peer, std::size_t slots,
+                            int64_t now_ms, std::vector<SwarmRequest>& out) {
+    for (auto it = pool_.begin(); it != pool_.end() && slots > 0;) {
+        auto chunk = it->second;
+        if (!peer.has(chunk)) {
+            ++it;
+            continue;
+        }
+        it = pool_.erase(it);
+        ++copies_[chunk];
+        peer.in_flight[chunk] = now_ms;
+        out.push_back({id, chunk});
+        --slots;
+    }
+}
+
+void SwarmScheduler::assign_endgame(SwarmPeerId id, Peer& peer,
+                                    std::size_t slots, int64_t now_ms,
+                                    std::vector<SwarmRequest>& out) {
+    // Oldest outstanding requests first: those are the likeliest stragglers
+    std::map<uint32_t, int64_t> oldest;
+    for (const auto& [other_id, other] : peers_) {
+        if (other_id == id) continue;
+        for (const auto& [chunk, sent] : other.in_flight) {
+            auto [it, inserted] = oldest.emplace(chunk, sent);
+            if (!inserted) it->second = std::min(it->second, sent);
+        }
+    }
+
+    std::vector<std::pair<int64_t, uint32_t>> candidates;
+    for (const auto& [chunk, sent] : oldest) {
+        if (done_[chunk] || copies_[chunk] >= config_.max_copies) continue;
+        if (!peer.has(chunk) || peer.in_flight.count(chunk)) continue;
+        candidates.emplace_back(sent, chunk);
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    for (const auto& [sent, chunk] : candidates) {
+        if (slots == 0) break;
+        ++copies_[chunk];
+        peer.in_flight[chunk] = now_ms;
+        out.push_back({id, chunk});
+        --slots;
+    }
+}
+
+} // namespace peerchat
@@ -0,0 +1,301 @@
+#include "peerchat/sync.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_set>
+
+#include <nlohmann/json.hpp>
+
+namespace peerchat {
+
+namespace {
+
+uint64_t splitmix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+void push_skip(std::vector<SyncRange>& out, const SyncItem& upper) {
+    if (!out.empty() && out.back().mode == SyncRange::Mode::Skip) {
+        out.back().upper = upper;
+        return;
+    }
+    SyncRange r;
+    r.upper = upper;
+    r.mode = SyncRange::Mode::Skip;
+    out.push_back(std::move(r));
+}
+
+std::size_t count_hashes(const std::vector<SyncRange>& ranges) {
+    std::size_t n = 0;
+    for (const auto& r : ranges) n += r.hashes.size();
+    return n;
+}
+
+} // namespace
+
+uint64_t sync_hash(std::string_view id) {
+    // FNV-1a, then a finalizer so XOR fingerprints see well-mixed bits
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c : id) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    return splitmix64(h);
+}
+
+// --- SyncIndex ---
+
+void SyncIndex::insert(SyncItem item) {
+    if (!dirty_ && !items_.empty() && item < items_.back()) {
+        dirty_ = true;
+    }
+    items_.push_back(item);
+    if (!dirty_) {
+        uint64_t prev = prefix_.empty() ? 0 : prefix_.back();
+        if (prefix_.empty()) prefix_.push_back(0);
+        prefix_.push_back(prev ^ item.hash);
+    }
+}
+
+void SyncIndex::erase_lowest(std::size_t n) {
+    ensure_sorted();
+    n = std::min(n, items_.size());
+    if (n == 0) return;
+    auto count = static_cast<std::ptrdiff_t>(n);
+    items_.erase(items_.begin(), items_.begin() + count);
+    // Prefixes now start after the erased items
+    uint64_t base = prefix_[n];
+    prefix_.erase(prefix_.begin(), prefix_.begin() + count);
+    for (auto& p : prefix_) p ^= base;
+}
+
+void SyncIndex::ensure_sorted() const {
+    if (!dirty_) return;
+    std::sort(items_.begin(), items_.end());
+    prefix_.assign(items_.size() + 1, 0);
+    for (std::size_t i = 0; i < items_.size(); ++i) {
+        prefix_[i + 1] = prefix_[i] ^ items_[i].hash;
+    }
+    dirty_ = false;
+}
+
+std::size_t SyncIndex::lower_bound(const SyncItem& bound) const {
+    ensure_sorted();
+    return static_cast<std::size_t>(
+        std::lower_bound(items_.begin(), items_.end(), bound) -
+        items_.begin());
+}
+
+const SyncItem& SyncIndex::at(std::size_t pos) const {
+    ensure_sorted();
+    return items_.at(pos);
+}
+
+uint64_t SyncIndex::fingerprint(std::size_t begin, std::size_t end) const {
+    ensure_sorted();
+    if (begin >= end) return 0;
+    return prefix_[end] ^ prefix_[begin];
+}
+
+// --- SyncPayload ---
+
+std::string SyncPayload::encode() const {
+    // Compact positional arrays: [ts delta, hash, mode, ...]. Timestamps
+    // are delta-encoded against the previous bound (wrapping, so any
+    // ordered sequence round-trips).
+    nlohmann::json r = nlohmann::json::array();
+    uint64_t prev_ts = 0;
+    for (const auto& range : ranges) {
+        auto ts = static_cast<uint64_t>(range.upper.timestamp);
+        nlohmann::json e = {ts - prev_ts, range.upper.hash,
+                            static_cast<int>(range.mode)};
+        prev_ts = ts;
+        if (range.mode == SyncRange::Mode::Fingerprint) {
+            e.push_back(range.fingerprint);
+            e.push_back(range.count);
+        } else if (range.mode == SyncRange::Mode::IdList) {
+            e.push_back(range.hashes);
+        }
+        r.push_back(std::move(e));
+    }
+
+    nlohmann::json j;
+    j["r"] = std::move(r);
+    if (!need.empty()) j["n"] = need;
+    return j.dump();
+}
+
+SyncPayload SyncPayload::decode(const std::string& data) {
+    auto j = nlohmann::json::parse(data);
+    SyncPayload p;
+
+    SyncItem prev = SyncItem::min();
+    uint64_t prev_ts = 0;
+    for (const auto& e : j.at("r")) {
+        SyncRange range;
+        prev_ts += e.at(0).get<uint64_t>();
+        range.upper.timestamp = static_cast<int64_t>(prev_ts);
+        range.upper.hash = e.at(1).get<uint64_t>();
+        auto mode = e.at(2).get<int>();
+        if (range.upper < prev) {
+            throw std::invalid_argument("Sync ranges out of order");
+        }
+        prev = range.upper;
+
+        switch (mode) {
+            case static_cast<int>(SyncRange::Mode::Skip):
+                range.mode = SyncRange::Mode::Skip;
+                break;
+            case static_cast<int>(SyncRange::Mode::Fingerprint):
+                range.mode = SyncRange::Mode::Fingerprint;
+                range.fingerprint = e.at(3).get<uint64_t>();
+                range.count = e.at(4).get<uint32_t>();
+                break;
+            case static_cast<int>(SyncRange::Mode::IdList):
+                range.mode = SyncRange::Mode::IdList;
+                range.hashes = e.at(3).get<std::vector<uint64_t>>();
+                break;
+            default: throw std::invalid_argument("Unknown sync range mode");
+        }
+        p.ranges.push_back(std::move(range));
+    }
+    if (j.contains("n")) {
+        p.need = j.at("n").get<std::vector<uint64_t>>();
+    }
+    return p;
+}
+
+// --- Reconciler ---
+
+Reconciler::Reconciler(const SyncIndex& index, SyncLimits limits)
+    : index_(index), limits_(limits) {
+    limits_.branching = std::max<std::size_t>(limits_.branching, 2);
+}
+
+std::vector<SyncRange> Reconciler::initiate() const {
+    SyncRange r;
+    r.upper = SyncItem::max();
+    r.mode = SyncRange::Mode::Fingerprint;
+    r.fingerprint = index_.fingerprint(0, index_.size());
+    r.count = static_cast<uint32_t>(index_.size());
+    return {r};
+}
+
+std::vector<SyncRange> Reconciler::reconcile(
+    const std::vector<SyncRange>& incoming, std::vector<uint64_t>& have,
+    std::vector<uint64_t>& need) const {
+    std::vector<SyncRange> out;
+    SyncItem lower = SyncItem::min();
+
+    for (const auto& r : incoming) {
+        std::size_t begin = index_.lower_bound(lower);
+        std::size_t end = index_.lower_bound(r.upper);
+
+        bool over_budget = out.size() >= limits_.max_ranges ||
+                           count_hashes(out) >= limits_.max_hashes;
+        if (over_budget) {
+            // Fold the rest of the key space into one fingerprint; the
+            // peer will split it again next round.
+            std::size_t tail = index_.size();
+            SyncRange rest;
+            rest.upper = SyncItem::max();
+            rest.mode = SyncRange::Mode::Fingerprint;
+            rest.fingerprint = index_.fingerprint(begin, tail);
+            rest.count = static_cast<uint32_t>(tail - begin);
+            out.push_back(std::move(rest));
+            return out;
+        }
+
+        switch (r.mode) {
+            case SyncRange::Mode::Skip: push_skip(out, r.upper); break;
+
+            case SyncRange::Mode::Fingerprint:
+                if (r.count == end - begin &&
+                    r.fingerprint == index_.fingerprint(begin, end)) {
+                    push_skip(out, r.upper);
+                } else if (r.count == 0) {
+                    // Peer has nothing here: everything we hold is missing
+                    for (std::size_t i = begin; i < end; ++i) {
+                        have.push_back(index_.at(i).hash);
+                    }
+                    push_skip(out, r.upper);
+                } else {
+                    split(begin, end, r.upper, out);
+                }
+                break;
+
+            case SyncRange::Mode::IdList: {
+                std::unordered_set<uint64_t> theirs(r.hashes.begin(),
+                                                    r.hashes.end());
+                std::unordered_set<uint64_t> ours;
+                ours.reserve(end - begin);
+                for (std::size_t i = begin; i < end; ++i) {
+                    uint64_t h = index_.at(i).hash;
+                    ours.insert(h);
+                    if (!theirs.count(h)) have.push_back(h);
+                }
+                for (uint64_t h : r.hashes) {
+                    if (!ours.count(h)) need.push_back(h);
+                }
+                push_skip(out, r.upper);
+                break;
+            }
+        }
+        lower = r.upper;
+    }
+
+    // Trailing skips carry no information
+    while (!out.empty() && out.back().mode == SyncRange::Mode::Skip) {
+        out.pop_back();
+    }
+    return out;
+}
+
+SyncItem Reconciler::bound_between(std::size_t pos) const {
+    // Shortest bound separating items [pos - 1] and [pos]: when their
+    // timestamps differ the hash part is not needed and encodes as 0.
+    const auto& next = index_.at(pos);
+    if (index_.at(pos - 1).timestamp < next.timestamp) {
+        return {next.timestamp, 0};
+    }
+    return next;
+}
+
+void Reconciler::split(std::size_t begin, std::size_t end,
+                       const SyncItem& upper,
+                       std::vector<SyncRange>& out) const {
+    std::size_t n = end - begin;
+    if (n <= limits_.id_list_threshold) {
+        SyncRange r;
+        r.upper = upper;
+        r.mode = SyncRange::Mode::IdList;
+        r.hashes.reserve(n);
+        for (std::size_t i = begin; i < end; ++i) {
+            r.hashes.push_back(index_.at(i).hash);
+        }
+        out.push_back(std::move(r));
+        return;
+    }
+
+    // Split into equally sized buckets; each bucket's upper bound is the
+    // first key of the next bucket.
+    std::size_t buckets = std::min(limits_.branching, n);
+    std::size_t per = n / buckets;
+    std::size_t extra = n % buckets;
+    std::size_t pos = begin;
+    for (std::size_t b = 0; b < buckets; ++b) {
+        std::size_t next = pos + per + (b < extra ? 1 : 0);
+        SyncRange r;
+        r.upper = (b + 1 == buckets) ? upper : bound_between(next);
+        r.mode = SyncRange::Mode::Fingerprint;
+        r.fingerprint = index_.fingerprint(pos, next);
+        r.count = static_cast<uint32_t>(next - pos);
+        out.push_back(std::move(r));
+        pos = next;
+    }
+}
+
+} // namespace peerchat
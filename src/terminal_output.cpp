@@ -0,0 +1,124 @@
+#include "peerchat/terminal_output.hpp"
+
+#include <cerrno>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace peerchat {
+
+struct TerminalOutput::Node {
+    std::string line;
+    LineKind kind;
+    Node* next{nullptr};
+};
+
+TerminalOutput::TerminalOutput(int fd, TerminalOutputOptions options)
+    : fd_(fd), options_(options), writer_([this] { run(); }) {}
+
+TerminalOutput::~TerminalOutput() {
+    stopping_ = true;
+    signal_.fetch_add(1, std::memory_order_release);
+    signal_.notify_one();
+    writer_.join();
+}
+
+void TerminalOutput::push(std::string line, LineKind kind) {
+    auto* node = new Node{std::move(line), kind};
+    node->next = head_.load(std::memory_order_relaxed);
+    while (!head_.compare_exchange_weak(node->next, node,
+                                        std::memory_order_release,
+                                        std::memory_order_relaxed)) {
+    }
+    pushed_.fetch_add(1, std::memory_order_relaxed);
+    signal_.fetch_add(1, std::memory_order_release);
+    signal_.notify_one();
+}
+
+void TerminalOutput::flush() {
+    auto target = pushed_.load();
+    urgent_ = true;
+    signal_.fetch_add(1, std::memory_order_release);
+    signal_.notify_one();
+    for (auto done = done_.load(); done < target; done = done_.load()) {
+        done_.wait(done);
+    }
+}
+
+TerminalOutput::Stats TerminalOutput::stats() const {
+    return {done_.load(), writes_.load(), collapsed_acks_.load()};
+}
+
+void TerminalOutput::run() {
+    for (;;) {
+        auto seen = signal_.load(std::memory_order_acquire);
+        if (head_.load(std::memory_order_acquire) == nullptr) {
+            if (stopping_) return;
+            signal_.wait(seen);
+            continue;
+        }
+        // Let the rest of a burst arrive, unless someone is waiting
+        if (!stopping_ && !urgent_.exchange(false)) {
+            std::this_thread::sleep_for(options_.flush_interval);
+        }
+        write_batch(head_.exchange(nullptr, std::memory_order_acquire));
+    }
+}
+
+void TerminalOutput::write_batch(Node* newest_first) {
+    // Reverse into arrival order
+    Node* oldest = nullptr;
+    std::size_t lines = 0;
+    std::size_t acks = 0;
+    while (newest_first) {
+        auto* next = newest_first->next;
+        newest_first->next = oldest;
+        oldest = newest_first;
+        newest_first = next;
+        ++lines;
+        if (oldest->kind == LineKind::Ack) ++acks;
+    }
+
+    const bool collapse = options_.collapse_acks_above != 0 &&
+                          acks > options_.collapse_acks_above;
+    buffer_.clear();
+    while (oldest) {
+        if (!(collapse && oldest->kind == LineKind::Ack)) {
+            buffer_ += oldest->line;
+            buffer_ += '\n';
+        }
+        auto* next = oldest->next;
+        delete oldest;
+        oldest = next;
+    }
+    if (collapse) {
+        buffer_ += "  (delivered: " + std::to_string(acks) + " messages)\n";
+        collapsed_acks_.fetch_add(acks, std::memory_order_relaxed);
+    }
+
+    write_all(buffer_.data(), buffer_.size());
+    writes_.fetch_add(1, std::memory_order_relaxed);
+    done_.fetch_add(lines, std::memory_order_release);
+    done_.notify_all();
+}
+
+void TerminalOutput::write_all(const char* data, std::size_t size) {
+    while (size > 0) {
+#if defined(_WIN32)
+        auto n = _write(fd_, data, static_cast<unsigned>(size));
+#else
+        auto n = ::write(fd_, data, size);
+#endif
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return; // terminal gone; nothing useful to do with the output
+        }
+        data += n;
+        size -= static_cast<std::size_t>(n);
+    }
+}
+
+} // namespace peerchat
@@ -0,0 +1,106 @@
+#include "peerchat/trace.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+
+#include <nlohmann/json.hpp>
+
+namespace peerchat::trace {
+
+namespace {
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Ring>> rings;
+};
+
+Registry& registry() {
+    // Leaked so threads still exiting during shutdown can trace
+    static auto* r = new Registry;
+    return *r;
+}
+
+} // namespace
+
+std::vector<Event> Ring::snapshot() const {
+    const uint64_t end = written_.load(std::memory_order_acquire);
+    const uint64_t begin =
+        std::max({floor_.load(std::memory_order_relaxed),
+                  end > kRingSize ? end - kRingSize : uint64_t{0}});
+    std::vector<Event> events;
+    events.reserve(end - std::min(begin, end));
+    for (uint64_t i = begin; i < end; ++i) {
+        const auto& slot = slots_[i % kRingSize];
+        events.push_back({slot.name.load(std::memory_order_relaxed),
+                          slot.start_ns.load(std::memory_order_relaxed),
+                          slot.dur_ns.load(std::memory_order_relaxed),
+                          slot.arg.load(std::memory_order_relaxed)});
+    }
+    // Slots the writer has claimed since may hold a mix of old and new
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t claimed = claimed_.load(std::memory_order_relaxed);
+    const uint64_t valid_from = claimed > kRingSize ? claimed - kRingSize : 0;
+    if (valid_from > begin) {
+        events.erase(events.begin(),
+                     events.begin() + static_cast<std::ptrdiff_t>(std::min(
+                                          valid_from - begin,
+                                          uint64_t{events.size()})));
+    }
+    return events;
+}
+
+void Ring::clear() {
+    floor_.store(written_.load(std::memory_order_acquire),
+                 std::memory_order_relaxed);
+}
+
+Ring& register_thread() {
+    auto& r = registry();
+    std::lock_guard lock(r.mutex);
+    auto tid = static_cast<uint32_t>(r.rings.size() + 1);
+    return *r.rings.emplace_back(std::make_unique<Ring>(tid));
+}
+
+std::string chrome_json() {
+    auto& r = registry();
+    std::vector<Ring*> rings;
+    {
+        std::lock_guard lock(r.mutex);
+        for (auto& ring : r.rings) rings.push_back(ring.get());
+    }
+
+    auto events = nlohmann::json::array();
+    for (const Ring* ring : rings) {
+        auto spans = ring->snapshot();
+        if (spans.empty()) continue;
+        events.push_back({{"ph", "M"},
+                          {"name", "thread_name"},
+                          {"pid", 1},
+                          {"tid", ring->tid()},
+                          {"args", {{"name", "thread " +
+                                                 std::to_string(
+                                                     ring->tid())}}}});
+        for (const auto& e : spans) {
+            events.push_back({{"ph", "X"},
+                              {"name", e.name},
+                              {"cat", "peerchat"},
+                              {"pid", 1},
+                              {"tid", ring->tid()},
+                              {"ts", static_cast<double>(e.start_ns) / 1e3},
+                              {"dur", static_cast<double>(e.dur_ns) / 1e3},
+                              {"args", {{"n", e.arg}}}});
+        }
+    }
+    return nlohmann::json{{"traceEvents", std::move(events)},
+                          {"displayTimeUnit", "ns"}}
+        .dump();
+}
+
+void clear() {
+    auto& r = registry();
+    std::lock_guard lock(r.mutex);
+    for (auto& ring : r.rings) ring->clear();
+}
+
+} // namespace peerchat::trace
@@ -0,0 +1,222 @@
+#include "peerchat/transport.hpp"
+
+#include "peerchat/connection.hpp"
+#include "peerchat/relay.hpp"
+
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+
+namespace peerchat {
+
+std::string transport_kind_to_string(TransportKind kind) {
+    switch (kind) {
+        case TransportKind::Tcp: return "tcp";
+        case TransportKind::Udp: return "udp";
+        case TransportKind::Relay: return "relay";
+    }
+    return "unknown";
+}
+
+TcpTransport::TcpTransport(asio::io_context& io, uint16_t port)
+    : io_(io), server_(io, port, [this](ConnectionPtr conn) {
+          if (on_accept_) {
+              on_accept_(std::move(conn));
+          } else {
+              conn->close();
+          }
+      }) {}
+
+void TcpTransport::listen(ConnectCallback on_accept) {
+    on_accept_ = std::move(on_accept);
+}
+
+void TcpTransport::dial(const std::string& host, uint16_t port,
+                        ConnectCallback on_connect, ErrorCallback on_error) {
+    auto resolver = std::make_shared<asio::ip::tcp::resolver>(io_);
+    auto socket = std::make_shared<asio::ip::tcp::socket>(io_);
+    resolver->async_resolve(
+        host, std::to_string(port),
+        [resolver, socket, on_connect = std::move(on_connect),
+         on_error = std::move(on_error)](
+            asio::error_code ec,
+            asio::ip::tcp::resolver::results_type endpoints) mutable {
+            if (ec) {
+                on_error(ec.message());
+                return;
+            }
+            asio::async_connect(
+                *socket, endpoints,
+                [socket, on_connect = std::move(on_connect),
+                 on_error = std::move(on_error)](
+                    asio::error_code ec, const asio::ip::tcp::endpoint& ep) {
+                    if (ec) {
+                        spdlog::error("Connect failed: {}", ec.message());
+                        on_error(ec.message());
+                        return;
+                    }
+                    spdlog::info("Connected to {}:{}",
+                                 ep.address().to_string(), ep.port());
+                    on_connect(Connection::create(std::move(*socket)));
+                });
+        });
+}
+
+UdpTransport::UdpTransport(asio::io_context& io, uint16_t port,
+                           UdpConfig config)
+    : io_(io),
+      endpoint_(UdpEndpoint::create(
+          io, port,
+          [this](ConnectionPtr conn) {
+              if (on_accept_) {
+                  on_accept_(std::move(conn));
+              } else {
+                  conn->close();
+              }
+          },
+          std::move(config))) {}
+
+void UdpTransport::listen(ConnectCallback on_accept) {
+    on_accept_ = std::move(on_accept);
+}
+
+void UdpTransport::dial(const std::string& host, uint16_t port,
+                        ConnectCallback on_connect, ErrorCallback on_error) {
+    auto resolver = std::make_shared<asio::ip::udp::resolver>(io_);
+    resolver->async_resolve(
+        asio::ip::udp::v4(), host, std::to_string(port),
+        [this, resolver, on_connect = std::move(on_connect),
+         on_error = std::move(on_error)](
+            asio::error_code ec,
+            asio::ip::udp::resolver::results_type endpoints) {
+            if (ec || endpoints.empty()) {
+                on_error(ec ? ec.message() : "no address");
+                return;
+            }
+            on_connect(endpoint_->connect(endpoints.begin()->endpoint()));
+        });
+}
+
+RelayTransport::RelayTransport(asio::io_context& io, std::string relay_host,
+                               uint16_t relay_port, std::string name)
+    : io_(io),
+      relay_host_(std::move(relay_host)),
+      relay_port_(relay_port),
+      name_(std::move(name)),
+      retry_timer_(io) {}
+
+void RelayTransport::listen(ConnectCallback on_accept) {
+    on_accept_ = std::move(on_accept);
+    register_with_relay();
+}
+
+void RelayTransport::dial(const std::string& host, uint16_t,
+                          ConnectCallback on_connect, ErrorCallback on_error) {
+    open(relay_frame(RelayOp::Connect, host), std::move(on_connect),
+         std::move(on_error));
+}
+
+void RelayTransport::stop() {
+    stopped_ = true;
+    retry_timer_.cancel();
+    if (control_) control_->close();
+}
+
+void RelayTransport::open(std::vector<uint8_t> setup,
+                          ConnectCallback on_connect, ErrorCallback on_error) {
+    auto resolver = std::make_shared<asio::ip::tcp::resolver>(io_);
+    auto socket = std::make_shared<asio::ip::tcp::socket>(io_);
+    auto frame = std::make_shared<std::vector<uint8_t>>(std::move(setup));
+    resolver->async_resolve(
+        relay_host_, std::to_string(relay_port_),
+        [resolver, socket, frame, on_connect = std::move(on_connect),
+         on_error = std::move(on_error)](
+            asio::error_code ec,
+            asio::ip::tcp::resolver::results_type endpoints) mutable {
+            if (ec) {
+                on_error(ec.message());
+                return;
+            }
+            asio::async_connect(
+                *socket, endpoints,
+                [socket, frame, on_connect = std::move(on_connect),
+                 on_error = std::move(on_error)](
+                    asio::error_code ec, const asio::ip::tcp::endpoint&) {
+                    if (ec) {
+                        on_error("relay: " + ec.message());
+                        return;
+                    }
+                    // The relay reads exactly this frame; the session's
+                    // own frames follow it on the same stream
+                    asio::async_write(
+                        *socket, asio::buffer(*frame),
+                        [socket, frame, on_connect, on_error](
+                            asio::error_code ec, std::size_t) {
+                            if (ec) {
+                                on_error("relay: " + ec.message());
+                                return;
+                            }
+                            on_connect(Connection::create(std::move(*socket)));
+                        });
+                });
+        });
+}
+
+void RelayTransport::register_with_relay() {
+    if (stopped_) return;
+    open(
+        relay_frame(RelayOp::Listen, name_),
+        [this](ConnectionPtr conn) {
+            if (stopped_) {
+                conn->close();
+                return;
+            }
+            spdlog::info("Registered with relay {}:{} as {}", relay_host_,
+                         relay_port_, name_);
+            control_ = conn;
+            conn->start(
+                [this](std::string_view payload) {
+                    const auto j = nlohmann::json::parse(payload, nullptr,
+                                                         false);
+                    if (j.is_discarded() || !j.contains("key") ||
+                        j.value("type", "") != "relay_incoming") {
+                        return;
+                    }
+                    // A fresh connection for each session it announces
+                    open(
+                        relay_frame(RelayOp::Accept,
+                                    j["key"].get<std::string>()),
+                        [this](ConnectionPtr conn) {
+                            if (on_accept_) {
+                                on_accept_(std::move(conn));
+                            } else {
+                                conn->close();
+                            }
+                        },
+                        [](const std::string& reason) {
+                            spdlog::warn("Relayed session failed: {}",
+                                         reason);
+                        });
+                },
+                [this](const std::string& reason) {
+                    spdlog::warn("Lost relay {}:{}: {}", relay_host_,
+                                 relay_port_, reason);
+                    control_.reset();
+                    retry_later();
+                });
+        },
+        [this](const std::string& reason) {
+            spdlog::warn("Can't register with relay {}:{}: {}", relay_host_,
+                         relay_port_, reason);
+            retry_later();
+        });
+}
+
+void RelayTransport::retry_later() {
+    if (stopped_) return;
+    retry_timer_.expires_after(kRetryInterval);
+    retry_timer_.async_wait([this](asio::error_code ec) {
+        if (!ec) register_with_relay();
+    });
+}
+
+} // namespace peerchat
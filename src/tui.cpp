@@ -0,0 +1,278 @@
+#include "peerchat/tui.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+#include <spdlog/sinks/base_sink.h>
+#include <spdlog/spdlog.h>
+
+// Keep curses' function-like macros (erase, clear, move, ...) out of C++
+#define NCURSES_NOMACROS
+#include <curses.h>
+
+namespace peerchat {
+
+namespace {
+
+constexpr int kStatusRows = 1;
+constexpr int kInputRows = 1;
+
+// Log lines would scribble over the screen; show warnings and errors in
+// the scrollback instead
+class TuiLogSink : public spdlog::sinks::base_sink<std::mutex> {
+  public:
+    explicit TuiLogSink(std::function<void(std::string)> show)
+        : show_(std::move(show)) {}
+
+  protected:
+    void sink_it_(const spdlog::details::log_msg& msg) override {
+        show_("! " + std::string(msg.payload.data(), msg.payload.size()));
+    }
+    void flush_() override {}
+
+  private:
+    std::function<void(std::string)> show_;
+};
+
+} // namespace
+
+struct Tui::Screen {
+    WINDOW* log{nullptr};
+    WINDOW* status{nullptr};
+    WINDOW* input{nullptr};
+    int rows{0};
+    int cols{0};
+
+    Screen() {
+        initscr();
+        cbreak();
+        noecho();
+        nonl();
+        layout();
+    }
+
+    ~Screen() {
+        destroy();
+        endwin();
+    }
+
+    void layout() {
+        destroy();
+        getmaxyx(stdscr, rows, cols);
+        int log_rows = std::max(1, rows - kStatusRows - kInputRows);
+        log = newwin(log_rows, cols, 0, 0);
+        status = newwin(kStatusRows, cols, log_rows, 0);
+        input = newwin(kInputRows, cols, log_rows + kStatusRows, 0);
+        wbkgd(status, A_REVERSE);
+        keypad(input, TRUE);
+        wtimeout(input, static_cast<int>(kFrameInterval.count()));
+    }
+
+    void destroy() {
+        for (auto* w : {log, status, input}) {
+            if (w) delwin(w);
+        }
+        log = status = input = nullptr;
+    }
+
+    std::size_t log_rows() const {
+        return static_cast<std::size_t>(std::max(1, getmaxy(log)));
+    }
+};
+
+Tui::Tui(std::size_t scrollback_lines) : scrollback_(scrollback_lines) {}
+
+Tui::~Tui() = default;
+
+void Tui::run() {
+    screen_ = std::make_unique<Screen>();
+
+    auto previous = spdlog::default_logger();
+    auto sink = std::make_shared<TuiLogSink>(
+        [this](std::string line) { append(line); });
+    sink->set_level(spdlog::level::warn);
+    auto logger = std::make_shared<spdlog::logger>("tui", sink);
+    logger->set_level(previous->level());
+    spdlog::set_default_logger(logger);
+
+    display_system("Type /help for commands, or just type to chat. "
+                   "PgUp/PgDn scroll.");
+
+    auto last_draw = std::chrono::steady_clock::time_point{};
+    while (running()) {
+        int key = wgetch(screen_->input);
+        if (key != ERR) {
+            handle_key(key);
+            // Take the rest of a paste before drawing
+            wtimeout(screen_->input, 0);
+            while (running() && (key = wgetch(screen_->input)) != ERR) {
+                handle_key(key);
+            }
+            wtimeout(screen_->input,
+                     static_cast<int>(kFrameInterval.count()));
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_draw < kFrameInterval) continue;
+        uint8_t regions;
+        {
+            std::lock_guard lock(mutex_);
+            regions = std::exchange(damage_, 0);
+        }
+        if (regions) {
+            redraw(regions);
+            last_draw = now;
+        }
+    }
+
+    spdlog::set_default_logger(previous);
+    screen_.reset();
+}
+
+void Tui::display_message(const std::string& nick, const std::string& body) {
+    append("[" + nick + "] " + body);
+}
+
+void Tui::display_system(const std::string& msg) { append("* " + msg); }
+
+void Tui::display_ack(const std::string&) {
+    // Counted in the status bar rather than one line per message
+    std::lock_guard lock(mutex_);
+    ++delivered_;
+    damage_ |= kStatus;
+}
+
+void Tui::set_status(const std::string& status) {
+    std::lock_guard lock(mutex_);
+    status_ = status;
+    damage_ |= kStatus;
+}
+
+void Tui::append(const std::string& text) {
+    std::lock_guard lock(mutex_);
+    std::size_t start = 0;
+    for (;;) {
+        auto nl = text.find('\n', start);
+        scrollback_.push(std::string_view(text).substr(start, nl - start));
+        // Keep a scrolled-up view anchored on the same lines
+        if (scroll_ > 0) {
+            scroll_ = std::min(scroll_ + 1, scrollback_.size() - 1);
+            damage_ |= kStatus;
+        }
+        if (nl == std::string::npos) break;
+        start = nl + 1;
+    }
+    damage_ |= kLog;
+}
+
+void Tui::damage(uint8_t regions) {
+    std::lock_guard lock(mutex_);
+    damage_ |= regions;
+}
+
+void Tui::handle_key(int key) {
+    const auto page = screen_->log_rows();
+    // `to` maps the current offset to the new one
+    auto scroll = [this](auto to) {
+        std::lock_guard lock(mutex_);
+        auto max = scrollback_.size() ? scrollback_.size() - 1 : 0;
+        scroll_ = std::min(to(scroll_), max);
+        damage_ |= kLog | kStatus;
+    };
+
+    switch (key) {
+        case '\r':
+        case '\n':
+        case KEY_ENTER: {
+            auto line = std::move(input_);
+            input_.clear();
+            damage(kInput);
+            if (line.empty()) return;
+            append("> " + line);
+            process_line(line);
+            return;
+        }
+        case KEY_BACKSPACE:
+        case 127:
+        case 8:
+            // Drop a whole UTF-8 sequence
+            while (!input_.empty()) {
+                auto c = static_cast<unsigned char>(input_.back());
+                input_.pop_back();
+                if ((c & 0xc0) != 0x80) break;
+            }
+            damage(kInput);
+            return;
+        case KEY_PPAGE:
+            scroll([page](std::size_t s) { return s + page; });
+            return;
+        case KEY_NPAGE:
+            scroll([page](std::size_t s) { return s > page ? s - page : 0; });
+            return;
+        case KEY_HOME:
+            scroll([](std::size_t) { return SIZE_MAX; });
+            return;
+        case KEY_END:
+            scroll([](std::size_t) { return std::size_t{0}; });
+            return;
+        case KEY_RESIZE:
+            screen_->layout();
+            clearok(curscr, TRUE);
+            damage(kAll);
+            return;
+        default:
+            if (key >= 0x20 && key <= 0xff && key != 0x7f) {
+                input_ += static_cast<char>(key);
+                damage(kInput);
+            }
+    }
+}
+
+void Tui::redraw(uint8_t regions) {
+    auto& s = *screen_;
+    {
+        // Draw into curses' buffers under the lock; the terminal write
+        // in doupdate() happens outside it
+        std::lock_guard lock(mutex_);
+        if (regions & kLog) {
+            auto height = s.log_rows();
+            auto rows = scrollback_.view(height, static_cast<std::size_t>(
+                                                     std::max(1, s.cols)),
+                                         scroll_);
+            werase(s.log);
+            int y = static_cast<int>(height - rows.size());
+            for (auto row : rows) {
+                mvwaddnstr(s.log, y++, 0, row.data(),
+                           static_cast<int>(row.size()));
+            }
+            wnoutrefresh(s.log);
+        }
+        if (regions & kStatus) {
+            std::string text = " " + status_;
+            if (delivered_) {
+                text += " | delivered: " + std::to_string(delivered_);
+            }
+            if (scroll_) {
+                text += " | " + std::to_string(scroll_) + " newer lines below";
+            }
+            werase(s.status);
+            mvwaddnstr(s.status, 0, 0, text.c_str(), s.cols);
+            wnoutrefresh(s.status);
+        }
+    }
+    if (regions & kInput) {
+        // The tail of the line, leaving room for the prompt and cursor
+        auto room = static_cast<std::size_t>(std::max(1, s.cols - 3));
+        std::string_view shown = input_;
+        if (shown.size() > room) shown.remove_prefix(shown.size() - room);
+        werase(s.input);
+        mvwaddstr(s.input, 0, 0, "> ");
+        waddnstr(s.input, shown.data(), static_cast<int>(shown.size()));
+    }
+    // Always last, so the cursor ends up on the input line
+    wnoutrefresh(s.input);
+    doupdate();
+}
+
+} // namespace peerchat
@@ -0,0 +1,1057 @@
+#include "peerchat/udp_transport.hpp"
+
+#include "peerchat/metrics.hpp"
+#include "peerchat/trace.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include <spdlog/spdlog.h>
+
+namespace peerchat {
+
+namespace {
+
+using namespace std::chrono_literals;
+
+// Datagram: [type][u32 connection id][u64 packet number][frames...]
+enum class PacketType : uint8_t {
+    Initial = 1, // from the side that opened the connection, until answered
+    Short = 2,
+    Close = 3,
+};
+
+// Stream: [u8 stream][u64 offset][u16 length][bytes]
+// Ack:    [u16 delay in us][u8 count] then count x [u64 last][u64 first],
+//         newest range first
+// Ping:   nothing; asks for an ACK
+// Padding: a zero byte, filling Initial datagrams out to full size so
+//         the acceptor's amplification limit leaves room to answer
+enum class FrameType : uint8_t { Padding = 0, Stream = 1, Ack = 2, Ping = 3 };
+
+constexpr std::size_t kPacketHeader = 1 + 4 + 8;
+constexpr std::size_t kStreamFrameHeader = 1 + 1 + 8 + 2;
+constexpr std::size_t kMaxAckRanges = 16;
+// Bytes a stream may have outstanding past its first unacknowledged one;
+// the receiver buffers no more than this out of order
+constexpr uint64_t kStreamWindow = 1024 * 1024;
+// Separate runs of out-of-order bytes a stream may hold. Heavy loss
+// over a full window leaves a few hundred; far more is a peer scattering
+// tiny segments.
+constexpr std::size_t kMaxPendingRuns = 1024;
+// A packet is lost once one this many numbers later is acknowledged
+constexpr uint64_t kPacketThreshold = 3;
+// Ack-eliciting packets received before an ACK goes out at once
+constexpr std::size_t kAckEvery = 2;
+constexpr auto kMaxAckDelay = std::chrono::milliseconds(5);
+constexpr unsigned kMaxPtoBackoff = 6;
+
+void put_u16(std::vector<uint8_t>& out, uint16_t v) {
+    out.push_back(static_cast<uint8_t>(v >> 8));
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+void put_u32(std::vector<uint8_t>& out, uint32_t v) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<uint8_t>(v >> shift));
+    }
+}
+
+void put_u64(std::vector<uint8_t>& out, uint64_t v) {
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<uint8_t>(v >> shift));
+    }
+}
+
+void put_header(std::vector<uint8_t>& out, PacketType type, uint32_t id,
+                uint64_t pn) {
+    out.push_back(static_cast<uint8_t>(type));
+    put_u32(out, id);
+    put_u64(out, pn);
+}
+
+// Stores the bytes of [offset, offset + size) that `pending` lacks. Runs
+// stay disjoint and are joined where they touch, so overlapping or
+// repeated segments never take more memory than the bytes they cover.
+void add_pending(std::map<uint64_t, std::string>& pending, uint64_t offset,
+                 std::string_view bytes) {
+    const uint64_t end = offset + bytes.size();
+    uint64_t at = offset;
+    auto it = pending.upper_bound(at);
+    auto prev = it == pending.begin() ? pending.end() : std::prev(it);
+    if (prev != pending.end()) {
+        at = std::max(at, prev->first + prev->second.size());
+    }
+    auto touches = [&](uint64_t where) {
+        return prev != pending.end() &&
+               prev->first + prev->second.size() == where;
+    };
+    while (at < end) {
+        // `it` is the first run at or after `at`
+        const uint64_t stop =
+            it == pending.end() ? end : std::min(end, it->first);
+        if (stop > at) {
+            const auto piece = bytes.substr(at - offset, stop - at);
+            if (touches(at)) {
+                prev->second.append(piece);
+            } else {
+                prev = pending.emplace_hint(it, at, piece);
+            }
+        }
+        if (it == pending.end()) break;
+        at = std::max(at, it->first + it->second.size());
+        if (touches(it->first)) {
+            prev->second.append(it->second);
+            it = pending.erase(it);
+        } else {
+            prev = it++;
+        }
+    }
+}
+
+// Bounds-checked big-endian reads; `ok` turns false on overrun
+class Reader {
+  public:
+    Reader(const uint8_t* data, std::size_t len) : p_(data), end_(data + len) {}
+
+    uint64_t read(std::size_t n) {
+        if (static_cast<std::size_t>(end_ - p_) < n) {
+            ok = false;
+            p_ = end_;
+            return 0;
+        }
+        uint64_t v = 0;
+        for (std::size_t i = 0; i < n; ++i) v = (v << 8) | *p_++;
+        return v;
+    }
+    uint8_t u8() { return static_cast<uint8_t>(read(1)); }
+    uint16_t u16() { return static_cast<uint16_t>(read(2)); }
+    uint32_t u32() { return static_cast<uint32_t>(read(4)); }
+    uint64_t u64() { return read(8); }
+
+    std::string_view bytes(std::size_t n) {
+        if (static_cast<std::size_t>(end_ - p_) < n) {
+            ok = false;
+            p_ = end_;
+            return {};
+        }
+        std::string_view v(reinterpret_cast<const char*>(p_), n);
+        p_ += n;
+        return v;
+    }
+
+    bool done() const { return p_ == end_; }
+    const uint8_t* position() const { return p_; }
+    std::size_t remaining() const {
+        return static_cast<std::size_t>(end_ - p_);
+    }
+
+    bool ok{true};
+
+  private:
+    const uint8_t* p_;
+    const uint8_t* end_;
+};
+
+} // namespace
+
+// --- RangeSet ---
+
+uint64_t RangeSet::add(uint64_t first, uint64_t end) {
+    if (first >= end) return 0;
+    uint64_t added = end - first;
+    auto it = ranges_.upper_bound(first);
+    if (it != ranges_.begin() && std::prev(it)->second >= first) --it;
+
+    // Absorb every range that overlaps or touches [first, end)
+    uint64_t lo = first;
+    uint64_t hi = end;
+    while (it != ranges_.end() && it->first <= end) {
+        const uint64_t overlap_lo = std::max(first, it->first);
+        const uint64_t overlap_hi = std::min(end, it->second);
+        if (overlap_hi > overlap_lo) added -= overlap_hi - overlap_lo;
+        lo = std::min(lo, it->first);
+        hi = std::max(hi, it->second);
+        it = ranges_.erase(it);
+    }
+    ranges_.emplace(lo, hi);
+    return added;
+}
+
+void RangeSet::remove(uint64_t first, uint64_t end) {
+    if (first >= end) return;
+    auto it = ranges_.upper_bound(first);
+    if (it != ranges_.begin() && std::prev(it)->second > first) --it;
+    while (it != ranges_.end() && it->first < end) {
+        const auto [lo, hi] = *it;
+        it = ranges_.erase(it);
+        if (lo < first) ranges_.emplace(lo, first);
+        if (hi > end) {
+            ranges_.emplace(end, hi);
+            break;
+        }
+    }
+}
+
+bool RangeSet::contains(uint64_t value) const {
+    auto it = ranges_.upper_bound(value);
+    if (it == ranges_.begin()) return false;
+    return value < std::prev(it)->second;
+}
+
+void RangeSet::keep_highest(std::size_t n) {
+    while (ranges_.size() > n) ranges_.erase(ranges_.begin());
+}
+
+// --- RttEstimator ---
+
+void RttEstimator::sample(duration rtt, duration ack_delay) {
+    latest_ = rtt;
+    min_ = std::min(min_, rtt);
+    // The peer's ACK delay only counts if it leaves the minimum intact
+    auto adjusted = rtt;
+    if (rtt >= min_ + ack_delay) adjusted = rtt - ack_delay;
+
+    if (!has_sample_) {
+        has_sample_ = true;
+        smoothed_ = adjusted;
+        variance_ = adjusted / 2;
+        return;
+    }
+    const auto diff =
+        smoothed_ > adjusted ? smoothed_ - adjusted : adjusted - smoothed_;
+    variance_ = (3 * variance_ + diff) / 4;
+    smoothed_ = (7 * smoothed_ + adjusted) / 8;
+}
+
+RttEstimator::duration RttEstimator::pto(duration max_ack_delay) const {
+    return smoothed_ + std::max<duration>(4 * variance_, kGranularity) +
+           max_ack_delay;
+}
+
+// --- CongestionController ---
+
+void CongestionController::on_acked(std::size_t bytes, time_point sent) {
+    in_flight_ -= std::min(bytes, in_flight_);
+    // Nothing grows for packets sent before the last reduction
+    if (recovery_start_ && sent <= *recovery_start_) return;
+    if (window_ < ssthresh_) {
+        window_ += bytes;
+    } else {
+        window_ += kMaxDatagram * bytes / window_;
+    }
+    window_ = std::min(window_, kMaximumWindow);
+}
+
+void CongestionController::on_lost(std::size_t bytes, time_point sent,
+                                   time_point now) {
+    in_flight_ -= std::min(bytes, in_flight_);
+    if (recovery_start_ && sent <= *recovery_start_) return;
+    recovery_start_ = now;
+    window_ = std::max(window_ / 2, kMinimumWindow);
+    ssthresh_ = window_;
+}
+
+void CongestionController::on_discarded(std::size_t bytes) {
+    in_flight_ -= std::min(bytes, in_flight_);
+}
+
+// --- UdpConnection ---
+
+UdpConnection::UdpConnection(std::shared_ptr<UdpEndpoint> endpoint,
+                             asio::ip::udp::endpoint remote, uint32_t id,
+                             bool initiator, uint64_t first_pn)
+    : endpoint_(std::move(endpoint)),
+      remote_(std::move(remote)),
+      id_(id),
+      initiating_(initiator),
+      next_pn_(first_pn),
+      pacing_refill_(clock::now()),
+      validated_(initiator),
+      last_heard_(clock::now()),
+      timer_(endpoint_->io_),
+      ack_timer_(endpoint_->io_),
+      pacing_timer_(endpoint_->io_),
+      idle_timer_(endpoint_->io_) {}
+
+UdpConnection::~UdpConnection() { endpoint_->forget({remote_, id_}); }
+
+void UdpConnection::start(MessageCallback on_message, ErrorCallback on_error) {
+    std::vector<std::string> early;
+    {
+        std::lock_guard lock(mutex_);
+        on_message_ = std::move(on_message);
+        on_error_ = std::move(on_error);
+        started_ = true;
+        early.swap(early_);
+        if (closed_) return;
+
+        auto self = std::static_pointer_cast<UdpConnection>(shared_from_this());
+        idle_timer_.expires_after(endpoint_->config().idle_timeout);
+        idle_timer_.async_wait([this, self](asio::error_code ec) {
+            if (!ec) on_idle_timer();
+        });
+    }
+    for (const auto& payload : early) {
+        if (on_message_) on_message_(payload);
+    }
+}
+
+void UdpConnection::send(const std::string& json, Priority priority) {
+    PEERCHAT_TRACE_SCOPE_ARG("send", json.size());
+    std::lock_guard lock(mutex_);
+    if (closed_) return;
+    queue_locked(priority, json, !is_binary_frame(json));
+    NetMetrics::get().frames_out.inc();
+    flush_locked(clock::now());
+}
+
+void UdpConnection::send_batch(const std::vector<std::string>& messages,
+                               Priority priority) {
+    if (messages.empty()) return;
+    PEERCHAT_TRACE_SCOPE_ARG("send_batch", messages.size());
+    std::lock_guard lock(mutex_);
+    if (closed_) return;
+    for (const auto& json : messages) {
+        queue_locked(priority, json, !is_binary_frame(json));
+    }
+    NetMetrics::get().frames_out.inc(messages.size());
+    flush_locked(clock::now());
+}
+
+void UdpConnection::send_frame(std::vector<uint8_t> frame, Priority priority) {
+    PEERCHAT_TRACE_SCOPE_ARG("send_frame", frame.size());
+    std::lock_guard lock(mutex_);
+    if (closed_) return;
+    auto& stream = send_[static_cast<std::size_t>(priority)];
+    stream.data.append(reinterpret_cast<const char*>(frame.data()),
+                       frame.size());
+    NetMetrics::get().frames_out.inc();
+    flush_locked(clock::now());
+}
+
+void UdpConnection::queue_locked(Priority priority, std::string_view payload,
+                                 bool json) {
+    auto& stream = send_[static_cast<std::size_t>(priority)];
+    // Payloads close to the frame limit could outgrow it compressed
+    if (json && stream.compressor && payload.size() >= kCompressMinBytes &&
+        payload.size() + 512 <= kMaxFrameSize) {
+        auto compressed = stream.compressor->compress(std::string(payload));
+        return queue_locked(priority, compressed, false);
+    }
+    const auto at = stream.data.size();
+    stream.data.resize(at + FrameEncoder::kHeaderSize);
+    FrameEncoder::write_header(
+        reinterpret_cast<uint8_t*>(stream.data.data() + at), payload.size());
+    stream.data.append(payload);
+}
+
+void UdpConnection::close() {
+    std::lock_guard lock(mutex_);
+    if (closed_) return;
+    std::vector<uint8_t> packet;
+    put_header(packet, PacketType::Close, id_, next_pn_++);
+    endpoint_->send_to(remote_, packet.data(), packet.size());
+    release_locked();
+}
+
+void UdpConnection::release_locked() {
+    closed_ = true;
+    for (const auto& [pn, p] : sent_) cc_.on_discarded(p.bytes);
+    sent_.clear();
+    timer_.cancel();
+    ack_timer_.cancel();
+    pacing_timer_.cancel();
+    idle_timer_.cancel();
+}
+
+void UdpConnection::enable_compression() {
+    std::lock_guard lock(mutex_);
+    for (auto& stream : send_) {
+        if (!stream.compressor) {
+            stream.compressor = std::make_unique<FrameCompressor>();
+        }
+    }
+}
+
+bool UdpConnection::compression_enabled() const {
+    std::lock_guard lock(mutex_);
+    return send_[0].compressor != nullptr;
+}
+
+FrameCompressor::Stats UdpConnection::compression_stats() const {
+    std::lock_guard lock(mutex_);
+    FrameCompressor::Stats total;
+    for (const auto& stream : send_) {
+        if (!stream.compressor) continue;
+        const auto s = stream.compressor->stats();
+        total.frames += s.frames;
+        total.bytes_in += s.bytes_in;
+        total.bytes_out += s.bytes_out;
+    }
+    return total;
+}
+
+std::string UdpConnection::remote_address() const {
+    return remote_.address().to_string() + ":" +
+           std::to_string(remote_.port());
+}
+
+bool UdpConnection::is_open() const {
+    std::lock_guard lock(mutex_);
+    return !closed_;
+}
+
+UdpConnection::Stats UdpConnection::stats() const {
+    std::lock_guard lock(mutex_);
+    return {packets_sent_, packets_lost_, cc_.window(),
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                rtt_.smoothed())};
+}
+
+void UdpConnection::receive(uint64_t pn, const uint8_t* data,
+                            std::size_t len) {
+    PEERCHAT_TRACE_SCOPE_ARG("udp_receive", len);
+    struct StreamData {
+        std::size_t stream;
+        uint64_t offset;
+        std::string_view bytes;
+    };
+    std::vector<StreamData> frames;
+    RangeSet acked;
+    clock::duration ack_delay{0};
+    bool eliciting = false;
+
+    Reader r(data, len);
+    while (r.ok && !r.done()) {
+        switch (static_cast<FrameType>(r.u8())) {
+            case FrameType::Stream: {
+                const std::size_t stream = r.u8();
+                const uint64_t offset = r.u64();
+                const auto bytes = r.bytes(r.u16());
+                if (stream >= kPriorityClasses ||
+                    offset > std::numeric_limits<uint64_t>::max() / 2) {
+                    r.ok = false;
+                }
+                frames.push_back({stream, offset, bytes});
+                eliciting = true;
+                break;
+            }
+            case FrameType::Ack: {
+                ack_delay = std::chrono::microseconds(r.u16());
+                const auto count = r.u8();
+                for (unsigned i = 0; i < count && r.ok; ++i) {
+                    const uint64_t last = r.u64();
+                    const uint64_t first = r.u64();
+                    if (first > last) r.ok = false;
+                    acked.add(first, last + 1);
+                }
+                break;
+            }
+            case FrameType::Ping:
+                eliciting = true;
+                break;
+            case FrameType::Padding:
+                break;
+            default:
+                r.ok = false;
+        }
+    }
+    if (!r.ok) {
+        NetMetrics::get().parse_failures.inc();
+        return;
+    }
+
+    const auto now = clock::now();
+    bool bad_ack = false;
+    {
+        std::lock_guard lock(mutex_);
+        if (closed_) return;
+        bytes_received_ += kPacketHeader + len;
+        // Checked before anything else changes: it would have every
+        // packet in flight declared lost
+        if (!acked.empty() && !on_ack_locked(now, acked, ack_delay)) {
+            bad_ack = true;
+        }
+    }
+    if (bad_ack) {
+        NetMetrics::get().parse_failures.inc();
+        spdlog::warn("Dropping UDP connection: ACK for a packet never sent");
+        fail("acknowledged a packet never sent");
+        return;
+    }
+    {
+        std::lock_guard lock(mutex_);
+        if (closed_) return;
+        last_heard_ = now;
+        initiating_ = false;
+
+        const bool in_order =
+            received_.empty() ||
+            pn == std::prev(received_.ranges().end())->second;
+        const bool duplicate = received_.add(pn, pn + 1) == 0;
+        received_.keep_highest(kMaxAckRanges);
+        if (eliciting) {
+            if (unacked_++ == 0) oldest_unacked_ = now;
+            // Gaps and repeats are acknowledged at once, so the peer's
+            // loss detection doesn't wait on our ACK delay
+            if (unacked_ >= kAckEvery || !in_order || duplicate) {
+                ack_due_ = now;
+            } else {
+                ack_due_ = std::min(ack_due_, now + kMaxAckDelay);
+            }
+        }
+        flush_locked(now);
+        if (duplicate) return;
+    }
+
+    for (const auto& f : frames) {
+        if (!reassemble(f.stream, f.offset, f.bytes)) return;
+    }
+}
+
+void UdpConnection::peer_closed() { fail("connection closed by peer"); }
+
+bool UdpConnection::reassemble(std::size_t s, uint64_t offset,
+                               std::string_view bytes) {
+    auto& stream = recv_[s];
+    const uint64_t end = offset + bytes.size();
+    // Already passed on, or beyond what the sender may have outstanding
+    if (end <= stream.next || end > stream.next + kStreamWindow) return true;
+    if (offset > stream.next) {
+        add_pending(stream.pending, offset, bytes);
+        if (stream.pending.size() > kMaxPendingRuns) {
+            spdlog::warn("Dropping UDP connection: stream {} too fragmented",
+                         s);
+            return fail("too many gaps in a stream");
+        }
+        return true;
+    }
+
+    try {
+        auto feed = [&stream](std::string_view b, uint64_t at) {
+            const auto skip = stream.next - at;
+            stream.decoder.feed(
+                reinterpret_cast<const uint8_t*>(b.data()) + skip,
+                b.size() - skip);
+            stream.next = at + b.size();
+        };
+        feed(bytes, offset);
+        while (!stream.pending.empty() &&
+               stream.pending.begin()->first <= stream.next) {
+            auto node = stream.pending.extract(stream.pending.begin());
+            if (node.key() + node.mapped().size() > stream.next) {
+                feed(node.mapped(), node.key());
+            }
+        }
+        while (auto frame = stream.decoder.next_view()) {
+            if (!deliver(stream, *frame)) return false;
+        }
+    } catch (const std::exception& e) {
+        // The stream can't resync after a bad frame
+        NetMetrics::get().parse_failures.inc();
+        spdlog::warn("Dropping UDP connection: {}", e.what());
+        return fail(e.what());
+    }
+    return true;
+}
+
+bool UdpConnection::deliver(RecvStream& stream, std::string_view frame) {
+    std::string whole;
+    if (!frame.empty() &&
+        static_cast<uint8_t>(frame[0]) ==
+            static_cast<uint8_t>(FrameKind::Compressed)) {
+        if (!stream.decompressor) {
+            stream.decompressor = std::make_unique<FrameDecompressor>();
+        }
+        whole = stream.decompressor->decompress(
+            reinterpret_cast<const uint8_t*>(frame.data()), frame.size());
+        frame = whole;
+    }
+    {
+        std::lock_guard lock(mutex_);
+        if (closed_) return false;
+        if (!started_) {
+            early_.emplace_back(frame);
+            return true;
+        }
+    }
+    if (on_message_) on_message_(frame);
+    return true;
+}
+
+bool UdpConnection::fail(const std::string& reason) {
+    ErrorCallback on_error;
+    {
+        std::lock_guard lock(mutex_);
+        if (failed_ || closed_) return false;
+        failed_ = true;
+        std::vector<uint8_t> packet;
+        put_header(packet, PacketType::Close, id_, next_pn_++);
+        endpoint_->send_to(remote_, packet.data(), packet.size());
+        release_locked();
+        on_error = on_error_;
+    }
+    if (on_error) on_error(reason);
+    return false;
+}
+
+bool UdpConnection::on_ack_locked(clock::time_point now, const RangeSet& ranges,
+                                  clock::duration ack_delay) {
+    const uint64_t largest = std::prev(ranges.ranges().end())->second - 1;
+    if (largest >= next_pn_) return false;
+    bool acked_any = false;
+    for (const auto& [first, end] : ranges.ranges()) {
+        for (auto it = sent_.lower_bound(first);
+             it != sent_.end() && it->first < end;) {
+            const auto& p = it->second;
+            if (it->first == largest) rtt_.sample(now - p.sent, ack_delay);
+            cc_.on_acked(p.bytes, p.sent);
+            for (const auto& c : p.chunks) {
+                // A probe may resend bytes whose first copy was acked
+                // since; only what lies past `base` is news
+                auto& stream = send_[c.stream];
+                const uint64_t from = std::max(c.offset, stream.base);
+                const uint64_t to = c.offset + c.length;
+                if (from >= to) continue;
+                stream.acked.add(from, to);
+                stream.lost.remove(from, to);
+            }
+            acked_any = true;
+            it = sent_.erase(it);
+        }
+    }
+    if (!largest_acked_ || largest > *largest_acked_) largest_acked_ = largest;
+    if (!acked_any) return true;
+    pto_count_ = 0;
+    validated_ = true;
+
+    // Drop the acknowledged prefix of each stream. The buffer is only
+    // compacted once half of it is dead, to keep this linear overall.
+    for (auto& stream : send_) {
+        if (stream.acked.empty()) continue;
+        const auto [first, end] = *stream.acked.ranges().begin();
+        if (first > stream.base) continue;
+        stream.base = std::max(stream.base, end);
+        stream.acked.remove(first, end);
+        stream.lost.remove(0, end);
+        if ((stream.base - stream.start) * 2 >= stream.data.size()) {
+            stream.data.erase(0, stream.base - stream.start);
+            stream.start = stream.base;
+        }
+    }
+    detect_losses_locked(now);
+    return true;
+}
+
+UdpConnection::clock::duration UdpConnection::loss_delay_locked() const {
+    return std::max(std::max(rtt_.latest(), rtt_.smoothed()) * 9 / 8,
+                    RttEstimator::kGranularity);
+}
+
+void UdpConnection::detect_losses_locked(clock::time_point now) {
+    if (!largest_acked_) return;
+    const auto delay = loss_delay_locked();
+    for (auto it = sent_.begin();
+         it != sent_.end() && it->first < *largest_acked_;) {
+        if (*largest_acked_ - it->first >= kPacketThreshold ||
+            it->second.sent + delay <= now) {
+            const auto& p = it->second;
+            cc_.on_lost(p.bytes, p.sent, now);
+            for (const auto& c : p.chunks) requeue_locked(c);
+            ++packets_lost_;
+            NetMetrics::get().udp_packets_lost.inc();
+            it = sent_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void UdpConnection::requeue_locked(const Chunk& c) {
+    auto& stream = send_[c.stream];
+    const uint64_t first = std::max(c.offset, stream.base);
+    const uint64_t end = c.offset + c.length;
+    if (first >= end) return;
+    stream.lost.add(first, end);
+    for (const auto& [lo, hi] : stream.acked.ranges()) {
+        if (lo >= end) break;
+        stream.lost.remove(lo, hi);
+    }
+}
+
+bool UdpConnection::sendable_locked(const SendStream& stream) const {
+    return !stream.lost.empty() ||
+           (stream.next < stream.start + stream.data.size() &&
+            stream.next < stream.base + kStreamWindow);
+}
+
+void UdpConnection::flush_locked(clock::time_point now) {
+    if (closed_) return;
+
+    // Pace at 1.25 windows per round trip, in bursts of at most the
+    // initial window
+    const auto rtt = std::max<clock::duration>(rtt_.smoothed(), 1us);
+    const double rate = 1.25 * static_cast<double>(cc_.window()) /
+                        std::chrono::duration<double>(rtt).count();
+    pacing_tokens_ = std::min(
+        pacing_tokens_ +
+            rate * std::chrono::duration<double>(now - pacing_refill_).count(),
+        static_cast<double>(CongestionController::kInitialWindow));
+    pacing_refill_ = now;
+
+    std::vector<uint8_t> packet;
+    packet.reserve(kMaxDatagram);
+    while (!amplification_limited_locked() && build_locked(now, packet)) {
+        endpoint_->send_to(remote_, packet.data(), packet.size());
+        bytes_sent_ += packet.size();
+        packet.clear();
+    }
+
+    arm_timers_locked(now, rate);
+}
+
+bool UdpConnection::amplification_limited_locked() const {
+    return !validated_ && bytes_sent_ + kMaxDatagram > 3 * bytes_received_;
+}
+
+bool UdpConnection::build_locked(clock::time_point now,
+                                 std::vector<uint8_t>& packet) {
+    const bool has_data =
+        std::any_of(send_.begin(), send_.end(),
+                    [this](const auto& s) { return sendable_locked(s); });
+    const bool may_send =
+        probes_ > 0 ||
+        (cc_.can_send(kMaxDatagram) && pacing_tokens_ >= kMaxDatagram);
+    const bool send_data = has_data && may_send;
+    const bool send_ack = unacked_ > 0 && (now >= ack_due_ || send_data);
+    if (!send_data && !send_ack && probes_ == 0) return false;
+
+    const uint64_t pn = next_pn_++;
+    put_header(packet,
+               initiating_ ? PacketType::Initial : PacketType::Short, id_, pn);
+    if (unacked_ > 0) write_ack_locked(now, packet);
+
+    std::vector<Chunk> chunks;
+    if (send_data) {
+        // Streams fill the packet in priority order
+        for (std::size_t s = 0; s < kPriorityClasses; ++s) {
+            while (write_stream_locked(s, packet, chunks)) {
+            }
+        }
+    }
+    bool eliciting = !chunks.empty();
+    if (!eliciting && probes_ > 0) {
+        packet.push_back(static_cast<uint8_t>(FrameType::Ping));
+        eliciting = true;
+    }
+    if (initiating_) {
+        packet.resize(kMaxDatagram, static_cast<uint8_t>(FrameType::Padding));
+    }
+
+    ++packets_sent_;
+    if (eliciting) {
+        sent_.emplace(pn, SentPacket{now, packet.size(), std::move(chunks)});
+        cc_.on_sent(packet.size());
+        pacing_tokens_ -= static_cast<double>(packet.size());
+        if (probes_ > 0) --probes_;
+    }
+    return true;
+}
+
+void UdpConnection::write_ack_locked(clock::time_point now,
+                                     std::vector<uint8_t>& packet) {
+    // Held back since the oldest packet it newly covers arrived
+    const auto delay = std::chrono::duration_cast<std::chrono::microseconds>(
+        now - oldest_unacked_);
+    packet.push_back(static_cast<uint8_t>(FrameType::Ack));
+    put_u16(packet, static_cast<uint16_t>(std::clamp<int64_t>(
+                        delay.count(), 0, 0xffff)));
+    const auto& ranges = received_.ranges();
+    packet.push_back(static_cast<uint8_t>(ranges.size()));
+    for (auto it = ranges.rbegin(); it != ranges.rend(); ++it) {
+        put_u64(packet, it->second - 1);
+        put_u64(packet, it->first);
+    }
+    unacked_ = 0;
+    ack_due_ = clock::time_point::max();
+}
+
+bool UdpConnection::write_stream_locked(std::size_t s,
+                                        std::vector<uint8_t>& packet,
+                                        std::vector<Chunk>& chunks) {
+    if (packet.size() + kStreamFrameHeader >= kMaxDatagram) return false;
+    const std::size_t room = kMaxDatagram - packet.size() - kStreamFrameHeader;
+
+    auto& stream = send_[s];
+    uint64_t offset;
+    uint64_t length;
+    if (!stream.lost.empty()) {
+        const auto [first, end] = *stream.lost.ranges().begin();
+        offset = first;
+        length = std::min<uint64_t>(end - first, room);
+        stream.lost.remove(offset, offset + length);
+    } else {
+        const uint64_t limit =
+            std::min<uint64_t>(stream.start + stream.data.size(),
+                               stream.base + kStreamWindow);
+        if (stream.next >= limit) return false;
+        offset = stream.next;
+        length = std::min<uint64_t>(limit - offset, room);
+        stream.next += length;
+    }
+
+    packet.push_back(static_cast<uint8_t>(FrameType::Stream));
+    packet.push_back(static_cast<uint8_t>(s));
+    put_u64(packet, offset);
+    put_u16(packet, static_cast<uint16_t>(length));
+    const auto* bytes = reinterpret_cast<const uint8_t*>(stream.data.data()) +
+                        (offset - stream.start);
+    packet.insert(packet.end(), bytes, bytes + length);
+    chunks.push_back({static_cast<uint8_t>(s), offset,
+                      static_cast<uint32_t>(length)});
+    return true;
+}
+
+UdpConnection::clock::time_point UdpConnection::pto_deadline_locked() const {
+    const auto backoff = 1u << std::min(pto_count_, kMaxPtoBackoff);
+    return std::prev(sent_.end())->second.sent +
+           rtt_.pto(kMaxAckDelay) * backoff;
+}
+
+void UdpConnection::arm_timers_locked(clock::time_point now, double rate) {
+    auto self = std::static_pointer_cast<UdpConnection>(shared_from_this());
+
+    // Loss detection: the earliest packet that will count as lost by
+    // time, else the probe timeout
+    if (!sent_.empty()) {
+        auto deadline = pto_deadline_locked();
+        if (largest_acked_) {
+            const auto first = sent_.begin();
+            if (first->first < *largest_acked_) {
+                deadline = std::min(deadline,
+                                    first->second.sent + loss_delay_locked());
+            }
+        }
+        if (deadline != timer_deadline_) {
+            timer_deadline_ = deadline;
+            timer_.expires_at(deadline);
+            timer_.async_wait([this, self](asio::error_code ec) {
+                if (!ec) on_timer();
+            });
+        }
+    } else if (timer_deadline_ != clock::time_point::max()) {
+        timer_deadline_ = clock::time_point::max();
+        timer_.cancel();
+    }
+
+    // Held back by the amplification limit, an ACK waits for more from
+    // the peer rather than spinning on a timer already due
+    if (unacked_ > 0 && ack_due_ != clock::time_point::max() &&
+        ack_due_ != ack_deadline_ && !amplification_limited_locked()) {
+        ack_deadline_ = ack_due_;
+        ack_timer_.expires_at(ack_due_);
+        ack_timer_.async_wait([this, self](asio::error_code ec) {
+            if (!ec) on_flush_timer();
+        });
+    }
+
+    // Data held back by pacing alone goes out when the tokens are there
+    const bool has_data =
+        std::any_of(send_.begin(), send_.end(),
+                    [this](const auto& s) { return sendable_locked(s); });
+    if (!pacing_armed_ && has_data && cc_.can_send(kMaxDatagram) &&
+        pacing_tokens_ < kMaxDatagram) {
+        pacing_armed_ = true;
+        const auto wait = std::chrono::duration<double>(
+            (static_cast<double>(kMaxDatagram) - pacing_tokens_) / rate);
+        pacing_timer_.expires_at(
+            now + std::chrono::duration_cast<clock::duration>(wait));
+        pacing_timer_.async_wait([this, self](asio::error_code ec) {
+            {
+                std::lock_guard lock(mutex_);
+                pacing_armed_ = false;
+            }
+            if (!ec) on_flush_timer();
+        });
+    }
+}
+
+void UdpConnection::on_timer() {
+    std::lock_guard lock(mutex_);
+    if (closed_) return;
+    const auto now = clock::now();
+    timer_deadline_ = clock::time_point::max();
+
+    const auto lost_before = packets_lost_;
+    detect_losses_locked(now);
+    if (packets_lost_ == lost_before && !sent_.empty() &&
+        now >= pto_deadline_locked()) {
+        // Nothing acknowledged for a while: resend the oldest data, or
+        // ping, outside the window
+        ++pto_count_;
+        probes_ = 2;
+        for (const auto& c : sent_.begin()->second.chunks) requeue_locked(c);
+    }
+    flush_locked(now);
+}
+
+void UdpConnection::on_flush_timer() {
+    std::lock_guard lock(mutex_);
+    if (closed_) return;
+    ack_deadline_ = clock::time_point::max();
+    flush_locked(clock::now());
+}
+
+void UdpConnection::on_idle_timer() {
+    clock::time_point deadline;
+    {
+        std::lock_guard lock(mutex_);
+        if (closed_) return;
+        deadline = last_heard_ + endpoint_->config().idle_timeout;
+        if (clock::now() < deadline) {
+            auto self =
+                std::static_pointer_cast<UdpConnection>(shared_from_this());
+            idle_timer_.expires_at(deadline);
+            idle_timer_.async_wait([this, self](asio::error_code ec) {
+                if (!ec) on_idle_timer();
+            });
+            return;
+        }
+    }
+    fail("timed out");
+}
+
+// --- UdpEndpoint ---
+
+std::shared_ptr<UdpEndpoint> UdpEndpoint::create(asio::io_context& io,
+                                                 uint16_t port,
+                                                 ConnectCallback on_accept,
+                                                 UdpConfig config) {
+    std::shared_ptr<UdpEndpoint> endpoint(
+        new UdpEndpoint(io, port, std::move(on_accept), std::move(config)));
+    endpoint->do_receive();
+    return endpoint;
+}
+
+UdpEndpoint::UdpEndpoint(asio::io_context& io, uint16_t port,
+                         ConnectCallback on_accept, UdpConfig config)
+    : io_(io),
+      socket_(io, asio::ip::udp::endpoint(asio::ip::udp::v4(), port)),
+      on_accept_(std::move(on_accept)),
+      config_(std::move(config)),
+      rng_(config_.seed ? *config_.seed : std::random_device{}()) {
+    // A full send buffer drops the datagram, as the network would
+    socket_.non_blocking(true);
+    spdlog::info("Listening for UDP on port {}", this->port());
+}
+
+std::shared_ptr<UdpConnection> UdpEndpoint::connect(
+    const asio::ip::udp::endpoint& remote) {
+    std::lock_guard lock(mutex_);
+    uint32_t id;
+    do {
+        id = static_cast<uint32_t>(rng_());
+    } while (connections_.count({remote, id}));
+    auto conn =
+        std::make_shared<UdpConnection>(shared_from_this(), remote, id, true);
+    connections_[{remote, id}] = conn;
+    return conn;
+}
+
+void UdpEndpoint::stop() {
+    std::lock_guard lock(mutex_);
+    asio::error_code ec;
+    socket_.close(ec);
+}
+
+uint16_t UdpEndpoint::port() const {
+    return socket_.local_endpoint().port();
+}
+
+void UdpEndpoint::do_receive() {
+    auto self = shared_from_this();
+    socket_.async_receive_from(
+        asio::buffer(recv_buf_), sender_,
+        [this, self](asio::error_code ec, std::size_t len) {
+            if (ec == asio::error::operation_aborted) return;
+            if (!ec) {
+                NetMetrics::get().bytes_in.inc(len);
+                dispatch(len);
+            }
+            {
+                std::lock_guard lock(mutex_);
+                if (!socket_.is_open()) return;
+            }
+            // Errors here are reports about earlier sends (ICMP
+            // unreachable); the socket itself is fine
+            do_receive();
+        });
+}
+
+void UdpEndpoint::dispatch(std::size_t len) {
+    if (len < kPacketHeader) return;
+    Reader r(recv_buf_.data(), len);
+    const auto type = static_cast<PacketType>(r.u8());
+    const uint32_t id = r.u32();
+    const uint64_t pn = r.u64();
+    if (!r.ok || type < PacketType::Initial || type > PacketType::Close) {
+        return;
+    }
+
+    std::shared_ptr<UdpConnection> conn;
+    bool accepted = false;
+    {
+        std::lock_guard lock(mutex_);
+        const Key key{sender_, id};
+        if (auto it = connections_.find(key); it != connections_.end()) {
+            conn = it->second.lock();
+        }
+        // Only a packet that says it opens a connection may open one, so
+        // late packets of a closed connection don't resurrect it
+        if (!conn && type == PacketType::Initial && on_accept_) {
+            conn = std::make_shared<UdpConnection>(
+                shared_from_this(), sender_, id, false,
+                static_cast<uint32_t>(rng_()));
+            connections_[key] = conn;
+            accepted = true;
+        }
+    }
+    if (!conn) return;
+
+    if (accepted) {
+        spdlog::info("Accepted UDP connection from {}",
+                     conn->remote_address());
+        NetMetrics::get().connections_accepted.inc();
+        on_accept_(conn);
+    }
+    if (type == PacketType::Close) {
+        conn->peer_closed();
+    } else {
+        conn->receive(pn, r.position(), r.remaining());
+    }
+}
+
+void UdpEndpoint::send_to(const asio::ip::udp::endpoint& remote,
+                          const uint8_t* data, std::size_t len) {
+    std::lock_guard lock(mutex_);
+    if (config_.loss > 0.0 &&
+        std::uniform_real_distribution<double>(0.0, 1.0)(rng_) <
+            config_.loss) {
+        return;
+    }
+    asio::error_code ec;
+    socket_.send_to(asio::buffer(data, len), remote, 0, ec);
+    if (!ec) NetMetrics::get().bytes_out.inc(len);
+}
+
+void UdpEndpoint::forget(const Key& key) {
+    std::lock_guard lock(mutex_);
+    auto it = connections_.find(key);
+    if (it != connections_.end() && it->second.expired()) {
+        connections_.erase(it);
+    }
+}
+
+} // namespace peerchat
@@ -0,0 +1,111 @@
+#include "peerchat/write_scheduler.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace peerchat {
+
+namespace {
+
+// One fragment and its framing: the least a turn must be able to send
+constexpr std::size_t kQuantum = FrameEncoder::kHeaderSize +
+                                 kFragmentHeaderSize + kFragmentBytes;
+constexpr std::array<std::size_t, kPriorityClasses> kWeights{4, 2, 1};
+
+std::vector<uint8_t> compressed(FrameCompressor& compressor,
+                                const uint8_t* data, std::size_t len) {
+    return FrameEncoder::encode(compressor.compress(
+        std::string(reinterpret_cast<const char*>(data), len)));
+}
+
+} // namespace
+
+void WriteScheduler::push(Priority priority, const std::string& payload) {
+    queues_[static_cast<std::size_t>(priority)].push_back(
+        {FrameEncoder::encode(payload), 0, !is_binary_frame(payload)});
+    ++pending_;
+}
+
+void WriteScheduler::push_frame(Priority priority,
+                                std::vector<uint8_t> frame) {
+    queues_[static_cast<std::size_t>(priority)].push_back(
+        {std::move(frame), 0, false});
+    ++pending_;
+}
+
+std::optional<std::vector<uint8_t>> WriteScheduler::next(
+    FrameCompressor* compressor) {
+    if (pending_ == 0) return std::nullopt;
+    for (;;) {
+        auto& queue = queues_[turn_];
+        if (queue.empty()) {
+            deficit_[turn_] = 0;
+        } else if (auto cost = next_cost(queue.front());
+                   cost <= deficit_[turn_]) {
+            deficit_[turn_] -= cost;
+            return take(turn_, compressor);
+        }
+        turn_ = (turn_ + 1) % kPriorityClasses;
+        if (!queues_[turn_].empty()) {
+            deficit_[turn_] += kWeights[turn_] * kQuantum;
+        }
+    }
+}
+
+std::size_t WriteScheduler::next_cost(const Pending& p) const {
+    const auto len = p.frame.size() - FrameEncoder::kHeaderSize;
+    if (p.sent == 0 && (!fragment_ || len <= kFragmentBytes)) {
+        return p.frame.size();
+    }
+    return FrameEncoder::kHeaderSize + kFragmentHeaderSize +
+           std::min(kFragmentBytes, len - p.sent);
+}
+
+std::vector<uint8_t> WriteScheduler::take(std::size_t cls,
+                                          FrameCompressor* compressor) {
+    auto& head = queues_[cls].front();
+    const auto len = head.frame.size() - FrameEncoder::kHeaderSize;
+    const uint8_t* payload = head.frame.data() + FrameEncoder::kHeaderSize;
+    const bool compress = compressor && head.json;
+
+    if (head.sent == 0 && (!fragment_ || len <= kFragmentBytes)) {
+        std::vector<uint8_t> frame;
+        // Payloads close to the frame limit could outgrow it compressed
+        if (compress && len >= kCompressMinBytes &&
+            len + 512 <= kMaxFrameSize) {
+            frame = compressed(*compressor, payload, len);
+        } else {
+            frame = std::move(head.frame);
+        }
+        popped(cls);
+        return frame;
+    }
+
+    const auto n = std::min(kFragmentBytes, len - head.sent);
+    const bool last = head.sent + n == len;
+    std::vector<uint8_t> piece(FrameEncoder::kHeaderSize +
+                               kFragmentHeaderSize + n);
+    FrameEncoder::write_header(piece.data(), kFragmentHeaderSize + n);
+    uint8_t* out = piece.data() + FrameEncoder::kHeaderSize;
+    out[0] = static_cast<uint8_t>(FrameKind::Fragment);
+    out[1] = static_cast<uint8_t>(cls);
+    out[2] = last ? 1 : 0;
+    std::memcpy(out + kFragmentHeaderSize, payload + head.sent, n);
+    head.sent += n;
+
+    if (last) popped(cls);
+    if (compress) {
+        return compressed(*compressor, out, kFragmentHeaderSize + n);
+    }
+    return piece;
+}
+
+void WriteScheduler::popped(std::size_t cls) {
+    queues_[cls].pop_front();
+    if (--pending_ == 0) {
+        deficit_.fill(0);
+        turn_ = kIdleTurn;
+    }
+}
+
+} // namespace peerchat
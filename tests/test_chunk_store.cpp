@@ -0,0 +1,177 @@
+#include "peerchat/chunk_store.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+#include <gtest/gtest.h>
+
+using namespace peerchat;
+
+class ChunkStoreTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        dir_ = std::filesystem::temp_directory_path() / "peerchat_chunk_test";
+        std::filesystem::remove_all(dir_);
+    }
+
+    void TearDown() override { std::filesystem::remove_all(dir_); }
+
+    ChunkStoreConfig config(std::size_t memory_limit = 1024 * 1024) {
+        return {.directory = dir_, .memory_limit = memory_limit};
+    }
+
+    static std::vector<uint8_t> chunk(uint8_t fill, std::size_t len = 100) {
+        return std::vector<uint8_t>(len, fill);
+    }
+
+    static Sha256Digest hash_of(const std::vector<uint8_t>& data) {
+        return Sha256::hash(data.data(), data.size());
+    }
+
+    void put(ChunkStore& store, const std::vector<uint8_t>& data) {
+        store.put(hash_of(data), data.data(), data.size());
+    }
+
+    std::filesystem::path dir_;
+};
+
+TEST_F(ChunkStoreTest, PutAndGet) {
+    ChunkStore store(config());
+    auto a = chunk('a');
+    EXPECT_FALSE(store.contains(hash_of(a)));
+    EXPECT_FALSE(store.get(hash_of(a)));
+
+    put(store, a);
+    EXPECT_TRUE(store.contains(hash_of(a)));
+    EXPECT_EQ(store.get(hash_of(a)), a);
+    EXPECT_EQ(store.stats().memory_hits, 1u);
+    EXPECT_EQ(store.stats().misses, 1u);
+}
+
+TEST_F(ChunkStoreTest, LruEvictsColdChunksToDisk) {
+    ChunkStore store(config(250)); // room for two 100-byte chunks
+    auto a = chunk('a'), b = chunk('b'), c = chunk('c');
+    put(store, a);
+    put(store, b);
+    store.get(hash_of(a)); // a is now hotter than b
+    put(store, c);
+    EXPECT_EQ(store.memory_bytes(), 200u);
+
+    // b fell out of memory but is still on disk
+    EXPECT_EQ(store.get(hash_of(b)), b);
+    EXPECT_EQ(store.stats().disk_hits, 1u);
+    EXPECT_EQ(store.get(hash_of(a)), a);
+}
+
+TEST_F(ChunkStoreTest, MemoryOnlyWithoutDirectory) {
+    ChunkStore store({.directory = {}, .memory_limit = 150});
+    auto a = chunk('a'), b = chunk('b');
+    put(store, a);
+    put(store, b);
+    EXPECT_FALSE(store.contains(hash_of(a)));
+    EXPECT_EQ(store.get(hash_of(b)), b);
+    EXPECT_FALSE(std::filesystem::exists(dir_));
+}
+
+TEST_F(ChunkStoreTest, RefcountsAcrossFiles) {
+    ChunkStore store(config());
+    auto shared = chunk('s'), only1 = chunk('1'), only2 = chunk('2');
+    put(store, shared);
+    put(store, only1);
+
+    auto root1 = Sha256::hash("file1", 5);
+    auto root2 = Sha256::hash("file2", 5);
+    store.retain_file(root1,
+                      {hash_of(shared), hash_of(only1), hash_of(shared)});
+    // Chunks not fetched yet are held too
+    store.retain_file(root2, {hash_of(shared), hash_of(only2)});
+    store.retain_file(root2, {hash_of(shared), hash_of(only2)}); // no-op
+    EXPECT_EQ(store.refs(hash_of(shared)), 2u);
+    EXPECT_EQ(store.refs(hash_of(only1)), 1u);
+    EXPECT_EQ(store.refs(hash_of(only2)), 1u);
+
+    store.release_file(root1);
+    EXPECT_EQ(store.refs(hash_of(only1)), 0u);
+    EXPECT_EQ(store.refs(hash_of(shared)), 1u);
+
+    // Released chunks stay cached
+    store.release_file(root2);
+    EXPECT_EQ(store.refs(hash_of(shared)), 0u);
+    EXPECT_TRUE(store.contains(hash_of(shared)));
+    EXPECT_TRUE(store.contains(hash_of(only1)));
+}
+
+TEST_F(ChunkStoreTest, DiskLimitEvictsLeastRecentlyUsed) {
+    auto cfg = config();
+    cfg.disk_limit = 250; // room for two 100-byte chunks
+    ChunkStore store(cfg);
+    auto a = chunk('a'), b = chunk('b'), c = chunk('c');
+    put(store, a);
+    put(store, b);
+    store.get(hash_of(a)); // a is now hotter than b
+    put(store, c);
+
+    EXPECT_EQ(store.disk_bytes(), 200u);
+    EXPECT_EQ(store.stats().evicted, 1u);
+    EXPECT_FALSE(store.contains(hash_of(b)));
+    auto hex = to_hex(hash_of(b));
+    EXPECT_FALSE(std::filesystem::exists(dir_ / hex.substr(0, 2) / hex));
+    EXPECT_TRUE(store.contains(hash_of(a)));
+    EXPECT_TRUE(store.contains(hash_of(c)));
+}
+
+TEST_F(ChunkStoreTest, HeldChunksAreNotEvicted) {
+    auto cfg = config();
+    cfg.disk_limit = 250;
+    ChunkStore store(cfg);
+    auto a = chunk('a'), b = chunk('b'), c = chunk('c');
+    auto root = Sha256::hash("file", 4);
+    store.retain_file(root, {hash_of(a), hash_of(b), hash_of(c)});
+    put(store, a);
+    put(store, b);
+    put(store, c);
+    EXPECT_EQ(store.disk_bytes(), 300u);
+    EXPECT_TRUE(store.contains(hash_of(a)));
+
+    // Once the download ends the oldest goes
+    store.release_file(root);
+    EXPECT_EQ(store.disk_bytes(), 200u);
+    EXPECT_FALSE(store.contains(hash_of(a)));
+}
+
+TEST_F(ChunkStoreTest, ReloadKeepsChunksInRecencyOrder) {
+    auto a = chunk('a'), b = chunk('b');
+    {
+        ChunkStore store(config());
+        put(store, a);
+        put(store, b);
+    }
+    // Make a the older of the two on disk
+    auto hex = to_hex(hash_of(a));
+    std::filesystem::last_write_time(
+        dir_ / hex.substr(0, 2) / hex,
+        std::filesystem::file_time_type::clock::now() - std::chrono::hours(1));
+
+    auto cfg = config();
+    cfg.disk_limit = 150;
+    ChunkStore store(cfg);
+    EXPECT_FALSE(store.contains(hash_of(a)));
+    EXPECT_EQ(store.get(hash_of(b)), b);
+    EXPECT_EQ(store.stats().disk_hits, 1u);
+}
+
+TEST_F(ChunkStoreTest, CorruptDiskCopyIsDropped) {
+    auto a = chunk('a');
+    {
+        ChunkStore store(config());
+        put(store, a);
+    }
+    auto hex = to_hex(hash_of(a));
+    std::ofstream(dir_ / hex.substr(0, 2) / hex, std::ios::trunc) << "junk";
+
+    ChunkStore store(config());
+    EXPECT_TRUE(store.contains(hash_of(a)));
+    EXPECT_FALSE(store.get(hash_of(a)));
+    EXPECT_FALSE(store.contains(hash_of(a)));
+}
@@ -0,0 +1,79 @@
+#include "peerchat/compression.hpp"
+#include "peerchat/framing.hpp"
+#include "peerchat/message.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace peerchat;
+
+namespace {
+
+std::string decompress(FrameDecompressor& d, const std::string& payload) {
+    return d.decompress(reinterpret_cast<const uint8_t*>(payload.data()),
+                        payload.size());
+}
+
+std::vector<std::string> conversation(int count) {
+    const std::string alice = "6f1c2a4e-93b1-4c55-a1d7-0e2b9f8c3d41";
+    const std::string bob = "c08e7d12-5a3f-4b9e-8f60-71d4e2a9b5c7";
+    std::vector<std::string> out;
+    for (int i = 0; i < count; ++i) {
+        bool from_alice = i % 2 == 0;
+        auto text = Message::make_text(from_alice ? alice : bob,
+                                       from_alice ? "alice" : "bob",
+                                       from_alice ? "1234" : "8765",
+                                       "message number " + std::to_string(i));
+        out.push_back(text.serialize());
+        out.push_back(
+            Message::make_ack(from_alice ? bob : alice, text.id).serialize());
+    }
+    return out;
+}
+
+} // namespace
+
+TEST(CompressionTest, StreamRoundTrip) {
+    FrameCompressor c;
+    FrameDecompressor d;
+    for (const auto& frame : conversation(200)) {
+        auto packed = c.compress(frame);
+        ASSERT_EQ(static_cast<uint8_t>(packed[0]),
+                  static_cast<uint8_t>(FrameKind::Compressed));
+        EXPECT_EQ(decompress(d, packed), frame);
+    }
+    // Repeated keys and peer IDs should come close to vanishing
+    EXPECT_EQ(c.stats().frames, 400u);
+    EXPECT_LT(c.stats().bytes_out * 3, c.stats().bytes_in);
+}
+
+TEST(CompressionTest, DictionaryHelpsFirstFrame) {
+    FrameCompressor c;
+    auto first = Message::make_ping("6f1c2a4e-93b1-4c55-a1d7-0e2b9f8c3d41")
+                     .serialize();
+    // Two random UUIDs and a timestamp are all that's really new
+    auto packed = c.compress(first);
+    EXPECT_LT(packed.size() * 3, first.size() * 2);
+
+    FrameDecompressor d;
+    EXPECT_EQ(decompress(d, packed), first);
+}
+
+TEST(CompressionTest, CorruptFrameThrows) {
+    FrameCompressor c;
+    auto packed = c.compress(conversation(1)[0]);
+    for (std::size_t i = 1; i < packed.size(); ++i) packed[i] ^= 0x5A;
+
+    FrameDecompressor d;
+    EXPECT_THROW(decompress(d, packed), std::invalid_argument);
+    EXPECT_THROW(decompress(d, "{}"), std::invalid_argument);
+}
+
+TEST(CompressionTest, OversizedFrameThrows) {
+    // Compresses to a few bytes but inflates past the frame limit
+    FrameCompressor c;
+    auto packed = c.compress(std::string(kMaxFrameSize + 1, 'a'));
+    ASSERT_LT(packed.size(), 1024u);
+
+    FrameDecompressor d;
+    EXPECT_THROW(decompress(d, packed), std::invalid_argument);
+}
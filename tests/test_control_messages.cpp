@@ -0,0 +1,139 @@
+#include "peerchat/control_messages.hpp"
+#include "peerchat/message.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <new>
+
+#include <gtest/gtest.h>
+
+using namespace peerchat;
+
+namespace {
+
+// Counts heap allocations made on the test thread while armed
+thread_local bool g_counting = false;
+std::atomic<int> g_allocations{0};
+
+void set_env(const char* name, const char* value) {
+#ifdef _WIN32
+    _putenv_s(name, value);
+#else
+    setenv(name, value, 1);
+#endif
+}
+
+const char* home_var() {
+#ifdef _WIN32
+    return "USERPROFILE";
+#else
+    return "HOME";
+#endif
+}
+
+} // namespace
+
+// The default operator delete frees with std::free, matching this
+void* operator new(std::size_t size) {
+    if (g_counting) g_allocations.fetch_add(1);
+    if (void* p = std::malloc(size == 0 ? 1 : size)) return p;
+    throw std::bad_alloc();
+}
+
+class ControlSerializerTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        test_dir_ = std::filesystem::temp_directory_path() /
+                    "peerchat_control_test";
+        std::filesystem::create_directories(test_dir_);
+        const char* h = std::getenv(home_var());
+        original_home_ = h ? h : "";
+        set_env(home_var(), test_dir_.string().c_str());
+        identity_ = std::make_unique<Identity>("alice");
+    }
+
+    void TearDown() override {
+        identity_.reset();
+        std::filesystem::remove_all(test_dir_);
+        if (!original_home_.empty()) {
+            set_env(home_var(), original_home_.c_str());
+        }
+    }
+
+    // What the Message path produces for the same id and timestamp
+    static std::string reference(Message m, const std::string& rendered) {
+        auto parsed = Message::deserialize(rendered);
+        m.id = parsed.id;
+        m.timestamp = parsed.timestamp;
+        m.hlc = {m.timestamp, 0};
+        return m.serialize();
+    }
+
+    std::filesystem::path test_dir_;
+    std::string original_home_;
+    std::unique_ptr<Identity> identity_;
+};
+
+TEST_F(ControlSerializerTest, MatchesMessageSerialization) {
+    ControlSerializer control(*identity_, R"({"compression":["zstd/1"]})");
+    const auto& me = identity_->peer_id();
+    const int64_t ts = 1792400332180;
+
+    auto ping = control.ping(ts);
+    EXPECT_EQ(ping, reference(Message::make_ping(me), ping));
+    EXPECT_EQ(Message::deserialize(ping).timestamp, ts);
+
+    auto pong = control.pong(ts);
+    EXPECT_EQ(pong, reference(Message::make_pong(me), pong));
+
+    const std::string acked = "4b1e9c1a-0000-4000-8000-123456789abc";
+    auto ack = control.ack(acked, ts);
+    EXPECT_EQ(ack, reference(Message::make_ack(me, acked), ack));
+
+    auto hs = Message::make_handshake(me, "alice", identity_->tag());
+    hs.body = R"({"compression":["zstd/1"]})";
+    auto handshake = control.handshake(ts);
+    EXPECT_EQ(handshake, reference(hs, handshake));
+}
+
+TEST_F(ControlSerializerTest, FreshIdEachCall) {
+    ControlSerializer control(*identity_, "");
+    auto a = Message::deserialize(control.ping(1)).id;
+    auto b = Message::deserialize(control.ping(1)).id;
+    EXPECT_EQ(a.size(), 36u);
+    EXPECT_NE(a, b);
+}
+
+TEST_F(ControlSerializerTest, AckEscapesPeerSuppliedId) {
+    ControlSerializer control(*identity_, "");
+    const std::string odd = "quote\" slash\\ nl\n caf\xc3\xa9";
+    auto ack = control.ack(odd, 5);
+    EXPECT_EQ(Message::deserialize(ack).id, odd);
+    EXPECT_EQ(ack, reference(Message::make_ack(identity_->peer_id(), odd),
+                             ack));
+}
+
+TEST_F(ControlSerializerTest, HandshakeFollowsNicknameChange) {
+    ControlSerializer control(*identity_, "");
+    EXPECT_EQ(Message::deserialize(control.handshake(1)).nickname, "alice");
+    identity_->set_nickname("al\"ice");
+    EXPECT_EQ(Message::deserialize(control.handshake(2)).nickname, "al\"ice");
+}
+
+TEST_F(ControlSerializerTest, PingPongDoNotAllocate) {
+    ControlSerializer control(*identity_, "");
+    const std::string acked = "4b1e9c1a-0000-4000-8000-123456789abc";
+    control.ping(1792400332180); // grow the thread-local buffers
+    control.ack(acked, 1792400332180);
+
+    g_allocations = 0;
+    g_counting = true;
+    for (int i = 0; i < 100; ++i) {
+        control.ping(1792400332180 + i);
+        control.pong(1792400332180 + i);
+        control.ack(acked, 1792400332180);
+    }
+    g_counting = false;
+    EXPECT_EQ(g_allocations.load(), 0);
+}
@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+
+#if !defined(_WIN32)
+#include "peerchat/daemon.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace peerchat;
+using asio::local::stream_protocol;
+
+namespace {
+
+class DaemonTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        dir_ = std::filesystem::temp_directory_path() / "peerchat_daemon_test";
+        std::filesystem::create_directories(dir_);
+        path_ = dir_ / "control.sock";
+    }
+
+    void TearDown() override { std::filesystem::remove_all(dir_); }
+
+    // Blocking client for the control socket
+    struct Client {
+        asio::io_context io;
+        stream_protocol::socket socket{io};
+        asio::streambuf buf;
+
+        explicit Client(const std::filesystem::path& path) {
+            socket.connect(stream_protocol::endpoint(path.string()));
+        }
+
+        void write(const std::string& lines) {
+            asio::write(socket, asio::buffer(lines));
+        }
+
+        // Next event, or a null json at end of stream
+        nlohmann::json next() {
+            asio::error_code ec;
+            asio::read_until(socket, buf, '\n', ec);
+            if (ec) return nullptr;
+            std::istream is(&buf);
+            std::string line;
+            std::getline(is, line);
+            return nlohmann::json::parse(line);
+        }
+    };
+
+    std::filesystem::path dir_;
+    std::filesystem::path path_;
+};
+
+} // namespace
+
+TEST_F(DaemonTest, PipelinedCommandsRunInOrder) {
+    Daemon daemon(path_);
+    std::vector<std::string> sent;
+    bool quit_called = false;
+    daemon.on_text_input([&](const std::string& t) { sent.push_back(t); });
+    daemon.on_status_command([&] {
+        StatusReport report;
+        report.state = "Disconnected";
+        report.identity = "alice#0001";
+        daemon.display_status(report);
+    });
+    daemon.on_quit_command([&] { quit_called = true; });
+    std::thread runner([&] { daemon.run(); });
+
+    Client client(path_);
+    std::string batch;
+    for (int i = 0; i < 2000; ++i) {
+        batch += R"({"cmd":"send","text":"msg )" + std::to_string(i) + "\"}\n";
+    }
+    batch += R"({"cmd":"status","id":7})" "\n";
+    batch += R"({"cmd":"bogus"})" "\n";
+    batch += "not json\n";
+    batch += R"({"cmd":"quit","id":"q"})" "\n";
+    batch += R"({"cmd":"send","text":"after quit"})" "\n";
+    client.write(batch);
+
+    std::vector<nlohmann::json> events;
+    for (auto e = client.next(); !e.is_null(); e = client.next()) {
+        events.push_back(e);
+    }
+    runner.join();
+
+    ASSERT_EQ(sent.size(), 2000u);
+    EXPECT_EQ(sent.front(), "msg 0");
+    EXPECT_EQ(sent.back(), "msg 1999");
+    EXPECT_TRUE(quit_called);
+
+    // Only commands with an id, and failures, are answered, each once
+    ASSERT_EQ(events.size(), 4u);
+    EXPECT_EQ(events[0]["event"], "status");
+    EXPECT_EQ(events[0]["re"], 7);
+    EXPECT_EQ(events[0]["identity"], "alice#0001");
+    EXPECT_EQ(events[1]["event"], "error");
+    EXPECT_EQ(events[2]["event"], "error");
+    EXPECT_EQ(events[3]["event"], "ok");
+    EXPECT_EQ(events[3]["re"], "q");
+}
+
+TEST_F(DaemonTest, BroadcastsEventsFromOtherThreads) {
+    Daemon daemon(path_);
+    std::thread runner([&] { daemon.run(); });
+
+    Client a(path_);
+    Client b(path_);
+    // Round trips, so both clients are registered before the broadcast
+    a.write(R"({"cmd":"status","id":1})" "\n");
+    EXPECT_EQ(a.next()["event"], "ok");
+    b.write(R"({"cmd":"status","id":2})" "\n");
+    EXPECT_EQ(b.next()["event"], "ok");
+
+    std::thread network([&] {
+        daemon.display_message("bob#0002", "hello");
+        daemon.display_ack("4b1e9c1a");
+    });
+    network.join();
+
+    for (auto* c : {&a, &b}) {
+        auto msg = c->next();
+        EXPECT_EQ(msg["event"], "message");
+        EXPECT_EQ(msg["from"], "bob#0002");
+        EXPECT_EQ(msg["body"], "hello");
+        auto ack = c->next();
+        EXPECT_EQ(ack["event"], "ack");
+        EXPECT_EQ(ack["id"], "4b1e9c1a");
+    }
+
+    a.write(R"({"cmd":"quit"})" "\n");
+    runner.join();
+}
+
+TEST_F(DaemonTest, RefusesPathOfRunningDaemon) {
+    Daemon first(path_);
+    EXPECT_THROW(Daemon second(path_), std::runtime_error);
+}
+
+TEST_F(DaemonTest, ReplacesStaleSocket) {
+    { Daemon gone(path_); }
+    // A daemon that crashed leaves its socket file behind
+    {
+        asio::io_context io;
+        stream_protocol::acceptor stale(io, stream_protocol::endpoint(
+                                                path_.string()));
+    }
+    ASSERT_TRUE(std::filesystem::exists(path_));
+    Daemon daemon(path_);
+    EXPECT_TRUE(std::filesystem::exists(path_));
+}
+
+TEST_F(DaemonTest, LeavesOtherFilesAlone) {
+    std::ofstream(path_) << "not a socket";
+    EXPECT_THROW(Daemon daemon(path_), std::runtime_error);
+    EXPECT_TRUE(std::filesystem::is_regular_file(path_));
+}
+
+#endif
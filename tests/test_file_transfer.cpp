@@ -0,0 +1,349 @@
+#include "peerchat/chunk_store.hpp"
+#include "peerchat/file_transfer.hpp"
+#include "peerchat/framing.hpp"
+#include "peerchat/merkle.hpp"
+#include "peerchat/sha256.hpp"
+
+#include <gtest/gtest.h>
+
+#include <deque>
+#include <fstream>
+#include <random>
+
+using namespace peerchat;
+
+namespace fs = std::filesystem;
+
+TEST(Sha256Test, KnownVectors) {
+    EXPECT_EQ(to_hex(Sha256::hash("", 0)),
+              "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    EXPECT_EQ(to_hex(Sha256::hash("abc", 3)),
+              "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    std::string two_blocks =
+        "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    EXPECT_EQ(to_hex(Sha256::hash(two_blocks.data(), two_blocks.size())),
+              "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+}
+
+TEST(Sha256Test, IncrementalMatchesOneShot) {
+    std::string data(1000, 'a');
+    Sha256 h;
+    for (std::size_t i = 0; i < data.size(); i += 7) {
+        h.update(data.data() + i, std::min<std::size_t>(7, data.size() - i));
+    }
+    EXPECT_EQ(h.finish(), Sha256::hash(data.data(), data.size()));
+}
+
+TEST(Sha256Test, HexRoundTrip) {
+    auto d = Sha256::hash("abc", 3);
+    EXPECT_EQ(digest_from_hex(to_hex(d)), d);
+    EXPECT_THROW(digest_from_hex("abc"), std::invalid_argument);
+}
+
+TEST(MerkleTest, RootCoversEveryLeaf) {
+    std::vector<Sha256Digest> leaves;
+    for (int i = 0; i < 5; ++i) {
+        leaves.push_back(Sha256::hash(&i, sizeof(i)));
+    }
+    auto root = merkle_root(leaves);
+    EXPECT_EQ(merkle_root({leaves[0]}), leaves[0]);
+    for (auto& leaf : leaves) {
+        auto saved = leaf;
+        leaf[0] ^= 1;
+        EXPECT_NE(merkle_root(leaves), root);
+        leaf = saved;
+    }
+    EXPECT_EQ(merkle_root(leaves), root);
+}
+
+TEST(FileManifestTest, SerializeRoundTrip) {
+    FileManifest m;
+    m.root = Sha256::hash("x", 1);
+    m.name = "photo.jpg";
+    m.size = 100000;
+    auto back = FileManifest::deserialize(m.serialize());
+    EXPECT_EQ(back.root, m.root);
+    EXPECT_EQ(back.name, m.name);
+    EXPECT_EQ(back.size, m.size);
+    EXPECT_EQ(back.chunk_count(), 4u);
+    EXPECT_EQ(back.chunk_length(3), 100000u - 3 * kChunkSize);
+}
+
+TEST(FileManifestTest, RejectsForeignChunkSizes) {
+    FileManifest m;
+    m.root = Sha256::hash("x", 1);
+    m.name = "photo.jpg";
+    m.size = 100000;
+    for (uint32_t size : {1u, 4096u, kChunkSize / 2, kChunkSize * 2}) {
+        m.chunk_size = size;
+        EXPECT_THROW(FileManifest::deserialize(m.serialize()),
+                     std::invalid_argument)
+            << size;
+    }
+    m.chunk_size = kChunkSize;
+    m.size = 65ULL * 1024 * 1024 * 1024;
+    EXPECT_THROW(FileManifest::deserialize(m.serialize()),
+                 std::invalid_argument);
+}
+
+class FileTransferTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        dir_ = fs::temp_directory_path() / "peerchat_transfer_test";
+        fs::remove_all(dir_);
+        fs::create_directories(dir_ / "src");
+    }
+
+    void TearDown() override { fs::remove_all(dir_); }
+
+    fs::path write_file(const std::string& name, std::size_t size) {
+        std::mt19937 rng(static_cast<uint32_t>(size));
+        std::string data(size, '\0');
+        for (auto& c : data) c = static_cast<char>(rng());
+        return write_file(name, data);
+    }
+
+    fs::path write_file(const std::string& name, const std::string& data) {
+        auto path = dir_ / "src" / name;
+        std::ofstream(path, std::ios::binary) << data;
+        return path;
+    }
+
+    static std::string read_file(const fs::path& path) {
+        std::ifstream in(path, std::ios::binary);
+        return {std::istreambuf_iterator<char>(in), {}};
+    }
+
+    // Run frames between the two managers until both sides go quiet.
+    // `tamper` may modify each frame sent by the seeder.
+    void pump(TransferManager& seeder, TransferManager& leecher,
+              const std::function<void(std::vector<uint8_t>&)>& tamper = {}) {
+        std::deque<std::vector<uint8_t>> to_seeder, to_leecher;
+        FrameSender seeder_send = [&](std::vector<uint8_t> f) {
+            if (tamper) tamper(f);
+            to_leecher.push_back(std::move(f));
+        };
+        FrameSender leecher_send = [&](std::vector<uint8_t> f) {
+            to_seeder.push_back(std::move(f));
+        };
+        leecher.download(offered_, leecher_send);
+        while (!to_seeder.empty() || !to_leecher.empty()) {
+            if (!to_seeder.empty()) {
+                auto f = std::move(to_seeder.front());
+                to_seeder.pop_front();
+                seeder.handle_frame(f.data() + FrameEncoder::kHeaderSize,
+                                    f.size() - FrameEncoder::kHeaderSize,
+                                    seeder_send);
+            }
+            if (!to_leecher.empty()) {
+                auto f = std::move(to_leecher.front());
+                to_leecher.pop_front();
+                leecher.handle_frame(f.data() + FrameEncoder::kHeaderSize,
+                                     f.size() - FrameEncoder::kHeaderSize,
+                                     leecher_send);
+            }
+        }
+    }
+
+    fs::path dir_;
+    FileManifest offered_;
+};
+
+TEST_F(FileTransferTest, TransfersMultiBatchFile) {
+    // More chunks than one hash list frame holds
+    auto src = write_file("big.bin", kChunkSize * (kHashesPerFrame + 3) + 17);
+    TransferManager seeder("");
+    TransferManager leecher(dir_ / "dl", 4);
+    offered_ = seeder.share(src);
+
+    fs::path received;
+    leecher.on_complete([&](const FileManifest&, const fs::path& p,
+                            const TransferStats&) {
+        received = p;
+    });
+    pump(seeder, leecher);
+
+    ASSERT_EQ(received, dir_ / "dl" / "big.bin");
+    EXPECT_EQ(read_file(received), read_file(src));
+    EXPECT_FALSE(fs::exists(dir_ / "dl" / "big.bin.part"));
+}
+
+TEST_F(FileTransferTest, EmptyFile) {
+    auto src = write_file("empty.txt", 0);
+    TransferManager seeder("");
+    TransferManager leecher(dir_ / "dl");
+    offered_ = seeder.share(src);
+
+    bool done = false;
+    leecher.on_complete([&](const FileManifest&, const fs::path& p,
+                            const TransferStats&) {
+        done = true;
+        EXPECT_EQ(fs::file_size(p), 0u);
+    });
+    pump(seeder, leecher);
+    EXPECT_TRUE(done);
+}
+
+TEST_F(FileTransferTest, CorruptChunkIsRerequested) {
+    auto src = write_file("data.bin", kChunkSize * 5);
+    TransferManager seeder("");
+    TransferManager leecher(dir_ / "dl");
+    offered_ = seeder.share(src);
+
+    bool done = false;
+    leecher.on_complete([&](const FileManifest&, const fs::path&,
+                            const TransferStats&) {
+        done = true;
+    });
+    int corrupted = 0;
+    pump(seeder, leecher, [&](std::vector<uint8_t>& f) {
+        if (f[FrameEncoder::kHeaderSize] ==
+                static_cast<uint8_t>(FrameKind::Chunk) &&
+            corrupted < 3) {
+            f.back() ^= 0xFF;
+            ++corrupted;
+        }
+    });
+    EXPECT_EQ(corrupted, 3);
+    EXPECT_TRUE(done);
+    EXPECT_EQ(read_file(dir_ / "dl" / "data.bin"), read_file(src));
+}
+
+TEST_F(FileTransferTest, TamperedHashListFails) {
+    auto src = write_file("data.bin", kChunkSize * 3);
+    TransferManager seeder("");
+    TransferManager leecher(dir_ / "dl");
+    offered_ = seeder.share(src);
+
+    std::string error;
+    leecher.on_failed([&](const FileManifest&, const std::string& reason) {
+        error = reason;
+    });
+    pump(seeder, leecher, [](std::vector<uint8_t>& f) {
+        if (f[FrameEncoder::kHeaderSize] ==
+            static_cast<uint8_t>(FrameKind::HashList)) {
+            f.back() ^= 0x01;
+        }
+    });
+    EXPECT_NE(error.find("root"), std::string::npos);
+    EXPECT_FALSE(fs::exists(dir_ / "dl" / "data.bin"));
+    EXPECT_FALSE(fs::exists(dir_ / "dl" / "data.bin.part"));
+}
+
+TEST_F(FileTransferTest, CancelRemovesPartialFile) {
+    auto src = write_file("data.bin", kChunkSize * 3);
+    TransferManager seeder("");
+    TransferManager leecher(dir_ / "dl");
+    offered_ = seeder.share(src);
+
+    // The seeder never answers
+    leecher.download(offered_, [](std::vector<uint8_t>) {});
+    ASSERT_TRUE(fs::exists(dir_ / "dl" / "data.bin.part"));
+    leecher.cancel_downloads();
+    EXPECT_FALSE(fs::exists(dir_ / "dl" / "data.bin.part"));
+}
+
+TEST_F(FileTransferTest, PeerSuppliedNameCannotEscape) {
+    auto src = write_file("data.bin", 10);
+    TransferManager seeder("");
+    TransferManager leecher(dir_ / "dl");
+    offered_ = seeder.share(src);
+    offered_.name = "../../evil.bin";
+
+    fs::path received;
+    leecher.on_complete([&](const FileManifest&, const fs::path& p,
+                            const TransferStats&) {
+        received = p;
+    });
+    pump(seeder, leecher);
+    EXPECT_EQ(received, dir_ / "dl" / "evil.bin");
+
+    // A second copy gets a fresh name instead of overwriting
+    pump(seeder, leecher);
+    EXPECT_EQ(received, dir_ / "dl" / "evil (1).bin");
+}
+
+TEST_F(FileTransferTest, DeclinesOfferOverLimit) {
+    auto src = write_file("data.bin", 3 * kChunkSize);
+    TransferManager seeder("");
+    TransferManager leecher(dir_ / "dl");
+    leecher.set_max_download(2 * kChunkSize);
+    offered_ = seeder.share(src);
+
+    std::string error;
+    leecher.on_failed([&](const FileManifest&, const std::string& reason) {
+        error = reason;
+    });
+    pump(seeder, leecher);
+    EXPECT_NE(error.find("limit"), std::string::npos);
+    EXPECT_FALSE(fs::exists(dir_ / "dl" / "data.bin.part"));
+
+    // Nor does anything bigger than the disk get preallocated
+    error.clear();
+    leecher.set_max_download(UINT64_MAX);
+    offered_.size = UINT64_MAX / 2;
+    pump(seeder, leecher);
+    EXPECT_NE(error.find("disk space"), std::string::npos);
+    EXPECT_FALSE(fs::exists(dir_ / "dl" / "data.bin.part"));
+}
+
+TEST_F(FileTransferTest, MalformedFramesThrow) {
+    TransferManager mgr(dir_ / "dl");
+    FrameSender send = [](std::vector<uint8_t>) {};
+    uint8_t tiny[] = {0x01, 0x02};
+    EXPECT_THROW(mgr.handle_frame(tiny, sizeof(tiny), send),
+                 std::invalid_argument);
+    std::vector<uint8_t> unknown(40, 0);
+    unknown[0] = 0x7F;
+    EXPECT_THROW(mgr.handle_frame(unknown.data(), unknown.size(), send),
+                 std::invalid_argument);
+}
+
+TEST_F(FileTransferTest, SecondVersionFetchesOnlyChangedChunks) {
+    std::mt19937 rng(1);
+    std::string v1(kChunkSize * 8, '\0');
+    for (auto& c : v1) c = static_cast<char>(rng());
+    std::string v2 = v1;
+    v2[kChunkSize * 3 + 5] ^= 0x55; // one chunk differs
+
+    auto store = std::make_shared<ChunkStore>(
+        ChunkStoreConfig{.directory = dir_ / "chunks"});
+    TransferManager seeder("");
+    TransferManager leecher(dir_ / "dl", kDefaultRequestWindow, store);
+    TransferStats stats;
+    leecher.on_complete([&](const FileManifest&, const fs::path&,
+                            const TransferStats& s) { stats = s; });
+
+    offered_ = seeder.share(write_file("v1.bin", v1));
+    pump(seeder, leecher);
+    EXPECT_EQ(stats.bytes_fetched, v1.size());
+    EXPECT_EQ(stats.bytes_reused, 0u);
+
+    offered_ = seeder.share(write_file("v2.bin", v2));
+    pump(seeder, leecher);
+    EXPECT_EQ(stats.bytes_fetched, kChunkSize);
+    EXPECT_EQ(stats.bytes_reused, 7u * kChunkSize);
+    EXPECT_NEAR(stats.dedup_ratio(), 7.0 / 8, 1e-9);
+    EXPECT_EQ(read_file(dir_ / "dl" / "v2.bin"), v2);
+    // Finished downloads no longer hold their chunks
+    EXPECT_EQ(store->refs(Sha256::hash(
+                  reinterpret_cast<const uint8_t*>(v2.data()), kChunkSize)),
+              0u);
+}
+
+TEST_F(FileTransferTest, RepeatedChunksFetchedOnce) {
+    // Four identical zero chunks and a short distinct tail
+    std::string data(kChunkSize * 4, '\0');
+    data += "tail";
+    TransferManager seeder("");
+    TransferManager leecher(dir_ / "dl");
+    offered_ = seeder.share(write_file("sparse.bin", data));
+
+    TransferStats stats;
+    leecher.on_complete([&](const FileManifest&, const fs::path&,
+                            const TransferStats& s) { stats = s; });
+    pump(seeder, leecher);
+    EXPECT_EQ(stats.bytes_fetched, kChunkSize + 4u);
+    EXPECT_EQ(stats.bytes_reused, 3u * kChunkSize);
+    EXPECT_EQ(read_file(dir_ / "dl" / "sparse.bin"), data);
+}
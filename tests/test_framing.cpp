@@ -62,6 +62,28 @@ TEST(FramingTest, MultipleFrames) {
     EXPECT_FALSE(decoder.next().has_value());
 }
 
+TEST(FramingTest, ViewsPointIntoBuffer) {
+    auto f1 = FrameEncoder::encode("first");
+    auto f2 = FrameEncoder::encode("second");
+    std::vector<uint8_t> combined(f1);
+    combined.insert(combined.end(), f2.begin(), f2.end());
+
+    FrameDecoder decoder;
+    // The second frame is cut short and completed by the next feed
+    decoder.feed(combined.data(), combined.size() - 3);
+    auto v1 = decoder.next_view();
+    ASSERT_TRUE(v1.has_value());
+    EXPECT_EQ(*v1, "first");
+    EXPECT_FALSE(decoder.next_view().has_value());
+    EXPECT_EQ(decoder.buffered(), f2.size() - 3);
+
+    decoder.feed(combined.data() + combined.size() - 3, 3);
+    auto v2 = decoder.next_view();
+    ASSERT_TRUE(v2.has_value());
+    EXPECT_EQ(*v2, "second");
+    EXPECT_EQ(decoder.buffered(), 0u);
+}
+
 TEST(FramingTest, EmptyPayload) {
     auto frame = FrameEncoder::encode("");
     FrameDecoder decoder;
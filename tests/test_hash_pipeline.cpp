@@ -0,0 +1,135 @@
+#include "peerchat/hash_pipeline.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+#include <gtest/gtest.h>
+
+using namespace peerchat;
+
+namespace {
+
+std::vector<uint8_t> random_bytes(std::size_t len, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> out(len);
+    for (auto& b : out) b = static_cast<uint8_t>(rng());
+    return out;
+}
+
+// Restores automatic kernel selection after each test
+class Sha256KernelTest : public ::testing::Test {
+  protected:
+    void SetUp() override { saved_ = sha256_kernel(); }
+    void TearDown() override { sha256_set_kernel(saved_); }
+
+    Sha256Kernel saved_{};
+};
+
+} // namespace
+
+TEST_F(Sha256KernelTest, EveryKernelMatchesScalar) {
+    const std::size_t lengths[] = {0,  1,   55,  56,   63,   64,
+                                   65, 119, 120, 1000, 4096, 32768};
+    for (auto len : lengths) {
+        // Thirteen messages: one full group of eight plus a short one
+        std::vector<std::vector<uint8_t>> data;
+        std::vector<const uint8_t*> ptrs;
+        for (uint32_t i = 0; i < 13; ++i) {
+            data.push_back(random_bytes(len, static_cast<uint32_t>(len) + i));
+            ptrs.push_back(data.back().data());
+        }
+
+        sha256_set_kernel(Sha256Kernel::Scalar);
+        std::vector<Sha256Digest> expected(ptrs.size());
+        sha256_many(ptrs.data(), len, expected.data(), ptrs.size());
+
+        for (auto kernel : sha256_supported_kernels()) {
+            sha256_set_kernel(kernel);
+            for (std::size_t n = 1; n <= ptrs.size(); ++n) {
+                std::vector<Sha256Digest> got(n);
+                sha256_many(ptrs.data(), len, got.data(), n);
+                for (std::size_t i = 0; i < n; ++i) {
+                    EXPECT_EQ(got[i], expected[i])
+                        << sha256_kernel_name(kernel) << " len " << len
+                        << " n " << n << " i " << i;
+                }
+            }
+            EXPECT_EQ(Sha256::hash(ptrs[0], len), expected[0])
+                << sha256_kernel_name(kernel);
+        }
+    }
+}
+
+TEST_F(Sha256KernelTest, ScalarAlwaysSupported) {
+    auto kernels = sha256_supported_kernels();
+    ASSERT_FALSE(kernels.empty());
+    EXPECT_EQ(kernels.front(), Sha256Kernel::Scalar);
+    sha256_set_kernel(Sha256Kernel::Scalar);
+    EXPECT_EQ(sha256_kernel(), Sha256Kernel::Scalar);
+    EXPECT_EQ(to_hex(Sha256::hash("abc", 3)),
+              "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+}
+
+class HashPipelineTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        path_ = std::filesystem::temp_directory_path() /
+                "peerchat_hash_pipeline_test.bin";
+    }
+
+    void TearDown() override { std::filesystem::remove(path_); }
+
+    std::vector<uint8_t> write_file(std::size_t len) {
+        auto data = random_bytes(len, 42);
+        std::ofstream(path_, std::ios::binary)
+            .write(reinterpret_cast<const char*>(data.data()),
+                   static_cast<std::streamsize>(data.size()));
+        return data;
+    }
+
+    static std::vector<Sha256Digest> sequential(const std::vector<uint8_t>& data,
+                                                uint32_t chunk_size) {
+        std::vector<Sha256Digest> out;
+        for (std::size_t off = 0; off < data.size(); off += chunk_size) {
+            out.push_back(Sha256::hash(
+                data.data() + off, std::min<std::size_t>(chunk_size,
+                                                         data.size() - off)));
+        }
+        return out;
+    }
+
+    std::filesystem::path path_;
+};
+
+TEST_F(HashPipelineTest, MatchesSequentialHashing) {
+    // Several read batches, ending in a short chunk
+    const uint32_t chunk = 64 * 1024;
+    auto data = write_file(9 * 1024 * 1024 + 12345);
+    auto file = NativeFile::open(path_, NativeFile::Mode::Read);
+    auto expected = sequential(data, chunk);
+
+    for (std::size_t threads : {1, 3}) {
+        HashPipeline pipeline(threads);
+        EXPECT_EQ(pipeline.threads(), threads);
+        EXPECT_EQ(pipeline.hash_chunks(file, data.size(), chunk), expected);
+    }
+}
+
+TEST_F(HashPipelineTest, SmallAndEmptyFiles) {
+    HashPipeline pipeline(2);
+    auto data = write_file(1000);
+    auto file = NativeFile::open(path_, NativeFile::Mode::Read);
+    EXPECT_EQ(pipeline.hash_chunks(file, data.size(), 256),
+              sequential(data, 256));
+    EXPECT_TRUE(pipeline.hash_chunks(file, 0, 256).empty());
+}
+
+TEST_F(HashPipelineTest, ShortFileThrows) {
+    HashPipeline pipeline(2);
+    write_file(100 * 1024);
+    auto file = NativeFile::open(path_, NativeFile::Mode::Read);
+    EXPECT_THROW(pipeline.hash_chunks(file, 10 * 1024 * 1024, 1024),
+                 std::runtime_error);
+    EXPECT_THROW(pipeline.hash_chunks(file, 100, 0), std::invalid_argument);
+}
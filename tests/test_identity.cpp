@@ -110,6 +110,15 @@ TEST_F(IdentityTest, UniqueIds) {
     EXPECT_NE(id1, id2);
 }
 
+TEST_F(IdentityTest, EphemeralIsNotSaved) {
+    auto a = Identity::ephemeral("load");
+    auto b = Identity::ephemeral("load");
+    EXPECT_NE(a.peer_id(), b.peer_id());
+    EXPECT_EQ(a.nickname(), "load");
+    EXPECT_FALSE(
+        std::filesystem::exists(Identity::config_dir() / "identity.json"));
+}
+
 TEST_F(IdentityTest, DisplayNameFormat) {
     Identity id("alice");
     auto dn = id.display_name();
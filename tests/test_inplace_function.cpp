@@ -0,0 +1,48 @@
+#include "peerchat/inplace_function.hpp"
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include <gtest/gtest.h>
+
+using namespace peerchat;
+
+TEST(InplaceFunctionTest, CallsWithCapturedState) {
+    int total = 0;
+    InplaceFunction<void(std::string_view)> f =
+        [&total](std::string_view s) { total += static_cast<int>(s.size()); };
+    ASSERT_TRUE(f);
+    f("abc");
+    f(std::string("de"));
+    EXPECT_EQ(total, 5);
+
+    InplaceFunction<int(int, int)> add = [](int a, int b) { return a + b; };
+    EXPECT_EQ(add(2, 3), 5);
+}
+
+TEST(InplaceFunctionTest, MoveTransfersOwnership) {
+    auto token = std::make_shared<int>(7);
+    InplaceFunction<int()> a = [token] { return *token; };
+    EXPECT_EQ(token.use_count(), 2);
+
+    InplaceFunction<int()> b = std::move(a);
+    EXPECT_FALSE(a);
+    EXPECT_EQ(b(), 7);
+    EXPECT_EQ(token.use_count(), 2);
+
+    InplaceFunction<int()> c;
+    c = std::move(b);
+    EXPECT_EQ(c(), 7);
+    c = nullptr;
+    EXPECT_FALSE(c);
+    EXPECT_EQ(token.use_count(), 1);
+}
+
+TEST(InplaceFunctionTest, HoldsMoveOnlyCallables) {
+    auto owned = std::make_unique<std::string>("frame");
+    InplaceFunction<std::size_t()> f = [p = std::move(owned)] {
+        return p->size();
+    };
+    EXPECT_EQ(f(), 5u);
+}
@@ -0,0 +1,68 @@
+#include "peerchat/interned_string.hpp"
+#include "peerchat/message.hpp"
+
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace peerchat;
+
+TEST(InternedStringTest, EqualTextSharesStorage) {
+    InternedString a = "interned-alice";
+    InternedString b = std::string("interned-alice");
+    InternedString c = "interned-bob";
+    EXPECT_EQ(a, b);
+    EXPECT_EQ(&a.str(), &b.str());
+    EXPECT_NE(a, c);
+    EXPECT_EQ(a, "interned-alice");
+    EXPECT_LT(a, c);
+}
+
+TEST(InternedStringTest, EmptyNeedsNoEntry) {
+    auto before = InternedString::table_size();
+    InternedString e = "";
+    EXPECT_TRUE(e.empty());
+    EXPECT_EQ(e, InternedString());
+    EXPECT_EQ(e.str(), "");
+    EXPECT_EQ(InternedString::table_size(), before);
+}
+
+TEST(InternedStringTest, LastHandleFreesEntry) {
+    auto before = InternedString::table_size();
+    {
+        InternedString a = "interned-transient";
+        InternedString b = a;
+        InternedString c = std::move(b);
+        EXPECT_EQ(InternedString::table_size(), before + 1);
+        a = "interned-other";
+        EXPECT_EQ(InternedString::table_size(), before + 2);
+    }
+    EXPECT_EQ(InternedString::table_size(), before);
+}
+
+TEST(InternedStringTest, ConcurrentInterning) {
+    auto before = InternedString::table_size();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([] {
+            for (int i = 0; i < 2000; ++i) {
+                InternedString a = "interned-peer-" + std::to_string(i % 7);
+                InternedString b = a;
+                EXPECT_EQ(a, b);
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    EXPECT_EQ(InternedString::table_size(), before);
+}
+
+TEST(InternedStringTest, MessagesFromOnePeerShareFields) {
+    auto wire = Message::make_text("peer-42", "carol", "0042", "hi").serialize();
+    auto a = Message::deserialize(wire);
+    auto b = Message::deserialize(wire);
+    EXPECT_EQ(&a.sender.str(), &b.sender.str());
+    EXPECT_EQ(&a.nickname.str(), &b.nickname.str());
+    EXPECT_EQ(&a.tag.str(), &b.tag.str());
+    EXPECT_EQ(sizeof(a.sender), sizeof(void*));
+}
@@ -0,0 +1,59 @@
+#include "peerchat/logging.hpp"
+
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include <gtest/gtest.h>
+#include <spdlog/sinks/ostream_sink.h>
+#include <spdlog/spdlog.h>
+
+using namespace peerchat;
+
+namespace {
+
+// Points the default logger at a stream for the length of a test
+class CaptureLog {
+  public:
+    CaptureLog() : previous_(spdlog::default_logger()) {
+        auto sink = std::make_shared<spdlog::sinks::ostream_sink_mt>(out_);
+        sink->set_pattern("%v");
+        spdlog::set_default_logger(
+            std::make_shared<spdlog::logger>("capture", sink));
+    }
+    ~CaptureLog() { spdlog::set_default_logger(previous_); }
+
+    std::string text() const { return out_.str(); }
+
+  private:
+    std::ostringstream out_;
+    std::shared_ptr<spdlog::logger> previous_;
+};
+
+} // namespace
+
+TEST(LoggingTest, WritesEveryLineBeforeRestoring) {
+    CaptureLog capture;
+    auto sync = spdlog::default_logger();
+    {
+        AsyncLogging logging(LogConfig{.queue_size = 64,
+                                       .block_when_full = true});
+        EXPECT_NE(spdlog::default_logger(), sync);
+        for (int i = 0; i < 500; ++i) spdlog::info("line {}", i);
+        EXPECT_EQ(logging.dropped(), 0u);
+    }
+    EXPECT_EQ(spdlog::default_logger(), sync);
+    auto text = capture.text();
+    EXPECT_NE(text.find("line 0\n"), std::string::npos);
+    EXPECT_NE(text.find("line 499\n"), std::string::npos);
+}
+
+TEST(LoggingTest, LevelFiltersBeforeQueueing) {
+    CaptureLog capture;
+    {
+        AsyncLogging logging(LogConfig{.level = spdlog::level::warn});
+        spdlog::info("quiet");
+        spdlog::warn("loud");
+    }
+    EXPECT_EQ(capture.text(), "loud\n");
+}
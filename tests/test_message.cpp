@@ -1,4 +1,5 @@
 #include "peerchat/message.hpp"
+#include "peerchat/message_schema.hpp"
 
 #include <gtest/gtest.h>
 
@@ -15,6 +16,10 @@ TEST(MessageTest, TypeStringRoundtrip) {
     EXPECT_EQ(message_type_from_string("ping"), MessageType::Ping);
     EXPECT_EQ(message_type_to_string(MessageType::Pong), "pong");
     EXPECT_EQ(message_type_from_string("pong"), MessageType::Pong);
+    EXPECT_EQ(message_type_to_string(MessageType::Sync), "sync");
+    EXPECT_EQ(message_type_from_string("sync"), MessageType::Sync);
+    EXPECT_EQ(message_type_to_string(MessageType::FileOffer), "file_offer");
+    EXPECT_EQ(message_type_from_string("file_offer"), MessageType::FileOffer);
 }
 
 TEST(MessageTest, InvalidTypeThrows) {
@@ -92,3 +97,69 @@ TEST(MessageTest, JsonFieldsPresent) {
     EXPECT_EQ(j["type"], "text");
     EXPECT_EQ(j["tag"], "1530");
 }
+
+TEST(MessageTest, SerializeMatchesJsonDump) {
+    std::vector<Message> msgs = {
+        Message::make_text("peer-1", "alice", "1530", "hi"),
+        Message::make_text("peer-2", "b\"o\\b\n", "", "caf\xc3\xa9 \x01\t"),
+        Message::make_ack("peer-3", "not-a-uuid"),
+        Message::make_sync("peer-4", R"({"hashes":[1,2,3]})"),
+        Message::make_file_offer("peer-5", ""),
+    };
+    msgs[0].hlc = {-1, 4294967295u};
+    for (const auto& m : msgs) {
+        EXPECT_EQ(m.serialize(), m.to_json().dump());
+    }
+}
+
+TEST(MessageTest, SchemaLookupIsCompileTime) {
+    static_assert(kMessageTypeLookup.find("file_offer") ==
+                  static_cast<std::size_t>(MessageType::FileOffer));
+    static_assert(kMessageTypeLookup.find("texts") == kMessageTypeLookup.npos);
+    for (std::size_t i = 0; i < kMessageTypeCount; ++i) {
+        auto type = static_cast<MessageType>(i);
+        EXPECT_EQ(message_type_from_string(message_type_to_string(type)), type);
+    }
+    EXPECT_THROW(message_type_from_string(""), std::invalid_argument);
+}
+
+TEST(MessageTest, PerfectHashScalesPastTheSchema) {
+    std::vector<std::string> storage;
+    std::array<std::string_view, 300> names;
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        storage.push_back("rpc." + std::to_string(i * 7919));
+    }
+    for (std::size_t i = 0; i < names.size(); ++i) names[i] = storage[i];
+
+    PerfectHash<300> hash(names);
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        EXPECT_EQ(hash.find(names[i]), i);
+    }
+    EXPECT_EQ(hash.find("rpc.1"), hash.npos);
+}
+
+namespace {
+
+struct Recorder {
+    std::vector<MessageType> seen;
+    void any(const Message& m) { seen.push_back(m.type); }
+    void pong(const Message&) { seen.push_back(MessageType::Handshake); }
+};
+
+} // namespace
+
+TEST(MessageTest, DispatcherRoutesEachType) {
+    using Dispatcher = MessageDispatcher<
+        On<MessageType::Handshake, &Recorder::any>,
+        On<MessageType::Text, &Recorder::any>,
+        On<MessageType::Ack, &Recorder::any>,
+        On<MessageType::Ping, &Recorder::any>,
+        On<MessageType::Pong, &Recorder::pong>,
+        On<MessageType::Sync, &Recorder::any>,
+        On<MessageType::FileOffer, &Recorder::any>>;
+    Recorder r;
+    Dispatcher::dispatch(r, Message::make_text("p", "n", "t", "b"));
+    Dispatcher::dispatch(r, Message::make_pong("p"));
+    EXPECT_EQ(r.seen, (std::vector<MessageType>{MessageType::Text,
+                                                MessageType::Handshake}));
+}
@@ -0,0 +1,99 @@
+#include "peerchat/framing.hpp"
+#include "peerchat/metrics.hpp"
+
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace peerchat;
+
+TEST(MetricsTest, CounterSumsAcrossThreads) {
+    MetricsRegistry registry;
+    auto& counter = registry.counter("test_events_total", "Events");
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 10000; ++i) counter.inc();
+        });
+    }
+    for (auto& t : threads) t.join();
+    EXPECT_EQ(counter.value(), 80000u);
+}
+
+TEST(MetricsTest, RegistryReturnsSameMetricByName) {
+    MetricsRegistry registry;
+    auto& a = registry.counter("test_total", "A");
+    auto& b = registry.counter("test_total", "A");
+    EXPECT_EQ(&a, &b);
+    EXPECT_THROW(registry.gauge("test_total", "A"), std::logic_error);
+}
+
+TEST(MetricsTest, HistogramBucketsBoundRelativeError) {
+    for (uint64_t v : {0ull, 7ull, 8ull, 100ull, 12345ull, 1ull << 40,
+                       ~0ull}) {
+        auto i = Histogram::bucket_index(v);
+        ASSERT_LT(i, Histogram::kBuckets);
+        auto upper = Histogram::bucket_upper(i);
+        EXPECT_GE(upper, v);
+        EXPECT_LE(upper - v, v / 8) << v;
+        if (i > 0) {
+            EXPECT_LT(Histogram::bucket_upper(i - 1), v);
+        }
+    }
+}
+
+TEST(MetricsTest, HistogramQuantiles) {
+    Histogram h;
+    for (uint64_t us = 1; us <= 1000; ++us) h.record(us);
+    auto snap = h.snapshot();
+    EXPECT_EQ(snap.count, 1000u);
+    EXPECT_EQ(snap.sum, 500500u);
+    EXPECT_NEAR(static_cast<double>(snap.quantile(0.5)), 500.0, 500 / 8.0);
+    EXPECT_NEAR(static_cast<double>(snap.quantile(0.99)), 990.0, 990 / 8.0);
+    EXPECT_EQ(Histogram{}.snapshot().quantile(0.5), 0u);
+}
+
+TEST(MetricsTest, RendersPrometheusText) {
+    MetricsRegistry registry;
+    registry.counter("test_frames_total", "Frames").inc(3);
+    registry.gauge("test_depth", "Depth").set(-2);
+    registry.histogram("test_latency_seconds", "Latency")
+        .record(std::chrono::milliseconds(2));
+    auto text = registry.render_prometheus();
+    EXPECT_NE(text.find("# HELP test_frames_total Frames\n"
+                        "# TYPE test_frames_total counter\n"
+                        "test_frames_total 3\n"),
+              std::string::npos);
+    EXPECT_NE(text.find("test_depth -2\n"), std::string::npos);
+    EXPECT_NE(text.find("# TYPE test_latency_seconds summary\n"),
+              std::string::npos);
+    EXPECT_NE(text.find("test_latency_seconds{quantile=\"0.99\"} 0.002"),
+              std::string::npos);
+    EXPECT_NE(text.find("test_latency_seconds_sum 0.002\n"),
+              std::string::npos);
+    EXPECT_NE(text.find("test_latency_seconds_count 1\n"), std::string::npos);
+
+    auto summary = registry.summary();
+    ASSERT_EQ(summary.size(), 3u);
+    EXPECT_EQ(summary[0].first, "test_depth");
+    EXPECT_EQ(summary[2].first, "test_latency");
+}
+
+TEST(MetricsTest, FrameDecoderCountsFramesAndFailures) {
+    auto& metrics = NetMetrics::get();
+    auto frames = metrics.frames_in.value();
+    auto failures = metrics.parse_failures.value();
+
+    FrameDecoder decoder;
+    auto frame = FrameEncoder::encode("{}");
+    decoder.feed(frame.data(), frame.size());
+    ASSERT_TRUE(decoder.next());
+    EXPECT_EQ(metrics.frames_in.value(), frames + 1);
+
+    const uint8_t oversized[] = {0xFF, 0xFF, 0xFF, 0xFF};
+    decoder.feed(oversized, sizeof(oversized));
+    EXPECT_THROW(decoder.next(), std::length_error);
+    EXPECT_EQ(metrics.parse_failures.value(), failures + 1);
+}
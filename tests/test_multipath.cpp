@@ -0,0 +1,312 @@
+#include "peerchat/connection_manager.hpp"
+#include "peerchat/control_messages.hpp"
+#include "peerchat/identity.hpp"
+#include "peerchat/multipath.hpp"
+#include "peerchat/peer_manager.hpp"
+#include "peerchat/sim_network.hpp"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace peerchat;
+using namespace std::chrono_literals;
+
+namespace {
+
+std::string numbered(int seq) {
+    return R"({"seq":)" + std::to_string(seq) + "}";
+}
+
+// Everything one session delivers, in order
+struct Sink {
+    std::vector<std::string> messages;
+    std::string error;
+
+    void attach(const ConnectionPtr& conn) {
+        conn->start(
+            [this](std::string_view payload) {
+                messages.emplace_back(payload);
+            },
+            [this](const std::string& reason) { error = reason; });
+    }
+
+    // Data frames only
+    std::vector<std::string> data() const {
+        std::vector<std::string> result;
+        for (const auto& msg : messages) {
+            if (msg.starts_with(R"({"seq":)")) result.push_back(msg);
+        }
+        return result;
+    }
+};
+
+// A session from node 1 to node 2, whose paths are SimConnections
+// between different node pairs so each can have its own latency
+struct Sessions {
+    SimNetwork& net;
+    Identity id_a = Identity::ephemeral("alice");
+    Identity id_b = Identity::ephemeral("bob");
+    std::shared_ptr<MultipathConnection> a;
+    std::shared_ptr<MultipathConnection> b;
+    ConnectionManager manager;
+    std::vector<std::pair<ConnectionPtr, ConnectionPtr>> links;
+
+    explicit Sessions(SimNetwork& net)
+        : net(net),
+          a(std::make_shared<MultipathConnection>(net.io(),
+                                                  SessionToken{1, 2, 3}, true)),
+          manager(net.io(),
+                  [this](std::shared_ptr<MultipathConnection> session) {
+                      b = std::move(session);
+                  }) {}
+
+    // A path over nodes `from` -> `to`, with `latency` each way
+    void add_path(SimNetwork::NodeId from, SimNetwork::NodeId to,
+                  std::chrono::milliseconds latency, TransportKind kind) {
+        net.set_link(from, to, LinkConfig{.latency = latency});
+        auto link = net.connect(from, to);
+        a->add_path(link.first, kind);
+        manager.accept(link.second, kind);
+        links.push_back(link);
+    }
+};
+
+std::optional<uint8_t> active_path(const MultipathConnection& session) {
+    for (const auto& path : session.paths()) {
+        if (path.active) return path.id;
+    }
+    return std::nullopt;
+}
+
+} // namespace
+
+TEST(MultipathTest, MovesToFasterPathWithoutLosingOrder) {
+    asio::io_context io;
+    SimNetwork net(io);
+    Sessions s(net);
+    bool ready = false;
+    s.a->expect_paths(0, [&](auto) { ready = true; }, {});
+    s.add_path(1, 2, 40ms, TransportKind::Tcp);
+
+    Sink at_a;
+    Sink at_b;
+    at_a.attach(s.a);
+    ASSERT_TRUE(net.run_until([&] { return ready && s.b; }, 1s));
+    at_b.attach(s.b);
+    EXPECT_EQ(active_path(*s.a), 0);
+
+    // A better path comes up later
+    net.schedule(1s, [&] { s.add_path(3, 4, 5ms, TransportKind::Udp); });
+
+    // Traffic both ways throughout, one frame every 10 ms
+    constexpr int kFrames = 800;
+    for (int i = 0; i < kFrames; ++i) {
+        net.schedule(i * 10ms, [&, i] {
+            s.a->send(numbered(i));
+            if (s.b) s.b->send(numbered(i));
+        });
+    }
+    net.run_for(kFrames * 10ms + 1s);
+
+    EXPECT_EQ(active_path(*s.a), 1);
+    EXPECT_EQ(active_path(*s.b), 1);
+    const auto paths = s.a->paths();
+    ASSERT_EQ(paths.size(), 2u);
+    ASSERT_TRUE(paths[1].rtt);
+    EXPECT_LT(*paths[1].rtt, 20ms);
+    EXPECT_EQ(s.a->remote_address(), "udp://sim:4");
+
+    const auto got_b = at_b.data();
+    ASSERT_EQ(got_b.size(), static_cast<std::size_t>(kFrames));
+    for (int i = 0; i < kFrames; ++i) EXPECT_EQ(got_b[i], numbered(i));
+    const auto got_a = at_a.data();
+    ASSERT_EQ(got_a.size(), static_cast<std::size_t>(kFrames));
+    for (int i = 0; i < kFrames; ++i) EXPECT_EQ(got_a[i], numbered(i));
+}
+
+TEST(MultipathTest, FailsOverWhenActivePathDies) {
+    asio::io_context io;
+    SimNetwork net(io);
+    Sessions s(net);
+    bool ready = false;
+    s.a->expect_paths(0, [&](auto) { ready = true; }, {});
+    s.add_path(1, 2, 5ms, TransportKind::Tcp);
+    s.add_path(3, 4, 20ms, TransportKind::Udp);
+
+    Sink at_a;
+    Sink at_b;
+    at_a.attach(s.a);
+    ASSERT_TRUE(net.run_until([&] { return ready && s.b; }, 1s));
+    at_b.attach(s.b);
+    s.a->send(numbered(0));
+    net.run_for(1s);
+    ASSERT_EQ(active_path(*s.a), 0);
+
+    // The peer's end of the active path goes away
+    s.links[0].second->close();
+    net.run_for(100ms);
+    EXPECT_EQ(active_path(*s.a), 1);
+    EXPECT_TRUE(s.a->is_open());
+    EXPECT_TRUE(at_a.error.empty());
+
+    s.a->send(numbered(1));
+    s.b->send(numbered(2));
+    net.run_for(1s);
+    ASSERT_EQ(at_b.data().size(), 2u);
+    EXPECT_EQ(at_b.data()[1], numbered(1));
+    ASSERT_EQ(at_a.data().size(), 1u);
+    EXPECT_EQ(at_a.data()[0], numbered(2));
+
+    // And the session ends with its last path
+    s.links[1].second->close();
+    net.run_for(100ms);
+    EXPECT_FALSE(s.a->is_open());
+    EXPECT_FALSE(at_a.error.empty());
+}
+
+TEST(MultipathTest, HeartbeatsPassThroughAndProbesStayInside) {
+    asio::io_context io;
+    SimNetwork net(io);
+    Sessions s(net);
+    bool ready = false;
+    s.a->expect_paths(0, [&](auto) { ready = true; }, {});
+    s.add_path(1, 2, 5ms, TransportKind::Tcp);
+    s.add_path(3, 4, 10ms, TransportKind::Udp);
+
+    Sink at_a;
+    Sink at_b;
+    at_a.attach(s.a);
+    ASSERT_TRUE(net.run_until([&] { return ready && s.b; }, 1s));
+    at_b.attach(s.b);
+
+    // PeerManager's ping and pong are its own business
+    ControlSerializer control(s.id_a, "");
+    const std::string ping = control.ping(1);
+    const std::string pong = control.pong(2);
+    s.a->send(ping, Priority::Control);
+    s.b->send(pong, Priority::Control);
+    net.run_for(3s);
+    EXPECT_EQ(at_b.messages, std::vector<std::string>{ping});
+    EXPECT_EQ(at_a.messages, std::vector<std::string>{pong});
+
+    // Meanwhile both paths were measured
+    for (const auto& path : s.a->paths()) {
+        EXPECT_TRUE(path.rtt) << "path " << int{path.id};
+    }
+}
+
+TEST(MultipathTest, LegacyPeerGetsPlainPath) {
+    asio::io_context io;
+    SimNetwork net(io);
+    auto session =
+        std::make_shared<MultipathConnection>(io, SessionToken{}, true);
+    bool ready = false;
+    session->expect_paths(1, [&](auto) { ready = true; }, {});
+
+    // The peer never answers the Hello
+    auto [a, b] = net.connect(1, 2);
+    Sink peer;
+    peer.attach(b);
+    session->add_path(a, TransportKind::Tcp);
+    net.run_for(MultipathConnection::kHelloTimeout / 2);
+    EXPECT_FALSE(ready);
+    ASSERT_TRUE(net.run_until([&] { return ready; }, 1s));
+
+    Sink sink;
+    sink.attach(session);
+    session->send(numbered(1));
+    b->send(numbered(2));
+    net.run_for(100ms);
+    // Its first frame was the ignored Hello
+    ASSERT_EQ(peer.messages.size(), 2u);
+    EXPECT_EQ(peer.messages[1], numbered(1));
+    EXPECT_EQ(sink.data(), std::vector<std::string>{numbered(2)});
+}
+
+TEST(MultipathTest, AcceptsLegacyPeer) {
+    asio::io_context io;
+    SimNetwork net(io);
+    std::shared_ptr<MultipathConnection> session;
+    ConnectionManager manager(io, [&](auto s) { session = s; });
+
+    auto [a, b] = net.connect(1, 2);
+    manager.accept(b, TransportKind::Tcp);
+    a->send(numbered(1));
+    net.run_for(10ms);
+    ASSERT_NE(session, nullptr);
+
+    // Its first frame isn't lost to the routing
+    Sink sink;
+    sink.attach(session);
+    EXPECT_EQ(sink.data(), std::vector<std::string>{numbered(1)});
+    EXPECT_EQ(session->paths().size(), 1u);
+}
+
+TEST(MultipathTest, PeerManagersShakeHandsAcrossPaths) {
+    asio::io_context io;
+    SimNetwork net(io);
+    Sessions s(net);
+    PeerManager pa(io, s.id_a);
+    PeerManager pb(io, s.id_b);
+    std::vector<std::string> shown;
+    pb.on_display([&](const std::string&, const std::string& body) {
+        shown.push_back(body);
+    });
+
+    s.a->expect_paths(0, [&](auto session) {
+        pa.set_connection(session, true);
+    }, {});
+    s.add_path(1, 2, 30ms, TransportKind::Tcp);
+    ASSERT_TRUE(net.run_until([&] { return s.b != nullptr; }, 1s));
+    pb.set_connection(s.b, false);
+    ASSERT_TRUE(net.run_until(
+        [&] {
+            return pa.state() == PeerState::Connected &&
+                   pb.state() == PeerState::Connected;
+        },
+        2s));
+
+    s.add_path(3, 4, 2ms, TransportKind::Udp);
+    net.run_for(200ms);
+    for (int i = 0; i < 5; ++i) pa.send_text("before " + std::to_string(i));
+    ASSERT_TRUE(s.a->migrate(1));
+    for (int i = 0; i < 5; ++i) pa.send_text("after " + std::to_string(i));
+    net.run_for(1s);
+
+    ASSERT_EQ(shown.size(), 10u);
+    for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(shown[i], "before " + std::to_string(i));
+        EXPECT_EQ(shown[5 + i], "after " + std::to_string(i));
+    }
+    EXPECT_EQ(pa.state(), PeerState::Connected);
+}
+
+TEST(MultipathTest, DropsSessionHoldingTooMuch) {
+    asio::io_context io;
+    SimNetwork net(io);
+    Sessions s(net);
+    bool ready = false;
+    s.a->expect_paths(0, [&](auto) { ready = true; }, {});
+    s.add_path(1, 2, 5ms, TransportKind::Tcp);
+    s.add_path(3, 4, 5ms, TransportKind::Udp);
+
+    Sink at_b;
+    ASSERT_TRUE(net.run_until([&] { return ready && s.b; }, 1s));
+    at_b.attach(s.b);
+    s.a->send(numbered(0));
+    net.run_for(100ms);
+    ASSERT_EQ(at_b.data().size(), 1u);
+
+    // Frames on the other path, with no Moved marker to release them
+    const std::string frame(32 * 1024, 'x');
+    const auto frames = MultipathConnection::kMaxHeldBytes / frame.size() + 1;
+    for (std::size_t i = 0; i < frames; ++i) s.links[1].first->send(frame);
+    net.run_for(1s);
+    EXPECT_FALSE(s.b->is_open());
+    EXPECT_FALSE(at_b.error.empty());
+    EXPECT_EQ(at_b.data().size(), 1u);
+}
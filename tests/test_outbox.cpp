@@ -0,0 +1,165 @@
+#include "peerchat/outbox.hpp"
+
+#include <filesystem>
+
+#include <gtest/gtest.h>
+
+using namespace peerchat;
+
+class OutboxTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        dir_ = std::filesystem::temp_directory_path() / "peerchat_outbox_test";
+        std::filesystem::remove_all(dir_);
+    }
+
+    void TearDown() override { std::filesystem::remove_all(dir_); }
+
+    OutboxConfig config(std::size_t memory_limit, std::size_t quota) {
+        OutboxConfig c;
+        c.memory_limit = memory_limit;
+        c.max_per_peer = quota;
+        c.directory = dir_;
+        return c;
+    }
+
+    std::filesystem::path dir_;
+};
+
+TEST_F(OutboxTest, DrainReturnsMessagesInOrder) {
+    Outbox outbox(config(16, 100));
+    for (int i = 0; i < 5; ++i) {
+        EXPECT_TRUE(outbox.push("peer-a", "msg-" + std::to_string(i), 1000));
+    }
+    EXPECT_EQ(outbox.pending("peer-a"), 5u);
+
+    auto msgs = outbox.drain("peer-a", 1000);
+    ASSERT_EQ(msgs.size(), 5u);
+    for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(msgs[i], "msg-" + std::to_string(i));
+    }
+    EXPECT_EQ(outbox.pending("peer-a"), 0u);
+}
+
+TEST_F(OutboxTest, SpillsToDiskPastMemoryLimit) {
+    Outbox outbox(config(8, 1000));
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_TRUE(outbox.push("peer-a", "msg-" + std::to_string(i), 1000));
+    }
+    EXPECT_EQ(outbox.pending("peer-a"), 100u);
+    EXPECT_FALSE(std::filesystem::is_empty(dir_));
+
+    auto msgs = outbox.drain("peer-a", 1000);
+    ASSERT_EQ(msgs.size(), 100u);
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(msgs[i], "msg-" + std::to_string(i));
+    }
+    EXPECT_TRUE(std::filesystem::is_empty(dir_));
+}
+
+TEST_F(OutboxTest, SpilledMessagesSurviveRestart) {
+    {
+        Outbox outbox(config(4, 1000));
+        for (int i = 0; i < 20; ++i) {
+            outbox.push("peer-a", "msg-" + std::to_string(i), 1000);
+        }
+    }
+
+    // In-memory entries are lost, spilled ones are picked up again
+    Outbox outbox(config(4, 1000));
+    auto msgs = outbox.drain("peer-a", 1000);
+    ASSERT_FALSE(msgs.empty());
+    EXPECT_EQ(msgs.front(), "msg-0");
+}
+
+TEST_F(OutboxTest, PendingCountsSpillFilesFromLastRun) {
+    {
+        Outbox outbox(config(4, 1000));
+        for (int i = 0; i < 20; ++i) {
+            outbox.push("peer-a", "a", 1000);
+            outbox.push("../odd id", "b", 1000);
+        }
+    }
+
+    Outbox outbox(config(4, 1000));
+    auto odd = outbox.pending("../odd id");
+    EXPECT_GT(odd, 0u);
+    EXPECT_GT(outbox.pending("peer-a"), 0u);
+    EXPECT_EQ(outbox.total_pending(), outbox.pending("peer-a") + odd);
+    EXPECT_EQ(outbox.drain("../odd id", 1000).size(), odd);
+}
+
+TEST_F(OutboxTest, ExpireDropsSpilledMessages) {
+    auto c = config(4, 100);
+    c.ttl = std::chrono::seconds(60);
+    {
+        Outbox outbox(c);
+        for (int i = 0; i < 10; ++i) {
+            outbox.push("peer-a", "old", 0);
+        }
+        // The spill file ends up with five old entries and one fresh
+        for (int i = 0; i < 10; ++i) {
+            outbox.push("peer-b", i < 5 ? "old" : "fresh", i < 5 ? 0 : 50'000);
+        }
+    }
+
+    Outbox outbox(c);
+    auto spilled_a = outbox.pending("peer-a");
+    ASSERT_GT(spilled_a, 0u);
+    ASSERT_EQ(outbox.pending("peer-b"), 6u);
+
+    EXPECT_EQ(outbox.expire(100'000), spilled_a + 5);
+    EXPECT_EQ(outbox.pending("peer-a"), 0u);
+    EXPECT_FALSE(std::filesystem::exists(dir_ / "peer-a.outbox"));
+    EXPECT_EQ(outbox.pending("peer-b"), 1u);
+    EXPECT_EQ(outbox.drain("peer-b", 100'000),
+              std::vector<std::string>{"fresh"});
+}
+
+TEST_F(OutboxTest, QuotaRejectsNewMessages) {
+    Outbox outbox(config(4, 10));
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_TRUE(outbox.push("peer-a", "m", 1000));
+    }
+    EXPECT_FALSE(outbox.push("peer-a", "m", 1000));
+    // Quota is per peer
+    EXPECT_TRUE(outbox.push("peer-b", "m", 1000));
+}
+
+TEST_F(OutboxTest, ExpiredMessagesAreDropped) {
+    auto c = config(4, 100);
+    c.ttl = std::chrono::seconds(60);
+    Outbox outbox(c);
+
+    for (int i = 0; i < 10; ++i) {
+        outbox.push("peer-a", "old-" + std::to_string(i), 0);
+    }
+    outbox.push("peer-a", "fresh", 90'000);
+
+    auto msgs = outbox.drain("peer-a", 100'000);
+    ASSERT_EQ(msgs.size(), 1u);
+    EXPECT_EQ(msgs[0], "fresh");
+}
+
+TEST_F(OutboxTest, MemoryOnlyWithoutDirectory) {
+    OutboxConfig c;
+    c.memory_limit = 3;
+    Outbox outbox(c);
+    EXPECT_TRUE(outbox.push("peer-a", "1", 0));
+    EXPECT_TRUE(outbox.push("peer-a", "2", 0));
+    EXPECT_TRUE(outbox.push("peer-a", "3", 0));
+    EXPECT_FALSE(outbox.push("peer-a", "4", 0));
+    EXPECT_EQ(outbox.total_pending(), 3u);
+}
+
+TEST_F(OutboxTest, UnsafePeerIdStaysInsideDirectory) {
+    Outbox outbox(config(1, 100));
+    outbox.push("../../evil", "a", 0);
+    outbox.push("../../evil", "b", 0);
+    outbox.push("../../evil", "c", 0);
+
+    for (const auto& entry : std::filesystem::directory_iterator(dir_)) {
+        EXPECT_EQ(entry.path().parent_path(), dir_);
+    }
+    EXPECT_EQ(outbox.drain("../../evil", 0).size(), 3u);
+}
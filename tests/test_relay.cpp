@@ -0,0 +1,259 @@
+#include "peerchat/framing.hpp"
+#include "peerchat/relay.hpp"
+#include "peerchat/transport.hpp"
+
+#include <asio.hpp>
+#include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace peerchat;
+using namespace std::chrono_literals;
+
+namespace {
+
+std::string json_of(std::size_t size, int seq) {
+    return R"({"seq":)" + std::to_string(seq) + R"(,"body":")" +
+           std::string(size, 'x') + "\"}";
+}
+
+// Runs `io` on this thread until `done` or `limit`
+bool run_until(asio::io_context& io, const std::function<bool()>& done,
+               std::chrono::milliseconds limit = 5000ms) {
+    const auto deadline = std::chrono::steady_clock::now() + limit;
+    while (!done()) {
+        if (std::chrono::steady_clock::now() > deadline) return false;
+        io.restart();
+        io.run_for(5ms);
+    }
+    return true;
+}
+
+// A relay with bob registered, and alice's connection to bob through it
+struct Relayed {
+    asio::io_context io;
+    RelayServer relay;
+    RelayTransport bob_side;
+    RelayTransport alice_side;
+    ConnectionPtr alice;
+    ConnectionPtr bob;
+    std::vector<std::string> at_alice;
+    std::vector<std::string> at_bob;
+    std::string alice_error;
+
+    explicit Relayed(RelayConfig config)
+        : relay(io, 0, config),
+          bob_side(io, "127.0.0.1", relay.port(), "bob#0001"),
+          alice_side(io, "127.0.0.1", relay.port(), "alice#0002") {
+        bob_side.listen([this](ConnectionPtr conn) {
+            bob = conn;
+            conn->start(
+                [this](std::string_view json) { at_bob.emplace_back(json); },
+                [](const std::string&) {});
+        });
+    }
+
+    ~Relayed() {
+        bob_side.stop();
+        relay.stop();
+        io.restart();
+        io.poll();
+    }
+
+    bool dial(const std::string& name) {
+        if (!run_until(io, [&] { return !relay.names().empty(); })) {
+            return false;
+        }
+        alice_side.dial(
+            name, 0,
+            [this](ConnectionPtr conn) {
+                alice = conn;
+                conn->start(
+                    [this](std::string_view json) {
+                        at_alice.emplace_back(json);
+                    },
+                    [this](const std::string& reason) {
+                        alice_error = reason;
+                    });
+            },
+            [this](const std::string& reason) { alice_error = reason; });
+        return run_until(io, [&] { return alice != nullptr; });
+    }
+};
+
+void round_trip(RelayConfig config) {
+    Relayed r(config);
+    ASSERT_TRUE(r.dial("bob#0001"));
+
+    for (int i = 0; i < 50; ++i) r.alice->send(json_of(1000 * i, i));
+    ASSERT_TRUE(run_until(r.io, [&] {
+        return r.at_bob.size() == 50u && r.bob != nullptr;
+    }));
+    for (int i = 0; i < 50; ++i) EXPECT_EQ(r.at_bob[i], json_of(1000 * i, i));
+    r.bob->send(json_of(10, 99));
+    ASSERT_TRUE(run_until(r.io, [&] { return r.at_alice.size() == 1u; }));
+    EXPECT_EQ(r.at_alice[0], json_of(10, 99));
+
+    // Every byte of both streams, length prefixes included
+    const auto sessions = r.relay.sessions();
+    ASSERT_EQ(sessions.size(), 1u);
+    EXPECT_EQ(sessions[0].name, "bob#0001");
+    uint64_t sent = 0;
+    for (int i = 0; i < 50; ++i) sent += 4 + json_of(1000 * i, i).size();
+    EXPECT_EQ(sessions[0].bytes_to_peer, sent);
+    EXPECT_EQ(sessions[0].bytes_from_peer, 4 + json_of(10, 99).size());
+
+    // Closing one end closes the other
+    r.bob->close();
+    ASSERT_TRUE(run_until(r.io, [&] { return !r.alice_error.empty(); }));
+    EXPECT_TRUE(r.relay.sessions().empty());
+    EXPECT_EQ(r.relay.bytes_forwarded(), sent + 4 + json_of(10, 99).size());
+}
+
+} // namespace
+
+TEST(RelayTest, ForwardsWithSplice) {
+    round_trip(RelayConfig{.splice = true});
+}
+
+TEST(RelayTest, ForwardsThroughBuffer) {
+    round_trip(RelayConfig{.splice = false});
+}
+
+TEST(RelayTest, UnknownNameIsRefused) {
+    Relayed r(RelayConfig{});
+    ASSERT_TRUE(r.dial("carol#0003"));
+    ASSERT_TRUE(run_until(r.io, [&] { return !r.alice_error.empty(); }));
+    EXPECT_TRUE(r.relay.sessions().empty());
+}
+
+TEST(RelayTest, CapsSessionBandwidth) {
+    // 1 MB/s, so 600 KB past the 64 KiB burst takes over half a second
+    Relayed r(RelayConfig{.bandwidth_bps = 8'000'000});
+    ASSERT_TRUE(r.dial("bob#0001"));
+
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 20; ++i) r.alice->send(json_of(30'000, i));
+    ASSERT_TRUE(run_until(r.io, [&] { return r.at_bob.size() == 20u; }));
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_GE(elapsed, 450ms);
+    EXPECT_LT(elapsed, 2s);
+}
+
+TEST(RelayTest, NameStaysWithFirstHolder) {
+    Relayed r(RelayConfig{});
+    ASSERT_TRUE(run_until(r.io, [&] { return !r.relay.names().empty(); }));
+
+    // Someone else claims bob's name while bob is still registered
+    RelayTransport impostor(r.io, "127.0.0.1", r.relay.port(), "bob#0001");
+    bool stolen = false;
+    impostor.listen([&](ConnectionPtr conn) {
+        stolen = true;
+        conn->close();
+    });
+    run_until(r.io, [] { return false; }, 100ms);
+
+    ASSERT_TRUE(r.dial("bob#0001"));
+    ASSERT_TRUE(run_until(r.io, [&] { return r.bob != nullptr; }));
+    EXPECT_FALSE(stolen);
+    impostor.stop();
+}
+
+TEST(RelayTest, DropsConnectionsThatNeverSetUp) {
+    asio::io_context io;
+    RelayServer relay(io, 0, RelayConfig{.setup_timeout = 100ms});
+    asio::ip::tcp::socket silent(io);
+    silent.connect({asio::ip::make_address("127.0.0.1"), relay.port()});
+
+    std::array<char, 16> buf{};
+    asio::error_code read_ec;
+    bool closed = false;
+    silent.async_read_some(asio::buffer(buf),
+                           [&](asio::error_code ec, std::size_t) {
+                               read_ec = ec;
+                               closed = true;
+                           });
+    const auto start = std::chrono::steady_clock::now();
+    ASSERT_TRUE(run_until(io, [&] { return closed; }));
+    EXPECT_EQ(read_ec, asio::error::eof);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, 90ms);
+}
+
+TEST(RelayTest, StopReleasesConnectionsInSetup) {
+    asio::io_context io;
+    RelayServer relay(io, 0);
+    asio::ip::tcp::socket silent(io);
+    silent.connect({asio::ip::make_address("127.0.0.1"), relay.port()});
+    // Let the relay accept it and start waiting for its setup frame
+    run_until(io, [] { return false; }, 50ms);
+
+    relay.stop();
+    silent.close();
+    io.restart();
+    io.run_for(1s);
+    EXPECT_TRUE(io.stopped());
+}
+
+TEST(RelayTest, OnlyTheListenersHostJoins) {
+    asio::io_context io;
+    RelayServer relay(io, 0);
+    const asio::ip::tcp::endpoint at(asio::ip::make_address("127.0.0.1"),
+                                     relay.port());
+    // Raw sockets on their own context: the test reads them without
+    // blocking while `io` runs the relay
+    asio::io_context raw;
+    auto open = [&](const char* host) {
+        asio::ip::tcp::socket s(raw);
+        s.open(asio::ip::tcp::v4());
+        s.bind({asio::ip::make_address(host), 0});
+        s.connect(at);
+        s.non_blocking(true);
+        return s;
+    };
+    auto write = [](asio::ip::tcp::socket& s, RelayOp op,
+                    const std::string& arg) {
+        asio::write(s, asio::buffer(relay_frame(op, arg)));
+    };
+
+    auto carol = open("127.0.0.1");
+    write(carol, RelayOp::Listen, "carol#0003");
+    ASSERT_TRUE(run_until(io, [&] { return !relay.names().empty(); }));
+    auto alice = open("127.0.0.1");
+    write(alice, RelayOp::Connect, "carol#0003");
+
+    FrameDecoder decoder;
+    std::optional<std::string> incoming;
+    ASSERT_TRUE(run_until(io, [&] {
+        std::array<uint8_t, 256> buf{};
+        asio::error_code ec;
+        const auto n = carol.read_some(asio::buffer(buf), ec);
+        if (!ec) decoder.feed(buf.data(), n);
+        incoming = decoder.next();
+        return incoming.has_value();
+    }));
+    const auto key =
+        nlohmann::json::parse(*incoming).at("key").get<std::string>();
+
+    // The key alone doesn't admit a host other than carol's
+    auto intruder = open("127.0.0.2");
+    write(intruder, RelayOp::Accept, key);
+    ASSERT_TRUE(run_until(io, [&] {
+        std::array<uint8_t, 16> buf{};
+        asio::error_code ec;
+        intruder.read_some(asio::buffer(buf), ec);
+        return ec == asio::error::eof;
+    }));
+    EXPECT_TRUE(relay.sessions().empty());
+
+    auto joiner = open("127.0.0.1");
+    write(joiner, RelayOp::Accept, key);
+    ASSERT_TRUE(run_until(io, [&] { return relay.sessions().size() == 1u; }));
+    relay.stop();
+}
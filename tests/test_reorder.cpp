@@ -0,0 +1,141 @@
+#include "peerchat/clock.hpp"
+#include "peerchat/message.hpp"
+#include "peerchat/reorder_buffer.hpp"
+
+#include <gtest/gtest.h>
+
+#include <limits>
+
+using namespace peerchat;
+
+namespace {
+
+Message text_at(int64_t wall, uint32_t logical, const std::string& body) {
+    auto m = Message::make_text("peer-1", "alice", "0000", body);
+    m.hlc = {wall, logical};
+    return m;
+}
+
+std::vector<std::string> bodies(const std::vector<Message>& msgs) {
+    std::vector<std::string> out;
+    for (const auto& m : msgs) out.push_back(m.body);
+    return out;
+}
+
+} // namespace
+
+TEST(HybridClockTest, MonotonicWithFrozenWallClock) {
+    HybridClock clock([] { return int64_t{1000}; });
+    auto a = clock.now();
+    auto b = clock.now();
+    EXPECT_EQ(a.wall_ms, 1000);
+    EXPECT_LT(a, b);
+    EXPECT_EQ(b.logical, a.logical + 1);
+}
+
+TEST(HybridClockTest, UpdateMovesPastRemote) {
+    HybridClock clock([] { return int64_t{1000}; });
+    auto recv = clock.update({5000, 7});
+    EXPECT_EQ(recv.wall_ms, 5000);
+    EXPECT_EQ(recv.logical, 8u);
+
+    // Later local events stay ahead of the remote timestamp even though
+    // our wall clock is behind
+    auto next = clock.now();
+    EXPECT_GT(next, recv);
+}
+
+TEST(HybridClockTest, IgnoresRemoteBeyondMaxDrift) {
+    HybridClock clock([] { return int64_t{1000}; });
+    auto recv = clock.update({1000 + HybridClock::kMaxDriftMs + 1, 0});
+    EXPECT_EQ(recv.wall_ms, 1000);
+}
+
+TEST(HybridClockTest, SpentCounterMovesToNextMillisecond) {
+    HybridClock clock([] { return int64_t{1000}; });
+    const HlcTimestamp remote{5000, std::numeric_limits<uint32_t>::max()};
+    auto recv = clock.update(remote);
+    EXPECT_GT(recv, remote);
+    EXPECT_EQ(recv.wall_ms, 5001);
+    EXPECT_EQ(recv.logical, 0u);
+    EXPECT_GT(clock.now(), recv);
+}
+
+TEST(HybridClockTest, ExtremeRemoteWallClocks) {
+    HybridClock clock([] { return int64_t{1000}; });
+    auto ahead = clock.update({std::numeric_limits<int64_t>::max(), 0});
+    EXPECT_EQ(ahead.wall_ms, 1000);
+    auto behind = clock.update({std::numeric_limits<int64_t>::min(), 0});
+    EXPECT_EQ(behind.wall_ms, 1000);
+    EXPECT_GT(behind, ahead);
+}
+
+TEST(MessageHlcTest, SerializationRoundtrip) {
+    auto m = text_at(123456, 42, "hi");
+    auto restored = Message::deserialize(m.serialize());
+    EXPECT_EQ(restored.hlc, m.hlc);
+}
+
+TEST(MessageHlcTest, MissingHlcFallsBackToTimestamp) {
+    auto j = Message::make_text("peer-1", "alice", "0000", "hi").to_json();
+    j.erase("hlc");
+    auto m = Message::from_json(j);
+    EXPECT_EQ(m.hlc.wall_ms, m.timestamp);
+    EXPECT_EQ(m.hlc.logical, 0u);
+}
+
+TEST(ReorderBufferTest, HoldsUntilWindowElapses) {
+    ReorderBuffer buf(std::chrono::milliseconds(100));
+    buf.push(text_at(10, 0, "a"), 0);
+
+    std::vector<Message> out;
+    buf.release(50, out);
+    EXPECT_TRUE(out.empty());
+    ASSERT_TRUE(buf.next_deadline().has_value());
+    EXPECT_EQ(*buf.next_deadline(), 100);
+
+    buf.release(100, out);
+    ASSERT_EQ(out.size(), 1u);
+    EXPECT_TRUE(buf.empty());
+}
+
+TEST(ReorderBufferTest, ReleasesInCausalOrder) {
+    ReorderBuffer buf(std::chrono::milliseconds(100));
+    buf.push(text_at(30, 0, "c"), 0);
+    buf.push(text_at(10, 0, "a"), 10);
+    buf.push(text_at(20, 1, "b2"), 20);
+    buf.push(text_at(20, 0, "b1"), 30);
+
+    std::vector<Message> out;
+    buf.release(200, out);
+    EXPECT_EQ(bodies(out), (std::vector<std::string>{"a", "b1", "b2", "c"}));
+}
+
+TEST(ReorderBufferTest, LateHeadBlocksLaterMessages) {
+    ReorderBuffer buf(std::chrono::milliseconds(100));
+    buf.push(text_at(50, 0, "late"), 0);
+    buf.push(text_at(10, 0, "early"), 90);
+
+    // "late" has waited long enough but "early" sorts first and hasn't
+    std::vector<Message> out;
+    buf.release(120, out);
+    EXPECT_TRUE(out.empty());
+
+    buf.release(190, out);
+    EXPECT_EQ(bodies(out), (std::vector<std::string>{"early", "late"}));
+}
+
+TEST(ReorderBufferTest, CapacityForcesEarlyRelease) {
+    ReorderBuffer buf(std::chrono::milliseconds(1000), 2);
+    buf.push(text_at(3, 0, "c"), 0);
+    buf.push(text_at(1, 0, "a"), 0);
+    buf.push(text_at(2, 0, "b"), 0);
+
+    std::vector<Message> out;
+    buf.release(0, out);
+    EXPECT_EQ(bodies(out), (std::vector<std::string>{"a"}));
+    EXPECT_EQ(buf.size(), 2u);
+
+    buf.flush(out);
+    EXPECT_EQ(bodies(out), (std::vector<std::string>{"a", "b", "c"}));
+}
@@ -0,0 +1,64 @@
+#include "peerchat/scrollback.hpp"
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace peerchat;
+
+namespace {
+
+std::vector<std::string> rows(const Scrollback& sb, std::size_t height,
+                              std::size_t width, std::size_t scroll = 0) {
+    auto views = sb.view(height, width, scroll);
+    return {views.begin(), views.end()};
+}
+
+} // namespace
+
+TEST(ScrollbackTest, EvictsOldestWhenFull) {
+    Scrollback sb(3);
+    for (int i = 0; i < 5; ++i) sb.push("line " + std::to_string(i));
+    EXPECT_EQ(sb.size(), 3u);
+    EXPECT_EQ(sb.total(), 5u);
+    EXPECT_EQ(sb.line(0), "line 2");
+    EXPECT_EQ(sb.line(2), "line 4");
+}
+
+TEST(ScrollbackTest, ViewShowsNewestAtBottom) {
+    Scrollback sb(100);
+    for (int i = 0; i < 10; ++i) sb.push(std::to_string(i));
+    EXPECT_EQ(rows(sb, 3, 80), (std::vector<std::string>{"7", "8", "9"}));
+    EXPECT_EQ(rows(sb, 3, 80, 2), (std::vector<std::string>{"5", "6", "7"}));
+    // Scrolled past the start: only what exists
+    EXPECT_EQ(rows(sb, 3, 80, 8), (std::vector<std::string>{"0", "1"}));
+    EXPECT_TRUE(rows(sb, 3, 80, 10).empty());
+}
+
+TEST(ScrollbackTest, WrapsLongLinesIntoRows) {
+    Scrollback sb(10);
+    sb.push("a");
+    sb.push("abcdefgh");
+    sb.push("");
+    EXPECT_EQ(rows(sb, 4, 3),
+              (std::vector<std::string>{"abc", "def", "gh", ""}));
+    // The top of a wrapped line is cut off, not the bottom
+    EXPECT_EQ(rows(sb, 2, 3), (std::vector<std::string>{"gh", ""}));
+}
+
+TEST(ScrollbackTest, WrapKeepsUtf8SequencesWhole) {
+    Scrollback sb(10);
+    sb.push("ab\xc3\xa9" "cd"); // "abécd"
+    EXPECT_EQ(rows(sb, 5, 3),
+              (std::vector<std::string>{"ab", "\xc3\xa9" "c", "d"}));
+}
+
+TEST(ScrollbackTest, ViewCostIsBoundedByHeight) {
+    Scrollback sb(50000);
+    for (int i = 0; i < 200000; ++i) sb.push("message " + std::to_string(i));
+    EXPECT_EQ(sb.size(), 50000u);
+    auto view = rows(sb, 2, 80);
+    EXPECT_EQ(view, (std::vector<std::string>{"message 199998",
+                                              "message 199999"}));
+}
@@ -0,0 +1,251 @@
+#include "peerchat/identity.hpp"
+#include "peerchat/peer_manager.hpp"
+#include "peerchat/sim_network.hpp"
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace peerchat;
+using namespace std::chrono_literals;
+
+namespace {
+
+// Records what reaches one end of a connection, and when
+struct Sink {
+    std::vector<std::string> messages;
+    std::vector<NetClock::time_point> times;
+    std::string error;
+
+    void attach(SimNetwork& net, const ConnectionPtr& conn) {
+        conn->start(
+            [this, &net](std::string_view json) {
+                messages.emplace_back(json);
+                times.push_back(net.now());
+            },
+            [this](const std::string& reason) { error = reason; });
+    }
+};
+
+// Two PeerManagers joined by a simulated connection
+struct Pair {
+    Identity id_a = Identity::ephemeral("alice");
+    Identity id_b = Identity::ephemeral("bob");
+    PeerManager a;
+    PeerManager b;
+
+    Pair(SimNetwork& net, SimNetwork::NodeId na, SimNetwork::NodeId nb)
+        : a(net.io(), id_a), b(net.io(), id_b) {
+        auto [ca, cb] = net.connect(na, nb);
+        a.set_connection(ca, true);
+        b.set_connection(cb, false);
+    }
+
+    bool connected() const {
+        return a.state() == PeerState::Connected &&
+               b.state() == PeerState::Connected;
+    }
+};
+
+} // namespace
+
+TEST(SimNetworkTest, LatencyAndBandwidth) {
+    asio::io_context io;
+    LinkConfig link;
+    link.latency = 10ms;
+    link.bandwidth_bps = 8'000'000; // one byte per microsecond
+    SimNetwork net(io, 1, link);
+    auto [a, b] = net.connect(1, 2);
+    Sink sink;
+    sink.attach(net, b);
+
+    const auto start = net.now();
+    a->send(std::string(996, 'x')); // 1000 bytes with the prefix
+    a->send(std::string(996, 'y'));
+    net.run_for(50ms);
+
+    ASSERT_EQ(sink.messages.size(), 2u);
+    EXPECT_EQ(sink.times[0] - start, 10ms + 1ms);
+    EXPECT_EQ(sink.times[1] - start, 10ms + 2ms);
+    EXPECT_EQ(net.stats().bytes_delivered, 2000u);
+}
+
+TEST(SimNetworkTest, LossDelaysButKeepsOrder) {
+    asio::io_context io;
+    LinkConfig link;
+    link.loss = 0.2;
+    link.jitter = 5ms;
+    SimNetwork net(io, 7, link);
+    auto [a, b] = net.connect(1, 2);
+    Sink sink;
+    sink.attach(net, b);
+
+    for (int i = 0; i < 200; ++i) a->send(std::to_string(i));
+    net.run_for(60s);
+
+    ASSERT_EQ(sink.messages.size(), 200u);
+    for (int i = 0; i < 200; ++i) {
+        EXPECT_EQ(sink.messages[i], std::to_string(i));
+    }
+    EXPECT_GT(net.stats().retransmits, 0u);
+}
+
+TEST(SimNetworkTest, PartitionHoldsFramesUntilHealed) {
+    asio::io_context io;
+    SimNetwork net(io);
+    auto [a, b] = net.connect(1, 2);
+    Sink sink;
+    sink.attach(net, b);
+
+    a->send("before");
+    net.run_for(10ms);
+    net.partition({1});
+    a->send("during");
+    net.run_for(1s);
+    EXPECT_EQ(sink.messages.size(), 1u);
+    EXPECT_EQ(net.stats().frames_held, 1u);
+
+    net.heal();
+    a->send("after");
+    net.run_for(10ms);
+    EXPECT_EQ(sink.messages,
+              (std::vector<std::string>{"before", "during", "after"}));
+}
+
+TEST(SimNetworkTest, CloseReachesPeerAfterData) {
+    asio::io_context io;
+    SimNetwork net(io);
+    auto [a, b] = net.connect(1, 2);
+    Sink sink;
+    sink.attach(net, b);
+
+    a->send("last words");
+    a->close();
+    a->send("dropped");
+    net.run_for(10ms);
+
+    EXPECT_EQ(sink.messages, std::vector<std::string>{"last words"});
+    EXPECT_FALSE(sink.error.empty());
+    EXPECT_FALSE(b->is_open());
+}
+
+TEST(SimNetworkTest, PeersHandshakeAndAck) {
+    asio::io_context io;
+    SimNetwork net(io);
+    Pair pair(net, 1, 2);
+    ASSERT_TRUE(net.run_until([&] { return pair.connected(); }, 1s));
+
+    std::vector<std::string> shown;
+    int acks = 0;
+    pair.b.on_display([&](const std::string&, const std::string& body) {
+        shown.push_back(body);
+    });
+    pair.a.on_ack([&](const std::string&) { ++acks; });
+    pair.a.send_text("hello");
+    // Display waits out the reorder window; the ACK doesn't
+    ASSERT_TRUE(
+        net.run_until([&] { return acks == 1 && !shown.empty(); }, 1s));
+    EXPECT_EQ(shown, std::vector<std::string>{"hello"});
+}
+
+TEST(SimNetworkTest, DroppedOfflineMessageStaysOutOfHistory) {
+    asio::io_context io;
+    SimNetwork net(io);
+    Identity id_a = Identity::ephemeral("alice");
+    Identity id_b = Identity::ephemeral("bob");
+    OutboxConfig outbox;
+    outbox.max_per_peer = 2;
+    PeerManager a(net.io(), id_a, outbox);
+    PeerManager b(net.io(), id_b);
+    auto [ca, cb] = net.connect(1, 2);
+    a.set_connection(ca, true);
+    b.set_connection(cb, false);
+    ASSERT_TRUE(net.run_until(
+        [&] {
+            return a.state() == PeerState::Connected &&
+                   b.state() == PeerState::Connected;
+        },
+        1s));
+    a.disconnect();
+
+    // Queued for bob until the outbox is full; the rest is dropped
+    EXPECT_TRUE(a.send_text("one"));
+    EXPECT_TRUE(a.send_text("two"));
+    EXPECT_FALSE(a.send_text("three"));
+    EXPECT_EQ(a.history_size(id_b.peer_id()), 2u);
+}
+
+TEST(SimNetworkTest, HeartbeatNoticesLongPartition) {
+    asio::io_context io;
+    SimNetwork net(io);
+    Pair pair(net, 1, 2);
+    ASSERT_TRUE(net.run_until([&] { return pair.connected(); }, 1s));
+
+    // Ping interval plus pong timeout is 40s of simulated time
+    net.partition({1});
+    EXPECT_TRUE(net.run_until(
+        [&] {
+            return pair.a.state() == PeerState::Disconnected &&
+                   pair.b.state() == PeerState::Disconnected;
+        },
+        2min));
+    EXPECT_LT(net.elapsed(), 2min);
+}
+
+TEST(SimNetworkTest, SameSeedReplaysExactly) {
+    auto run = [](uint32_t seed) {
+        asio::io_context io;
+        LinkConfig link;
+        link.latency = 20ms;
+        link.jitter = 10ms;
+        link.loss = 0.05;
+        SimNetwork net(io, seed, link);
+        std::vector<std::unique_ptr<Pair>> pairs;
+        for (uint32_t i = 0; i < 8; ++i) {
+            pairs.push_back(std::make_unique<Pair>(net, 2 * i, 2 * i + 1));
+        }
+        std::vector<std::string> acked;
+        for (auto& p : pairs) {
+            p->a.on_ack([&](const std::string& id) { acked.push_back(id); });
+        }
+        net.run_for(1s);
+        for (int round = 0; round < 5; ++round) {
+            for (auto& p : pairs) p->a.send_text("ping");
+            net.run_for(500ms);
+        }
+        return std::make_pair(acked, net.stats().retransmits);
+    };
+    auto first = run(42);
+    EXPECT_EQ(first.first.size(), 40u);
+    EXPECT_EQ(run(42), first);
+    EXPECT_NE(run(43), first);
+}
+
+TEST(SimNetworkTest, ThousandsOfNodes) {
+    asio::io_context io;
+    LinkConfig link;
+    link.latency = 30ms;
+    link.jitter = 20ms;
+    SimNetwork net(io, 3, link);
+    constexpr uint32_t kPairs = 1000;
+    std::vector<std::unique_ptr<Pair>> pairs;
+    for (uint32_t i = 0; i < kPairs; ++i) {
+        pairs.push_back(std::make_unique<Pair>(net, 2 * i, 2 * i + 1));
+    }
+    int acks = 0;
+    for (auto& p : pairs) {
+        p->a.on_ack([&](const std::string&) { ++acks; });
+    }
+    ASSERT_TRUE(net.run_until(
+        [&] {
+            for (auto& p : pairs) {
+                if (!p->connected()) return false;
+            }
+            return true;
+        },
+        5s));
+    for (auto& p : pairs) p->a.send_text("hi");
+    EXPECT_TRUE(net.run_until([&] { return acks == int{kPairs}; }, 5s));
+}
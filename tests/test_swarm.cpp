@@ -0,0 +1,264 @@
+#include "peerchat/swarm.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <map>
+#include <queue>
+
+using namespace peerchat;
+
+namespace {
+
+constexpr uint32_t kChunk = 32 * 1024;
+// Link speed of one chunk per 100 ms
+constexpr double kUnit = kChunk / 100.0;
+
+// In-process swarm with throttled links. Each peer serves requests in
+// arrival order at `bytes_per_ms`, and both directions add `latency_ms`.
+// Time is simulated, so runs are exact and instant.
+class SwarmSim {
+  public:
+    struct Link {
+        double bytes_per_ms;
+        int64_t latency_ms;
+        std::vector<bool> have; // empty: whole file
+    };
+
+    SwarmSim(uint32_t chunks, SwarmConfig config = {})
+        : sched_(chunks, kChunk, config) {}
+
+    void add(SwarmPeerId id, Link link) {
+        if (link.have.empty()) {
+            sched_.add_peer(id);
+        } else {
+            sched_.add_peer(id, link.have);
+        }
+        links_[id] = std::move(link);
+    }
+
+    // Drop a peer at the given time; its queued work is lost
+    void fail_at(SwarmPeerId id, int64_t t) { failures_[id] = t; }
+
+    // Run to completion; returns the finish time in ms
+    int64_t run(int64_t limit_ms = 10'000'000) {
+        issue(0);
+        while (!sched_.complete() && !events_.empty()) {
+            auto ev = events_.top();
+            events_.pop();
+            if (ev.time > limit_ms) break;
+            now_ = ev.time;
+            if (ev.tick) {
+                issue(now_);
+                continue;
+            }
+            auto f = failures_.find(ev.peer);
+            if (f != failures_.end() && now_ >= f->second) {
+                if (links_.erase(ev.peer)) sched_.remove_peer(ev.peer);
+                continue;
+            }
+            if (!sched_.wanted(ev.peer, ev.chunk)) {
+                ++wasted_;
+                continue;
+            }
+            sched_.on_received(ev.peer, ev.chunk, now_);
+            ++delivered_[ev.peer];
+            issue(now_);
+        }
+        return now_;
+    }
+
+    SwarmScheduler& scheduler() { return sched_; }
+    uint64_t delivered(SwarmPeerId id) { return delivered_[id]; }
+    uint64_t wasted() const { return wasted_; }
+    const std::vector<SwarmRequest>& log() const { return log_; }
+
+  private:
+    struct Event {
+        int64_t time;
+        SwarmPeerId peer;
+        uint32_t chunk;
+        bool tick;
+        bool operator>(const Event& o) const { return time > o.time; }
+    };
+
+    void issue(int64_t now) {
+        for (const auto& req : sched_.next_requests(now)) {
+            log_.push_back(req);
+            auto& link = links_.at(req.peer);
+            auto& busy = busy_until_[req.peer];
+            auto arrive = now + link.latency_ms;
+            auto start = std::max<double>(static_cast<double>(arrive), busy);
+            busy = start + kChunk / link.bytes_per_ms;
+            auto delivered = static_cast<int64_t>(busy) + link.latency_ms;
+            events_.push({delivered, req.peer, req.chunk, false});
+        }
+        // Periodic wakeup so timeouts fire even when nothing arrives
+        if (!sched_.complete()) events_.push({now + 250, 0, 0, true});
+    }
+
+    SwarmScheduler sched_;
+    std::map<SwarmPeerId, Link> links_;
+    std::map<SwarmPeerId, double> busy_until_;
+    std::map<SwarmPeerId, int64_t> failures_;
+    std::map<SwarmPeerId, uint64_t> delivered_;
+    std::priority_queue<Event, std::vector<Event>, std::greater<>> events_;
+    std::vector<SwarmRequest> log_;
+    uint64_t wasted_{0};
+    int64_t now_{0};
+};
+
+} // namespace
+
+TEST(SwarmTest, SaturatesHeterogeneousPeers) {
+    constexpr uint32_t kChunks = 2000;
+    SwarmSim sim(kChunks);
+    // 32, 8, 4 and 1 chunks per 100 ms, with varying latency
+    sim.add(1, {kUnit * 32, 40, {}});
+    sim.add(2, {kUnit * 8, 10, {}});
+    sim.add(3, {kUnit * 4, 80, {}});
+    sim.add(4, {kUnit * 1, 5, {}});
+
+    auto t = sim.run();
+    ASSERT_TRUE(sim.scheduler().complete());
+
+    double total_rate = kUnit * (32 + 8 + 4 + 1);
+    double ideal = kChunks * double(kChunk) / total_rate;
+    EXPECT_LT(t, ideal * 1.15 + 200) << "ideal " << ideal << " ms";
+
+    // Work is split roughly in proportion to link speed
+    EXPECT_GT(sim.delivered(1), sim.delivered(2));
+    EXPECT_GT(sim.delivered(2), sim.delivered(3));
+    EXPECT_GT(sim.delivered(3), sim.delivered(4));
+    EXPECT_NEAR(double(sim.delivered(1)) / kChunks, 32.0 / 45, 0.08);
+}
+
+TEST(SwarmTest, WindowCoversBandwidthDelayProduct) {
+    SwarmSim sim(4000);
+    sim.add(1, {kUnit * 100, 20, {}}); // fast, far away
+    sim.add(2, {kUnit * 100, 1, {}});  // fast, close by
+    sim.run();
+    auto far = sim.scheduler().stats(1);
+    auto near = sim.scheduler().stats(2);
+    EXPECT_GT(far.min_rtt_ms, 40);
+    EXPECT_GT(sim.scheduler().window(1), sim.scheduler().window(2) * 4);
+    // The far peer still delivers its share
+    EXPECT_NEAR(double(sim.delivered(1)) / 4000, 0.5, 0.1);
+    EXPECT_LT(near.min_rtt_ms, 5);
+}
+
+TEST(SwarmTest, RarestChunksRequestedFirst) {
+    constexpr uint32_t kChunks = 64;
+    SwarmScheduler sched(kChunks, kChunk, {.min_window = 8});
+    std::vector<bool> even(kChunks, false);
+    for (uint32_t c = 0; c < kChunks; c += 2) even[c] = true;
+    sched.add_peer(1, even);
+    sched.add_peer(2, even);
+    sched.add_peer(3); // seed
+
+    // The seed is the only source of odd chunks, so it gets those first
+    auto reqs = sched.next_requests(0);
+    std::vector<uint32_t> from_seed;
+    for (const auto& r : reqs) {
+        if (r.peer == 3) from_seed.push_back(r.chunk);
+        else EXPECT_EQ(r.chunk % 2, 0u);
+    }
+    ASSERT_EQ(from_seed.size(), 8u);
+    for (auto c : from_seed) EXPECT_EQ(c % 2, 1u) << c;
+}
+
+TEST(SwarmTest, NewlyAnnouncedChunksChangeRarity) {
+    SwarmScheduler sched(4, kChunk, {.min_window = 1});
+    sched.add_peer(1, {true, true, true, true});
+    sched.add_peer(2, {true, false, true, true});
+    sched.peer_has(2, 1);
+    sched.add_peer(3, {false, false, true, true});
+    // Chunks 0 and 1 are held by two peers, 2 and 3 by three
+    auto reqs = sched.next_requests(0);
+    ASSERT_EQ(reqs.size(), 3u);
+    std::vector<uint32_t> chunks;
+    for (const auto& r : reqs) chunks.push_back(r.chunk);
+    std::sort(chunks.begin(), chunks.end());
+    EXPECT_EQ(chunks, (std::vector<uint32_t>{0, 1, 2}));
+}
+
+TEST(SwarmTest, EndgameRescuesSlowTail) {
+    auto run = [](std::size_t copies) {
+        SwarmSim sim(200, {.max_copies = copies});
+        sim.add(1, {kUnit * 200, 5, {}});
+        sim.add(2, {kUnit * 0.05, 5, {}}); // 2 s per chunk
+        return sim.run();
+    };
+    auto without = run(1);
+    auto with = run(2);
+    EXPECT_LT(with * 2, without) << with << " vs " << without;
+}
+
+TEST(SwarmTest, EndgameCancelsDuplicates) {
+    SwarmScheduler sched(1, kChunk, {.min_window = 1});
+    sched.add_peer(1);
+    sched.add_peer(2);
+
+    // The only chunk goes to one peer, and endgame asks the other too
+    auto reqs = sched.next_requests(0);
+    ASSERT_EQ(reqs.size(), 2u);
+    EXPECT_TRUE(sched.in_endgame());
+    EXPECT_EQ(reqs[0].chunk, 0u);
+    EXPECT_EQ(reqs[1].chunk, 0u);
+    EXPECT_NE(reqs[0].peer, reqs[1].peer);
+
+    std::vector<SwarmRequest> cancels;
+    sched.on_received(reqs[1].peer, 0, 20, &cancels);
+    ASSERT_EQ(cancels.size(), 1u);
+    EXPECT_EQ(cancels[0].peer, reqs[0].peer);
+    EXPECT_FALSE(sched.wanted(reqs[0].peer, 0));
+    EXPECT_TRUE(sched.complete());
+}
+
+TEST(SwarmTest, LostPeerWorkIsReassigned) {
+    SwarmSim sim(500);
+    sim.add(1, {kUnit * 100, 10, {}});
+    sim.add(2, {kUnit * 100, 10, {}});
+    sim.fail_at(2, 100);
+    sim.run();
+    EXPECT_TRUE(sim.scheduler().complete());
+    EXPECT_GT(sim.delivered(2), 0u);
+    EXPECT_GT(sim.delivered(1), 400u);
+}
+
+TEST(SwarmTest, StalledRequestsTimeOut) {
+    SwarmScheduler sched(2, kChunk,
+                         {.min_window = 1, .max_copies = 1,
+                          .min_timeout_ms = 100});
+    sched.add_peer(1);
+    sched.add_peer(2);
+    auto reqs = sched.next_requests(0);
+    ASSERT_EQ(reqs.size(), 2u);
+
+    // Peer 1 answers; peer 2 goes silent
+    uint32_t c1 = reqs[0].peer == 1 ? reqs[0].chunk : reqs[1].chunk;
+    sched.on_received(1, c1, 5);
+    auto again = sched.next_requests(200);
+    ASSERT_EQ(again.size(), 1u);
+    EXPECT_EQ(again[0].peer, 1u);
+    EXPECT_EQ(sched.stats(2).timeouts, 1u);
+}
+
+TEST(SwarmTest, SoleHolderIsNotTimedOut) {
+    SwarmScheduler sched(1, kChunk, {.min_timeout_ms = 100});
+    sched.add_peer(1);
+    ASSERT_EQ(sched.next_requests(0).size(), 1u);
+    EXPECT_TRUE(sched.next_requests(10'000).empty());
+    EXPECT_TRUE(sched.wanted(1, 0));
+}
+
+TEST(SwarmTest, CorruptChunkIsRequestedAgain) {
+    SwarmScheduler sched(1, kChunk, {.min_window = 1});
+    sched.add_peer(1);
+    ASSERT_EQ(sched.next_requests(0).size(), 1u);
+    sched.on_failed(1, 0);
+    EXPECT_EQ(sched.stats(1).failures, 1u);
+    auto again = sched.next_requests(1);
+    ASSERT_EQ(again.size(), 1u);
+    EXPECT_EQ(again[0].chunk, 0u);
+}
@@ -0,0 +1,224 @@
+#include "peerchat/history.hpp"
+#include "peerchat/sync.hpp"
+
+#include <algorithm>
+#include <random>
+#include <set>
+
+#include <gtest/gtest.h>
+
+using namespace peerchat;
+
+namespace {
+
+struct SimResult {
+    std::set<uint64_t> a_only; // found missing on B
+    std::set<uint64_t> b_only; // found missing on A
+    std::size_t bytes{0};
+    int rounds{0};
+};
+
+// Run the protocol between two indexes until both sides are satisfied,
+// passing every round through the wire encoding.
+SimResult simulate(const SyncIndex& a, const SyncIndex& b) {
+    Reconciler ra(a);
+    Reconciler rb(b);
+    SimResult result;
+
+    SyncPayload msg;
+    msg.ranges = ra.initiate();
+    bool a_turn = false; // next receiver is B
+    while (!msg.ranges.empty() || !msg.need.empty()) {
+        auto wire = msg.encode();
+        result.bytes += wire.size();
+        auto in = SyncPayload::decode(wire);
+        ++result.rounds;
+
+        std::vector<uint64_t> have;
+        SyncPayload reply;
+        const auto& r = a_turn ? ra : rb;
+        reply.ranges = r.reconcile(in.ranges, have, reply.need);
+        if (a_turn) {
+            result.a_only.insert(have.begin(), have.end());
+            result.b_only.insert(reply.need.begin(), reply.need.end());
+        } else {
+            result.b_only.insert(have.begin(), have.end());
+            result.a_only.insert(reply.need.begin(), reply.need.end());
+        }
+        msg = std::move(reply);
+        a_turn = !a_turn;
+        if (result.rounds > 200) break;
+    }
+    return result;
+}
+
+uint64_t item_hash(uint64_t i) { return sync_hash(std::to_string(i)); }
+
+} // namespace
+
+TEST(SyncTest, IdenticalSetsFinishInOneRound) {
+    SyncIndex a;
+    SyncIndex b;
+    for (int i = 0; i < 1000; ++i) {
+        a.insert({i, item_hash(i)});
+        b.insert({i, item_hash(i)});
+    }
+    auto r = simulate(a, b);
+    EXPECT_EQ(r.rounds, 1);
+    EXPECT_TRUE(r.a_only.empty());
+    EXPECT_TRUE(r.b_only.empty());
+}
+
+TEST(SyncTest, EmptySide) {
+    SyncIndex a;
+    SyncIndex b;
+    for (int i = 0; i < 500; ++i) {
+        a.insert({i, item_hash(i)});
+    }
+    auto r = simulate(a, b);
+    EXPECT_EQ(r.a_only.size(), 500u);
+    EXPECT_TRUE(r.b_only.empty());
+
+    auto r2 = simulate(b, a);
+    EXPECT_TRUE(r2.a_only.empty());
+    EXPECT_EQ(r2.b_only.size(), 500u);
+}
+
+TEST(SyncTest, UnorderedInsertsAreSorted) {
+    SyncIndex idx;
+    for (int i = 100; i > 0; --i) {
+        idx.insert({i, item_hash(i)});
+    }
+    EXPECT_EQ(idx.at(0).timestamp, 1);
+    EXPECT_EQ(idx.lower_bound({50, 0}), 49u);
+    EXPECT_EQ(idx.fingerprint(0, 2), item_hash(1) ^ item_hash(2));
+}
+
+TEST(SyncTest, PayloadRoundtrip) {
+    SyncPayload p;
+    SyncRange fp;
+    fp.upper = {42, 7};
+    fp.mode = SyncRange::Mode::Fingerprint;
+    fp.fingerprint = 0xdeadbeefcafef00dULL;
+    fp.count = 12;
+    SyncRange ids;
+    ids.upper = SyncItem::max();
+    ids.mode = SyncRange::Mode::IdList;
+    ids.hashes = {1, 2, 0xffffffffffffffffULL};
+    p.ranges = {fp, ids};
+    p.need = {5, 6};
+
+    auto d = SyncPayload::decode(p.encode());
+    ASSERT_EQ(d.ranges.size(), 2u);
+    EXPECT_EQ(d.ranges[0].upper, fp.upper);
+    EXPECT_EQ(d.ranges[0].fingerprint, fp.fingerprint);
+    EXPECT_EQ(d.ranges[0].count, 12u);
+    EXPECT_EQ(d.ranges[1].upper, SyncItem::max());
+    EXPECT_EQ(d.ranges[1].hashes, ids.hashes);
+    EXPECT_EQ(d.need, p.need);
+}
+
+TEST(SyncTest, OutOfOrderRangesRejected) {
+    // Timestamps are delta-encoded, so go backwards via the hash part
+    EXPECT_THROW(SyncPayload::decode(R"({"r":[[10,5,0],[0,1,0]]})"),
+                 std::invalid_argument);
+    // ...or via a wrapping delta
+    EXPECT_THROW(
+        SyncPayload::decode(R"({"r":[[10,0,0],[18446744073709551615,0,0]]})"),
+        std::invalid_argument);
+}
+
+TEST(SyncTest, MillionMessageHistoriesSmallDelta) {
+    constexpr uint64_t kCommon = 1'000'000;
+    constexpr uint64_t kOnlyA = 40;
+    constexpr uint64_t kOnlyB = 25;
+
+    std::mt19937_64 rng(1234);
+    std::set<uint64_t> only_a;
+    std::set<uint64_t> only_b;
+
+    // Interleave the unique messages at random points in time
+    std::vector<std::pair<SyncItem, int>> items; // 0 = both, 1 = A, 2 = B
+    items.reserve(kCommon + kOnlyA + kOnlyB);
+    for (uint64_t i = 0; i < kCommon; ++i) {
+        items.push_back({{static_cast<int64_t>(i * 10), item_hash(i)}, 0});
+    }
+    for (uint64_t i = 0; i < kOnlyA + kOnlyB; ++i) {
+        int64_t ts = static_cast<int64_t>(rng() % (kCommon * 10));
+        uint64_t h = item_hash(kCommon + i);
+        int side = i < kOnlyA ? 1 : 2;
+        items.push_back({{ts, h}, side});
+        (side == 1 ? only_a : only_b).insert(h);
+    }
+    std::sort(items.begin(), items.end());
+
+    SyncIndex a;
+    SyncIndex b;
+    for (const auto& [item, side] : items) {
+        if (side != 2) a.insert(item);
+        if (side != 1) b.insert(item);
+    }
+
+    auto r = simulate(a, b);
+    EXPECT_EQ(r.a_only, only_a);
+    EXPECT_EQ(r.b_only, only_b);
+
+    // A flat list of 8-byte hashes would cost 8 MB; reconciliation must
+    // scale with the 65 differing messages instead.
+    std::size_t flat = kCommon * sizeof(uint64_t);
+    EXPECT_LT(r.bytes, flat / 50);
+    RecordProperty("rounds", r.rounds);
+    RecordProperty("bytes", static_cast<int>(r.bytes));
+}
+
+TEST(HistoryTest, DeduplicatesById) {
+    History h;
+    auto m = Message::make_text("peer-1", "alice", "0000", "hi");
+    EXPECT_TRUE(h.add(m));
+    EXPECT_FALSE(h.add(m));
+    EXPECT_EQ(h.size(), 1u);
+    EXPECT_TRUE(h.contains(m.id));
+
+    const auto* found = h.find(sync_hash(m.id));
+    ASSERT_NE(found, nullptr);
+    EXPECT_EQ(found->body, "hi");
+    EXPECT_EQ(h.index().size(), 1u);
+}
+
+TEST(HistoryTest, DropsOldestPastCapacity) {
+    History h(32);
+    std::vector<Message> sent;
+    auto text = [&](int64_t ts) {
+        auto m = Message::make_text("peer-1", "alice", "0000",
+                                    std::to_string(ts));
+        m.timestamp = ts;
+        return m;
+    };
+    for (int64_t ts = 100; ts < 132; ++ts) {
+        sent.push_back(text(ts));
+        ASSERT_TRUE(h.add(sent.back()));
+    }
+    // Full, and older than everything kept
+    EXPECT_FALSE(h.add(text(0)));
+    EXPECT_EQ(h.size(), 32u);
+
+    // One more evicts the oldest few at once
+    sent.push_back(text(132));
+    EXPECT_TRUE(h.add(sent.back()));
+    EXPECT_EQ(h.size(), 30u);
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_FALSE(h.contains(sent[i].id));
+    }
+    EXPECT_TRUE(h.contains(sent[3].id));
+    EXPECT_TRUE(h.contains(sent.back().id));
+    EXPECT_EQ(h.messages().front().body, "103");
+
+    uint64_t expected = 0;
+    for (const auto& m : h.messages()) {
+        expected ^= sync_hash(m.id);
+        EXPECT_EQ(h.find(sync_hash(m.id)), &m);
+    }
+    ASSERT_EQ(h.index().size(), h.size());
+    EXPECT_EQ(h.index().fingerprint(0, h.index().size()), expected);
+    EXPECT_EQ(h.index().at(0).timestamp, 103);
+}
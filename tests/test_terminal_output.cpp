@@ -0,0 +1,119 @@
+#include "peerchat/terminal_output.hpp"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace peerchat;
+
+namespace {
+
+// Pipe whose read end is drained after the writer is done
+class Pipe {
+  public:
+    Pipe() {
+        EXPECT_EQ(::pipe(fds_), 0);
+        // Large enough that the tests never block the writer
+        ::fcntl(fds_[1], F_SETPIPE_SZ, 1 << 20);
+    }
+    ~Pipe() {
+        ::close(fds_[0]);
+        ::close(fds_[1]);
+    }
+    int write_fd() const { return fds_[1]; }
+
+    std::string drain() {
+        ::fcntl(fds_[0], F_SETFL, O_NONBLOCK);
+        std::string out;
+        char buf[4096];
+        ssize_t n;
+        while ((n = ::read(fds_[0], buf, sizeof(buf))) > 0) {
+            out.append(buf, static_cast<std::size_t>(n));
+        }
+        return out;
+    }
+
+  private:
+    int fds_[2];
+};
+
+} // namespace
+
+TEST(TerminalOutputTest, WritesLinesInOrder) {
+    Pipe pipe;
+    {
+        TerminalOutput out(pipe.write_fd());
+        out.push("one");
+        out.push("two");
+        out.flush();
+        out.push("three");
+    }
+    EXPECT_EQ(pipe.drain(), "one\ntwo\nthree\n");
+}
+
+TEST(TerminalOutputTest, CoalescesBurstIntoFewWrites) {
+    Pipe pipe;
+    TerminalOutput out(pipe.write_fd(), {std::chrono::milliseconds(50), 0});
+    for (int i = 0; i < 1000; ++i) out.push("line " + std::to_string(i));
+    out.flush();
+
+    auto stats = out.stats();
+    EXPECT_EQ(stats.lines, 1000u);
+    EXPECT_LE(stats.writes, 3u);
+    auto text = pipe.drain();
+    EXPECT_EQ(text.rfind("line 999\n"), text.size() - 9);
+}
+
+TEST(TerminalOutputTest, ConcurrentProducersLoseNothing) {
+    Pipe pipe;
+    TerminalOutput out(pipe.write_fd());
+    std::vector<std::thread> producers;
+    for (int t = 0; t < 4; ++t) {
+        producers.emplace_back([&out, t] {
+            for (int i = 0; i < 500; ++i) {
+                out.push(std::to_string(t) + ":" + std::to_string(i));
+            }
+        });
+    }
+    for (auto& p : producers) p.join();
+    out.flush();
+
+    auto text = pipe.drain();
+    std::vector<int> next(4, 0);
+    std::size_t pos = 0;
+    while (pos < text.size()) {
+        auto nl = text.find('\n', pos);
+        auto line = text.substr(pos, nl - pos);
+        int t = line[0] - '0';
+        // Each producer's lines stay in its own order
+        EXPECT_EQ(std::stoi(line.substr(2)), next[t]++);
+        pos = nl + 1;
+    }
+    EXPECT_EQ(next, (std::vector<int>{500, 500, 500, 500}));
+}
+
+TEST(TerminalOutputTest, CollapsesAckFlood) {
+    Pipe pipe;
+    TerminalOutput out(pipe.write_fd(), {std::chrono::milliseconds(50), 8});
+    out.push("[bob] hi");
+    for (int i = 0; i < 20; ++i) {
+        out.push("  (delivered: " + std::to_string(i) + ")",
+                 TerminalOutput::LineKind::Ack);
+    }
+    out.flush();
+    EXPECT_EQ(out.stats().collapsed_acks, 20u);
+    EXPECT_EQ(pipe.drain(), "[bob] hi\n  (delivered: 20 messages)\n");
+
+    // A few at a time are shown as they are
+    out.push("  (delivered: x)", TerminalOutput::LineKind::Ack);
+    out.flush();
+    EXPECT_EQ(pipe.drain(), "  (delivered: x)\n");
+}
+
+#endif
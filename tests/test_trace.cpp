@@ -0,0 +1,78 @@
+#include "peerchat/trace.hpp"
+
+#include <atomic>
+#include <memory>
+#include <set>
+#include <thread>
+
+#include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
+
+using namespace peerchat;
+
+TEST(TraceTest, RingKeepsEventsInOrder) {
+    trace::Ring ring(1);
+    ring.push("a", 10, 1, 0);
+    ring.push("b", 20, 2, 7);
+    auto events = ring.snapshot();
+    ASSERT_EQ(events.size(), 2u);
+    EXPECT_STREQ(events[0].name, "a");
+    EXPECT_EQ(events[1].start_ns, 20u);
+    EXPECT_EQ(events[1].arg, 7u);
+}
+
+TEST(TraceTest, RingOverwritesOldest) {
+    auto ring = std::make_unique<trace::Ring>(1);
+    const std::size_t total = trace::kRingSize + 100;
+    for (std::size_t i = 0; i < total; ++i) ring->push("e", i, 0, 0);
+    auto events = ring->snapshot();
+    ASSERT_EQ(events.size(), trace::kRingSize);
+    EXPECT_EQ(events.front().start_ns, 100u);
+    EXPECT_EQ(events.back().start_ns, total - 1);
+
+    ring->clear();
+    EXPECT_TRUE(ring->snapshot().empty());
+    ring->push("f", 1, 0, 0);
+    EXPECT_EQ(ring->snapshot().size(), 1u);
+}
+
+TEST(TraceTest, ChromeJsonHasEveryThread) {
+    trace::clear();
+    { trace::Scope scope("main_span", 42); }
+    std::thread([] { trace::Scope scope("worker_span"); }).join();
+
+    auto j = nlohmann::json::parse(trace::chrome_json());
+    int spans = 0;
+    std::set<uint32_t> tids;
+    for (const auto& e : j.at("traceEvents")) {
+        if (e.at("ph") != "X") continue;
+        ++spans;
+        tids.insert(e.at("tid").get<uint32_t>());
+        if (e.at("name") == "main_span") {
+            EXPECT_EQ(e.at("args").at("n"), 42);
+        }
+        EXPECT_GE(e.at("dur").get<double>(), 0.0);
+    }
+    EXPECT_EQ(spans, 2);
+    EXPECT_EQ(tids.size(), 2u);
+}
+
+TEST(TraceTest, SnapshotWhileWriting) {
+    auto ring = std::make_unique<trace::Ring>(1);
+    std::atomic<bool> done{false};
+    std::thread writer([&] {
+        for (uint64_t i = 0; i < 200'000; ++i) ring->push("e", i, i, i);
+        done = true;
+    });
+    while (!done) {
+        // Whatever survives must be a consistent, contiguous run
+        auto events = ring->snapshot();
+        for (std::size_t i = 0; i < events.size(); ++i) {
+            ASSERT_EQ(events[i].dur_ns, events[i].start_ns);
+            if (i > 0) {
+                ASSERT_EQ(events[i].start_ns, events[i - 1].start_ns + 1);
+            }
+        }
+    }
+    writer.join();
+}
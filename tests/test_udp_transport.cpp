@@ -0,0 +1,545 @@
+#include "peerchat/framing.hpp"
+#include "peerchat/udp_transport.hpp"
+
+#include <asio.hpp>
+#include <gtest/gtest.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace peerchat;
+
+namespace {
+
+std::string json_of(std::size_t size, char fill, int seq) {
+    return R"({"seq":)" + std::to_string(seq) + R"(,"body":")" +
+           std::string(size, fill) + "\"}";
+}
+
+// Collects what a connection delivers, from the io thread
+struct Inbox {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<std::string> messages;
+    std::string error;
+
+    MessageCallback on_message() {
+        return [this](std::string_view payload) {
+            std::lock_guard lock(mutex);
+            messages.emplace_back(payload);
+            cv.notify_all();
+        };
+    }
+    ErrorCallback on_error() {
+        return [this](const std::string& reason) {
+            std::lock_guard lock(mutex);
+            error = reason;
+            cv.notify_all();
+        };
+    }
+    bool wait_for(std::size_t n, std::chrono::seconds timeout =
+                                     std::chrono::seconds(20)) {
+        std::unique_lock lock(mutex);
+        return cv.wait_for(lock, timeout,
+                           [&] { return messages.size() >= n; });
+    }
+    bool wait_error() {
+        std::unique_lock lock(mutex);
+        return cv.wait_for(lock, std::chrono::seconds(5),
+                           [&] { return !error.empty(); });
+    }
+};
+
+// [type][u32 connection id][u64 packet number]
+constexpr std::size_t kPacketHeader = 1 + 4 + 8;
+
+// A datagram as a peer would send it: `type` 1 is Initial, 2 Short.
+// `frames` are already encoded.
+std::vector<uint8_t> datagram(uint8_t type, uint32_t id, uint64_t pn,
+                              const std::vector<uint8_t>& frames) {
+    std::vector<uint8_t> out{type};
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<uint8_t>(id >> shift));
+    }
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<uint8_t>(pn >> shift));
+    }
+    out.insert(out.end(), frames.begin(), frames.end());
+    return out;
+}
+
+void put_stream_frame(std::vector<uint8_t>& out, uint8_t stream,
+                      uint64_t offset, std::string_view bytes) {
+    out.push_back(1);
+    out.push_back(stream);
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<uint8_t>(offset >> shift));
+    }
+    out.push_back(static_cast<uint8_t>(bytes.size() >> 8));
+    out.push_back(static_cast<uint8_t>(bytes.size()));
+    out.insert(out.end(), bytes.begin(), bytes.end());
+}
+
+// The stream frames of a datagram we received: pn and (offset, bytes)
+struct Sent {
+    uint64_t pn{0};
+    std::vector<std::pair<uint64_t, std::string>> chunks;
+};
+
+Sent parse_datagram(const uint8_t* data, std::size_t len) {
+    auto get = [&](std::size_t at, int n) {
+        uint64_t v = 0;
+        for (int i = 0; i < n; ++i) v = (v << 8) | data[at + i];
+        return v;
+    };
+    Sent out;
+    out.pn = get(5, 8);
+    std::size_t at = kPacketHeader;
+    while (at < len && data[at] == 1) {
+        const uint64_t offset = get(at + 2, 8);
+        const auto length = static_cast<std::size_t>(get(at + 10, 2));
+        out.chunks.emplace_back(
+            offset, std::string(reinterpret_cast<const char*>(data) + at + 12,
+                                length));
+        at += 12 + length;
+    }
+    return out;
+}
+
+// Ack frame for the given packet numbers, one range each
+std::vector<uint8_t> ack_frame(const std::vector<uint64_t>& pns) {
+    std::vector<uint8_t> out{2, 0, 0, static_cast<uint8_t>(pns.size())};
+    for (uint64_t pn : pns) {
+        for (int i = 0; i < 2; ++i) {
+            for (int shift = 56; shift >= 0; shift -= 8) {
+                out.push_back(static_cast<uint8_t>(pn >> shift));
+            }
+        }
+    }
+    return out;
+}
+
+} // namespace
+
+class UdpTransportTest : public ::testing::Test {
+  protected:
+    void TearDown() override {
+        if (server_) server_->stop();
+        if (client_) client_->stop();
+        io_.stop();
+        if (io_thread_.joinable()) io_thread_.join();
+    }
+
+    // Endpoints on loopback; the server side starts whatever connects
+    void open(UdpConfig config = {}) {
+        server_ = UdpEndpoint::create(
+            io_, 0,
+            [this](ConnectionPtr conn) {
+                accepted_ = conn;
+                conn->start(server_inbox_.on_message(),
+                            server_inbox_.on_error());
+            },
+            config);
+        if (config.seed) *config.seed += 1;
+        client_ = UdpEndpoint::create(io_, 0, {}, config);
+        conn_ = client_->connect(asio::ip::udp::endpoint(
+            asio::ip::make_address("127.0.0.1"), server_->port()));
+        conn_->start(client_inbox_.on_message(), client_inbox_.on_error());
+
+        auto work = asio::make_work_guard(io_);
+        io_thread_ = std::thread([this, work = std::move(work)]() mutable {
+            io_.run();
+        });
+    }
+
+    asio::io_context io_;
+    std::thread io_thread_;
+    std::shared_ptr<UdpEndpoint> server_;
+    std::shared_ptr<UdpEndpoint> client_;
+    std::shared_ptr<UdpConnection> conn_;
+    ConnectionPtr accepted_;
+    Inbox server_inbox_;
+    Inbox client_inbox_;
+};
+
+TEST(RangeSetTest, MergesAndSplits) {
+    RangeSet set;
+    EXPECT_EQ(set.add(0, 10), 10u);
+    EXPECT_EQ(set.add(20, 30), 10u);
+    EXPECT_EQ(set.size(), 2u);
+    // Fills the gap and overlaps both sides
+    EXPECT_EQ(set.add(5, 25), 10u);
+    ASSERT_EQ(set.size(), 1u);
+    EXPECT_EQ(set.ranges().begin()->second, 30u);
+    EXPECT_EQ(set.add(3, 4), 0u);
+
+    set.remove(10, 15);
+    EXPECT_EQ(set.size(), 2u);
+    EXPECT_TRUE(set.contains(9));
+    EXPECT_FALSE(set.contains(10));
+    EXPECT_FALSE(set.contains(14));
+    EXPECT_TRUE(set.contains(15));
+    EXPECT_FALSE(set.contains(30));
+
+    // Adjacent ranges join
+    set.add(30, 31);
+    EXPECT_EQ(std::prev(set.ranges().end())->second, 31u);
+    set.keep_highest(1);
+    EXPECT_FALSE(set.contains(0));
+    EXPECT_TRUE(set.contains(20));
+}
+
+TEST(CongestionControllerTest, HalvesOncePerRecovery) {
+    CongestionController cc;
+    const auto t0 = std::chrono::steady_clock::now();
+    const auto window = cc.window();
+
+    // Slow start doubles per window acknowledged
+    cc.on_sent(window);
+    cc.on_acked(window, t0);
+    EXPECT_EQ(cc.window(), 2 * window);
+    EXPECT_TRUE(cc.in_slow_start());
+
+    // Several losses from the same flight cost one halving
+    const auto t1 = t0 + std::chrono::milliseconds(10);
+    cc.on_sent(3 * kMaxDatagram);
+    cc.on_lost(kMaxDatagram, t0, t1);
+    cc.on_lost(kMaxDatagram, t0, t1);
+    EXPECT_EQ(cc.window(), window);
+    EXPECT_FALSE(cc.in_slow_start());
+    // Nor do packets from before the reduction grow it again
+    cc.on_acked(kMaxDatagram, t0);
+    EXPECT_EQ(cc.window(), window);
+    EXPECT_EQ(cc.in_flight(), 0u);
+
+    // After it, roughly one datagram per window
+    cc.on_sent(window);
+    cc.on_acked(window, t1 + std::chrono::milliseconds(1));
+    EXPECT_EQ(cc.window(), window + kMaxDatagram);
+}
+
+TEST(RttEstimatorTest, SmoothsSamples) {
+    RttEstimator rtt;
+    EXPECT_FALSE(rtt.has_sample());
+    rtt.sample(std::chrono::milliseconds(40), {});
+    EXPECT_EQ(rtt.smoothed(), std::chrono::milliseconds(40));
+    EXPECT_EQ(rtt.variance(), std::chrono::milliseconds(20));
+
+    // The peer's ACK delay is taken off, but never below the minimum
+    rtt.sample(std::chrono::milliseconds(48), std::chrono::milliseconds(8));
+    EXPECT_EQ(rtt.smoothed(), std::chrono::milliseconds(40));
+    rtt.sample(std::chrono::milliseconds(42), std::chrono::milliseconds(8));
+    EXPECT_EQ(rtt.min(), std::chrono::milliseconds(40));
+    EXPECT_GT(rtt.smoothed(), std::chrono::milliseconds(40));
+}
+
+TEST_F(UdpTransportTest, LoopbackRoundTrip) {
+    open();
+    conn_->send(json_of(10, 'a', 1));
+    ASSERT_TRUE(server_inbox_.wait_for(1));
+    EXPECT_EQ(server_inbox_.messages[0], json_of(10, 'a', 1));
+    ASSERT_NE(accepted_, nullptr);
+    EXPECT_EQ(accepted_->remote_address(),
+              "127.0.0.1:" + std::to_string(client_->port()));
+
+    accepted_->send(json_of(10, 'b', 2));
+    ASSERT_TRUE(client_inbox_.wait_for(1));
+    EXPECT_EQ(client_inbox_.messages[0], json_of(10, 'b', 2));
+    EXPECT_TRUE(client_inbox_.error.empty());
+}
+
+TEST_F(UdpTransportTest, StreamsStayOrderedUnderLoss) {
+    open(UdpConfig{.loss = 0.2, .seed = 1});
+
+    // Three interleaved streams, with payloads spanning many datagrams
+    constexpr int kPerClass = 60;
+    for (int i = 0; i < kPerClass; ++i) {
+        conn_->send(json_of(8 * 1024, 'b', i), Priority::Bulk);
+        conn_->send(json_of(100, 'i', i), Priority::Interactive);
+        conn_->send(json_of(20, 'c', i), Priority::Control);
+    }
+    ASSERT_TRUE(server_inbox_.wait_for(3 * kPerClass))
+        << server_inbox_.messages.size() << " delivered";
+
+    std::array<int, kPriorityClasses> next{};
+    const std::string fills = "cib";
+    std::lock_guard lock(server_inbox_.mutex);
+    for (const auto& msg : server_inbox_.messages) {
+        // Last character of the body tells the class
+        const auto cls = fills.find(msg[msg.size() - 3]);
+        ASSERT_NE(cls, std::string::npos);
+        const auto& expected =
+            json_of(cls == 0 ? 20 : cls == 1 ? 100 : 8 * 1024, fills[cls],
+                    next[cls]++);
+        EXPECT_EQ(msg, expected);
+    }
+    EXPECT_GT(conn_->stats().packets_lost, 0u);
+}
+
+TEST_F(UdpTransportTest, CompressesPerStream) {
+    open(UdpConfig{.loss = 0.1, .seed = 1});
+    conn_->enable_compression();
+    for (int i = 0; i < 20; ++i) {
+        conn_->send(json_of(2000, 'x', i), Priority::Bulk);
+        conn_->send(json_of(500, 'y', i), Priority::Interactive);
+    }
+    ASSERT_TRUE(server_inbox_.wait_for(40));
+    EXPECT_EQ(conn_->compression_stats().frames, 40u);
+    EXPECT_TRUE(server_inbox_.error.empty());
+}
+
+TEST_F(UdpTransportTest, CloseReachesPeer) {
+    open();
+    conn_->send(json_of(10, 'a', 1));
+    ASSERT_TRUE(server_inbox_.wait_for(1));
+    conn_->close();
+    EXPECT_FALSE(conn_->is_open());
+    ASSERT_TRUE(server_inbox_.wait_error());
+    EXPECT_FALSE(accepted_->is_open());
+}
+
+TEST_F(UdpTransportTest, SilentPeerTimesOut) {
+    open(UdpConfig{.idle_timeout = std::chrono::milliseconds(200)});
+    // Nobody is listening on the other end any more
+    server_->stop();
+    conn_->send(json_of(10, 'a', 1));
+    ASSERT_TRUE(client_inbox_.wait_error());
+    EXPECT_EQ(client_inbox_.error, "timed out");
+}
+
+TEST_F(UdpTransportTest, ScatteredSegmentsFailConnection) {
+    open();
+    asio::io_context raw_io;
+    asio::ip::udp::socket raw(raw_io, asio::ip::udp::v4());
+    const asio::ip::udp::endpoint server(asio::ip::make_address("127.0.0.1"),
+                                         server_->port());
+
+    // One byte at every other offset: each its own run past the gap at 0
+    uint64_t offset = 1;
+    for (uint64_t pn = 0; pn < 30; ++pn) {
+        std::vector<uint8_t> frames;
+        for (int i = 0; i < 80; ++i, offset += 2) {
+            put_stream_frame(frames, 2, offset, "x");
+        }
+        raw.send_to(asio::buffer(datagram(1, 77, pn, frames)), server);
+    }
+    ASSERT_TRUE(server_inbox_.wait_error());
+    EXPECT_EQ(server_inbox_.error, "too many gaps in a stream");
+}
+
+TEST_F(UdpTransportTest, OverlappingSegmentsReassemble) {
+    open();
+    asio::io_context raw_io;
+    asio::ip::udp::socket raw(raw_io, asio::ip::udp::v4());
+    const asio::ip::udp::endpoint server(asio::ip::make_address("127.0.0.1"),
+                                         server_->port());
+
+    const auto encoded = FrameEncoder::encode(json_of(40, 'o', 1));
+    const std::string_view wire(reinterpret_cast<const char*>(encoded.data()),
+                                encoded.size());
+    // Out of order, overlapping and repeated, the start last
+    const std::vector<std::pair<std::size_t, std::size_t>> pieces{
+        {20, 35}, {10, 25}, {30, wire.size()}, {12, 14}, {8, 12}, {0, 9}};
+    uint64_t pn = 0;
+    for (const auto& [from, to] : pieces) {
+        std::vector<uint8_t> frames;
+        put_stream_frame(frames, 1, from, wire.substr(from, to - from));
+        raw.send_to(asio::buffer(datagram(pn == 0 ? 1 : 2, 78, pn, frames)),
+                    server);
+        ++pn;
+    }
+    ASSERT_TRUE(server_inbox_.wait_for(1));
+    EXPECT_EQ(server_inbox_.messages[0], json_of(40, 'o', 1));
+    EXPECT_TRUE(server_inbox_.error.empty());
+}
+
+TEST_F(UdpTransportTest, AckForUnsentPacketFailsConnection) {
+    open();
+    asio::io_context raw_io;
+    asio::ip::udp::socket raw(raw_io, asio::ip::udp::v4());
+    const asio::ip::udp::endpoint server(asio::ip::make_address("127.0.0.1"),
+                                         server_->port());
+
+    // Ack: [type 2][u16 delay][u8 count][u64 last][u64 first]
+    std::vector<uint8_t> frames{2, 0, 0, 1};
+    for (int i = 0; i < 2; ++i) {
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            frames.push_back(static_cast<uint8_t>((1ULL << 40) >> shift));
+        }
+    }
+    raw.send_to(asio::buffer(datagram(1, 79, 0, frames)), server);
+    ASSERT_TRUE(server_inbox_.wait_error());
+    EXPECT_EQ(server_inbox_.error, "acknowledged a packet never sent");
+}
+
+TEST_F(UdpTransportTest, UnvalidatedPeerGetsAtMostThreeTimesItsBytes) {
+    open();
+    asio::io_context raw_io;
+    asio::ip::udp::socket raw(raw_io, asio::ip::udp::v4());
+    const asio::ip::udp::endpoint server(asio::ip::make_address("127.0.0.1"),
+                                         server_->port());
+
+    // A spoofed Initial carrying one message; its sender never ACKs
+    const auto encoded = FrameEncoder::encode(json_of(10, 's', 1));
+    std::vector<uint8_t> frames;
+    put_stream_frame(frames, 1, 0,
+                     std::string_view(
+                         reinterpret_cast<const char*>(encoded.data()),
+                         encoded.size()));
+    // Padded like a real client's, so the server has room to answer
+    frames.resize(kMaxDatagram - kPacketHeader);
+    const auto initial = datagram(1, 80, 0, frames);
+    raw.send_to(asio::buffer(initial), server);
+    ASSERT_TRUE(server_inbox_.wait_for(1));
+    for (int i = 0; i < 20; ++i) {
+        accepted_->send(json_of(4000, 'r', i), Priority::Bulk);
+    }
+
+    std::size_t received = 0;
+    std::array<uint8_t, 2048> buf{};
+    raw.non_blocking(true);
+    const auto until =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+    while (std::chrono::steady_clock::now() < until) {
+        asio::ip::udp::endpoint from;
+        asio::error_code ec;
+        const auto n = raw.receive_from(asio::buffer(buf), from, 0, ec);
+        if (ec) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            continue;
+        }
+        received += n;
+    }
+    EXPECT_GT(received, 0u);
+    EXPECT_LE(received, 3 * initial.size());
+}
+
+TEST_F(UdpTransportTest, LostBulkDatagramDoesNotHoldUpControl) {
+    open();
+    asio::io_context raw_io;
+    asio::ip::udp::socket raw(raw_io, asio::ip::udp::v4());
+    const asio::ip::udp::endpoint server(asio::ip::make_address("127.0.0.1"),
+                                         server_->port());
+    auto wire = [](const std::vector<uint8_t>& frame) {
+        return std::string(reinterpret_cast<const char*>(frame.data()),
+                           frame.size());
+    };
+    const auto bulk = wire(FrameEncoder::encode(json_of(2000, 'b', 1)));
+    const auto control = wire(FrameEncoder::encode(json_of(10, 'c', 2)));
+
+    // The Bulk frame's first datagram is lost; its second arrives, and
+    // then a Control frame
+    constexpr std::size_t kLost = 1000;
+    std::vector<uint8_t> frames;
+    put_stream_frame(frames, 2, kLost, std::string_view(bulk).substr(kLost));
+    frames.resize(kMaxDatagram - kPacketHeader);
+    raw.send_to(asio::buffer(datagram(1, 81, 0, frames)), server);
+    frames.clear();
+    put_stream_frame(frames, 0, 0, control);
+    raw.send_to(asio::buffer(datagram(2, 81, 1, frames)), server);
+
+    ASSERT_TRUE(server_inbox_.wait_for(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    {
+        std::lock_guard lock(server_inbox_.mutex);
+        ASSERT_EQ(server_inbox_.messages.size(), 1u);
+        EXPECT_EQ(server_inbox_.messages[0], json_of(10, 'c', 2));
+    }
+
+    // The retransmission repairs the gap
+    frames.clear();
+    put_stream_frame(frames, 2, 0, std::string_view(bulk).substr(0, kLost));
+    raw.send_to(asio::buffer(datagram(2, 81, 2, frames)), server);
+    ASSERT_TRUE(server_inbox_.wait_for(2));
+    EXPECT_EQ(server_inbox_.messages[1], json_of(2000, 'b', 1));
+}
+
+TEST_F(UdpTransportTest, LateAckForProbeKeepsStreamOffsets) {
+    // The client talks to a raw socket, which acknowledges only what the
+    // test says
+    asio::io_context raw_io;
+    asio::ip::udp::socket raw(
+        raw_io, asio::ip::udp::endpoint(asio::ip::make_address("127.0.0.1"),
+                                        0));
+    raw.non_blocking(true);
+    client_ = UdpEndpoint::create(io_, 0);
+    conn_ = client_->connect(raw.local_endpoint());
+    conn_->start(client_inbox_.on_message(), client_inbox_.on_error());
+    auto work = asio::make_work_guard(io_);
+    io_thread_ = std::thread([this, work = std::move(work)]() mutable {
+        io_.run();
+    });
+
+    asio::ip::udp::endpoint client;
+    uint32_t id = 0;
+    // Datagrams until one carries stream data at `offset`
+    auto wait_for_offset = [&](uint64_t offset) -> std::optional<Sent> {
+        std::array<uint8_t, 2048> buf{};
+        const auto until =
+            std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (std::chrono::steady_clock::now() < until) {
+            asio::error_code ec;
+            const auto n = raw.receive_from(asio::buffer(buf), client, 0, ec);
+            if (ec) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                continue;
+            }
+            id = static_cast<uint32_t>((buf[1] << 24) | (buf[2] << 16) |
+                                       (buf[3] << 8) | buf[4]);
+            auto sent = parse_datagram(buf.data(), n);
+            for (const auto& [at, bytes] : sent.chunks) {
+                if (at == offset) return sent;
+            }
+        }
+        return std::nullopt;
+    };
+    auto wire = [](const std::string& json) {
+        const auto frame = FrameEncoder::encode(json);
+        return std::string(reinterpret_cast<const char*>(frame.data()),
+                           frame.size());
+    };
+    const auto first = wire(json_of(400, 'a', 1));
+    const auto second = wire(json_of(400, 'b', 2));
+    const auto third = wire(json_of(40, 'c', 3));
+
+    // Sent, then resent by a probe while the original stays in flight
+    conn_->send(json_of(400, 'a', 1));
+    const auto original = wait_for_offset(0);
+    ASSERT_TRUE(original);
+    const auto probe = wait_for_offset(0);
+    ASSERT_TRUE(probe);
+    conn_->send(json_of(400, 'b', 2));
+    const auto later = wait_for_offset(first.size());
+    ASSERT_TRUE(later);
+
+    // The original and the later data are acked, then the probe. The
+    // first ACK is held back so the round trip it measures keeps the
+    // probe from being declared lost before its own ACK arrives.
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    raw.send_to(asio::buffer(datagram(2, id, 0,
+                                      ack_frame({original->pn, later->pn}))),
+                client);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    raw.send_to(asio::buffer(datagram(2, id, 1, ack_frame({probe->pn}))),
+                client);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    // New data still goes out, at its own offset
+    conn_->send(json_of(40, 'c', 3));
+    const auto next = wait_for_offset(first.size() + second.size());
+    ASSERT_TRUE(next);
+    for (const auto& [at, bytes] : next->chunks) {
+        if (at == first.size() + second.size()) {
+            EXPECT_EQ(bytes, third);
+        }
+    }
+    EXPECT_TRUE(client_inbox_.error.empty());
+}
@@ -0,0 +1,186 @@
+#include "peerchat/compression.hpp"
+#include "peerchat/framing.hpp"
+#include "peerchat/write_scheduler.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace peerchat;
+
+namespace {
+
+// Payload of an encoded frame
+std::string payload_of(const std::vector<uint8_t>& frame) {
+    FrameDecoder decoder;
+    decoder.feed(frame.data(), frame.size());
+    auto payload = decoder.next();
+    EXPECT_TRUE(payload.has_value());
+    return payload.value_or("");
+}
+
+std::string json_of(std::size_t size, char fill) {
+    return R"({"body":")" + std::string(size, fill) + "\"}";
+}
+
+// Drains the scheduler the way the receiving side would see it
+std::vector<std::string> drain(WriteScheduler& scheduler,
+                               FrameCompressor* compressor = nullptr) {
+    FrameDecompressor decompressor;
+    FragmentAssembler assembler;
+    std::vector<std::string> out;
+    while (auto frame = scheduler.next(compressor)) {
+        auto payload = payload_of(*frame);
+        if (static_cast<uint8_t>(payload[0]) ==
+            static_cast<uint8_t>(FrameKind::Compressed)) {
+            payload = decompressor.decompress(
+                reinterpret_cast<const uint8_t*>(payload.data()),
+                payload.size());
+        }
+        if (static_cast<uint8_t>(payload[0]) ==
+            static_cast<uint8_t>(FrameKind::Fragment)) {
+            auto whole = assembler.add(payload);
+            if (!whole) continue;
+            payload = std::move(*whole);
+        }
+        out.push_back(std::move(payload));
+    }
+    return out;
+}
+
+} // namespace
+
+TEST(WriteSchedulerTest, KeepsOrderWithinAClass) {
+    WriteScheduler scheduler;
+    for (char c : std::string("abc")) {
+        scheduler.push(Priority::Interactive, json_of(10, c));
+    }
+    EXPECT_EQ(scheduler.size(), 3u);
+    auto out = drain(scheduler);
+    ASSERT_EQ(out.size(), 3u);
+    EXPECT_EQ(out[0], json_of(10, 'a'));
+    EXPECT_EQ(out[2], json_of(10, 'c'));
+    EXPECT_TRUE(scheduler.empty());
+}
+
+TEST(WriteSchedulerTest, ControlGoesFirstFromIdle) {
+    WriteScheduler scheduler;
+    scheduler.push(Priority::Bulk, json_of(10, 'b'));
+    scheduler.push(Priority::Interactive, json_of(10, 'i'));
+    scheduler.push(Priority::Control, json_of(10, 'c'));
+    auto out = drain(scheduler);
+    ASSERT_EQ(out.size(), 3u);
+    EXPECT_EQ(out[0], json_of(10, 'c'));
+    EXPECT_EQ(out[1], json_of(10, 'i'));
+    EXPECT_EQ(out[2], json_of(10, 'b'));
+}
+
+TEST(WriteSchedulerTest, ControlCutsIntoFragmentedBulk) {
+    WriteScheduler scheduler;
+    scheduler.enable_fragmentation();
+    const auto big = json_of(60 * 1024, 'x');
+    scheduler.push(Priority::Bulk, big);
+
+    // The transfer is under way when a ping turns up
+    auto first = scheduler.next();
+    ASSERT_TRUE(first.has_value());
+    EXPECT_EQ(static_cast<uint8_t>(payload_of(*first)[0]),
+              static_cast<uint8_t>(FrameKind::Fragment));
+    EXPECT_LE(first->size(), FrameEncoder::kHeaderSize +
+                                 kFragmentHeaderSize + kFragmentBytes);
+
+    const auto ping = json_of(10, 'p');
+    scheduler.push(Priority::Control, ping);
+    auto second = scheduler.next();
+    ASSERT_TRUE(second.has_value());
+    EXPECT_EQ(payload_of(*second), ping);
+
+    // The rest of the payload still arrives intact
+    FragmentAssembler assembler;
+    ASSERT_FALSE(assembler.add(payload_of(*first)).has_value());
+    std::optional<std::string> whole;
+    while (auto frame = scheduler.next()) {
+        whole = assembler.add(payload_of(*frame));
+    }
+    EXPECT_EQ(whole, big);
+}
+
+TEST(WriteSchedulerTest, SharesBandwidthByWeight) {
+    WriteScheduler scheduler;
+    scheduler.enable_fragmentation();
+    for (int i = 0; i < 8; ++i) {
+        scheduler.push(Priority::Interactive, json_of(32 * 1024, 'i'));
+        scheduler.push(Priority::Bulk, json_of(32 * 1024, 'b'));
+    }
+
+    // While both are backlogged, interactive gets twice bulk's share
+    std::size_t interactive = 0;
+    std::size_t bulk = 0;
+    for (int i = 0; i < 30; ++i) {
+        auto payload = payload_of(*scheduler.next());
+        (payload[1] == static_cast<char>(Priority::Interactive) ? interactive
+                                                                : bulk) +=
+            payload.size();
+    }
+    EXPECT_NEAR(static_cast<double>(interactive) / static_cast<double>(bulk),
+                2.0, 0.2);
+}
+
+TEST(WriteSchedulerTest, UnfragmentedWithoutPeerSupport) {
+    WriteScheduler scheduler;
+    const auto big = json_of(40 * 1024, 'x');
+    scheduler.push(Priority::Bulk, big);
+    auto frame = scheduler.next();
+    ASSERT_TRUE(frame.has_value());
+    EXPECT_EQ(payload_of(*frame), big);
+    EXPECT_FALSE(scheduler.next().has_value());
+}
+
+TEST(WriteSchedulerTest, PassesEncodedFramesThrough) {
+    WriteScheduler scheduler;
+    auto frame = FrameEncoder::encode(std::string("\x04payload", 8));
+    const auto* data = frame.data();
+    scheduler.push_frame(Priority::Bulk, std::move(frame));
+    auto out = scheduler.next();
+    ASSERT_TRUE(out.has_value());
+    // Handed back without a copy
+    EXPECT_EQ(out->data(), data);
+}
+
+TEST(WriteSchedulerTest, CompressesInWireOrder) {
+    FrameCompressor compressor;
+    WriteScheduler scheduler;
+    scheduler.enable_fragmentation();
+    const auto big = json_of(20 * 1024, 'x');
+    const auto ack = json_of(100, 'a');
+    scheduler.push(Priority::Bulk, big);
+    scheduler.push(Priority::Bulk, json_of(100, 'b'));
+    scheduler.push(Priority::Control, ack);
+
+    // The decompressor only works if pieces were compressed in the
+    // order they leave
+    auto out = drain(scheduler, &compressor);
+    ASSERT_EQ(out.size(), 3u);
+    EXPECT_EQ(out[0], ack);
+    EXPECT_EQ(out[1], big);
+    EXPECT_EQ(out[2], json_of(100, 'b'));
+    EXPECT_GT(compressor.stats().frames, 3u);
+}
+
+TEST(FragmentAssemblerTest, RejectsMalformed) {
+    FragmentAssembler assembler;
+    EXPECT_THROW(assembler.add(std::string("\x06\x01", 2)),
+                 std::invalid_argument);
+    EXPECT_THROW(assembler.add(std::string("\x06\x07\x00x", 4)),
+                 std::invalid_argument);
+    EXPECT_THROW(assembler.add(std::string("\x06\x01\x02x", 4)),
+                 std::invalid_argument);
+
+    std::string piece("\x06\x02\x00", 3);
+    piece += std::string(kMaxFrameSize / 2, 'x');
+    EXPECT_FALSE(assembler.add(piece).has_value());
+    EXPECT_FALSE(assembler.add(piece).has_value());
+    EXPECT_THROW(assembler.add(piece), std::invalid_argument);
+}
@@ -0,0 +1,556 @@
+// Load generator and soak test: runs many peers in this process (or in
+// several forked ones), connected in pairs over loopback, each sending
+// chat messages at a fixed rate. Reports throughput, send-to-ACK latency
+// and memory per peer every few seconds, and a summary at the end.
+//
+//   peerchat_load --pairs 500 --rate 20 --size 200 --duration 60
+//   peerchat_load --pairs 50 --duration 0 --report 60   # soak until ^C
+//   peerchat_load --pairs 8 --duration 5 --trace load.json
+
+#include "peerchat/connection.hpp"
+#include "peerchat/identity.hpp"
+#include "peerchat/metrics.hpp"
+#include "peerchat/peer_manager.hpp"
+#include "peerchat/trace.hpp"
+#include "peerchat/transport.hpp"
+
+#include <asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace peerchat;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Options {
+    std::size_t pairs{16};
+    double rate{10.0};        // messages per second, per peer
+    std::size_t size{64};     // message body bytes
+    double duration{30.0};    // seconds; 0 runs until interrupted
+    double report{5.0};       // seconds between progress lines
+    std::size_t threads{1};   // io threads per process
+    std::size_t procs{1};     // processes, each running `pairs` pairs
+    bool json{false};
+    bool verbose{false};
+    std::string trace; // where to write the hot-path trace
+};
+
+std::atomic<bool> g_stop{false};
+
+void usage() {
+    std::cout
+        << "Usage: peerchat_load [OPTIONS]\n"
+        << "  --pairs N       Connected peer pairs per process (default 16)\n"
+        << "  --rate R        Messages per second per peer (default 10)\n"
+        << "  --size BYTES    Message body size (default 64)\n"
+        << "  --duration S    Seconds to run, 0 until ^C (default 30)\n"
+        << "  --report S      Seconds between progress lines (default 5)\n"
+        << "  --threads N     io threads per process (default 1)\n"
+#if !defined(_WIN32)
+        << "  --procs N       Processes to fork (default 1)\n"
+#endif
+        << "  --json          Print the summary as JSON\n"
+        << "  --trace FILE    Write a Chrome/Perfetto trace (needs a\n"
+        << "                  -DPEERCHAT_TRACE=ON build)\n"
+        << "  --verbose       Keep peerchat's info logging\n";
+}
+
+Options parse_args(int argc, char* argv[]) {
+    Options o;
+    std::vector<std::string> av(argv + 1, argv + argc);
+    for (std::size_t i = 0; i < av.size(); ++i) {
+        const bool has_value = i + 1 < av.size();
+        if (av[i] == "--pairs" && has_value) {
+            o.pairs = std::stoul(av[++i]);
+        } else if (av[i] == "--rate" && has_value) {
+            o.rate = std::stod(av[++i]);
+        } else if (av[i] == "--size" && has_value) {
+            o.size = std::stoul(av[++i]);
+        } else if (av[i] == "--duration" && has_value) {
+            o.duration = std::stod(av[++i]);
+        } else if (av[i] == "--report" && has_value) {
+            o.report = std::stod(av[++i]);
+        } else if (av[i] == "--threads" && has_value) {
+            o.threads = std::max<std::size_t>(1, std::stoul(av[++i]));
+        } else if (av[i] == "--procs" && has_value) {
+            o.procs = std::max<std::size_t>(1, std::stoul(av[++i]));
+        } else if (av[i] == "--json") {
+            o.json = true;
+        } else if (av[i] == "--trace" && has_value) {
+            o.trace = av[++i];
+        } else if (av[i] == "--verbose") {
+            o.verbose = true;
+        } else {
+            usage();
+            std::exit(av[i] == "--help" || av[i] == "-h" ? 0 : 2);
+        }
+    }
+    return o;
+}
+
+void write_trace(const std::string& path) {
+    if (!trace::kEnabled) {
+        std::cerr << "--trace: trace points are not compiled in; rebuild "
+                     "with -DPEERCHAT_TRACE=ON\n";
+        return;
+    }
+    std::ofstream(path) << trace::chrome_json();
+}
+
+// Resident set size in bytes
+std::size_t rss_bytes() {
+#if defined(__linux__)
+    std::ifstream statm("/proc/self/statm");
+    std::size_t pages = 0, resident = 0;
+    if (statm >> pages >> resident) {
+        return resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    }
+    return 0;
+#elif !defined(_WIN32)
+    // Peak rather than current, but close enough for a growing soak
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return static_cast<std::size_t>(usage.ru_maxrss);
+#else
+    return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+#endif
+#else
+    return 0;
+#endif
+}
+
+// Counts since the run started, plus the latency distribution
+struct Totals {
+    uint64_t sent{0};
+    uint64_t acked{0};
+    uint64_t dropped{0};
+    uint64_t disconnects{0};
+    Histogram::Snapshot latency;
+
+    Totals& operator+=(const Totals& o) {
+        sent += o.sent;
+        acked += o.acked;
+        dropped += o.dropped;
+        disconnects += o.disconnects;
+        latency.count += o.latency.count;
+        latency.sum += o.latency.sum;
+        for (std::size_t i = 0; i < Histogram::kBuckets; ++i) {
+            latency.buckets[i] += o.latency.buckets[i];
+        }
+        return *this;
+    }
+
+    Totals since(const Totals& before) const {
+        Totals d = *this;
+        d.sent -= before.sent;
+        d.acked -= before.acked;
+        d.dropped -= before.dropped;
+        d.disconnects -= before.disconnects;
+        d.latency.count -= before.latency.count;
+        d.latency.sum -= before.latency.sum;
+        for (std::size_t i = 0; i < Histogram::kBuckets; ++i) {
+            d.latency.buckets[i] -= before.latency.buckets[i];
+        }
+        return d;
+    }
+};
+
+// A share of the peers, all driven by one io thread. PeerManager isn't
+// thread-safe, so everything touching a shard's peers runs on its thread.
+class Shard {
+  public:
+    Shard(const Options& opts, std::size_t pairs, uint32_t seed)
+        : opts_(opts), tick_(io_), body_(opts.size, 'x'), rng_(seed) {
+        transport_ = std::make_unique<TcpTransport>(io_, 0);
+        transport_->listen(
+            [this](ConnectionPtr conn) { accept(std::move(conn)); });
+        for (std::size_t i = 0; i < 2 * pairs; ++i) {
+            identities_.push_back(Identity::ephemeral(
+                "load" + std::to_string(seed) + "_" + std::to_string(i)));
+            auto& peer = peers_.emplace_back(std::make_unique<PeerManager>(
+                io_, identities_.back()));
+            peer->on_ack([this](const std::string&) {
+                acked_.fetch_add(1, std::memory_order_relaxed);
+            });
+            const bool dialer = i % 2 == 0;
+            peer->on_disconnect([this, i, dialer](const std::string&) {
+                disconnects_.fetch_add(1, std::memory_order_relaxed);
+                if (dialer) redial(i);
+            });
+        }
+        // Spread sends so the peers don't fire in lockstep
+        std::uniform_real_distribution<double> jitter(0.0, 1.0);
+        for (std::size_t i = 0; i < peers_.size(); ++i) {
+            credit_.push_back(jitter(rng_));
+        }
+    }
+
+    void start() {
+        asio::post(io_, [this] {
+            for (std::size_t i = 0; i < peers_.size(); i += 2) dial(i);
+            last_tick_ = Clock::now();
+            schedule_tick();
+        });
+        thread_ = std::thread([this] { io_.run(); });
+    }
+
+    void stop() {
+        asio::post(io_, [this] {
+            tick_.cancel();
+            transport_->stop();
+            for (auto& p : peers_) p->disconnect();
+            io_.stop();
+        });
+        if (thread_.joinable()) thread_.join();
+    }
+
+    std::size_t connected() const {
+        return connected_.load(std::memory_order_relaxed);
+    }
+    std::size_t peer_count() const { return peers_.size(); }
+
+    void add_to(Totals& t) const {
+        t.sent += sent_.load(std::memory_order_relaxed);
+        t.acked += acked_.load(std::memory_order_relaxed);
+        t.dropped += dropped_.load(std::memory_order_relaxed);
+        t.disconnects += disconnects_.load(std::memory_order_relaxed);
+    }
+
+  private:
+    static constexpr auto kTick = std::chrono::milliseconds(10);
+    static constexpr auto kRedialDelay = std::chrono::seconds(1);
+
+    void dial(std::size_t i) {
+        transport_->dial(
+            "127.0.0.1", transport_->port(),
+            [this, i](ConnectionPtr conn) {
+                peers_[i]->set_connection(std::move(conn), true);
+            },
+            [this, i](const std::string&) { redial(i); });
+    }
+
+    void redial(std::size_t i) {
+        auto timer = std::make_shared<asio::steady_timer>(io_, kRedialDelay);
+        timer->async_wait([this, i, timer](asio::error_code ec) {
+            if (!ec && !g_stop) dial(i);
+        });
+    }
+
+    // Inbound connections go to whichever listening-side peer is idle
+    void accept(ConnectionPtr conn) {
+        for (std::size_t i = 1; i < peers_.size(); i += 2) {
+            if (peers_[i]->state() == PeerState::Disconnected) {
+                peers_[i]->set_connection(std::move(conn), false);
+                return;
+            }
+        }
+        conn->close();
+    }
+
+    void schedule_tick() {
+        tick_.expires_after(kTick);
+        tick_.async_wait([this](asio::error_code ec) {
+            if (ec) return;
+            send_due();
+            schedule_tick();
+        });
+    }
+
+    // Each peer earns `rate` messages per second of credit; a peer that
+    // is down or stalled can't bank more than a tenth of a second's worth
+    void send_due() {
+        auto now = Clock::now();
+        double earned = opts_.rate *
+                        std::chrono::duration<double>(now - last_tick_).count();
+        last_tick_ = now;
+        const double cap = std::max(1.0, opts_.rate / 10);
+        std::size_t up = 0;
+        for (std::size_t i = 0; i < peers_.size(); ++i) {
+            auto& peer = *peers_[i];
+            if (peer.state() != PeerState::Connected) continue;
+            ++up;
+            credit_[i] = std::min(credit_[i] + earned, cap + 1);
+            for (; credit_[i] >= 1; credit_[i] -= 1) {
+                if (peer.send_text(body_)) {
+                    sent_.fetch_add(1, std::memory_order_relaxed);
+                } else {
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        }
+        connected_.store(up, std::memory_order_relaxed);
+    }
+
+    const Options& opts_;
+    asio::io_context io_;
+    asio::steady_timer tick_;
+    std::unique_ptr<TcpTransport> transport_;
+    std::deque<Identity> identities_;
+    std::vector<std::unique_ptr<PeerManager>> peers_;
+    std::vector<double> credit_;
+    std::string body_;
+    std::mt19937 rng_;
+    Clock::time_point last_tick_;
+    std::thread thread_;
+
+    std::atomic<uint64_t> sent_{0};
+    std::atomic<uint64_t> acked_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> disconnects_{0};
+    std::atomic<std::size_t> connected_{0};
+};
+
+std::string format_ms(uint64_t micros) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.2f ms",
+                  static_cast<double>(micros) / 1e3);
+    return buf;
+}
+
+void print_interval(const std::string& who, double elapsed, double secs,
+                    std::size_t peers, std::size_t connected,
+                    const Totals& d, std::size_t rss_per_peer) {
+    std::printf("%s[%7.0fs] %zu/%zu up  sent %.0f/s  acked %.0f/s  "
+                "p50 %s  p99 %s  p999 %s  rss/peer %.1f KiB\n",
+                who.c_str(), elapsed, connected, peers,
+                static_cast<double>(d.sent) / secs,
+                static_cast<double>(d.acked) / secs,
+                format_ms(d.latency.quantile(0.5)).c_str(),
+                format_ms(d.latency.quantile(0.99)).c_str(),
+                format_ms(d.latency.quantile(0.999)).c_str(),
+                static_cast<double>(rss_per_peer) / 1024);
+    std::fflush(stdout);
+}
+
+nlohmann::json to_json(const Totals& t, std::size_t peers, double secs,
+                       std::size_t rss_per_peer) {
+    nlohmann::json buckets = nlohmann::json::array();
+    for (std::size_t i = 0; i < Histogram::kBuckets; ++i) {
+        if (t.latency.buckets[i]) buckets.push_back({i, t.latency.buckets[i]});
+    }
+    return {{"peers", peers},
+            {"seconds", secs},
+            {"sent", t.sent},
+            {"acked", t.acked},
+            {"dropped", t.dropped},
+            {"disconnects", t.disconnects},
+            {"acked_per_second", static_cast<double>(t.acked) / secs},
+            {"latency_us",
+             {{"p50", t.latency.quantile(0.5)},
+              {"p99", t.latency.quantile(0.99)},
+              {"p999", t.latency.quantile(0.999)},
+              {"count", t.latency.count},
+              {"sum", t.latency.sum}}},
+            {"latency_buckets", std::move(buckets)},
+            {"rss_per_peer_bytes", rss_per_peer}};
+}
+
+Totals from_json(const nlohmann::json& j) {
+    Totals t;
+    t.sent = j.at("sent");
+    t.acked = j.at("acked");
+    t.dropped = j.at("dropped");
+    t.disconnects = j.at("disconnects");
+    t.latency.count = j.at("latency_us").at("count");
+    t.latency.sum = j.at("latency_us").at("sum");
+    for (const auto& b : j.at("latency_buckets")) {
+        t.latency.buckets.at(b.at(0).get<std::size_t>()) = b.at(1);
+    }
+    return t;
+}
+
+void print_summary(const nlohmann::json& r) {
+    std::printf("\n%s peers, %.0f s: %s sent, %s acked (%.0f/s), "
+                "%s dropped, %s disconnects\n"
+                "send-to-ACK latency: p50 %s  p99 %s  p999 %s\n"
+                "memory: %.1f KiB per peer\n",
+                r["peers"].dump().c_str(), r["seconds"].get<double>(),
+                r["sent"].dump().c_str(), r["acked"].dump().c_str(),
+                r["acked_per_second"].get<double>(),
+                r["dropped"].dump().c_str(), r["disconnects"].dump().c_str(),
+                format_ms(r["latency_us"]["p50"]).c_str(),
+                format_ms(r["latency_us"]["p99"]).c_str(),
+                format_ms(r["latency_us"]["p999"]).c_str(),
+                r["rss_per_peer_bytes"].get<double>() / 1024);
+}
+
+// Runs this process's share of the load and returns its summary
+nlohmann::json run(const Options& opts, const std::string& who,
+                   uint32_t seed) {
+    const auto rss_base = rss_bytes();
+    std::vector<std::unique_ptr<Shard>> shards;
+    for (std::size_t t = 0; t < opts.threads; ++t) {
+        auto pairs = opts.pairs / opts.threads +
+                     (t < opts.pairs % opts.threads ? 1 : 0);
+        shards.push_back(std::make_unique<Shard>(
+            opts, pairs, seed + static_cast<uint32_t>(t)));
+    }
+    std::size_t peers = 0;
+    for (auto& s : shards) peers += s->peer_count();
+
+    auto totals = [&] {
+        Totals t;
+        for (auto& s : shards) s->add_to(t);
+        t.latency = NetMetrics::get().ack_latency.snapshot();
+        return t;
+    };
+    auto connected = [&] {
+        std::size_t n = 0;
+        for (auto& s : shards) n += s->connected();
+        return n;
+    };
+    auto rss_per_peer = [&] {
+        auto rss = rss_bytes();
+        return peers && rss > rss_base ? (rss - rss_base) / peers : 0;
+    };
+
+    for (auto& s : shards) s->start();
+
+    const auto start = Clock::now();
+    const auto report = std::chrono::duration<double>(opts.report);
+    auto next_report = start + report;
+    auto last = totals();
+    auto last_time = start;
+    const Totals base = last;
+    while (!g_stop) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        auto now = Clock::now();
+        const double elapsed =
+            std::chrono::duration<double>(now - start).count();
+        if (opts.duration > 0 && elapsed >= opts.duration) break;
+        if (now < next_report) continue;
+        auto t = totals();
+        print_interval(who, elapsed,
+                       std::chrono::duration<double>(now - last_time).count(),
+                       peers, connected(), t.since(last), rss_per_peer());
+        last = t;
+        last_time = now;
+        next_report += std::chrono::duration_cast<Clock::duration>(report);
+    }
+
+    const double secs =
+        std::chrono::duration<double>(Clock::now() - start).count();
+    auto result = to_json(totals().since(base), peers, secs, rss_per_peer());
+    for (auto& s : shards) s->stop();
+    return result;
+}
+
+#if !defined(_WIN32)
+// Forks one child per process; each runs its share and writes its summary
+// back through a pipe, and the parent merges them
+nlohmann::json run_forked(const Options& opts) {
+    struct Child {
+        pid_t pid;
+        int fd;
+    };
+    std::vector<Child> children;
+    for (std::size_t p = 0; p < opts.procs; ++p) {
+        int fds[2];
+        if (::pipe(fds) != 0) throw std::runtime_error("pipe failed");
+        pid_t pid = ::fork();
+        if (pid < 0) throw std::runtime_error("fork failed");
+        if (pid == 0) {
+            ::close(fds[0]);
+            auto who = "[proc " + std::to_string(p) + "] ";
+            auto out = run(opts, who, static_cast<uint32_t>(p) * 1000).dump();
+            if (!opts.trace.empty()) {
+                write_trace(opts.trace + "." + std::to_string(p));
+            }
+            std::size_t off = 0;
+            while (off < out.size()) {
+                auto n = ::write(fds[1], out.data() + off, out.size() - off);
+                if (n <= 0) break;
+                off += static_cast<std::size_t>(n);
+            }
+            ::_exit(0);
+        }
+        ::close(fds[1]);
+        children.push_back({pid, fds[0]});
+    }
+
+    Totals merged;
+    std::size_t peers = 0, rss = 0;
+    double secs = 0;
+    for (auto& c : children) {
+        std::string out;
+        char buf[4096];
+        for (ssize_t n; (n = ::read(c.fd, buf, sizeof(buf))) > 0;) {
+            out.append(buf, static_cast<std::size_t>(n));
+        }
+        ::close(c.fd);
+        ::waitpid(c.pid, nullptr, 0);
+        if (out.empty()) continue; // the child died; count what's left
+        auto r = nlohmann::json::parse(out);
+        merged += from_json(r);
+        peers += r["peers"].get<std::size_t>();
+        rss += r["rss_per_peer_bytes"].get<std::size_t>() *
+               r["peers"].get<std::size_t>();
+        secs = std::max(secs, r["seconds"].get<double>());
+    }
+    return to_json(merged, peers, secs, peers ? rss / peers : 0);
+}
+#endif
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    auto opts = parse_args(argc, argv);
+    spdlog::set_level(opts.verbose ? spdlog::level::info
+                                   : spdlog::level::warn);
+    std::signal(SIGINT, [](int) { g_stop = true; });
+    std::signal(SIGTERM, [](int) { g_stop = true; });
+#if !defined(_WIN32)
+    // A peer closing mid-write must not kill the run
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+    nlohmann::json result;
+    try {
+#if !defined(_WIN32)
+        if (opts.procs > 1) {
+            result = run_forked(opts);
+        } else {
+            result = run(opts, "", 1);
+            if (!opts.trace.empty()) write_trace(opts.trace);
+        }
+#else
+        if (opts.procs > 1) {
+            std::cerr << "--procs needs fork(); running in one process\n";
+        }
+        result = run(opts, "", 1);
+        if (!opts.trace.empty()) write_trace(opts.trace);
+#endif
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    if (opts.json) {
+        result.erase("latency_buckets");
+        std::cout << result.dump(2) << "\n";
+    } else {
+        print_summary(result);
+    }
+    return 0;
+}